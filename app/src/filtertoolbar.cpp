@@ -1,5 +1,6 @@
 #include "filtertoolbar.h"
 
+#include <logdor/FilterScan.h>
 #include <logdor/Query.h>
 
 #include <QCheckBox>
@@ -436,20 +437,24 @@ void FilterToolbar::emitFilterChanged()
 {
     // Tint the input by validity: regex mode validates the pattern, query
     // mode validates syntax only (schema-aware errors surface per viewer).
+    // A "| head N" / "| tail N" suffix belongs to neither; check the rest.
+    QString text = m_input->text();
+    logdor::takeMatchLimit(&text);
     if (m_regexModeButton->isChecked()) {
-        const QRegularExpression regex(m_input->text());
+        const QRegularExpression regex(text);
         m_input->setStyleSheet(
-            regex.isValid() || m_input->text().isEmpty()
+            regex.isValid() || text.isEmpty()
                 ? "QLineEdit { background-color: #90EE90; color: black; }"
                 : "QLineEdit { background-color: #FFB6C1; color: black; }");
     } else if (m_queryModeButton->isChecked() && !m_input->text().isEmpty()) {
         logdor::QueryError error;
-        const auto query = logdor::CompiledQuery::compile(
-            m_input->text(), {},
-            m_caseSensitiveButton->isChecked() ? Qt::CaseSensitive
-                                               : Qt::CaseInsensitive,
-            logdor::QueryOption::AllowUnknownFields, &error);
-        if (query) {
+        const bool valid = text.isEmpty()
+            || logdor::CompiledQuery::compile(
+                text, {},
+                m_caseSensitiveButton->isChecked() ? Qt::CaseSensitive
+                                                   : Qt::CaseInsensitive,
+                logdor::QueryOption::AllowUnknownFields, &error);
+        if (valid) {
             m_input->setStyleSheet(
                 "QLineEdit { background-color: #90EE90; color: black; }");
             m_input->setToolTip(QString());
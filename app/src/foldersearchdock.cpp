@@ -181,6 +181,7 @@ void FolderSearchDock::startSearch()
     query.regexMode = m_regexCheck->isChecked();
     query.caseSensitivity = m_caseCheck->isChecked() ? Qt::CaseSensitive
                                                      : Qt::CaseInsensitive;
+    query.indexCache = m_indexCache;
     m_watcher.setFuture(grepFolder(files, query));
 }
 
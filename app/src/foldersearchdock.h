@@ -28,6 +28,12 @@ public:
 
     void setFolder(const QString& path);
     void focusPattern();
+    /// Where searches look up each file's trigram index (GrepQuery::
+    /// indexCache); null searches every byte.
+    void setIndexCache(std::shared_ptr<const logdor::LineIndexCache> cache)
+    {
+        m_indexCache = std::move(cache);
+    }
 
 signals:
     /// The user activated a match: open @p path and select @p line.
@@ -48,6 +54,7 @@ private:
     QTreeWidget* m_results = nullptr;
     QLabel* m_status = nullptr;
     QFutureWatcher<logdor::GrepFileResult> m_watcher;
+    std::shared_ptr<const logdor::LineIndexCache> m_indexCache;
     qint64 m_totalMatches = 0;
 };
 
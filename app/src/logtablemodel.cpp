@@ -35,6 +35,38 @@ void LogTableModel::setRowSet(RowSet rows)
     endResetModel();
 }
 
+void LogTableModel::growRowSet(RowSet rows)
+{
+    const qint64 oldSize = m_rows.size();
+    const qint64 newSize = rows.size();
+    // The current rows must sit in @p rows as one run starting at `front`.
+    const qint64 front = oldSize > 0 ? rows.rowForSourceLine(m_rows.sourceLine(0)) : 0;
+    if (!m_order.empty() || rows.lineCount() != m_rows.lineCount() || front < 0
+        || front + oldSize > newSize
+        || (oldSize > 0
+            && rows.sourceLine(front + oldSize - 1) != m_rows.sourceLine(oldSize - 1))) {
+        setRowSet(std::move(rows));
+        return;
+    }
+    if (front > 0) {
+        // Rows before the current ones first, then those after.
+        std::vector<qint32> head;
+        head.reserve(size_t(front + oldSize));
+        for (qint64 row = 0; row < front + oldSize; ++row)
+            head.push_back(qint32(rows.sourceLine(row)));
+        beginInsertRows(QModelIndex(), 0, int(front - 1));
+        m_rows = RowSet::fromLines(std::move(head), rows.lineCount());
+        endInsertRows();
+    }
+    if (newSize > front + oldSize) {
+        beginInsertRows(QModelIndex(), int(front + oldSize), int(newSize - 1));
+        m_rows = std::move(rows);
+        endInsertRows();
+    } else {
+        m_rows = std::move(rows);
+    }
+}
+
 void LogTableModel::extendSource(std::shared_ptr<FileSource> source,
                                  std::shared_ptr<const LineIndex> index,
                                  qint64 spliceLine, RowSet rows)
@@ -106,6 +138,34 @@ int LogTableModel::rowForSourceLine(qint64 line) const
     return int(m_inverse[size_t(rowSetPos)]);
 }
 
+void LogTableModel::prefetchRows(int firstRow, int count) const
+{
+    if (!m_source || !m_index)
+        return;
+    // Rows of a filtered view sit scattered through the file: coalesce
+    // neighbours whose gap is small into one range, so a screen costs a
+    // few advice calls rather than one per row.
+    constexpr quint64 kMaxGap = 64 * 1024;
+    const int end = int(qMin<qint64>(qint64(firstRow) + count, m_rows.size()));
+    quint64 rangeStart = 0;
+    quint64 rangeEnd = 0;
+    for (int row = qMax(0, firstRow); row < end; ++row) {
+        const qint64 line = sourceLineForRow(row);
+        const quint64 start = m_index->offsetOf(line);
+        const quint64 stop = start + quint64(m_index->rawLengthOf(line));
+        if (rangeEnd > rangeStart && start >= rangeStart && start <= rangeEnd + kMaxGap) {
+            rangeEnd = qMax(rangeEnd, stop);
+            continue;
+        }
+        if (rangeEnd > rangeStart)
+            m_source->prefetch(rangeStart, rangeEnd - rangeStart);
+        rangeStart = start;
+        rangeEnd = stop;
+    }
+    if (rangeEnd > rangeStart)
+        m_source->prefetch(rangeStart, rangeEnd - rangeStart);
+}
+
 QColor LogTableModel::severityColor(Severity severity)
 {
     switch (severity) {
@@ -40,6 +40,15 @@ public:
     void setRowSet(logdor::RowSet rows); // clears any row order
     const logdor::RowSet& rowSet() const { return m_rows; }
 
+    /**
+     * Streaming filter: @p rows holds every current row as one run, plus
+     * rows before and after it (the next partial of the same scan).
+     * Adopted via row insertion, so the view keeps its selection; anything
+     * else (an active row order, a different line count, the current rows
+     * not found as a run) falls back to setRowSet().
+     */
+    void growRowSet(logdor::RowSet rows);
+
     /**
      * Follow mode: the SAME file grew. Swaps the pointers, drops the parse
      * cache for @p spliceLine (an unterminated final line may have changed),
@@ -66,6 +75,11 @@ public:
     qint64 sourceLineForRow(int row) const;  // -1 when out of range
     int rowForSourceLine(qint64 line) const; // -1 when hidden
 
+    /// Ask the source to page in the raw bytes of view rows
+    /// [firstRow, firstRow + count) - the screens the view shows next.
+    /// A hint: returns at once, clamps to the row count.
+    void prefetchRows(int firstRow, int count) const;
+
     /// Exact legacy logcat palette; invalid QColor for None (no brush).
     static QColor severityColor(logdor::Severity severity);
 
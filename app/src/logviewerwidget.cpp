@@ -11,8 +11,10 @@
 #include <QJsonArray>
 #include <QItemSelectionModel>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMenu>
 #include <QScrollBar>
+#include <QShortcut>
 #include <QTableView>
 #include <QVBoxLayout>
 
@@ -24,6 +26,8 @@ LogViewerWidget::LogViewerWidget(QWidget* parent)
     : QWidget(parent)
     , m_view(new QTableView(this))
     , m_statusStrip(new QLabel(this))
+    , m_scanStrip(new QLabel(this))
+    , m_findEdit(new QLineEdit(this))
     , m_model(new LogTableModel(this))
 {
     m_histogramStrip = new HistogramStrip(this);
@@ -34,11 +38,45 @@ LogViewerWidget::LogViewerWidget(QWidget* parent)
     layout->setSpacing(0);
     layout->addWidget(m_histogramStrip);
     layout->addWidget(m_view);
+    layout->addWidget(m_findEdit);
+    layout->addWidget(m_scanStrip);
     layout->addWidget(m_statusStrip);
 
     m_statusStrip->setStyleSheet(
         "QLabel { background-color: #FFB6C1; color: black; padding: 3px; }");
     m_statusStrip->hide();
+    m_scanStrip->setStyleSheet("QLabel { padding: 3px; }");
+    m_scanStrip->hide();
+
+    // Find bar: Ctrl+F opens it, Enter / F3 / Shift+F3 step through the
+    // rows, Escape closes it.
+    m_findEdit->setPlaceholderText(tr("Find (F3 next, Shift+F3 previous)"));
+    m_findEdit->setClearButtonEnabled(true);
+    m_findEdit->hide();
+    const auto shortcut = [this](const QKeySequence& keys, auto slot) {
+        auto* action = new QShortcut(keys, this);
+        action->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(action, &QShortcut::activated, this, slot);
+    };
+    shortcut(QKeySequence::Find, [this]() {
+        m_findEdit->show();
+        m_findEdit->setFocus();
+        m_findEdit->selectAll();
+    });
+    shortcut(QKeySequence(Qt::Key_F3), [this]() { findNext(m_findEdit->text()); });
+    shortcut(QKeySequence(Qt::SHIFT | Qt::Key_F3),
+             [this]() { findNext(m_findEdit->text(), true); });
+    connect(m_findEdit, &QLineEdit::returnPressed, this,
+            [this]() { findNext(m_findEdit->text()); });
+    connect(m_findEdit, &QLineEdit::textEdited, this,
+            [this]() { m_findEdit->setStyleSheet(QString()); });
+    auto* closeFind = new QShortcut(QKeySequence(Qt::Key_Escape), m_findEdit);
+    closeFind->setContext(Qt::WidgetShortcut);
+    connect(closeFind, &QShortcut::activated, this, [this]() {
+        m_findWatcher.cancel();
+        m_findEdit->hide();
+        m_view->setFocus();
+    });
 
     m_view->setModel(m_model);
     m_view->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -62,12 +100,22 @@ LogViewerWidget::LogViewerWidget(QWidget* parent)
             this, &LogViewerWidget::onSelectionChanged);
     connect(m_view->horizontalHeader(), &QHeaderView::sectionClicked,
             this, &LogViewerWidget::onHeaderClicked);
+    connect(m_view->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            &LogViewerWidget::prefetchViewport);
+    connect(m_model, &QAbstractItemModel::modelReset, this,
+            &LogViewerWidget::prefetchViewport);
+    connect(&m_scanWatcher, &QFutureWatcherBase::resultsReadyAt,
+            this, &LogViewerWidget::onScanPartial);
+    connect(&m_scanWatcher, &QFutureWatcherBase::progressValueChanged,
+            this, &LogViewerWidget::updateScanStrip);
     connect(&m_scanWatcher, &QFutureWatcherBase::finished,
             this, &LogViewerWidget::onScanFinished);
     connect(&m_extractWatcher, &QFutureWatcherBase::finished,
             this, &LogViewerWidget::onExtractFinished);
     connect(&m_sortWatcher, &QFutureWatcherBase::finished,
             this, &LogViewerWidget::onSortFinished);
+    connect(&m_findWatcher, &QFutureWatcherBase::finished,
+            this, &LogViewerWidget::onFindFinished);
     connect(&m_histogramWatcher, &QFutureWatcherBase::finished, this, [this]() {
         if (m_histogramWatcher.future().isCanceled())
             return;
@@ -117,6 +165,7 @@ LogViewerWidget::~LogViewerWidget()
     m_scanWatcher.cancel();
     m_extractWatcher.cancel();
     m_sortWatcher.cancel();
+    m_findWatcher.cancel();
 }
 
 void LogViewerWidget::setCoreSource(std::shared_ptr<FileSource> source,
@@ -126,18 +175,23 @@ void LogViewerWidget::setCoreSource(std::shared_ptr<FileSource> source,
     m_scanWatcher.cancel();
     m_extractWatcher.cancel();
     m_sortWatcher.cancel();
+    m_findWatcher.cancel();
     m_source = std::move(source);
     m_index = std::move(index);
+    m_textIndex.reset();
     m_timeContext = TimeSettings::instance().contextForFile(
         m_source ? m_source->filePath() : QString());
     m_columnCache.clear();
     m_lineConstraint.reset(); // constraints don't survive a file switch
     m_activeQuery.reset();
+    m_rowsFilter.reset();
+    m_filterCache.clear();
     m_scanAfterExtract = false;
     m_sortAfterExtract = false;
     m_tailScanSplice = -1;
     m_tailExtractSplice = -1;
     m_pinnedForExtend = false;
+    endStreaming();
     m_sortColumn = -1;
     clearSortIndicator();
     m_statusStrip->hide();
@@ -168,11 +222,14 @@ void LogViewerWidget::extendCoreSource(std::shared_ptr<FileSource> source,
 
     // If an earlier extension's tail work never landed, the visible rows lag
     // more than one splice behind - a fresh full filter is the simple truth.
-    const bool interrupted = m_tailScanSplice >= 0 || m_tailExtractSplice >= 0;
+    // So do a streaming scan's partial rows.
+    const bool interrupted = m_tailScanSplice >= 0 || m_tailExtractSplice >= 0
+        || m_streaming;
     m_scanWatcher.cancel();
     m_extractWatcher.cancel();
     m_tailScanSplice = -1;
     m_tailExtractSplice = -1;
+    endStreaming();
 
     auto* scrollBar = m_view->verticalScrollBar();
     m_pinnedForExtend = scrollBar->value() >= scrollBar->maximum();
@@ -180,9 +237,11 @@ void LogViewerWidget::extendCoreSource(std::shared_ptr<FileSource> source,
     m_source = std::move(source);
     m_index = std::move(index);
 
-    if (interrupted || m_sortColumn >= 0 || m_pendingRestore) {
+    if (interrupted || m_sortColumn >= 0 || m_pendingRestore
+        || m_matchLimit.count > 0) {
         // Sorted views re-sort over a full rescan; the follow UI pauses
-        // follow while a sort is active, so this is the rare path.
+        // follow while a sort is active, so this is the rare path. A match
+        // limit is re-answered by a fresh scan too: it stops early.
         m_syncing = true;
         m_model->setSource(m_source, m_index, m_parser);
         m_syncing = false;
@@ -233,6 +292,9 @@ void LogViewerWidget::setParser(std::shared_ptr<const FormatParser> parser)
     m_sortWatcher.cancel();
     m_columnCache.clear(); // columns are parser-specific
     m_activeQuery.reset();
+    m_rowsFilter.reset();
+    m_filterCache.clear();
+    endStreaming(); // the model's rows reset below
     m_sortColumn = -1;
     clearSortIndicator();
     m_syncing = true;
@@ -535,11 +597,14 @@ void LogViewerWidget::applyFilter(const FilterOptions& options)
 
     m_activeQuery.reset();
     m_scanAfterExtract = false;
+    // "error | head 500": the suffix limits the scan, the rest filters.
+    m_filterText = options.query;
+    m_matchLimit = takeMatchLimit(&m_filterText);
 
-    if (options.inQueryMode && !options.query.isEmpty()) {
+    if (options.inQueryMode && !m_filterText.isEmpty()) {
         QueryError error;
         m_activeQuery = CompiledQuery::compile(
-            options.query, m_parser->schema(),
+            m_filterText, m_parser->schema(),
             options.caseSensitivity, {}, &error, m_timeContext);
         if (!m_activeQuery) {
             // Keep the previous rows; surface the schema-aware message.
@@ -547,22 +612,72 @@ void LogViewerWidget::applyFilter(const FilterOptions& options)
             emit queryError(error.message, int(error.position));
             return;
         }
-        m_statusStrip->hide();
-        if (ensureColumns(m_activeQuery->referencedColumns(),
-                          m_activeQuery->needsSeverity())) {
-            m_scanAfterExtract = true;
-            return; // scan continues in onExtractFinished
-        }
-    } else {
-        m_statusStrip->hide();
+    }
+    m_statusStrip->hide();
+    if (applyCachedFilter())
+        return;
+    if (m_activeQuery
+        && ensureColumns(m_activeQuery->referencedColumns(),
+                         m_activeQuery->needsSeverity())) {
+        m_scanAfterExtract = true;
+        return; // scan continues in onExtractFinished
     }
     startScan();
 }
 
+bool LogViewerWidget::applyCachedFilter()
+{
+    LineFilter filter = buildLineFilter();
+    const FilterScanResult* hit
+        = m_filterCache.find(FilterResultCache::keyOf(filter, m_timeContext));
+    if (!hit)
+        return false;
+    const qint64 decided = hit->rows.lineCount();
+    const qint64 total = m_index->lineCount();
+    if (decided == total && hit->fileSize == m_index->fileSize()) {
+        m_scanWatcher.cancel();
+        m_tailScanSplice = -1;
+        endStreaming();
+        FilterScanResult result = *hit;
+        result.elapsedMs = 0;
+        showScanResult(result, std::move(filter));
+        return true;
+    }
+
+    // Decided before follow mode grew the file: show those rows at once and
+    // tail-scan the new lines, as an extension would. Field queries would
+    // need their columns extended first, sorted views re-sort over a full
+    // scan, and a match limit may now pick other lines; all take the full
+    // path.
+    if (decided > total || hit->fileSize > m_index->fileSize() || m_activeQuery
+        || m_sortColumn >= 0 || m_pendingRestore || filter.limit.count > 0)
+        return false;
+    // An unterminated last line that grew since is decided again, as an
+    // extension's firstNewLine does.
+    const qint64 splice = decided > 0 && m_index->endOffsetOf(decided - 1) != hit->fileSize
+        ? decided - 1
+        : decided;
+    m_scanWatcher.cancel();
+    endStreaming();
+    m_syncing = true;
+    m_model->setRowSet(RowSet::appended(hit->rows, splice, {}, total));
+    restoreSelectionSilently();
+    m_syncing = false;
+    m_rowsFilter.reset(); // the rows miss the tail's matches until it lands
+    const qint64 matchCount = hit->matchCount;
+    startTailScan(splice);
+    refreshHistogram();
+    emit filterApplied(matchCount, 0);
+    return true;
+}
+
 void LogViewerWidget::setExtraPredicate(
-    std::function<bool(qint64, QByteArrayView)> predicate, bool refilter)
+    std::function<bool(qint64, QByteArrayView)> predicate, bool refilter,
+    const QString& cacheKey)
 {
     m_extraPredicate = std::move(predicate);
+    m_extraPredicateKey = m_extraPredicate ? cacheKey : QString();
+    m_rowsFilter.reset(); // the rows no longer bound the new predicate's
     if (refilter && m_source && m_index)
         applyFilter(m_lastOptions);
 }
@@ -573,6 +688,8 @@ void LogViewerWidget::setLineConstraint(
     if (sortedLines && sortedLines->empty())
         sortedLines.reset();
     m_lineConstraint = std::move(sortedLines);
+    ++m_constraintGeneration;
+    m_rowsFilter.reset();
     if (m_source && m_index)
         applyFilter(m_lastOptions);
 }
@@ -656,7 +773,8 @@ void LogViewerWidget::startTailScan(qint64 spliceLine)
         = std::max<qint64>(0, spliceLine - m_lastOptions.contextLinesBefore);
     LineFilter filter = buildLineFilter();
     m_scanWatcher.setFuture(scanFilter(m_source, m_index, std::move(filter),
-                                       kDefaultFilterChunkLines, firstLine));
+                                       kDefaultFilterChunkLines, firstLine, -1, -1,
+                                       m_textIndex));
 }
 
 void LogViewerWidget::finishTailScan(qint64 spliceLine,
@@ -689,9 +807,29 @@ void LogViewerWidget::startScan()
 {
     m_scanWatcher.cancel();
     m_tailScanSplice = -1;
+    endStreaming();
 
     LineFilter filter = buildLineFilter();
-    m_scanWatcher.setFuture(scanFilter(m_source, m_index, std::move(filter)));
+    m_scanningFilter = filter;
+    // As-you-type: when the new filter narrows the one the rows came from,
+    // only those rows can match. Rows left behind by an interrupted follow
+    // extension don't cover the index and take the full scan.
+    const RowSet& rows = m_model->rowSet();
+    if (m_rowsFilter && filter.narrows(*m_rowsFilter) && !rows.isAll()
+        && rows.lineCount() == m_index->lineCount()) {
+        m_scanWatcher.setFuture(refineFilter(m_source, m_index, std::move(filter),
+                                             rows, kDefaultFilterChunkLines,
+                                             kDefaultFilterPublishMs));
+        return;
+    }
+    // Viewport-first: start at the line the user is looking at (or is
+    // about to be restored to) and spread outward.
+    const qint64 focus = m_pendingRestore ? m_pendingScrollLine
+        : m_sortColumn < 0               ? topSourceLine()
+                                         : -1;
+    m_scanWatcher.setFuture(scanFilter(m_source, m_index, std::move(filter),
+                                       kDefaultFilterChunkLines, 0,
+                                       kDefaultFilterPublishMs, focus, m_textIndex));
 }
 
 LineFilter LogViewerWidget::buildLineFilter() const
@@ -702,9 +840,10 @@ LineFilter LogViewerWidget::buildLineFilter() const
         filter.columns = m_columnCache.snapshot(
             m_activeQuery->referencedColumns(), m_activeQuery->needsSeverity());
     } else if (!m_lastOptions.inQueryMode) {
-        filter.query = m_lastOptions.query;
+        filter.query = m_filterText;
         filter.regexMode = m_lastOptions.inRegexMode;
     }
+    filter.limit = m_matchLimit;
     filter.caseSensitive = m_lastOptions.caseSensitivity == Qt::CaseSensitive;
     filter.invert = m_lastOptions.invertFilter;
     filter.contextBefore = m_lastOptions.contextLinesBefore;
@@ -721,17 +860,71 @@ LineFilter LogViewerWidget::buildLineFilter() const
                 return false;
             return !chrome || chrome(line, raw);
         };
+        if (!chrome || !m_extraPredicateKey.isEmpty())
+            filter.extraPredicateKey = QStringLiteral("lines#%1|%2")
+                                           .arg(m_constraintGeneration)
+                                           .arg(m_extraPredicateKey);
     } else {
         filter.extraPredicate = m_extraPredicate;
+        filter.extraPredicateKey = m_extraPredicateKey;
     }
     return filter;
 }
 
+void LogViewerWidget::onScanPartial(int /*begin*/, int end)
+{
+    // Tail scans don't stream; a sorted view or a pending restore waits for
+    // the complete rows.
+    const QFuture<FilterScanResult> future = m_scanWatcher.future();
+    if (future.isCanceled() || m_tailScanSplice >= 0 || m_sortColumn >= 0
+        || m_pendingRestore)
+        return;
+    const FilterScanResult partial = future.resultAt(end - 1);
+    if (!partial.partial)
+        return; // the complete result: onScanFinished
+    // The first partial replaces the previous filter's rows; later ones grow
+    // them around the viewport. Either way the line at the top stays there
+    // (or its nearest surviving row), so the view settles where the user
+    // was looking while the rest fills in.
+    const qint64 anchor = topSourceLine();
+    m_syncing = true;
+    if (m_streaming)
+        m_model->growRowSet(partial.rows);
+    else
+        m_model->setRowSet(partial.rows);
+    restoreSelectionSilently();
+    m_syncing = false;
+    if (anchor >= 0)
+        scrollToSourceLine(anchor);
+    m_rowsFilter.reset(); // partial rows bound no filter
+    m_streaming = true;
+    m_streamedMatches = partial.matchCount;
+    updateScanStrip();
+}
+
+void LogViewerWidget::updateScanStrip()
+{
+    if (!m_streaming)
+        return;
+    m_scanStrip->setText(tr("Filtering... %L1 matches so far (%2%)")
+                             .arg(m_streamedMatches)
+                             .arg(m_scanWatcher.progressValue() / 10));
+    m_scanStrip->show();
+}
+
+void LogViewerWidget::endStreaming()
+{
+    m_streaming = false;
+    m_scanStrip->hide();
+}
+
 void LogViewerWidget::onScanFinished()
 {
     if (m_scanWatcher.future().isCanceled())
         return;
-    const FilterScanResult result = m_scanWatcher.future().result();
+    // Streamed partials come first; the complete result is the last one.
+    const QFuture<FilterScanResult> future = m_scanWatcher.future();
+    const FilterScanResult result = future.resultAt(future.resultCount() - 1);
 
     if (m_tailScanSplice >= 0) {
         const qint64 splice = m_tailScanSplice;
@@ -740,9 +933,26 @@ void LogViewerWidget::onScanFinished()
         return;
     }
 
+    m_filterCache.insert(FilterResultCache::keyOf(m_scanningFilter, m_timeContext),
+                         result);
+    showScanResult(result, std::move(m_scanningFilter));
+}
+
+void LogViewerWidget::showScanResult(const FilterScanResult& result,
+                                     LineFilter filter)
+{
+    const qint64 anchor = m_streaming ? topSourceLine() : -1;
     m_syncing = true;
-    m_model->setRowSet(result.rows); // clears any sort order
+    if (m_streaming)
+        m_model->growRowSet(result.rows); // completes the partial rows
+    else
+        m_model->setRowSet(result.rows); // clears any sort order
     m_syncing = false;
+    endStreaming();
+    if (anchor >= 0)
+        scrollToSourceLine(anchor);
+    m_rowsFilter = std::move(filter);
+    m_rowsFilter->columns = {}; // narrows() never reads them; don't pin them
 
     if (m_pendingRestore) {
         applyPendingRestore();
@@ -887,15 +1097,25 @@ QJsonObject LogViewerWidget::saveViewState() const
         state.insert(QStringLiteral("sortColumn"), m_sortColumn);
         state.insert(QStringLiteral("sortOrder"), int(m_sortOrder));
     }
-    const QModelIndex top = m_view->indexAt(QPoint(0, 0));
-    if (top.isValid()) {
-        const qint64 line = m_model->sourceLineForRow(top.row());
-        if (line >= 0)
-            state.insert(QStringLiteral("firstVisibleLine"), double(line));
-    }
+    const qint64 line = topSourceLine();
+    if (line >= 0)
+        state.insert(QStringLiteral("firstVisibleLine"), double(line));
     return state;
 }
 
+qint64 LogViewerWidget::topSourceLine() const
+{
+    const QModelIndex top = m_view->indexAt(QPoint(0, 0));
+    return top.isValid() ? m_model->sourceLineForRow(top.row()) : -1;
+}
+
+void LogViewerWidget::scrollToSourceLine(qint64 line)
+{
+    const int row = nearestRowForSourceLine(line);
+    if (row >= 0)
+        m_view->scrollTo(m_model->index(row, 0), QAbstractItemView::PositionAtTop);
+}
+
 void LogViewerWidget::restoreViewState(const QJsonObject& state)
 {
     PendingViewState pending;
@@ -947,6 +1167,19 @@ void LogViewerWidget::applyPendingScroll()
     m_pendingScrollLine = -1;
 }
 
+void LogViewerWidget::prefetchViewport()
+{
+    // Mapped sources are advised random while idle, so a scroll faults in
+    // one page at a time; hint the screens the user is heading into.
+    constexpr int kScreensAhead = 3;
+    const int top = m_view->rowAt(0);
+    if (top < 0)
+        return;
+    const int screen
+        = m_view->viewport()->height() / m_view->verticalHeader()->defaultSectionSize() + 1;
+    m_model->prefetchRows(top - screen, screen * (kScreensAhead + 2));
+}
+
 int LogViewerWidget::nearestRowForSourceLine(qint64 line) const
 {
     // Natural order only: row positions are ascending in source line, so the
@@ -1000,6 +1233,71 @@ void LogViewerWidget::onSelectionChanged()
     emit linesSelected(lines);
 }
 
+void LogViewerWidget::findNext(const QString& text, bool backward)
+{
+    if (!m_source || !m_index)
+        return;
+    if (text.isEmpty()) {
+        m_findEdit->show();
+        m_findEdit->setFocus();
+        return;
+    }
+    // From the current row, else the top of the viewport inclusive, else
+    // the first (last) line.
+    qint64 from = -1;
+    const QModelIndex current = m_view->currentIndex();
+    if (current.isValid()) {
+        from = m_model->sourceLineForRow(current.row());
+    } else if (const qint64 top = topSourceLine(); top >= 0) {
+        from = backward ? top : top - 1;
+    } else {
+        from = backward ? m_index->lineCount() : -1;
+    }
+    m_findText = text;
+    m_findBackward = backward;
+    m_findWrapped = false;
+    startFind(from);
+}
+
+void LogViewerWidget::startFind(qint64 fromLine)
+{
+    // The filter bar's case and regex flags apply; field queries search text.
+    LineFilter filter;
+    filter.query = m_findText;
+    filter.caseSensitive = m_lastOptions.caseSensitivity == Qt::CaseSensitive;
+    filter.regexMode = m_lastOptions.inRegexMode && !m_lastOptions.inQueryMode;
+    m_findWatcher.cancel();
+    m_findWatcher.setFuture(findMatch(m_source, m_index, std::move(filter),
+                                      m_model->rowSet(), fromLine, m_findBackward));
+}
+
+void LogViewerWidget::onFindFinished()
+{
+    if (m_findWatcher.future().isCanceled() || !m_index)
+        return;
+    const qint64 line = m_findWatcher.result().line;
+    if (line < 0) {
+        if (!m_findWrapped) {
+            // Past the last (first) row: once more from the other end.
+            m_findWrapped = true;
+            startFind(m_findBackward ? m_index->lineCount() : -1);
+            return;
+        }
+        m_findEdit->setStyleSheet(
+            "QLineEdit { background-color: #FFB6C1; color: black; }");
+        return;
+    }
+    m_findEdit->setStyleSheet(QString());
+    // The rows may have changed under the search: a hidden line is no hit.
+    const int row = m_model->rowForSourceLine(line);
+    if (row < 0)
+        return;
+    const QModelIndex target = m_model->index(row, 0);
+    m_view->scrollTo(target, QAbstractItemView::PositionAtCenter);
+    m_view->selectionModel()->setCurrentIndex(
+        target, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+}
+
 void LogViewerWidget::selectSourceLines(const QList<int>& sourceLines)
 {
     m_syncing = true;
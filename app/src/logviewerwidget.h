@@ -20,6 +20,7 @@
 
 class HistogramStrip;
 class QLabel;
+class QLineEdit;
 class QMenu;
 class QTableView;
 
@@ -57,17 +58,31 @@ public:
     /// Text mode filters directly; query mode (options.inQueryMode) compiles
     /// the field query against the parser schema, extracting any missing
     /// columns first. Compile errors keep the previous rows and show a
-    /// status strip.
+    /// status strip. A "| head N" / "| tail N" suffix in any mode keeps the
+    /// first / last N matches (logdor::takeMatchLimit).
     void applyFilter(const FilterOptions& options);
 
     /// Structured predicate (e.g. logcat level/tag chrome), ANDed with the
-    /// filter. Re-runs the scan when @p refilter.
+    /// filter. Re-runs the scan when @p refilter. Filters with a predicate
+    /// reuse cached results only under the same non-empty @p cacheKey
+    /// (LineFilter::extraPredicateKey).
     void setExtraPredicate(std::function<bool(qint64, QByteArrayView)> predicate,
-                           bool refilter = true);
+                           bool refilter = true, const QString& cacheKey = {});
 
     /// Enables annotation markers/tooltips and the note context menu.
     void setAnnotationHub(AnnotationHub* hub);
 
+    /**
+     * PluginInterface::setTextIndex pass-through: full text scans skip the
+     * blocks @p index rules out (logdor::scanFilter()). Arrives after
+     * setCoreSource(), which drops it; kept across follow-mode extensions,
+     * where it still covers the lines it was built over.
+     */
+    void setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index)
+    {
+        m_textIndex = std::move(index);
+    }
+
     /// PluginInterface::setHighlightRules pass-through.
     void setHighlightRules(const QList<HighlightRule>& rules)
     {
@@ -81,6 +96,16 @@ public:
      */
     void setLineConstraint(std::shared_ptr<const std::vector<qint32>> sortedLines);
 
+    /**
+     * Select the next row (previous when @p backward) past the current one
+     * whose line contains @p text - the find bar's F3 / Shift+F3; Ctrl+F
+     * opens the bar, as does an empty @p text. Searches the visible rows
+     * without filtering (logdor::findMatch), with the filter bar's case and
+     * regex flags, and wraps around once. No current row: from the top of
+     * the viewport.
+     */
+    void findNext(const QString& text, bool backward = false);
+
     LogTableModel* model() const { return m_model; }
     QTableView* tableView() const { return m_view; }
 
@@ -111,26 +136,44 @@ public slots:
 
 private slots:
     void onSelectionChanged();
+    void onScanPartial(int begin, int end);
+    void updateScanStrip();
     void onScanFinished();
     void onExtractFinished();
     void onSortFinished();
+    void onFindFinished();
     void onHeaderClicked(int section);
     void onContextMenuRequested(const QPoint& pos);
 
 private:
     void addFilterActions(QMenu* menu, const QModelIndex& clicked);
     void startScan();
+    void startFind(qint64 fromLine);
+    // Drop the streaming state: the rows no longer show a scan in flight.
+    void endStreaming();
     void startTailScan(qint64 spliceLine);
     void finishTailScan(qint64 spliceLine,
                         const logdor::FilterScanResult& result);
     logdor::LineFilter buildLineFilter() const;
+    // Show a full-file result: rows, then sort/selection/restore, histogram.
+    void showScanResult(const logdor::FilterScanResult& result,
+                        logdor::LineFilter filter);
+    // Apply the current filter from m_filterCache; false when it must scan.
+    bool applyCachedFilter();
     void startSort();
     // ensureColumns for the current m_sortColumn, then sort (shared by
     // header clicks and view-state restore).
     void requestSort();
     void applyPendingRestore();
     void applyPendingScroll();
+    // Page in the bytes of the rows around the viewport: one screen back,
+    // a few ahead.
+    void prefetchViewport();
     int nearestRowForSourceLine(qint64 line) const;
+    // Source line of the row at the top of the viewport; -1 when empty.
+    qint64 topSourceLine() const;
+    // Natural order: put @p line (or the nearest row after it) at the top.
+    void scrollToSourceLine(qint64 line);
     // Ensure the given columns/severity are cached; returns true when an
     // extraction was started (completion continues the pending work).
     bool ensureColumns(const QList<int>& columns, bool needsSeverity);
@@ -147,25 +190,46 @@ private:
 
     QTableView* m_view = nullptr;
     QLabel* m_statusStrip = nullptr;
+    QLabel* m_scanStrip = nullptr; // "still filtering" while a scan streams
+    QLineEdit* m_findEdit = nullptr;
     HistogramStrip* m_histogramStrip = nullptr;
     LogTableModel* m_model = nullptr;
     std::shared_ptr<logdor::FileSource> m_source;
     std::shared_ptr<const logdor::LineIndex> m_index;
     std::shared_ptr<const logdor::FormatParser> m_parser;
+    std::shared_ptr<const logdor::TrigramIndex> m_textIndex;
 
     QFutureWatcher<logdor::FilterScanResult> m_scanWatcher;
     QFutureWatcher<logdor::ColumnScanResult> m_extractWatcher;
     QFutureWatcher<logdor::SortResult> m_sortWatcher;
     QFutureWatcher<logdor::HistogramResult> m_histogramWatcher;
+    QFutureWatcher<logdor::FindResult> m_findWatcher;
+    QString m_findText;
+    bool m_findBackward = false;
+    bool m_findWrapped = false; // the search in flight restarted at an end
     logdor::ColumnCache m_columnCache;
 
     FilterOptions m_lastOptions;
+    // m_lastOptions.query without its "| head N" / "| tail N" suffix.
+    QString m_filterText;
+    logdor::MatchLimit m_matchLimit;
     // Zone/reference-date for the current file's timestamps; the column
     // cache is only valid for the context it was extracted with.
     logdor::TimeParseContext m_timeContext;
     std::shared_ptr<const logdor::CompiledQuery> m_activeQuery;
     std::function<bool(qint64, QByteArrayView)> m_extraPredicate;
+    QString m_extraPredicateKey;
     std::shared_ptr<const std::vector<qint32>> m_lineConstraint;
+    quint64 m_constraintGeneration = 0; // names m_lineConstraint in cache keys
+    logdor::FilterResultCache m_filterCache; // recent filters over this file
+
+    // The filter of the scan in flight, and the one the model's rows came
+    // from: a narrower filter only rescans those rows (refineFilter).
+    logdor::LineFilter m_scanningFilter;
+    std::optional<logdor::LineFilter> m_rowsFilter;
+    // The rows are a partial result of the scan in flight (onScanPartial).
+    bool m_streaming = false;
+    qint64 m_streamedMatches = 0;
 
     bool m_scanAfterExtract = false;
     bool m_sortAfterExtract = false;
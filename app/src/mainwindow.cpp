@@ -103,15 +103,34 @@ MainWindow::MainWindow(QWidget* parent)
     QShortcut* filterShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_L), this);
     connect(filterShortcut, &QShortcut::activated, this, &MainWindow::onFocusFilterInput);
 
-    // Indexing runs on a worker thread; the watcher delivers progress and
-    // completion back on the GUI thread.
+    // Indexing runs on a worker thread; the watcher delivers progress,
+    // partial snapshots and completion back on the GUI thread.
     m_indexWatcher = new QFutureWatcher<logdor::IndexingResult>(this);
     connect(m_indexWatcher, &QFutureWatcherBase::progressValueChanged,
             this, &MainWindow::onIndexingProgress);
+    connect(m_indexWatcher, &QFutureWatcherBase::resultReadyAt,
+            this, &MainWindow::onIndexingPartial);
     connect(m_indexWatcher, &QFutureWatcherBase::finished,
             this, &MainWindow::onIndexingFinished);
+    m_textIndexWatcher = new QFutureWatcher<logdor::TrigramIndexResult>(this);
+    connect(m_textIndexWatcher, &QFutureWatcherBase::finished,
+            this, &MainWindow::onTextIndexingFinished);
 
-    // Decompression stage for .gz opens; feeds the same progress dialog.
+    // Reopening a large log maps its cached index instead of rescanning.
+    // indexCache/maxMB = 0 turns the cache off.
+    {
+        QSettings settings("Logdor", "Logdor");
+        const qint64 maxMb = settings.value("indexCache/maxMB",
+            logdor::LineIndexCache::kDefaultMaxBytes / (1024 * 1024)).toLongLong();
+        if (maxMb > 0) {
+            m_indexCache = std::make_shared<const logdor::LineIndexCache>(
+                QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                    + QStringLiteral("/index-cache"),
+                quint64(maxMb) * 1024 * 1024);
+        }
+    }
+
+    // Decompression stage for compressed opens; feeds the same progress dialog.
     m_openWatcher
         = new QFutureWatcher<logdor::FileSource::AsyncOpenResult>(this);
     connect(m_openWatcher, &QFutureWatcherBase::progressValueChanged,
@@ -320,6 +339,7 @@ MainWindow::~MainWindow()
     // The indexing task holds its own shared_ptr to the file source, so it
     // can finish (or notice the cancel) safely after we're gone.
     m_indexWatcher->cancel();
+    m_textIndexWatcher->cancel();
     delete ui;
 }
 
@@ -382,6 +402,8 @@ void MainWindow::createPluginDock(const QString& pluginName,
             // Feed the open file to a plugin enabled late
             if (checked && m_fileSource && m_lineIndex) {
                 plugin->setCoreSource(m_fileSource, m_lineIndex);
+                if (m_textIndex)
+                    plugin->setTextIndex(m_textIndex);
                 plugin->setFilter(m_filterOptions);
             }
         });
@@ -460,6 +482,8 @@ void MainWindow::addPluginPane(const QString& baseName, bool showNow)
         dock->raise();
         if (m_fileSource && m_lineIndex) {
             extra->setCoreSource(m_fileSource, m_lineIndex);
+            if (m_textIndex)
+                extra->setTextIndex(m_textIndex);
             extra->setFilter(m_filterOptions);
         }
         scheduleSettingsSave();
@@ -569,6 +593,7 @@ void MainWindow::ensureSearchDock()
     if (m_searchDock)
         return;
     m_searchDock = new FolderSearchDock(this);
+    m_searchDock->setIndexCache(m_indexCache);
     addDockWidget(Qt::BottomDockWidgetArea, m_searchDock);
     // Created after loadSettings' restoreState, so apply the saved layout
     // (area, size, floating) to it explicitly.
@@ -722,6 +747,7 @@ void MainWindow::closeEvent(QCloseEvent* event)
 {
     m_closing = true; // dock closes during teardown must not remove panes
     m_indexWatcher->cancel();
+    m_textIndexWatcher->cancel();
     // Capture the open file's session BEFORE teardown so quitting keeps its
     // state for the next run (the historical gap: only file SWITCHES did).
     if (!m_currentFileName.isEmpty() && m_lineIndex)
@@ -758,6 +784,8 @@ bool MainWindow::openFile(const QString& fileName)
     if (m_indexWatcher->isRunning()) {
         m_indexWatcher->cancel();
     }
+    m_textIndexWatcher->cancel();
+    m_textIndex.reset();
 
     // Save the outgoing file's notes before anything else can fail.
     flushAnnotationSave();
@@ -782,7 +810,8 @@ bool MainWindow::openFile(const QString& fileName)
         m_indexProgress->setLabelText(
             tr("Decompressing %1...").arg(QFileInfo(fileName).fileName()));
         m_indexProgress->setValue(0);
-        m_openWatcher->setFuture(logdor::FileSource::openAsync(fileName));
+        m_openWatcher->setFuture(
+            logdor::FileSource::openAsync(fileName, m_indexCache));
         return true;
     }
 
@@ -813,7 +842,19 @@ void MainWindow::startIndexingCurrentFile()
     m_indexProgress->setLabelText(
         tr("Indexing %1...").arg(QFileInfo(m_pendingFileName).fileName()));
     m_indexProgress->setValue(0);
-    m_indexWatcher->setFuture(logdor::buildLineIndex(m_fileSource));
+    // Files past index/sparseAboveMB (0 = never) get a sparse index: a few
+    // MB of checkpoints instead of ~4 bytes per line.
+    const qint64 sparseAboveMb = QSettings("Logdor", "Logdor")
+                                     .value("index/sparseAboveMB", 0)
+                                     .toLongLong();
+    const bool sparse = sparseAboveMb > 0
+        && m_fileSource->size() > quint64(sparseAboveMb) * 1024 * 1024;
+    // Progressive: the head of a multi-GB file is on screen after the
+    // first publish interval instead of after the whole scan.
+    m_indexWatcher->setFuture(logdor::buildLineIndex(
+        m_fileSource, m_indexCache, logdor::kDefaultIndexChunkSize,
+        logdor::kDefaultIndexThreads, sparse ? logdor::kDefaultSparseStride : 1,
+        logdor::kDefaultPublishInterval));
 }
 
 void MainWindow::onAsyncOpenFinished()
@@ -846,6 +887,33 @@ void MainWindow::onIndexingProgress(int permille)
         m_indexProgress->setValue(permille);
 }
 
+void MainWindow::onIndexingPartial(int resultIndex)
+{
+    const logdor::IndexingResult result = m_indexWatcher->resultAt(resultIndex);
+    if (!result.partial || m_indexWatcher->isCanceled())
+        return; // the final index is handled by onIndexingFinished()
+
+    if (m_lineIndex) {
+        extendShownIndex(result.index);
+        return;
+    }
+    // First snapshot: let viewers show and scroll the head of the file
+    // while the rest indexes. Annotations, session and filter wait for the
+    // final index.
+    m_lineIndex = result.index;
+    m_pluginManager->setCoreSource(m_fileSource, m_lineIndex);
+}
+
+void MainWindow::extendShownIndex(std::shared_ptr<const logdor::LineIndex> index)
+{
+    // An unterminated last line may have grown, as in follow mode.
+    const qint64 oldCount = m_lineIndex->lineCount();
+    const qint64 firstNewLine
+        = m_lineIndex->lastLineTerminated() ? oldCount : oldCount - 1;
+    m_lineIndex = std::move(index);
+    m_pluginManager->extendCoreSource(m_fileSource, m_lineIndex, firstNewLine);
+}
+
 void MainWindow::onIndexingFinished()
 {
     m_indexProgress->reset();
@@ -855,21 +923,35 @@ void MainWindow::onIndexingFinished()
     m_pendingFileName.clear();
 
     if (m_indexWatcher->future().isCanceled()) {
+        if (m_lineIndex) {
+            // Drop the partial view rather than pass off a truncated file.
+            m_pluginManager->setCoreSource(nullptr, nullptr);
+            m_lineIndex.reset();
+        }
         setWindowTitle(tr("Logdor"));
         ui->statusbar->showMessage(tr("Indexing cancelled"), 3000);
         return;
     }
 
-    const logdor::IndexingResult result = m_indexWatcher->future().result();
-    m_lineIndex = result.index;
+    // The final index is the last result; any earlier ones were partial
+    // snapshots, and if those are on screen the viewers extend in place.
+    const QFuture<logdor::IndexingResult> future = m_indexWatcher->future();
+    const logdor::IndexingResult result = future.resultAt(future.resultCount() - 1);
+    const bool shownEarly = m_lineIndex != nullptr;
+    if (shownEarly)
+        extendShownIndex(result.index);
+    else
+        m_lineIndex = result.index;
 
     const char* modeName = "buffered";
     if (m_fileSource->mode() == logdor::FileSource::Mode::Mapped)
         modeName = "mapped";
     else if (m_fileSource->mode() == logdor::FileSource::Mode::Decompressed)
         modeName = "decompressed";
+    else if (m_fileSource->mode() == logdor::FileSource::Mode::Seekable)
+        modeName = "seekable";
     qDebug() << "Indexed" << result.lineCount << "lines in" << result.elapsedMs
-             << "ms," << modeName;
+             << "ms," << modeName << (result.fromCache ? "(cached)" : "");
     ui->statusbar->showMessage(tr("Indexed %L1 lines in %2 ms")
                                    .arg(result.lineCount)
                                    .arg(result.elapsedMs),
@@ -883,7 +965,9 @@ void MainWindow::onIndexingFinished()
 
     // Every viewer is core-aware: hand out the source and filter. Opening a
     // file costs the line index, nothing else.
-    m_pluginManager->setCoreSource(m_fileSource, m_lineIndex);
+    if (!shownEarly)
+        m_pluginManager->setCoreSource(m_fileSource, m_lineIndex);
+    startTextIndexing();
     // Revisited files come back the way they were left; first visits keep
     // the current toolbar filter. setFilter() below applies either in one
     // shot, and viewers finish their part when their scans land.
@@ -930,8 +1014,9 @@ void MainWindow::onIndexingFinished()
 
     // Following a decompressed snapshot is meaningless - the on-disk bytes
     // are not the displayed bytes.
-    m_followAction->setEnabled(m_fileSource->mode()
-                               != logdor::FileSource::Mode::Decompressed);
+    m_followAction->setEnabled(
+        m_fileSource->mode() != logdor::FileSource::Mode::Decompressed
+        && m_fileSource->mode() != logdor::FileSource::Mode::Seekable);
     if (m_refollowAfterLoad) {
         m_refollowAfterLoad = false;
         if (m_followAction->isEnabled())
@@ -949,6 +1034,33 @@ void MainWindow::onFollowToggled(bool on)
     }
 }
 
+void MainWindow::startTextIndexing()
+{
+    m_textIndexWatcher->cancel();
+    m_textIndex.reset();
+    if (!m_indexCache || m_fileSource->size() < m_indexCache->minFileSize())
+        return;
+    m_textIndexWatcher->setFuture(
+        logdor::buildTrigramIndex(m_fileSource, m_lineIndex, m_indexCache));
+}
+
+void MainWindow::onTextIndexingFinished()
+{
+    // A cancelled build belongs to a file that is gone or being replaced.
+    if (m_textIndexWatcher->future().isCanceled() || !m_lineIndex)
+        return;
+    const logdor::TrigramIndexResult result = m_textIndexWatcher->result();
+    m_textIndex = result.index;
+    const double bytes = double(m_textIndex->memoryUsage());
+    ui->statusbar->showMessage(tr("Search index: %1 MiB, %2 bytes/line, in %3 ms")
+                                   .arg(bytes / (1024 * 1024), 0, 'f', 1)
+                                   .arg(bytes / double(qMax<qint64>(m_textIndex->lineCount(), 1)),
+                                        0, 'f', 2)
+                                   .arg(result.elapsedMs),
+                               3000);
+    m_pluginManager->setTextIndex(m_textIndex);
+}
+
 void MainWindow::onFollowExtended(std::shared_ptr<logdor::FileSource> source,
                                   std::shared_ptr<const logdor::LineIndex> index,
                                   qint64 firstNewLine)
@@ -1354,7 +1466,7 @@ void MainWindow::saveSessionsFile() const
 void MainWindow::onActionOpenTriggered()
 {
     QFileDialog fileDialog(this, tr("Open File"), QString(),
-                           tr("Log files (*.log *.txt *.json *.gz);;"
+                           tr("Log files (*.log *.txt *.json *.gz *.zst *.xz *.lz4);;"
                               "All Files (*)"));
     fileDialog.selectNameFilter(tr("All Files (*)"));
     while (fileDialog.exec() == QDialog::Accepted
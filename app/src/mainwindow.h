@@ -12,7 +12,9 @@
 #include "pluginmanager.h"
 #include <logdor/FileSource.h>
 #include <logdor/LineIndex.h>
+#include <logdor/LineIndexCache.h>
 #include <logdor/LineIndexer.h>
+#include <logdor/TrigramIndex.h>
 #include <memory>
 
 class FolderSearchDock;
@@ -56,7 +58,9 @@ private slots:
     void onFilterTermRequested(const QString& term);
     void onFocusFilterInput();
     void onIndexingProgress(int permille);
+    void onIndexingPartial(int resultIndex);
     void onIndexingFinished();
+    void onTextIndexingFinished();
     void onAsyncOpenFinished();
     void onFollowToggled(bool on);
     void onFollowExtended(std::shared_ptr<logdor::FileSource> source,
@@ -110,6 +114,13 @@ private:
     // Kick off buildLineIndex over m_fileSource/m_pendingFileName - the
     // second stage of openFile (first stage may be an async decompression).
     void startIndexingCurrentFile();
+    // Replace the on-screen partial index with its extension (a later
+    // snapshot or the final index); viewers grow in place like following.
+    void extendShownIndex(std::shared_ptr<const logdor::LineIndex> index);
+    // Build (or look up) the trigram index of the indexed file in the
+    // background; viewers get it via setTextIndex. Only for files the
+    // index cache would keep, and only with the cache on.
+    void startTextIndexing();
     // Per-file view state (filter + plugin states), kept for the app run so
     // cycling between files brings each one back the way it was left.
     void captureSession();
@@ -142,7 +153,12 @@ private:
     std::shared_ptr<logdor::FileSource> m_fileSource;
     std::shared_ptr<const logdor::LineIndex> m_lineIndex;
     QFutureWatcher<logdor::IndexingResult>* m_indexWatcher = nullptr;
-    // Async open (decompression) preceding indexing for .gz files.
+    // Persisted indexes under the app data dir; null when disabled.
+    std::shared_ptr<const logdor::LineIndexCache> m_indexCache;
+    // The current file's trigram index, once built; null before.
+    std::shared_ptr<const logdor::TrigramIndex> m_textIndex;
+    QFutureWatcher<logdor::TrigramIndexResult>* m_textIndexWatcher = nullptr;
+    // Async open (decompression) preceding indexing for compressed files.
     QFutureWatcher<logdor::FileSource::AsyncOpenResult>* m_openWatcher = nullptr;
     QProgressDialog* m_indexProgress = nullptr;
     QString m_pendingFileName;
@@ -11,6 +11,7 @@
 
 #include <logdor/FileSource.h>
 #include <logdor/LineIndex.h>
+#include <logdor/TrigramIndex.h>
 
 #include <memory>
 
@@ -122,6 +123,18 @@ public:
         setCoreSource(std::move(source), std::move(index));
     }
 
+    /**
+     * The current file's trigram block index, built in the background once
+     * the line index is ready (after setCoreSource()). Viewers pass it to
+     * logdor::scanFilter() so text filters skip the blocks that cannot
+     * match. Null until built, after a new file, and on files too small to
+     * index. GUI thread only.
+     */
+    virtual void setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index)
+    {
+        Q_UNUSED(index)
+    }
+
     /**
      * Shared annotation state (notes on lines/ranges). Called once at
      * startup; the pointer stays valid for the application lifetime.
@@ -215,7 +228,8 @@ protected:
 // /3.4: timeRangeRequested histogram-brush filter routing.
 // /3.5: setHighlightRules fan-out + highlightRequested routing.
 // /3.6: supportsMultiplePanes/createInstance multi-pane support.
-#define PluginInterface_iid "com.logdor.PluginInterface/3.6"
+// /3.7: setTextIndex trigram block index fan-out.
+#define PluginInterface_iid "com.logdor.PluginInterface/3.7"
 Q_DECLARE_INTERFACE(PluginInterface, PluginInterface_iid)
 
 #endif // PLUGININTERFACE_H
@@ -199,6 +199,13 @@ void PluginManager::extendCoreSource(std::shared_ptr<logdor::FileSource> source,
         plugin->coreSourceExtended(source, index, firstNewLine);
 }
 
+void PluginManager::setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index)
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
+    for (PluginInterface* plugin : enabledPlugins())
+        plugin->setTextIndex(index);
+}
+
 void PluginManager::setHighlightRules(const QList<HighlightRule>& rules)
 {
     Q_ASSERT(QThread::currentThread() == qApp->thread());
@@ -53,6 +53,10 @@ public:
                           std::shared_ptr<const logdor::LineIndex> index,
                           qint64 firstNewLine);
 
+    // Fan the current file's trigram block index out to enabled plugins,
+    // once built (after setCoreSource). GUI thread only.
+    void setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index);
+
     // Hand the shared annotation hub to ALL loaded plugins (pointer is
     // stable for the app lifetime, so disabled plugins get it too).
     void setAnnotationHub(AnnotationHub* hub);
@@ -82,6 +82,33 @@ private slots:
         QCOMPARE(model.columnCount(), 0);
     }
 
+    void growRowSetInsertsOrResets()
+    {
+        QTemporaryDir dir;
+        auto o = openContent(dir, "g.log", QByteArray("a\nb\nc\nd\ne\nf\n"));
+        LogTableModel model;
+        QAbstractItemModelTester tester(
+            &model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+        model.setSource(o.source, o.index, parserById(u"plaintext"));
+        model.setRowSet(RowSet::fromLines({ 3 }, 6));
+
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+        model.growRowSet(RowSet::fromLines({ 3, 4 }, 6)); // after
+        QCOMPARE(inserted.count(), 1);
+        model.growRowSet(RowSet::fromLines({ 1, 3, 4, 5 }, 6)); // both ends
+        QCOMPARE(inserted.count(), 3);
+        QCOMPARE(reset.count(), 0);
+        QCOMPARE(model.rowCount(), 4);
+        QCOMPARE(model.sourceLineForRow(0), qint64(1));
+        QCOMPARE(model.sourceLineForRow(3), qint64(5));
+
+        // Not an extension of the current rows: a reset.
+        model.growRowSet(RowSet::fromLines({ 0, 4, 5 }, 6));
+        QCOMPARE(reset.count(), 1);
+        QCOMPARE(model.sourceLineForRow(0), qint64(0));
+    }
+
     void numberColumnShowsSourceLinesUnderFilter()
     {
         QTemporaryDir dir;
@@ -167,6 +167,38 @@ private slots:
         QCOMPARE(widget.model()->sourceLineForRow(0), qint64(1)); // now "two"
     }
 
+    void cachedFilterRedecidesGrownUnterminatedLine()
+    {
+        QTemporaryDir dir;
+        const QString path = dir.filePath("cached.log");
+        auto o = openContent(dir, "cached.log", "one\ntw");
+        LogViewerWidget widget;
+        widget.setParser(parserById(u"plaintext"));
+        widget.setCoreSource(o.source, o.index);
+        widget.applyFilter(FilterOptions(QStringLiteral("two")));
+        QVERIFY(waitForScan(widget));
+        QCOMPARE(widget.model()->rowCount(), 0); // cached: "tw" does not match
+        widget.applyFilter(FilterOptions(QStringLiteral("one")));
+        QVERIFY(waitForScan(widget));
+
+        // The last line grows in place: same line count, more bytes.
+        o = growFile(path, o, "o", widget);
+        QTRY_COMPARE_WITH_TIMEOUT(widget.model()->rowCount(), 1, 5000);
+        widget.applyFilter(FilterOptions(QStringLiteral("two")));
+        QTRY_COMPARE_WITH_TIMEOUT(widget.model()->rowCount(), 1, 5000);
+        QCOMPARE(widget.model()->sourceLineForRow(0), qint64(1));
+
+        // Then gains a terminator and a new line; the cached "two" result
+        // still decides only "one\ntw".
+        widget.applyFilter(FilterOptions(QStringLiteral("one")));
+        QTRY_COMPARE_WITH_TIMEOUT(widget.model()->rowCount(), 1, 5000);
+        growFile(path, o, "\nother two\n", widget);
+        widget.applyFilter(FilterOptions(QStringLiteral("two")));
+        QTRY_COMPARE_WITH_TIMEOUT(widget.model()->rowCount(), 2, 5000);
+        QCOMPARE(widget.model()->sourceLineForRow(0), qint64(1));
+        QCOMPARE(widget.model()->sourceLineForRow(1), qint64(2));
+    }
+
     void extendQueryModeSplicesColumns()
     {
         QTemporaryDir dir;
@@ -192,6 +224,46 @@ private slots:
         QCOMPARE(widget.model()->sourceLineForRow(2), qint64(4));
     }
 
+    void findNextStepsThroughVisibleRows()
+    {
+        QTemporaryDir dir;
+        QByteArray content;
+        for (int i = 0; i < 50; ++i)
+            content += (i % 10 == 3 ? "needle " : "hay ") + QByteArray::number(i) + "\n";
+        auto o = openContent(dir, "f.log", content);
+
+        LogViewerWidget widget;
+        widget.setParser(parserById(u"plaintext"));
+        widget.setCoreSource(o.source, o.index);
+        const auto currentLine = [&] {
+            const QModelIndex current = widget.tableView()->currentIndex();
+            return current.isValid()
+                ? widget.model()->sourceLineForRow(current.row()) : qint64(-1);
+        };
+
+        widget.findNext(QStringLiteral("needle"));
+        QTRY_COMPARE(currentLine(), qint64(3));
+        widget.findNext(QStringLiteral("needle"));
+        QTRY_COMPARE(currentLine(), qint64(13));
+        widget.findNext(QStringLiteral("NEEDLE"), true);
+        QTRY_COMPARE(currentLine(), qint64(3));
+        widget.findNext(QStringLiteral("needle"), true); // wraps to the end
+        QTRY_COMPARE(currentLine(), qint64(43));
+
+        // Filtered: only visible rows are hits, and nothing is re-filtered.
+        {
+            QSignalSpy spy(&widget, &LogViewerWidget::filterApplied);
+            widget.applyFilter(FilterOptions(QStringLiteral("3")));
+            QVERIFY(spy.wait(5000));
+        }
+        const int rows = widget.model()->rowCount();
+        widget.tableView()->setCurrentIndex(
+            widget.model()->index(widget.model()->rowForSourceLine(13), 0));
+        widget.findNext(QStringLiteral("needle"));
+        QTRY_COMPARE(currentLine(), qint64(23));
+        QCOMPARE(widget.model()->rowCount(), rows);
+    }
+
     void viewStateRoundTrip()
     {
         QTemporaryDir dir;
@@ -1,10 +1,17 @@
 // bench_index: performance gate for line indexing.
 //
 // Usage: bench_index <logfile> --min-mbps N --max-bytes-per-line X --check-cancel-ms N
+//        [--min-speedup X] [--sparse-stride N --max-sparse-bytes-per-line X]
 //
 // Runs buildLineIndex twice and scores the warm run (the cold run is
 // disk-bound and machine-dependent). Exit code != 0 when a gate is missed,
-// so CTest treats threshold regressions as failures.
+// so CTest treats threshold regressions as failures. --min-speedup adds a
+// thread-scaling table (1, 2, 4, ... threads, all hot-cache) and gates the
+// all-cores run against the sequential one. The warm run is repeated with
+// LOGDOR_FORCE_SCALAR_INDEX=1 so the vectorized newline kernel and the
+// scalar memchr loop are reported side by side. --sparse-stride adds a
+// sparse build (one checkpoint per N lines) gated on its memory per line,
+// with a full sequential walk of its offsets timed against the dense index.
 
 #include <logdor/FileSource.h>
 #include <logdor/LineIndexer.h>
@@ -31,18 +38,35 @@ qint64 vmHwmKb()
     return -1;
 }
 
-logdor::IndexingResult runOnce(const QString& path)
+logdor::IndexingResult runOnce(const QString& path,
+                               int threads = logdor::kDefaultIndexThreads,
+                               int sparseStride = 1)
 {
     auto src = logdor::FileSource::open(path);
     if (!src) {
         std::fprintf(stderr, "bench_index: cannot open %s\n", qPrintable(path));
         std::exit(1);
     }
-    auto future = logdor::buildLineIndex(std::move(src));
+    auto future = logdor::buildLineIndex(std::move(src),
+                                         logdor::kDefaultIndexChunkSize, threads,
+                                         sparseStride);
     future.waitForFinished();
     return future.result();
 }
 
+// Touch every line's offset and length in order, as a viewer scroll or a
+// chunked scan does. Returns the elapsed ms; the checksum defeats DCE.
+qint64 walkLines(const logdor::LineIndex& index, quint64* checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+    quint64 sum = 0;
+    for (qint64 line = 0; line < index.lineCount(); ++line)
+        sum += index.offsetOf(line) + quint64(index.lengthOf(line));
+    *checksum = sum;
+    return timer.elapsed();
+}
+
 } // namespace
 
 int main(int argc, char** argv)
@@ -56,6 +80,12 @@ int main(int argc, char** argv)
         { "min-mbps", "Fail below this warm throughput (MB/s)", "n", "0" },
         { "max-bytes-per-line", "Fail above this index memory per line", "x", "1e9" },
         { "check-cancel-ms", "Fail if cancellation takes longer (0 = skip)", "n", "0" },
+        { "min-speedup", "Fail if all-cores indexing is not this many times "
+                         "faster than one thread (0 = skip)", "x", "0" },
+        { "sparse-stride", "Also build a sparse index with this many lines per "
+                           "checkpoint (0 = skip)", "n", "0" },
+        { "max-sparse-bytes-per-line", "Fail above this sparse index memory "
+                                       "per line", "x", "1e9" },
     });
     parser.process(app);
     if (parser.positionalArguments().isEmpty()) {
@@ -66,6 +96,10 @@ int main(int argc, char** argv)
     const double minMbps = parser.value("min-mbps").toDouble();
     const double maxBytesPerLine = parser.value("max-bytes-per-line").toDouble();
     const qint64 maxCancelMs = parser.value("check-cancel-ms").toLongLong();
+    const double minSpeedup = parser.value("min-speedup").toDouble();
+    const int sparseStride = parser.value("sparse-stride").toInt();
+    const double maxSparseBytesPerLine
+        = parser.value("max-sparse-bytes-per-line").toDouble();
 
     const qint64 hwmBefore = vmHwmKb();
 
@@ -80,6 +114,13 @@ int main(int argc, char** argv)
     const double mb = double(warm.bytesScanned) / (1000.0 * 1000.0);
     const double mbps = warm.elapsedMs > 0 ? mb / (double(warm.elapsedMs) / 1000.0)
                                            : 1e9;
+    // Same warm cache, scalar kernel: the vector kernel's gain on this corpus.
+    qputenv("LOGDOR_FORCE_SCALAR_INDEX", "1");
+    const auto scalar = runOnce(path);
+    qunsetenv("LOGDOR_FORCE_SCALAR_INDEX");
+    const double scalarMbps = scalar.elapsedMs > 0
+        ? mb / (double(scalar.elapsedMs) / 1000.0) : 1e9;
+
     const double bytesPerLine =
         double(warm.index->memoryUsage()) / double(warm.lineCount);
     const qint64 hwmAfter = vmHwmKb();
@@ -88,8 +129,10 @@ int main(int argc, char** argv)
                 mb, (long long)warm.lineCount,
                 warm.index->isWide() ? ", wide index" : "");
     std::printf("cold run:        %lld ms\n", (long long)cold.elapsedMs);
-    std::printf("warm run:        %lld ms  (%.0f MB/s)\n",
-                (long long)warm.elapsedMs, mbps);
+    std::printf("warm run:        %lld ms  (%.0f MB/s, %s kernel)\n",
+                (long long)warm.elapsedMs, mbps, logdor::lineIndexKernelName());
+    std::printf("warm scalar:     %lld ms  (%.0f MB/s)\n",
+                (long long)scalar.elapsedMs, scalarMbps);
     std::printf("index memory:    %.2f bytes/line (%lld KiB total)\n", bytesPerLine,
                 (long long)(warm.index->memoryUsage() / 1024));
     if (hwmBefore > 0 && hwmAfter > 0)
@@ -107,6 +150,57 @@ int main(int argc, char** argv)
         ok = false;
     }
 
+    if (minSpeedup > 0) {
+        // Every run here is hot-cache (the runs above warmed it), so this
+        // measures CPU scaling, not the disk.
+        const int maxThreads = qMax(1, QThread::idealThreadCount());
+        qint64 sequentialMs = 0;
+        double speedup = 1.0;
+        for (int threads = 1;; threads = qMin(threads * 2, maxThreads)) {
+            const auto run = runOnce(path, threads);
+            const qint64 ms = qMax<qint64>(run.elapsedMs, 1);
+            if (threads == 1)
+                sequentialMs = ms;
+            speedup = double(sequentialMs) / double(ms);
+            std::printf("threads %3d:     %lld ms  (%.0f MB/s, %.2fx)\n", threads,
+                        (long long)run.elapsedMs, mb / (double(ms) / 1000.0),
+                        speedup);
+            if (threads == maxThreads)
+                break;
+        }
+        if (maxThreads < 2) {
+            std::printf("scaling gate:    skipped (one core)\n");
+        } else if (speedup < minSpeedup) {
+            std::fprintf(stderr, "FAIL: %d-thread speedup %.2fx < gate %.2fx\n",
+                         maxThreads, speedup, minSpeedup);
+            ok = false;
+        }
+    }
+
+    if (sparseStride > 1) {
+        const auto sparse = runOnce(path, logdor::kDefaultIndexThreads, sparseStride);
+        const double sparseBytesPerLine
+            = double(sparse.index->memoryUsage()) / double(sparse.lineCount);
+        quint64 denseSum = 0, sparseSum = 0;
+        const qint64 denseWalkMs = walkLines(*warm.index, &denseSum);
+        const qint64 sparseWalkMs = walkLines(*sparse.index, &sparseSum);
+        std::printf("sparse /%-4d:    %lld ms  (%.3f bytes/line, %lld KiB total)\n",
+                    sparseStride, (long long)sparse.elapsedMs, sparseBytesPerLine,
+                    (long long)(sparse.index->memoryUsage() / 1024));
+        std::printf("sequential walk: %lld ms dense, %lld ms sparse\n",
+                    (long long)denseWalkMs, (long long)sparseWalkMs);
+        if (sparse.lineCount != warm.lineCount || sparseSum != denseSum) {
+            std::fprintf(stderr, "FAIL: sparse index disagrees with dense\n");
+            ok = false;
+        }
+        if (sparseBytesPerLine > maxSparseBytesPerLine) {
+            std::fprintf(stderr,
+                         "FAIL: sparse index memory %.3f B/line > gate %.3f B/line\n",
+                         sparseBytesPerLine, maxSparseBytesPerLine);
+            ok = false;
+        }
+    }
+
     if (maxCancelMs > 0) {
         auto src = logdor::FileSource::open(path);
         auto future = logdor::buildLineIndex(std::move(src));
@@ -9,12 +9,15 @@
 // Temporal terms work too - e.g. --query "time>=\"01-01 10:00:00.000\"" or
 // --query "time<12:30" on a logcat file. DateTimeCmp is an integer compare
 // (IntCmp-class throughput); TimeOfDayCmp adds a binary search per row.
+// Both scans print each worker's utilization (busy share of wall time).
 
 #include <logdor/ColumnScan.h>
 #include <logdor/FilterScan.h>
 #include <logdor/FormatRegistry.h>
 #include <logdor/LineIndexer.h>
 
+#include "bench_report.h"
+
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QElapsedTimer>
@@ -106,8 +109,10 @@ int main(int argc, char** argv)
                 qPrintable(query->text()), (long long)warm.matchCount);
     std::printf("extraction:      %lld ms  (%.0f MB/s), %zu column bytes\n",
                 (long long)cols.elapsedMs, extractMbps, columnBytes);
+    bench::printUtilization("extract util:", cols.stats);
     std::printf("warm query:      %lld ms\n", (long long)warm.rows.size() >= 0
                     ? (long long)warm.elapsedMs : 0);
+    bench::printUtilization("query util:", warm.stats);
 
     bool ok = true;
     if (extractMbps < minExtractMbps) {
@@ -0,0 +1,185 @@
+// bench_reopen: performance gate for reopening a file through the
+// persistent line-index cache.
+//
+// Usage: bench_reopen <logfile> [--append-bytes 1M] [--max-reopen-ms N]
+//        [--max-grown-ms N]
+//
+// Copies the corpus to scratch, indexes it once without the cache (the
+// scan every reopen used to pay), stores the index, then times an
+// Identical reopen (a mapped cache file, no scan) and a Grown reopen after
+// appending a burst (cached prefix + scan of the new bytes only). Both
+// cached results are cross-checked against a full rebuild.
+
+#include <logdor/FileSource.h>
+#include <logdor/LineIndexCache.h>
+#include <logdor/LineIndexer.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+#include <cstdio>
+
+using namespace logdor;
+
+namespace {
+
+qint64 parseBytes(const QString& text, bool* ok)
+{
+    QString t = text.trimmed().toUpper();
+    qint64 mult = 1;
+    if (t.endsWith('K')) { mult = 1024; t.chop(1); }
+    else if (t.endsWith('M')) { mult = 1024 * 1024; t.chop(1); }
+    else if (t.endsWith('G')) { mult = 1024 * 1024 * 1024; t.chop(1); }
+    return t.toLongLong(ok) * mult;
+}
+
+// Wall time of open + index, the way the shell reopens a file.
+IndexingResult reopen(const QString& path,
+                      std::shared_ptr<const LineIndexCache> cache, qint64* wallMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto src = FileSource::open(path);
+    if (!src) {
+        std::fprintf(stderr, "bench_reopen: cannot open %s\n", qPrintable(path));
+        std::exit(1);
+    }
+    auto future = buildLineIndex(std::move(src), std::move(cache));
+    future.waitForFinished();
+    *wallMs = timer.elapsed();
+    return future.result();
+}
+
+bool sameLines(const LineIndex& a, const LineIndex& b)
+{
+    if (a.lineCount() != b.lineCount() || a.fileSize() != b.fileSize())
+        return false;
+    const qint64 step = qMax<qint64>(1, a.lineCount() / 100000);
+    for (qint64 line = 0; line < a.lineCount(); line += step) {
+        if (a.offsetOf(line) != b.offsetOf(line)
+            || a.endsWithCrLf(line) != b.endsWithCrLf(line))
+            return false;
+    }
+    return a.lineCount() == 0
+        || a.offsetOf(a.lineCount() - 1) == b.offsetOf(b.lineCount() - 1);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("logfile", "Corpus to copy and reopen");
+    parser.addOptions({
+        { "append-bytes", "Growth before the Grown reopen", "n", "1M" },
+        { "max-reopen-ms", "Fail if the Identical reopen exceeds this", "n",
+          "1000000" },
+        { "max-grown-ms", "Fail if the Grown reopen exceeds this", "n",
+          "1000000" },
+    });
+    parser.process(app);
+    if (parser.positionalArguments().isEmpty()) {
+        std::fprintf(stderr, "bench_reopen: missing logfile argument\n");
+        return 2;
+    }
+
+    const QString corpus = parser.positionalArguments().first();
+    bool okBytes = false;
+    const qint64 appendBytes = parseBytes(parser.value("append-bytes"), &okBytes);
+    const qint64 maxReopenMs = parser.value("max-reopen-ms").toLongLong();
+    const qint64 maxGrownMs = parser.value("max-grown-ms").toLongLong();
+    if (!okBytes || appendBytes <= 0) {
+        std::fprintf(stderr, "bench_reopen: invalid --append-bytes\n");
+        return 2;
+    }
+
+    // Grow a scratch copy so the shared corpus stays byte-exact for the
+    // other benches.
+    const QString scratch = corpus + ".reopen-scratch";
+    QFile::remove(scratch);
+    if (!QFile::copy(corpus, scratch)) {
+        std::fprintf(stderr, "bench_reopen: cannot copy corpus to %s\n",
+                     qPrintable(scratch));
+        return 1;
+    }
+    QTemporaryDir cacheDir;
+    auto cache = std::make_shared<const LineIndexCache>(cacheDir.path());
+
+    // Uncached reopen, hot page cache: what every reopen cost before.
+    qint64 scanMs = 0;
+    reopen(scratch, nullptr, &scanMs); // warms the page cache
+    const IndexingResult scanned = reopen(scratch, nullptr, &scanMs);
+
+    QElapsedTimer storeTimer;
+    storeTimer.start();
+    if (!cache->store(*FileSource::open(scratch), *scanned.index)) {
+        std::fprintf(stderr, "bench_reopen: storing the index failed\n");
+        return 1;
+    }
+    const qint64 storeMs = storeTimer.elapsed();
+
+    qint64 identicalMs = 0;
+    const IndexingResult identical = reopen(scratch, cache, &identicalMs);
+
+    QByteArray burst;
+    for (qint64 i = 0; burst.size() < appendBytes; ++i)
+        burst += "appended line " + QByteArray::number(i) + " transaction ok\n";
+    {
+        QFile f(scratch);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Append)
+            || f.write(burst) != burst.size()) {
+            std::fprintf(stderr, "bench_reopen: append failed\n");
+            return 1;
+        }
+    }
+    qint64 grownMs = 0;
+    const IndexingResult grown = reopen(scratch, cache, &grownMs);
+    QThreadPool::globalInstance()->waitForDone(); // background store
+    qint64 rebuildMs = 0;
+    const IndexingResult rebuilt = reopen(scratch, nullptr, &rebuildMs);
+    QFile::remove(scratch);
+
+    std::printf("file:            %s (%.1f MB, %lld lines)\n", qPrintable(corpus),
+                double(scanned.bytesScanned) / (1000.0 * 1000.0),
+                (long long)scanned.lineCount);
+    std::printf("uncached reopen: %lld ms  (full scan, hot cache)\n",
+                (long long)scanMs);
+    std::printf("cache store:     %lld ms  (%.1f MB on disk)\n", (long long)storeMs,
+                double(cache->diskUsage()) / (1000.0 * 1000.0));
+    std::printf("identical:       %lld ms  (%s, %lld bytes scanned)\n",
+                (long long)identicalMs,
+                identical.index && identical.index->isMapped() ? "mapped" : "MISS",
+                (long long)identical.bytesScanned);
+    std::printf("grown +%lld B:   %lld ms  (%s, %lld bytes scanned)\n",
+                (long long)burst.size(), (long long)grownMs,
+                grown.fromCache ? "cached prefix" : "MISS",
+                (long long)grown.bytesScanned);
+
+    bool ok = true;
+    if (!identical.fromCache || !sameLines(*identical.index, *scanned.index)) {
+        std::fprintf(stderr, "FAIL: identical reopen missed the cache or differs\n");
+        ok = false;
+    }
+    if (!grown.fromCache || !sameLines(*grown.index, *rebuilt.index)) {
+        std::fprintf(stderr, "FAIL: grown reopen missed the cache or differs\n");
+        ok = false;
+    }
+    if (identicalMs > maxReopenMs) {
+        std::fprintf(stderr, "FAIL: identical reopen %lld ms > gate %lld ms\n",
+                     (long long)identicalMs, (long long)maxReopenMs);
+        ok = false;
+    }
+    if (grownMs > maxGrownMs) {
+        std::fprintf(stderr, "FAIL: grown reopen %lld ms > gate %lld ms\n",
+                     (long long)grownMs, (long long)maxGrownMs);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Report helpers shared by the bench executables. Header-only: each bench
+// is a single translation unit.
+
+#include <logdor/ScanStats.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace logdor::bench {
+
+// One figure per worker: its busy share of the scan's wall time.
+inline void printUtilization(const char* label, const ScanStats& stats)
+{
+    std::printf("%-16s", label);
+    double least = 1.0;
+    for (double share : stats.threadUtilization) {
+        std::printf(" %.2f", share);
+        least = std::min(least, share);
+    }
+    std::printf("  (min %.2f, %llu chunks)\n", least, (unsigned long long)stats.chunks);
+}
+
+} // namespace logdor::bench
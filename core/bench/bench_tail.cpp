@@ -2,18 +2,25 @@
 //
 // Usage: bench_tail <logfile> [--append-bytes 64K] [--iterations 8]
 //        [--query text] [--max-extend-ms N] [--max-scan-ms N]
+//        [--max-extend-growth X]
 //
 // Copies the corpus to scratch, then repeatedly appends a burst, reopens,
 // extends the index, and tail-scans the new lines - the exact per-tick work
 // FollowController schedules. Gates the WORST iteration: a tick must sit
 // well under the 1 s poll interval on a 10M-line file. A final full rebuild
 // cross-checks the chained extends.
+//
+// The same ticks also run on a 1/16 prefix of the corpus: extends share
+// every full index block, so their cost must not grow with the file.
+// --max-extend-growth gates the full/prefix ratio of the worst extends
+// (with 1 ms of slack for timer noise on sub-ms ticks).
 
 #include <logdor/FilterScan.h>
 #include <logdor/LineIndexer.h>
 
 #include <QCommandLineParser>
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 
@@ -33,6 +40,80 @@ qint64 parseBytes(const QString& text, bool* ok)
     return t.toLongLong(ok) * mult;
 }
 
+struct TickStats {
+    qint64 worstExtendUs = 0;
+    qint64 worstScanMs = 0;
+    qint64 newLines = 0;
+    qint64 lines = 0; // before the first tick
+    bool ok = false;  // chained extends agree with a rebuild
+};
+
+// Index @p scratch, then grow-extend-scan it @p iterations times.
+TickStats runTicks(const QString& scratch, const QByteArray& burst,
+                   const LineFilter& filter, int iterations)
+{
+    TickStats stats;
+    auto source = FileSource::open(scratch);
+    if (!source) {
+        std::fprintf(stderr, "bench_tail: cannot open %s\n", qPrintable(scratch));
+        return stats;
+    }
+    auto indexFuture = buildLineIndex(source);
+    indexFuture.waitForFinished();
+    auto index = indexFuture.result().index;
+    stats.lines = index->lineCount();
+
+    for (int i = 0; i < iterations; ++i) {
+        {
+            QFile grow(scratch);
+            if (!grow.open(QIODevice::WriteOnly | QIODevice::Append)
+                || grow.write(burst) != burst.size()) {
+                std::fprintf(stderr, "bench_tail: append failed\n");
+                return stats;
+            }
+        }
+        const qint64 oldCount = index->lineCount();
+        const qint64 firstNewLine
+            = index->lastLineTerminated() ? oldCount : oldCount - 1;
+
+        auto reopened = FileSource::open(scratch); // follow always reopens
+        if (!reopened) {
+            std::fprintf(stderr, "bench_tail: reopen failed\n");
+            return stats;
+        }
+        QElapsedTimer extendTimer;
+        extendTimer.start();
+        auto extendFuture = extendLineIndex(reopened, index);
+        extendFuture.waitForFinished();
+        stats.worstExtendUs
+            = qMax(stats.worstExtendUs, extendTimer.nsecsElapsed() / 1000);
+        const IndexingResult extended = extendFuture.result();
+
+        auto scanFuture = scanFilter(reopened, extended.index, filter,
+                                     kDefaultFilterChunkLines, firstNewLine);
+        scanFuture.waitForFinished();
+        stats.worstScanMs = qMax(stats.worstScanMs, scanFuture.result().elapsedMs);
+
+        stats.newLines += extended.index->lineCount() - oldCount;
+        source = std::move(reopened);
+        index = extended.index;
+    }
+
+    // Sanity: the chained extends must agree with a cold rebuild.
+    auto rebuildFuture = buildLineIndex(source);
+    rebuildFuture.waitForFinished();
+    const auto rebuilt = rebuildFuture.result().index;
+    stats.ok = rebuilt->lineCount() == index->lineCount()
+        && rebuilt->fileSize() == index->fileSize();
+    if (!stats.ok) {
+        std::fprintf(stderr, "FAIL: extended index diverged from rebuild "
+                             "(%lld vs %lld lines)\n",
+                     (long long)index->lineCount(),
+                     (long long)rebuilt->lineCount());
+    }
+    return stats;
+}
+
 } // namespace
 
 int main(int argc, char** argv)
@@ -50,6 +131,9 @@ int main(int argc, char** argv)
           "1000000" },
         { "max-scan-ms", "Fail if the slowest tail scan exceeds this", "n",
           "1000000" },
+        { "max-extend-growth",
+          "Fail if the slowest extend on the corpus exceeds this multiple of "
+          "the one on its 1/16 prefix", "x", "1000000" },
     });
     parser.process(app);
     if (parser.positionalArguments().isEmpty()) {
@@ -63,32 +147,27 @@ int main(int argc, char** argv)
     const int iterations = parser.value("iterations").toInt();
     const qint64 maxExtendMs = parser.value("max-extend-ms").toLongLong();
     const qint64 maxScanMs = parser.value("max-scan-ms").toLongLong();
+    const double maxExtendGrowth = parser.value("max-extend-growth").toDouble();
     if (!okBytes || appendBytes <= 0 || iterations <= 0) {
         std::fprintf(stderr, "bench_tail: invalid sizes\n");
         return 2;
     }
 
-    // Grow a scratch copy so the shared corpus stays byte-exact for the
+    // Grow scratch copies so the shared corpus stays byte-exact for the
     // other benches.
     const QString scratch = corpus + ".tail-scratch";
+    const QString prefixScratch = corpus + ".tail-prefix-scratch";
     QFile::remove(scratch);
-    if (!QFile::copy(corpus, scratch)) {
-        std::fprintf(stderr, "bench_tail: cannot copy corpus to %s\n",
-                     qPrintable(scratch));
+    QFile::remove(prefixScratch);
+    QFile in(corpus);
+    QFile prefix(prefixScratch);
+    if (!QFile::copy(corpus, scratch) || !in.open(QIODevice::ReadOnly)
+        || !prefix.open(QIODevice::WriteOnly)
+        || prefix.write(in.read(in.size() / 16)) != in.size() / 16) {
+        std::fprintf(stderr, "bench_tail: cannot copy corpus to scratch\n");
         return 1;
     }
-
-    auto source = FileSource::open(scratch);
-    if (!source) {
-        std::fprintf(stderr, "bench_tail: cannot open %s\n", qPrintable(scratch));
-        return 1;
-    }
-    auto indexFuture = buildLineIndex(source);
-    indexFuture.waitForFinished();
-    auto index = indexFuture.result().index;
-    std::printf("file:            %s (%lld lines, %lld MB)\n",
-                qPrintable(corpus), (long long)index->lineCount(),
-                (long long)(index->fileSize() / (1024 * 1024)));
+    prefix.close();
 
     QByteArray burst;
     while (burst.size() < appendBytes)
@@ -97,70 +176,39 @@ int main(int argc, char** argv)
     LineFilter filter;
     filter.query = parser.value("query");
 
-    qint64 worstExtendMs = 0, worstScanMs = 0, totalNewLines = 0;
-    for (int i = 0; i < iterations; ++i) {
-        {
-            QFile grow(scratch);
-            if (!grow.open(QIODevice::WriteOnly | QIODevice::Append)
-                || grow.write(burst) != burst.size()) {
-                std::fprintf(stderr, "bench_tail: append failed\n");
-                return 1;
-            }
-        }
-        const qint64 oldCount = index->lineCount();
-        const qint64 firstNewLine
-            = index->lastLineTerminated() ? oldCount : oldCount - 1;
-
-        auto reopened = FileSource::open(scratch); // follow always reopens
-        if (!reopened) {
-            std::fprintf(stderr, "bench_tail: reopen failed\n");
-            return 1;
-        }
-        auto extendFuture = extendLineIndex(reopened, index);
-        extendFuture.waitForFinished();
-        const IndexingResult extended = extendFuture.result();
-        worstExtendMs = qMax(worstExtendMs, extended.elapsedMs);
-
-        auto scanFuture = scanFilter(reopened, extended.index, filter,
-                                     kDefaultFilterChunkLines, firstNewLine);
-        scanFuture.waitForFinished();
-        const FilterScanResult scan = scanFuture.result();
-        worstScanMs = qMax(worstScanMs, scan.elapsedMs);
-
-        totalNewLines += extended.index->lineCount() - oldCount;
-        source = std::move(reopened);
-        index = extended.index;
-    }
-
-    // Sanity: the chained extends must agree with a cold rebuild.
-    auto rebuildFuture = buildLineIndex(source);
-    rebuildFuture.waitForFinished();
-    const auto rebuilt = rebuildFuture.result().index;
+    const TickStats small = runTicks(prefixScratch, burst, filter, iterations);
+    const TickStats full = runTicks(scratch, burst, filter, iterations);
+    QFile::remove(prefixScratch);
     QFile::remove(scratch);
-    if (rebuilt->lineCount() != index->lineCount()
-        || rebuilt->fileSize() != index->fileSize()) {
-        std::fprintf(stderr, "FAIL: extended index diverged from rebuild "
-                             "(%lld vs %lld lines)\n",
-                     (long long)index->lineCount(),
-                     (long long)rebuilt->lineCount());
+    if (!small.ok || !full.ok)
         return 1;
-    }
 
+    std::printf("file:            %s (%lld lines, prefix %lld lines)\n",
+                qPrintable(corpus), (long long)full.lines, (long long)small.lines);
     std::printf("ticks:           %d x %lld KB appended (%lld new lines)\n",
                 iterations, (long long)(appendBytes / 1024),
-                (long long)totalNewLines);
-    std::printf("worst extend:    %lld ms\n", (long long)worstExtendMs);
-    std::printf("worst tail scan: %lld ms\n", (long long)worstScanMs);
+                (long long)full.newLines);
+    std::printf("worst extend:    %.2f ms  (1/16 prefix: %.2f ms)\n",
+                double(full.worstExtendUs) / 1000.0,
+                double(small.worstExtendUs) / 1000.0);
+    std::printf("worst tail scan: %lld ms\n", (long long)full.worstScanMs);
 
     bool ok = true;
-    if (worstExtendMs > maxExtendMs) {
-        std::fprintf(stderr, "FAIL: extend %lld ms > gate %lld ms\n",
-                     (long long)worstExtendMs, (long long)maxExtendMs);
+    if (full.worstExtendUs > maxExtendMs * 1000) {
+        std::fprintf(stderr, "FAIL: extend %.2f ms > gate %lld ms\n",
+                     double(full.worstExtendUs) / 1000.0, (long long)maxExtendMs);
+        ok = false;
+    }
+    if (double(full.worstExtendUs)
+        > maxExtendGrowth * double(small.worstExtendUs) + 1000.0) {
+        std::fprintf(stderr, "FAIL: extend grew %.1fx with 16x the file > gate %.1fx\n",
+                     double(full.worstExtendUs) / double(qMax<qint64>(1, small.worstExtendUs)),
+                     maxExtendGrowth);
         ok = false;
     }
-    if (worstScanMs > maxScanMs) {
+    if (full.worstScanMs > maxScanMs) {
         std::fprintf(stderr, "FAIL: tail scan %lld ms > gate %lld ms\n",
-                     (long long)worstScanMs, (long long)maxScanMs);
+                     (long long)full.worstScanMs, (long long)maxScanMs);
         ok = false;
     }
     return ok ? 0 : 1;
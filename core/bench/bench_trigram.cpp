@@ -0,0 +1,179 @@
+// bench_trigram: performance gate for the trigram block index.
+//
+// Usage: bench_trigram <logfile> [--query TEXT] [--min-build-mbps N]
+//        [--max-bytes-per-line X] [--min-speedup X] [--check-cancel-ms N]
+//
+// Builds the index twice (the first run warms the page cache) and scores
+// the warm build: throughput, memoryUsage() and bytes per line. Then times
+// a rare-needle scanFilter() with and without the index - the scan reads
+// only the blocks the index keeps - and cross-checks the two results, and
+// round-trips the index through a LineIndexCache directory.
+
+#include <logdor/FileSource.h>
+#include <logdor/FilterScan.h>
+#include <logdor/LineIndexCache.h>
+#include <logdor/LineIndexer.h>
+#include <logdor/TrigramIndex.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <cstdio>
+
+using namespace logdor;
+
+namespace {
+
+TrigramIndexResult build(std::shared_ptr<FileSource> source,
+                         std::shared_ptr<const LineIndex> index)
+{
+    auto future = buildTrigramIndex(std::move(source), std::move(index));
+    future.waitForFinished();
+    return future.result();
+}
+
+// Best of three warm scans.
+FilterScanResult bestScan(std::shared_ptr<FileSource> source,
+                          std::shared_ptr<const LineIndex> index,
+                          const LineFilter& filter,
+                          std::shared_ptr<const TrigramIndex> trigrams)
+{
+    FilterScanResult best;
+    best.elapsedMs = -1;
+    for (int run = 0; run < 3; ++run) {
+        auto future = scanFilter(source, index, filter, kDefaultFilterChunkLines, 0, -1,
+                                 -1, trigrams);
+        future.waitForFinished();
+        FilterScanResult result = future.resultAt(future.resultCount() - 1);
+        if (best.elapsedMs < 0 || result.elapsedMs < best.elapsedMs)
+            best = std::move(result);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("logfile", "Corpus to index");
+    parser.addOptions({
+        { "query", "Needle to scan for", "text", "req-7f3a9c41" },
+        { "min-build-mbps", "Fail below this warm build throughput (MB/s)", "n", "0" },
+        { "max-bytes-per-line", "Fail above this index memory per line", "x", "1e9" },
+        { "min-speedup", "Fail if the indexed scan is not this many times "
+                         "faster than the plain one (0 = skip)", "x", "0" },
+        { "check-cancel-ms", "Fail if cancellation takes longer (0 = skip)", "n", "0" },
+    });
+    parser.process(app);
+    if (parser.positionalArguments().isEmpty()) {
+        std::fprintf(stderr, "bench_trigram: missing logfile argument\n");
+        return 2;
+    }
+
+    const QString path = parser.positionalArguments().first();
+    const double minMbps = parser.value("min-build-mbps").toDouble();
+    const double maxBytesPerLine = parser.value("max-bytes-per-line").toDouble();
+    const double minSpeedup = parser.value("min-speedup").toDouble();
+    const qint64 maxCancelMs = parser.value("check-cancel-ms").toLongLong();
+
+    auto source = FileSource::open(path);
+    if (!source) {
+        std::fprintf(stderr, "bench_trigram: cannot open %s\n", qPrintable(path));
+        return 1;
+    }
+    auto indexing = buildLineIndex(source);
+    indexing.waitForFinished();
+    const auto index = indexing.result().index;
+
+    build(source, index); // warms the page cache
+    const TrigramIndexResult built = build(source, index);
+    const TrigramIndex& trigrams = *built.index;
+    const double mb = double(index->fileSize()) / (1000.0 * 1000.0);
+    const double mbps = mb / (double(qMax<qint64>(built.elapsedMs, 1)) / 1000.0);
+    const double bytesPerLine
+        = double(trigrams.memoryUsage()) / double(qMax<qint64>(index->lineCount(), 1));
+
+    QTemporaryDir cacheDir;
+    const LineIndexCache cache(cacheDir.path(), LineIndexCache::kDefaultMaxBytes, 0);
+    QElapsedTimer storeTimer;
+    storeTimer.start();
+    const bool stored = trigrams.store(cache, *source);
+    const qint64 storeMs = storeTimer.elapsed();
+    QElapsedTimer lookupTimer;
+    lookupTimer.start();
+    const auto looked = TrigramIndex::lookup(cache, *source);
+    const qint64 lookupMs = lookupTimer.elapsed();
+
+    LineFilter filter;
+    filter.query = parser.value("query");
+    const FilterScanResult plain = bestScan(source, index, filter, nullptr);
+    const FilterScanResult pruned = bestScan(source, index, filter, built.index);
+    const double speedup
+        = double(qMax<qint64>(plain.elapsedMs, 1)) / double(qMax<qint64>(pruned.elapsedMs, 1));
+
+    std::printf("file:            %s (%.1f MB, %lld lines)\n", qPrintable(path), mb,
+                (long long)index->lineCount());
+    std::printf("build:           %lld ms  (%.0f MB/s, %lld blocks of %lld lines)\n",
+                (long long)built.elapsedMs, mbps, (long long)trigrams.blockCount(),
+                (long long)trigrams.blockLines());
+    std::printf("memory:          %.1f MB  (%.3f B/line, %lld trigrams)\n",
+                double(trigrams.memoryUsage()) / (1000.0 * 1000.0), bytesPerLine,
+                (long long)trigrams.trigramCount());
+    std::printf("store / lookup:  %lld ms / %lld ms  (%.1f MB on disk)\n",
+                (long long)storeMs, (long long)lookupMs,
+                double(cache.diskUsage()) / (1000.0 * 1000.0));
+    std::printf("scan \"%s\":  %lld ms plain, %lld ms indexed  (%llu of %llu chunks, "
+                "%.1fx)\n",
+                qPrintable(filter.query), (long long)plain.elapsedMs,
+                (long long)pruned.elapsedMs, (unsigned long long)pruned.stats.chunks,
+                (unsigned long long)plain.stats.chunks, speedup);
+
+    bool ok = true;
+    if (!stored || !looked || looked->trigramCount() != trigrams.trigramCount()) {
+        std::fprintf(stderr, "FAIL: the index did not round-trip the cache\n");
+        ok = false;
+    }
+    if (pruned.matchCount != plain.matchCount || pruned.rows.size() != plain.rows.size()) {
+        std::fprintf(stderr, "FAIL: indexed scan found %lld matches, plain %lld\n",
+                     (long long)pruned.matchCount, (long long)plain.matchCount);
+        ok = false;
+    }
+    if (mbps < minMbps) {
+        std::fprintf(stderr, "FAIL: build %.0f MB/s < gate %.0f MB/s\n", mbps, minMbps);
+        ok = false;
+    }
+    if (bytesPerLine > maxBytesPerLine) {
+        std::fprintf(stderr, "FAIL: index memory %.3f B/line > gate %.3f B/line\n",
+                     bytesPerLine, maxBytesPerLine);
+        ok = false;
+    }
+    if (minSpeedup > 0 && speedup < minSpeedup) {
+        std::fprintf(stderr, "FAIL: indexed scan %.1fx faster < gate %.1fx\n", speedup,
+                     minSpeedup);
+        ok = false;
+    }
+
+    if (maxCancelMs > 0) {
+        auto future = buildTrigramIndex(source, index);
+        QThread::msleep(20); // let the build get going
+        QElapsedTimer cancelTimer;
+        cancelTimer.start();
+        future.cancel();
+        future.waitForFinished();
+        const qint64 cancelMs = cancelTimer.elapsed();
+        std::printf("cancel latency:  %lld ms\n", (long long)cancelMs);
+        if (cancelMs > maxCancelMs) {
+            std::fprintf(stderr, "FAIL: cancel latency %lld ms > gate %lld ms\n",
+                         (long long)cancelMs, (long long)maxCancelMs);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -16,13 +16,14 @@ struct ColumnScanResult {
     QHash<int, std::shared_ptr<const ColumnData>> columns; // the requested ones
     std::shared_ptr<const std::vector<quint8>> severity;   // when requested
     qint64 elapsedMs = 0;
+    ScanStats stats;
 };
 
 /**
  * One chunk-parallel pass over ALL source lines: parseLine once per line,
  * filling every requested column (and the severity vector) in the same pass.
- * Same QPromise contract as scanFilter: cancellable between super-chunks,
- * permille progress. This is what field queries and column sorting pay once
+ * Same QPromise contract and chunking as scanFilter: cancellable between
+ * chunks, permille progress. This is what field queries and column sorting pay once
  * per (file, column); results are immutable and shared.
  *
  * DateTime columns additionally get UTC epoch milliseconds: the codec comes
@@ -2,13 +2,13 @@
 
 #include <QByteArray>
 #include <QByteArrayView>
-#include <QCache>
 #include <QFile>
 #include <QFuture>
 #include <QMutex>
 #include <QString>
 
 #include <memory>
+#include <utility>
 
 QT_BEGIN_NAMESPACE
 template <typename T> class QPromise;
@@ -16,66 +16,115 @@ QT_END_NAMESPACE
 
 namespace logdor {
 
+class LineIndexCache;
+namespace detail {
+class BlockCache;
+struct SeekIndex;
+}
+
 /**
  * Read-only owner of a log file's bytes.
  *
  * Primary mode memory-maps the whole file (the OS page cache holds the data;
  * nothing is duplicated on the heap). When mapping fails - exotic
  * filesystems, exhausted address space - the source degrades to Buffered
- * mode: pread-style 4 MiB block reads behind a small LRU cache, instead of
- * refusing to open the file.
+ * mode: positional 4 MiB block reads behind a small sharded LRU cache,
+ * instead of refusing to open the file.
  *
  * Held by std::shared_ptr so a background consumer (e.g. a cancelled index
  * build) can keep the mapping alive after the owner has moved on to another
  * file; views into the map stay valid for the shared_ptr's lifetime.
  *
- * Thread safety: all const accessors are safe from any thread. Buffered-mode
- * reads serialize on an internal mutex.
+ * Compressed files (gzip, zstd, xz, lz4 - each when built with its
+ * library) open Decompressed when small, else Seekable: random access that
+ * keeps a checkpoint every kCheckpointSpacing decompressed bytes and serves
+ * reads by decoding from the nearest one into the block cache - nothing
+ * near the file's size is ever resident. Gzip checkpoints are zran-style
+ * (inflate window state); zstd ones are frame starts, taken from the
+ * seekable format's seek table or the frame headers. Formats without seek
+ * points (xz, lz4, single-frame zstd) always open Decompressed.
+ *
+ * Access policy (Mapped): the mapping is advised random while idle, so the
+ * view's scattered faults pull in only the pages it shows, and sequential
+ * while a full pass holds a SequentialScan. prefetch() pages in the range
+ * the viewport is about to show; dropPages() evicts a range a one-off pass
+ * has finished with. All three are hints - content never changes.
+ *
+ * Thread safety: all const accessors are safe from any thread. Buffered
+ * and Seekable reads are positional (pread, or ReadFile at an offset) and
+ * take no lock beyond a short one on a cache shard, so concurrent scans
+ * read - and decompress - in parallel.
  */
 class FileSource {
 public:
-    /// Decompressed = a gzip stream inflated to the heap at open time; the
-    /// source then behaves exactly like a contiguous plain file whose bytes
-    /// are the decompressed content (indexing, scans, identity - unchanged).
-    enum class Mode { Mapped, Buffered, Decompressed };
+    /// Decompressed = a compressed stream inflated to the heap at open time;
+    /// the source then behaves exactly like a contiguous plain file whose
+    /// bytes are the decompressed content (indexing, scans, identity -
+    /// unchanged). Seekable = a larger one served from checkpoints; like
+    /// Buffered it is non-contiguous and read through read()/readInto().
+    enum class Mode { Mapped, Buffered, Decompressed, Seekable };
 
     static constexpr qsizetype kBlockSize = 4 * 1024 * 1024;
     static constexpr int kMaxCachedBlocks = 32; // <=128 MiB resident
+    /// Seekable: minimum decompressed bytes between checkpoints, and the
+    /// usual span size of the block cache. Zstd spans end on frame
+    /// boundaries, so they may run longer (up to 16 MiB).
+    static constexpr quint64 kCheckpointSpacing = 4 * 1024 * 1024;
+    /// Seekable: spans readInto() keeps apart from the block cache.
+    static constexpr int kMaxScanSpans = 8;
+    /// Seekable content up to this size opens Decompressed, larger Seekable.
+    static constexpr quint64 kMaxInflatedBytes = 64 * 1024 * 1024;
+    /// Content without seek points is refused beyond this size (bomb cap).
+    static constexpr quint64 kMaxWholeBytes = quint64(4) * 1024 * 1024 * 1024;
 
     /**
      * Open @p path read-only. Returns nullptr (and sets @p error) only when
      * the file itself cannot be opened; a failed mmap falls back to Buffered.
-     * Gzip content (magic bytes win over suffix) is inflated whole - bounded
-     * by a 4 GiB gzip-bomb cap (LOGDOR_MAX_DECOMPRESSED_MB overrides).
+     * Compressed content is recognized by magic bytes, not suffix. Gzip
+     * costs one inflate pass; a multi-frame zstd file only a walk over its
+     * frame headers (or none, with a seek table). Up to kMaxInflatedBytes
+     * (LOGDOR_MAX_DECOMPRESSED_MB overrides) the content is kept whole,
+     * beyond that only its checkpoints are. Xz, lz4 and single-frame zstd
+     * decode whole, up to kMaxWholeBytes (LOGDOR_MAX_WHOLE_MB overrides).
+     * With a @p cache the checkpoints of a Seekable file are stored next to
+     * its line indexes and reused while the file is unchanged, so a reopen
+     * skips the pass.
      * Set LOGDOR_FORCE_BUFFERED=1 to skip mapping (used by tests).
      */
-    static std::shared_ptr<FileSource> open(const QString& path,
-                                            QString* error = nullptr);
+    static std::shared_ptr<FileSource> open(
+        const QString& path, QString* error = nullptr,
+        std::shared_ptr<const LineIndexCache> cache = nullptr);
 
-    /// Cheap sniff: does the file start with the gzip magic (and is gzip
-    /// support compiled in)?
+    /// Cheap sniff: does the file start with the magic of a compressed
+    /// format whose support is compiled in?
     static bool isCompressedFile(const QString& path);
 
     struct AsyncOpenResult {
         std::shared_ptr<FileSource> source; // null on failure/cancel
         QString error;
+        bool fromCache = false; // Seekable checkpoints came from the cache
     };
 
     /**
      * open() off-thread: plain files resolve almost instantly, compressed
-     * ones inflate with permille progress over the COMPRESSED bytes and
-     * cancellation between 4 MiB steps - the shell's "nothing blocks on
-     * file size" contract for .gz. Failure is reported in the result, not
-     * by an empty future.
+     * ones decode (gzip member-parallel for concatenated archives) with
+     * permille progress over the COMPRESSED bytes and cancellation between
+     * 4 MiB steps - the shell's "nothing blocks on file size" contract for
+     * compressed logs. Failure is reported in the result, not by an empty
+     * future.
      */
-    static QFuture<AsyncOpenResult> openAsync(const QString& path);
+    static QFuture<AsyncOpenResult> openAsync(
+        const QString& path, std::shared_ptr<const LineIndexCache> cache = nullptr);
 
     QString filePath() const { return m_file.fileName(); }
     quint64 size() const { return m_size; }
     Mode mode() const { return m_mode; }
 
     /// True when the whole file is addressable as one contiguous range.
-    bool isContiguous() const { return m_mode != Mode::Buffered; }
+    bool isContiguous() const
+    {
+        return m_mode == Mode::Mapped || m_mode == Mode::Decompressed;
+    }
 
     /// Base pointer of the contiguous range; nullptr unless isContiguous().
     const char* data() const;
@@ -88,30 +137,97 @@ public:
 
     /**
      * Copy a range into @p dst without touching the block cache - for large
-     * sequential scans (the indexer) that would otherwise evict it.
+     * sequential scans (the indexer) that would otherwise evict it. Seekable
+     * mode decodes through its own kMaxScanSpans-span cache instead.
+     * Buffered mode hints the OS to read ahead the range after a long read.
      * Returns the number of bytes copied (clamped to the file end).
      */
     qsizetype readInto(quint64 offset, char* dst, qsizetype length) const;
 
+    /**
+     * Scope of a front-to-back pass (index build, filter scan). While any
+     * is alive a Mapped source is advised sequential - aggressive OS
+     * read-ahead, pages reclaimed behind the pass - and random again once
+     * the last one ends. Nests across threads; other modes ignore it.
+     * Move-only; the source must outlive it.
+     */
+    class SequentialScan {
+    public:
+        SequentialScan(SequentialScan&& other) noexcept
+            : m_source(std::exchange(other.m_source, nullptr))
+        {
+        }
+        SequentialScan& operator=(SequentialScan&&) = delete;
+        ~SequentialScan();
+
+    private:
+        friend class FileSource;
+        explicit SequentialScan(const FileSource* source) : m_source(source) {}
+        const FileSource* m_source;
+    };
+
+    /// Enter a sequential pass; it ends when the result is destroyed.
+    [[nodiscard]] SequentialScan sequentialScan() const;
+
+    /**
+     * Start paging in [offset, offset + length) in the background - the
+     * rows the viewport shows next. Returns at once. Mapped and Buffered
+     * only; clamps to the file end.
+     */
+    void prefetch(quint64 offset, quint64 length) const;
+
+    /**
+     * Drop [offset, offset + length) from this process's mapping and the OS
+     * page cache (pages another process maps stay), so a one-off pass over
+     * a huge file does not push everything else out. Later reads fault the
+     * bytes back in. Mapped and Buffered only; a no-op on Windows and macOS
+     * beyond unmapping.
+     */
+    void dropPages(quint64 offset, quint64 length) const;
+
+    /**
+     * Bytes of [offset, offset + length) in memory right now - for Mapped,
+     * the pages the OS cache holds (mincore). Heap-backed content is all
+     * resident; Buffered and Seekable cannot tell and report the whole
+     * (clamped) range, so schedulers keep file order for them.
+     */
+    quint64 residentBytes(quint64 offset, quint64 length) const;
+
     FileSource(const FileSource&) = delete;
     FileSource& operator=(const FileSource&) = delete;
 
+    ~FileSource();
+
 private:
-    FileSource() = default;
+    FileSource();
 
+    qsizetype readAt(quint64 offset, char* dst, qsizetype length) const;
     QByteArray readUncached(quint64 offset, qsizetype length) const;
+    qsizetype readSpans(quint64 offset, char* dst, qsizetype length,
+                        const detail::BlockCache& cache) const;
     static std::shared_ptr<FileSource> openImpl(
         const QString& path, QString* error,
-        QPromise<AsyncOpenResult>* promise);
+        const std::shared_ptr<const LineIndexCache>& cache,
+        QPromise<AsyncOpenResult>* promise, bool* fromCache);
 
     mutable QFile m_file;
+    int m_fd = -1;           // m_file's descriptor, for positional reads
+    quint64 m_fileSize = 0;  // on-disk bytes; m_size is the content's
     quint64 m_size = 0;
     const uchar* m_map = nullptr;
     QByteArray m_decompressed; // Decompressed mode's whole content
+    std::shared_ptr<const detail::SeekIndex> m_seek; // Seekable checkpoints
     Mode m_mode = Mode::Mapped;
 
-    mutable QMutex m_ioMutex; // guards m_file and m_blockCache in Buffered mode
-    mutable QCache<quint64, QByteArray> m_blockCache { kMaxCachedBlocks };
+    // Guards m_file when it has no descriptor for positional reads.
+    mutable QMutex m_ioMutex;
+    // Guards m_sequentialScans and the mapping advice it decides.
+    mutable QMutex m_adviceMutex;
+    mutable int m_sequentialScans = 0;
+    // Buffered: 4 MiB blocks keyed by block number. Seekable: decompressed
+    // spans keyed by checkpoint number, costed in kBlockSize units.
+    std::unique_ptr<detail::BlockCache> m_blockCache;
+    std::unique_ptr<detail::BlockCache> m_scanCache; // Seekable readInto()
 };
 
 } // namespace logdor
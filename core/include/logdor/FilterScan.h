@@ -4,7 +4,11 @@
 #include "logdor/LineIndex.h"
 #include "logdor/Query.h"
 #include "logdor/RowSet.h"
+#include "logdor/ScanStats.h"
+#include "logdor/TimestampParse.h"
+#include "logdor/TrigramIndex.h"
 
+#include <QCache>
 #include <QFuture>
 #include <QString>
 
@@ -13,6 +17,20 @@
 
 namespace logdor {
 
+/// Keep only the first (or, fromEnd, the last) count matches; 0 = all.
+struct MatchLimit {
+    qint64 count = 0;
+    bool fromEnd = false;
+};
+
+/**
+ * Split a trailing "| head N" or "| tail N" (case-insensitive, N > 0) off
+ * @p text, which keeps the rest with trailing spaces removed, and return
+ * it. No suffix: an unlimited MatchLimit, @p text untouched. Applies in
+ * every filter mode, so a regex that must end in such text needs a group.
+ */
+MatchLimit takeMatchLimit(QString* text);
+
 /**
  * Core mirror of the shell's filter bar state (core cannot include app
  * headers). Semantics are legacy-exact: a line is a match when
@@ -35,6 +53,13 @@ struct LineFilter {
      */
     std::function<bool(qint64 line, QByteArrayView raw)> extraPredicate;
 
+    /**
+     * Identity of extraPredicate for FilterResultCache: predicates with the
+     * same non-empty key accept the same lines. Empty with a predicate set
+     * makes the filter uncacheable.
+     */
+    QString extraPredicateKey;
+
     /**
      * Compiled field query (query mode). When set it REPLACES the plain
      * query/regexMode text match; `columns` must cover
@@ -44,37 +69,234 @@ struct LineFilter {
     std::shared_ptr<const CompiledQuery> fieldQuery;
     ColumnSnapshot columns;
 
+    /**
+     * Matches kept before context expansion: the scan stops once it has
+     * limit.count of them, ascending from the first line or, fromEnd,
+     * descending from the last. An empty query with a limit keeps the first
+     * or last lines.
+     */
+    MatchLimit limit;
+
     bool isPassthrough() const
     {
-        return query.isEmpty() && !fieldQuery && !extraPredicate;
+        return query.isEmpty() && !fieldQuery && !extraPredicate && limit.count == 0;
     }
+
+    /**
+     * True when every line this filter matches is provably a match of
+     * @p previous, so refineFilter() may start from @p previous's rows: a
+     * plain needle extending the previous one ("connection ti" ->
+     * "connection tim") with the same case, regex and invert flags (under
+     * invert, a needle shortening it), an identical query, a field query
+     * ANDing terms onto the previous one (CompiledQuery::narrows()), or
+     * any query after an empty one. Never after a limited filter, whose
+     * rows miss the matches past its limit. Context is not compared - it is
+     * expanded afresh - and neither are extraPredicate and columns: the
+     * caller vouches that those are unchanged.
+     */
+    bool narrows(const LineFilter& previous) const;
 };
 
 struct FilterScanResult {
     RowSet rows;
     qint64 matchCount = 0; // matches before context expansion
     qint64 elapsedMs = 0;
+    bool partial = false;  // streamed snapshot; more results follow
+    quint64 fileSize = 0;  // bytes of the lines decided; 0 on a snapshot
+    ScanStats stats;
+};
+
+/// countFilter()'s answer: exact, or (partial) an estimate whose 95%
+/// confidence interval is [low, high]. Exact counts have low == high.
+struct FilterCountResult {
+    qint64 matchCount = 0;
+    qint64 low = 0;
+    qint64 high = 0;
+    qint64 elapsedMs = 0;
+    bool partial = false; // estimate; more results follow
+    ScanStats stats;      // the full pass's; empty on estimates
+};
+
+/// findMatch()'s answer.
+struct FindResult {
+    qint64 line = -1;         // the nearest match; -1 when there is none
+    qint64 rowsSearched = 0;  // rows read to decide it
+    qint64 elapsedMs = 0;
+};
+
+/**
+ * Per-file LRU of scan results, so toggling back to a recent filter
+ * applies it without a scan. Bounded by the rows' memoryUsage() (plus a
+ * small per-entry overhead); a result larger than maxBytes() is not kept.
+ *
+ * Entries are keyed by keyOf(): the normalized filter, not the LineFilter
+ * object. An entry remembers how many lines it decided
+ * (rows.lineCount()) and their bytes (fileSize); after follow mode grows
+ * the file it still covers that prefix, and the caller tail-scans the rest
+ * (scanFilter() with firstLine) instead of rescanning - from the last
+ * decided line when it had no terminator and has grown since. Clear it when the file or parser
+ * changes. Not thread-safe: owned by the viewer on the GUI thread.
+ */
+class FilterResultCache {
+public:
+    static constexpr qsizetype kDefaultMaxBytes = 64 * 1024 * 1024;
+
+    explicit FilterResultCache(qsizetype maxBytes = kDefaultMaxBytes);
+
+    /**
+     * Normalized identity of @p filter: what decides its rows, with the
+     * flags that cannot matter dropped (invert, case and regex under an
+     * empty query; columns). Field queries key by their trimmed text,
+     * compiled against @p timeContext. Empty - do not cache - for
+     * passthrough filters and predicates without an extraPredicateKey.
+     */
+    static QString keyOf(const LineFilter& filter, const TimeParseContext& timeContext = {});
+
+    /// The result stored under @p key, now the most recently used; null
+    /// when absent or @p key is empty.
+    const FilterScanResult* find(const QString& key);
+
+    /// Store @p result under @p key (replacing any entry), evicting the
+    /// least recently used ones down to maxBytes().
+    void insert(const QString& key, FilterScanResult result);
+
+    void clear() { m_entries.clear(); }
+    qsizetype maxBytes() const { return m_entries.maxCost(); }
+    qsizetype memoryUsage() const { return m_entries.totalCost(); }
+
+private:
+    QCache<QString, FilterScanResult> m_entries;
 };
 
 constexpr qint64 kDefaultFilterChunkLines = 256 * 1024;
 
+/// Publication interval the viewer streams long scans with: short enough
+/// that the first matches show while a cold file is still being read, long
+/// enough that a scan finishing within it publishes nothing.
+constexpr qint64 kDefaultFilterPublishMs = 250;
+
 /**
  * Chunk-parallel scan over all lines on worker threads. Same QPromise
- * contract as buildLineIndex: cancellable between super-chunks, permille
+ * contract as buildLineIndex: cancellable between chunks, permille
  * progress, deliver to the GUI thread with a QFutureWatcher and check
  * isCanceled() before result(). Passthrough filters resolve to RowSet::all()
  * without touching the file.
  *
+ * Chunks hold at most @p linesPerChunk lines and 4 MiB (a longer line is a
+ * chunk of its own); idle workers take the next pending chunk and results
+ * merge in line order, so a chunk of megabyte lines stalls only its own
+ * worker.
+ *
  * @p firstLine > 0 limits the scan to [firstLine, lineCount) - follow
  * mode's tail scan after an index extension. Matches are found only there,
  * but context expansion may still reach below firstLine; the caller splices
  * the returned rows onto its previous RowSet. A passthrough filter yields
  * exactly the tail lines.
+ *
+ * A filter.limit claims chunks in line order (reversed for fromEnd) and
+ * stops claiming once the merged chunks hold enough matches, so the usual
+ * "first/last N" question reads only the chunks that answer it.
+ *
+ * @p publishIntervalMs >= 0 streams the scan: once that many ms have passed
+ * since the previous publication, the next merged chunk adds the rows of
+ * every line decided so far as an extra future result with partial set
+ * (matchCount counts those matches; stats are left empty). Lines are
+ * decided in order, so each partial's rows are a prefix of the final rows
+ * apart from the backward context of matches still to come (but see
+ * @p focusLine). Show them via
+ * QFutureWatcher::resultsReadyAt(). The complete result is always the LAST
+ * one - resultAt(resultCount() - 1), not result() - and the only one when
+ * streaming is off (the default) or the scan ends within the interval.
+ * Cancellation is unchanged: a cancelled scan publishes nothing further.
+ *
+ * @p focusLine in [firstLine, lineCount) scans viewport-first: the chunk
+ * holding that line goes first, then the chunks after and before it in
+ * turn, spreading outward. Partials then cover a run of lines around the
+ * focus that grows at both ends; each one's rows are a contiguous run of
+ * the next one's (context can't land between them). The complete result
+ * is identical to an unfocused scan; only the order of work changes.
+ * Ignored under a filter.limit, which sets its own order.
+ *
+ * @p trigrams, an index of @p index's file (buildTrigramIndex()), skips the
+ * blocks that cannot hold the text needle - a regex's required literal - or,
+ * in query mode, one of CompiledQuery::requiredLiterals(). Only those blocks
+ * are read; progress and partials count the rest. Lines the index does not
+ * cover are scanned as usual, and so is every line under invert or with
+ * nothing of three bytes to look up. The result is the unpruned one.
  */
 QFuture<FilterScanResult> scanFilter(std::shared_ptr<FileSource> source,
                                      std::shared_ptr<const LineIndex> index,
                                      LineFilter filter,
                                      qint64 linesPerChunk = kDefaultFilterChunkLines,
-                                     qint64 firstLine = 0);
+                                     qint64 firstLine = 0,
+                                     qint64 publishIntervalMs = -1,
+                                     qint64 focusLine = -1,
+                                     std::shared_ptr<const TrigramIndex> trigrams = nullptr);
+
+/**
+ * scanFilter() restricted to the lines of @p candidates - the rows a
+ * previous scan returned for a filter that @p filter narrows (see
+ * LineFilter::narrows()). Every match of @p filter is among them, context
+ * rows included, so the lines between are never read; context is then
+ * expanded around the new matches over the whole file. Same promise
+ * contract, streaming (@p publishIntervalMs) and result as scanFilter(); an
+ * all() candidate set is a full scanFilter().
+ */
+QFuture<FilterScanResult> refineFilter(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndex> index,
+                                       LineFilter filter, RowSet candidates,
+                                       qint64 linesPerChunk = kDefaultFilterChunkLines,
+                                       qint64 publishIntervalMs = -1);
+
+/// Sample windows countFilter() estimates from by default: 64 windows of
+/// kCountSampleLines lines read in a few milliseconds even off a cold disk.
+constexpr int kDefaultCountSampleChunks = 64;
+constexpr qint64 kCountSampleLines = 1024;
+
+/**
+ * How many lines match @p filter, without materializing them: the scan
+ * counts per chunk and allocates no match vector or RowSet. Context and
+ * filter.limit do not apply. Same promise contract as scanFilter(); the
+ * exact count is the LAST result, and a passthrough filter resolves to the
+ * line count without touching the file.
+ *
+ * @p sampleChunks > 0 estimates first: one window of at most
+ * min(@p linesPerChunk, kCountSampleLines) lines at a random spot in each of
+ * @p sampleChunks equal strata of the file is counted, and the extrapolated
+ * total is published as a partial result with a 95% interval. The full pass
+ * follows; with @p publishIntervalMs >= 0 it refines the estimate as it
+ * goes - exact over the lines decided so far, extrapolated over the rest -
+ * once per interval. Files under four times the sample's size skip the
+ * estimate: the exact count is as quick.
+ */
+QFuture<FilterCountResult> countFilter(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndex> index,
+                                       LineFilter filter,
+                                       qint64 linesPerChunk = kDefaultFilterChunkLines,
+                                       int sampleChunks = 0,
+                                       qint64 publishIntervalMs = -1);
+
+/// Rows findMatch() reads first; each further chunk doubles.
+constexpr qint64 kFindFirstChunkLines = 256;
+
+/**
+ * Find next/previous without filtering: the first row of @p within after
+ * @p fromLine (before it when @p backward) whose line @p filter matches -
+ * the viewer passes its current rows; all() searches every line. Context
+ * and filter.limit do not apply. Same promise contract as scanFilter(),
+ * progress over the rows to search.
+ *
+ * Chunks run outward from @p fromLine in search order, the first holding
+ * kFindFirstChunkLines rows and each next one twice as many up to
+ * @p linesPerChunk (and 4 MiB); claiming stops once a merged chunk holds a
+ * hit, so a nearby match costs a few small reads and a distant one a
+ * parallel scan up to it. No wrap-around: callers search again from -1
+ * (forward) or lineCount() (backward).
+ */
+QFuture<FindResult> findMatch(std::shared_ptr<FileSource> source,
+                              std::shared_ptr<const LineIndex> index,
+                              LineFilter filter, RowSet within, qint64 fromLine,
+                              bool backward = false,
+                              qint64 linesPerChunk = kDefaultFilterChunkLines);
 
 } // namespace logdor
@@ -22,6 +22,7 @@ struct GeoPoint {
 struct GeoScanResult {
     std::vector<GeoPoint> points; // ascending by line
     qint64 elapsedMs = 0;
+    ScanStats stats;
 };
 
 /**
@@ -35,8 +36,8 @@ bool parseCoordinates(QByteArrayView raw, double* latitude, double* longitude);
 
 /**
  * Find every line carrying a coordinate pair. Chunk-parallel on worker
- * threads; same QPromise contract as scanFilter (cancellable between
- * super-chunks, permille progress).
+ * threads; same QPromise contract and chunking as scanFilter (cancellable
+ * between chunks, permille progress).
  */
 QFuture<GeoScanResult> scanCoordinates(
     std::shared_ptr<FileSource> source,
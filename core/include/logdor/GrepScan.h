@@ -5,14 +5,21 @@
 #include <QString>
 #include <QStringList>
 
+#include <memory>
+
 namespace logdor {
 
+class LineIndexCache;
+
 struct GrepQuery {
     QString pattern;
     bool regexMode = false;
     Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive;
     int maxMatchesPerFile = 1000;
     qsizetype maxExcerptBytes = 400;
+    /// Where to look up each file's TrigramIndex: blocks it rules out for
+    /// the needle (or a regex's required literal) are not read.
+    std::shared_ptr<const LineIndexCache> indexCache;
 };
 
 struct GrepMatch {
@@ -31,12 +38,13 @@ struct GrepFileResult {
 
 /**
  * Folder-wide search: a dedicated streaming grep - no per-file LineIndex,
- * just a sequential chunked line walk per file (gzip works through
- * FileSource::open). Files are searched in order and each REPORTABLE file
+ * just a sequential chunked line walk per file (.gz, .zst, .xz and .lz4
+ * work through FileSource::open). Files are searched in order and each REPORTABLE file
  * (matches, error, or binary skip; clean no-match files stay silent)
  * arrives as its own future result - consume with resultReadyAt to stream
  * into the UI. An empty pattern is a no-op. Cancellation is honored
- * between 16 MiB chunks.
+ * between 16 MiB chunks. With query.indexCache, a file with a stored
+ * TrigramIndex skips the blocks that cannot match; results are unchanged.
  */
 QFuture<GrepFileResult> grepFolder(QStringList files, GrepQuery query);
 
@@ -3,15 +3,19 @@
 #include <QtGlobal>
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace logdor {
 
+class FileSource;
+
 /**
  * Compact index of line boundaries in a byte stream.
  *
- * Pure offset structure: no file I/O, no Qt containers on hot paths. Byte
- * access composes at the FileSource level.
+ * Offset structure: no file I/O, no Qt containers on hot paths. Byte
+ * access composes at the FileSource level - except in sparse mode, where
+ * the index reads its FileSource to resolve lines between checkpoints.
  *
  * Line semantics (legacy-exact, matching the pre-core scanner):
  *  - Lines are separated by '\n' only. A lone '\r' is content, not a separator.
@@ -22,21 +26,60 @@ namespace logdor {
  *
  * Storage: block-delta encoding. Line starts are grouped in blocks of 1024;
  * each block stores one 64-bit base offset, each line a 32-bit delta from its
- * block base (~4.13 bytes/line). If any delta would overflow 32 bits (a >4 GiB
- * span inside one block), the whole index migrates to a plain 64-bit array
+ * block base (~4.13 bytes/line). If a delta would overflow 32 bits (a >4 GiB
+ * span inside one block), that block migrates to plain 64-bit offsets
  * ("wide mode") - correctness preserved, memory sacrificed only for
  * pathological inputs.
  *
- * Build single-threaded via addTerminator()+finalize(), then treat as
- * immutable; const access is safe from any thread afterwards.
+ * Blocks are persistent: once full they are never written again, and copies
+ * of an index share them. A builder only writes its last block (and the
+ * last page of the block table), which every copy clones - so
+ * resumedFrom() and snapshot() cost O(1024) plus the appended lines, not
+ * O(lines), and follow-mode extends stay flat as the file grows.
+ *
+ * Sparse mode (setSparse) keeps only every Nth line start ("checkpoint",
+ * same block-delta encoding) and no CRLF bits: ~4/N bytes/line, under 0.1
+ * at N = 64. Other lines are found by scanning forward from their
+ * checkpoint; each thread caches its last decoded N-line span, so
+ * sequential access (viewer pages, chunked scans) costs one extra pass
+ * over the bytes rather than N per line.
+ *
+ * Build single-threaded via addTerminator()/addTerminators()+finalize(),
+ * then treat as immutable; const access is safe from any thread afterwards.
+ * Blocks may also live in an immutable image mapped by LineIndexCache; the
+ * query API reads both through the same block table.
  */
 class LineIndex {
 public:
+    LineIndex() = default;
+    LineIndex(const LineIndex& other);
+    LineIndex(LineIndex&& other) noexcept;
+    LineIndex& operator=(const LineIndex& other);
+    LineIndex& operator=(LineIndex&& other) noexcept;
+
     static constexpr int kBlockShift = 10; // 1024 lines per block
     static constexpr qint64 kBlockMask = (qint64(1) << kBlockShift) - 1;
+    static constexpr qint64 kBlockSize = kBlockMask + 1;
+
+    /// addTerminators() flag: set on a position whose '\n' follows a '\r'.
+    /// File offsets never reach bit 63.
+    static constexpr quint64 kPrecededByCr = quint64(1) << 63;
+
+    /// Largest setSparse() stride.
+    static constexpr int kMaxSparseStride = 4096;
 
     //=== Builder API (single writer, then immutable) =========================
 
+    /**
+     * Switch to sparse mode: keep one checkpoint per @p stride lines and
+     * resolve the rest by scanning @p source (the bytes being indexed; it
+     * must outlive every read of the index, which the shared_ptr ensures).
+     * @p stride <= 1 keeps the dense layout. Call before the first
+     * terminator, or on a resumedFrom() copy with the same stride to point
+     * it at a reopened source.
+     */
+    void setSparse(int stride, std::shared_ptr<const FileSource> source);
+
     /// Hint the expected number of lines to avoid reallocation churn.
     void reserveLines(qint64 approx);
 
@@ -48,21 +91,40 @@ public:
      */
     void addTerminator(quint64 newlinePos, bool precededByCr);
 
+    /**
+     * Bulk addTerminator(): @p count '\n' positions, strictly increasing
+     * and past any earlier ones, each OR-ed with kPrecededByCr when its
+     * line ends with "\r\n". The indexer's SIMD kernels emit this layout
+     * directly.
+     */
+    void addTerminators(const quint64* terminators, qsizetype count);
+
     /// Complete the index. @p fileSizeBytes is the total stream length.
     void finalize(quint64 fileSizeBytes);
 
+    /**
+     * A finalized copy of this index while it is still being built,
+     * holding only the lines whose terminator has been added (the
+     * provisional line being scanned is left out, so every snapshot line is
+     * final). Lets a build publish progress to readers as immutable
+     * snapshots; shares every full block, so it costs O(1024).
+     */
+    LineIndex snapshot() const;
+
     //=== Query API (valid after finalize) =====================================
 
     qint64 lineCount() const noexcept { return m_count; }
     quint64 fileSize() const noexcept { return m_fileSize; }
+    /// True when some block needed 64-bit offsets.
     bool isWide() const noexcept { return m_wideMode; }
+    bool isSparse() const noexcept { return m_stride > 1; }
+    /// Lines per checkpoint: 1 for a dense index.
+    int sparseStride() const noexcept { return m_stride; }
 
     /// Byte offset of the first byte of @p line.
     quint64 offsetOf(qint64 line) const noexcept
     {
-        return m_wideMode ? m_wide[size_t(line)]
-                          : m_blockBase[size_t(line >> kBlockShift)]
-                                + m_delta[size_t(line)];
+        return m_stride > 1 ? sparseOffsetOf(line) : entryOffset(line);
     }
 
     /// One past the last byte of @p line including its terminator ('\n').
@@ -89,9 +151,20 @@ public:
     /// True when @p line is terminated by "\r\n".
     bool endsWithCrLf(qint64 line) const noexcept
     {
-        return size_t(line) < m_crlf.size() && m_crlf[size_t(line)];
+        if (m_stride > 1)
+            return sparseEndsWithCrLf(line);
+        const qint64 at = line & kBlockMask;
+        return line < m_entries && (blockOf(line).crlf[at >> 6] >> (at & 63)) & 1;
     }
 
+    /**
+     * The line holding byte @p offset - its content or its terminator.
+     * Offsets at or past fileSize() give the last line; -1 when there are
+     * no lines. A binary search over the stored starts, then (sparse) over
+     * the checkpoint's decoded span: O(log lines).
+     */
+    qint64 lineAt(quint64 offset) const noexcept;
+
     /// True when the final line ends with '\n' (follow mode: an appended
     /// byte then belongs to a NEW line, not to the final one).
     bool lastLineTerminated() const noexcept { return m_lastLineTerminated; }
@@ -105,33 +178,91 @@ public:
      */
     quint64 resumeOffset() const noexcept
     {
-        return m_count == 0 || m_lastLineTerminated ? m_fileSize
-                                                    : offsetOf(m_count - 1);
+        return m_count == 0 || m_lastLineTerminated ? m_fileSize : m_lastStart;
     }
 
     /**
      * A copy of @p index reopened for building: finalize() is undone so
      * addTerminator()/finalize() may append what lies past resumeOffset().
      * The source index is untouched - concurrent readers keep their
-     * immutable snapshot (copy-on-extend, never in-place growth).
+     * immutable snapshot (copy-on-extend, never in-place growth). Only the
+     * last block is copied; the rest, mapped ones included, is shared.
      */
     static LineIndex resumedFrom(const LineIndex& index);
 
-    /// Bytes of heap memory held by the index structure itself.
+    /// Bytes of heap memory held by the index structure itself, counting
+    /// blocks shared with other copies; mapped blocks cost only their
+    /// block-table entry.
     size_t memoryUsage() const noexcept;
 
+    /// True when some blocks live in a LineIndexCache file mapping.
+    bool isMapped() const noexcept { return m_image != nullptr; }
+
 private:
+    friend class LineIndexCache; // writes and maps the raw arrays
+
+    struct SparseState; // the scanned source; identity keys the span cache
+    struct Block;       // heap storage of one block
+    struct Page;        // up to kPageBlocks BlockRefs and the Blocks they own
+
+    static constexpr int kPageShift = 2 * kBlockShift; // 1024 blocks per page
+    static constexpr size_t kPageBlocks = size_t(1) << kBlockShift;
+
+    // Where one block's entries live: a heap Block or a mapped cache image.
+    struct BlockRef {
+        quint64 base;         // offset of the block's first entry
+        const quint32* delta; // entry offset - base; null for a wide block
+        const quint64* wide;  // absolute entry offsets of a wide block
+        const quint64* crlf;  // dense: bit per line, "\r\n"
+    };
+    struct PageSlot {
+        const BlockRef* refs; // page->refs, cached for the read path
+        std::shared_ptr<Page> page;
+    };
+
+    const BlockRef& blockOf(qint64 entry) const noexcept
+    {
+        return m_pages[size_t(entry >> kPageShift)]
+            .refs[size_t(entry >> kBlockShift) & (kPageBlocks - 1)];
+    }
+
+    // Stored start number @p entry: line @p entry when dense, checkpoint
+    // @p entry (line entry * stride) when sparse.
+    quint64 entryOffset(qint64 entry) const noexcept
+    {
+        const BlockRef& block = blockOf(entry);
+        const size_t at = size_t(entry & kBlockMask);
+        return block.delta ? block.base + block.delta[at] : block.wide[at];
+    }
+    quint64 sparseOffsetOf(qint64 line) const noexcept;
+    bool sparseEndsWithCrLf(qint64 line) const noexcept;
+    void decodeSpan(qint64 span, quint64* starts, quint64* crlfWords) const;
+
     void appendStart(quint64 offset);
+    void pushEntry(quint64 offset);
     void popLastStart();
-    void migrateToWide();
+    void startBlock(quint64 base);
+    void widenTail();
+    void setCrlf(qint64 line, bool crlf);
+    void cloneTail();
+    void bindTail() noexcept;
+    void mapArrays(const quint64* base, const quint32* delta,
+                   const quint64* wide, const quint64* crlf, qint64 entries);
 
-    std::vector<quint64> m_blockBase; // one per 1024 lines (narrow mode)
-    std::vector<quint32> m_delta;     // one per line (narrow mode)
-    std::vector<quint64> m_wide;      // one per line (wide mode)
-    std::vector<bool> m_crlf;         // per terminated line: ends with "\r\n"
+    // The block table: page p holds blocks [p * kPageBlocks, ...). Full
+    // pages and blocks are shared with copies; the last ones are this
+    // index's own while it builds.
+    std::vector<PageSlot> m_pages;
+    Block* m_tail = nullptr;       // last block, written while building
+    BlockRef* m_tailRef = nullptr; // its entry in the last page
+    std::shared_ptr<const void> m_image; // keeps mapped blocks alive
+    std::shared_ptr<const SparseState> m_sparse;
 
     qint64 m_count = 0;
+    qint64 m_entries = 0;   // stored starts; == m_count when dense
+    quint64 m_lastStart = 0; // start of line m_count - 1
     quint64 m_fileSize = 0;
+    int m_stride = 1;
     bool m_wideMode = false;
     bool m_lastLineTerminated = false;
     bool m_finalized = false;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "logdor/FileIdentity.h"
+#include "logdor/LineIndex.h"
+
+#include <QString>
+
+#include <memory>
+
+namespace logdor {
+
+class FileSource;
+
+/**
+ * Persistent on-disk cache of finished LineIndexes, so reopening a large
+ * log skips the full newline scan.
+ *
+ * One file per log path in directory(), named by a hash of the absolute
+ * path. It holds the index arrays verbatim (block bases, deltas or wide
+ * offsets, CRLF bits) behind a header recording the FileIdentity, the
+ * log's mtime and a hash of the last indexed 4 KiB. lookup() maps the
+ * file read-only, checks in one pass over the arrays that the line starts
+ * ascend within the log, and hands back a LineIndex that reads straight
+ * from the mapping: no newline scan, just a block table of 32 bytes per
+ * 1024 lines. Extending it keeps sharing the mapped blocks.
+ *
+ *  - Identical: same identity, mtime and tail hash - the index is complete.
+ *  - Grown: same identity prefix and tail hash, file larger - the index
+ *    covers a prefix; extend it over the new bytes (buildLineIndex() with a
+ *    cache does this).
+ *  - Mismatch: no usable entry.
+ *
+ * Cache files are versioned and native-endian; anything unexpected reads
+ * as Mismatch and is overwritten by the next store(). The cache is bounded
+ * by maxBytes(): store() evicts least-recently-used files (lookup() hits
+ * refresh a file's mtime) until the directory fits. Logs smaller than
+ * minFileSize() are not worth a cache file and are never stored, nor are
+ * sparse indexes (their arrays are tiny, and a cache entry would have to
+ * carry the byte source along).
+ *
+ * The directory also holds FileSource's checkpoint files for compressed
+ * logs (see checkpointFilePath()) and trigram indexes (trigramFilePath());
+ * all kinds share the maxBytes() budget and LRU.
+ *
+ * Stateless beyond its configuration: safe to share across threads. The
+ * directory is the caller's choice (the app uses its data location); core
+ * holds no global paths.
+ */
+class LineIndexCache {
+public:
+    static constexpr quint64 kDefaultMaxBytes = quint64(2) * 1024 * 1024 * 1024;
+    static constexpr quint64 kDefaultMinFileSize = 64 * 1024 * 1024;
+
+    explicit LineIndexCache(const QString& directory,
+                            quint64 maxBytes = kDefaultMaxBytes,
+                            quint64 minFileSize = kDefaultMinFileSize);
+
+    QString directory() const { return m_directory; }
+    quint64 maxBytes() const { return m_maxBytes; }
+    quint64 minFileSize() const { return m_minFileSize; }
+
+    struct Entry {
+        std::shared_ptr<const LineIndex> index; // null on Mismatch
+        IdentityMatch match = IdentityMatch::Mismatch;
+    };
+
+    /// Find the cached index for @p source (keyed by its filePath()).
+    Entry lookup(const FileSource& source) const;
+
+    /**
+     * Write @p index for @p source (atomically replacing any older entry),
+     * then evict down to maxBytes(). @p index must be finalized and cover a
+     * prefix of @p source. Returns false when the file is below
+     * minFileSize() or on I/O failure (e.g. the old entry is still mapped
+     * on Windows); the cache is best-effort and never an error path.
+     */
+    bool store(const FileSource& source, const LineIndex& index) const;
+
+    /// Delete least-recently-used cache files until the total is within
+    /// maxBytes().
+    void evict() const;
+
+    /// Total bytes of cache files in directory().
+    quint64 diskUsage() const;
+
+    /// The cache file for the log at @p logPath.
+    QString cacheFilePath(const QString& logPath) const;
+
+    /// The checkpoint file FileSource::open() keeps for the compressed log
+    /// at @p logPath.
+    QString checkpointFilePath(const QString& logPath) const;
+
+    /// The file TrigramIndex::store() keeps for the log at @p logPath.
+    QString trigramFilePath(const QString& logPath) const;
+
+private:
+    QString m_directory;
+    quint64 m_maxBytes;
+    quint64 m_minFileSize;
+};
+
+} // namespace logdor
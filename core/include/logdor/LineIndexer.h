@@ -9,41 +9,102 @@
 
 namespace logdor {
 
+class LineIndexCache;
+
 struct IndexingResult {
     std::shared_ptr<const LineIndex> index;
     qint64 lineCount = 0;
     quint64 bytesScanned = 0;
     qint64 elapsedMs = 0;
+    bool fromCache = false; // index (or the prefix it extends) came from a LineIndexCache
+    bool partial = false;   // progressive snapshot; more results follow
 };
 
 constexpr qsizetype kDefaultIndexChunkSize = 16 * 1024 * 1024;
+constexpr int kDefaultIndexThreads = 0; // 0 = QThread::idealThreadCount()
+constexpr int kDefaultSparseStride = 64;  // ~0.06 B/line; see LineIndex::setSparse
+constexpr quint64 kDefaultPublishInterval = 256 * 1024 * 1024;
 
 /**
  * Scan @p source for line boundaries on a worker thread.
  *
- * The scan is sequential in @p chunkSize chunks: memchr runs at multiple
- * GB/s on one core, cold files are disk-bound anyway, and sequential access
- * maximizes OS readahead. Cancellation (QFuture::cancel()) is acknowledged
- * between chunks; progress is reported in permille (0..1000).
+ * With @p threads == 1 the scan is sequential in @p chunkSize chunks:
+ * memchr runs at multiple GB/s on one core, and sequential access maximizes
+ * OS readahead on cold files. Otherwise rounds of @p threads chunks are
+ * scanned in parallel - each worker records its chunk's terminators, seeing
+ * the byte before the chunk so a "\r\n" split across the edge is detected
+ * exactly as the sequential carry byte does - and the per-chunk results are
+ * stitched into the index in file order. Hot-cache files scale with cores;
+ * a file no larger than one chunk is always scanned sequentially.
+ *
+ * Terminators are found by a vectorized kernel picked at runtime (SSE2
+ * baseline, AVX2/AVX-512 when available; see lineIndexKernelName()) that
+ * classifies 64 bytes per step and feeds LineIndex::addTerminators(). Its
+ * output is identical to the scalar memchr loop, which
+ * LOGDOR_FORCE_SCALAR_INDEX=1 selects instead.
+ *
+ * @p sparseStride > 1 builds a sparse index (LineIndex::setSparse): one
+ * checkpoint per that many lines, the rest resolved from @p source on
+ * access - for files whose dense index would not fit in RAM.
+ *
+ * @p publishInterval > 0 makes the build progressive: every that many
+ * scanned bytes, an immutable LineIndex::snapshot() of the complete lines so
+ * far (sharing the index's full blocks) is added as an extra future result
+ * with partial set. Show them via QFutureWatcher::resultReadyAt(); each one
+ * extends the previous exactly as extendLineIndex() extends its input (an
+ * unterminated last line may grow, earlier lines never change). The final
+ * index is always the LAST result - resultAt(resultCount() - 1), not
+ * result() - and the only one when publishing is off (the default).
+ *
+ * Cancellation (QFuture::cancel()) is acknowledged between chunks (between
+ * rounds in parallel mode); progress is reported in permille (0..1000).
  *
  * Deliver completion to the GUI thread with a QFutureWatcher and check
  * isCanceled() before calling result().
  */
 QFuture<IndexingResult> buildLineIndex(std::shared_ptr<FileSource> source,
-                                       qsizetype chunkSize = kDefaultIndexChunkSize);
+                                       qsizetype chunkSize = kDefaultIndexChunkSize,
+                                       int threads = kDefaultIndexThreads,
+                                       int sparseStride = 1,
+                                       quint64 publishInterval = 0);
+
+/**
+ * buildLineIndex() through a persistent @p cache (null: plain build). An
+ * Identical entry is returned as-is - a mapped index, no scan. A Grown one
+ * is extended over the new bytes only, as extendLineIndex() would. Either
+ * way fromCache is set and bytesScanned counts only what was scanned.
+ * Anything scanned is stored back on a separate pool task after the result
+ * is delivered, so the cache write never delays the first paint. Sparse
+ * builds bypass the cache. With @p publishInterval > 0 a Grown entry's
+ * cached prefix is published as a partial result before its extension.
+ */
+QFuture<IndexingResult> buildLineIndex(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndexCache> cache,
+                                       qsizetype chunkSize = kDefaultIndexChunkSize,
+                                       int threads = kDefaultIndexThreads,
+                                       int sparseStride = 1,
+                                       quint64 publishInterval = 0);
 
 /**
  * Incrementally index growth: rescan only [previous->resumeOffset(),
  * source->size()) and return a NEW index (copy-on-extend - @p previous stays
  * immutable for its concurrent readers; a cancelled extend leaves it the
- * only truth). @p source is the follow controller's REOPENED FileSource for
- * the same identity-matched file; a source smaller than the previous index
- * (rotation raced the reopen) returns @p previous unchanged - callers
- * resolve that through FileIdentity. bytesScanned counts only the rescanned
- * suffix.
+ * only truth). The new index shares @p previous's full blocks, so an
+ * extend costs O(appended lines) however large the file. @p source is the
+ * follow controller's REOPENED FileSource for the same identity-matched
+ * file; a source smaller than the previous index (rotation raced the
+ * reopen) returns @p previous unchanged - callers resolve that through
+ * FileIdentity. bytesScanned counts only the rescanned suffix. @p threads
+ * as for buildLineIndex; typical growth fits one chunk. A sparse
+ * @p previous stays sparse and reads @p source from then on.
  */
 QFuture<IndexingResult> extendLineIndex(std::shared_ptr<FileSource> source,
                                         std::shared_ptr<const LineIndex> previous,
-                                        qsizetype chunkSize = kDefaultIndexChunkSize);
+                                        qsizetype chunkSize = kDefaultIndexChunkSize,
+                                        int threads = kDefaultIndexThreads);
+
+/// Newline kernel the next build will use: "avx512", "avx2", "sse2" or
+/// "scalar" (non-x86 builds, or LOGDOR_FORCE_SCALAR_INDEX set).
+const char* lineIndexKernelName();
 
 } // namespace logdor
@@ -136,12 +136,13 @@ struct ColumnSnapshot {
  *   term  := FIELD op value | text
  *   op    := ':' | '=' | '!=' | '<' | '<=' | '>' | '>='
  *
- * Free text terms substring-match the whole raw line. Field names resolve
- * against the schema case-insensitively with spaces stripped. String fields:
- * ':' = contains, '*'/'?' in the value = anchored wildcard, '=' exact;
- * ordering ops compare bytes lexicographically. Integer fields: numeric,
- * unparseable rows never match. SeverityName-hinted fields compare severity
- * enum order for named levels.
+ * Free text terms substring-match the whole raw line; a query with several
+ * plain (ASCII) free-text terms finds them all in one pass per line. Field
+ * names resolve against the schema case-insensitively with spaces stripped.
+ * String fields: ':' = contains, '*'/'?' in the value = anchored wildcard,
+ * '=' exact; ordering ops compare bytes lexicographically. Integer fields:
+ * numeric, unparseable rows never match. SeverityName-hinted fields compare
+ * severity enum order for named levels.
  *
  * DateTime fields compare temporally: a value that parses as a date,
  * time-of-day, or datetime (parseTimeLiteral) becomes a half-open range at
@@ -179,14 +180,40 @@ public:
 
     QString text() const { return m_text; }
 
+    /**
+     * True when every line this query matches is provably matched by
+     * @p previous: the texts are equal, or @p previous is the first few
+     * top-level AND operands of this one ("level:error" -> "level:error
+     * tag:wifi"). Both must come from the same schema and time context;
+     * case sensitivity and options are compared.
+     */
+    bool narrows(const CompiledQuery& previous) const;
+
+    /**
+     * Byte literals every matching line contains: the needles of free-text
+     * terms (a regex term's required literal) reached from the root through
+     * AND alone, pre-lowercased when case-insensitive. Lets a block index
+     * (TrigramIndex) rule out blocks before any line is evaluated; empty
+     * when the query has none.
+     */
+    QList<QByteArray> requiredLiterals() const;
+
 private:
     CompiledQuery();
 
+    // Gather the plain free-text terms into m_terms once parsing is done.
+    void gatherTerms();
+
     struct Node;
+    struct Terms;
     std::unique_ptr<Node> m_root;
+    std::unique_ptr<const Terms> m_terms; // null: every term searches alone
     QString m_text;
     QList<int> m_referencedColumns;
     bool m_needsSeverity = false;
+    Qt::CaseSensitivity m_cs = Qt::CaseInsensitive;
+    QueryOptions m_options;
+    QList<qsizetype> m_conjunctEnds; // see narrows()
 
     friend struct QueryParser;
 };
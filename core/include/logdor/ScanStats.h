@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+namespace logdor {
+
+/**
+ * How a chunk-parallel scan kept its workers busy. Per worker, the share
+ * of the scan's wall time spent scanning chunks (0..1): near 1 everywhere
+ * on a balanced warm scan, lower where workers sat idle - waiting for the
+ * merge window to advance past a slow chunk, or for work at the end.
+ */
+struct ScanStats {
+    std::vector<double> threadUtilization;
+    quint64 chunks = 0; // chunks the lines were cut into
+};
+
+} // namespace logdor
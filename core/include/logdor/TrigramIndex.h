@@ -0,0 +1,119 @@
+#pragma once
+
+#include "logdor/FileSource.h"
+#include "logdor/LineIndex.h"
+#include "logdor/ScanStats.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFuture>
+
+#include <memory>
+#include <vector>
+
+namespace logdor {
+
+class LineIndexCache;
+
+/**
+ * Trigram inverted index over blocks of lines, so a text search can skip
+ * the blocks that cannot hold its needle.
+ *
+ * Lines are grouped in blocks of blockLines(). For every three-byte run
+ * inside a line (ASCII letters folded to lower case; runs across a line end
+ * are left out) the index keeps the ascending list of blocks holding it,
+ * delta-encoded as varints - a posting list. A literal can only occur in
+ * the blocks that every one of its trigrams lists, so candidates()
+ * intersects those lists. Folding lets one index serve case-sensitive and
+ * case-insensitive searches alike, as a superset of the exact blocks.
+ *
+ * An index speaks for the lines its LineIndex had when it was built
+ * (coveredLines()); lines past those - follow-mode growth, or an
+ * unterminated last line that grew - must always be searched.
+ *
+ * Persisted beside the file's LineIndexCache entry (lookup()/store()),
+ * behind the same FileIdentity and tail-hash checks. Immutable once built;
+ * const access is safe from any thread.
+ */
+class TrigramIndex {
+public:
+    /// Lines per block: ~1 MiB of typical log text, so a rare needle reads
+    /// a few megabytes and the posting lists stay a few percent of the file.
+    static constexpr qint64 kDefaultBlockLines = 8 * LineIndex::kBlockSize;
+
+    qint64 blockLines() const { return m_blockLines; }
+    qint64 blockCount() const { return qint64(m_blockOffsets.size()); }
+    qint64 lineCount() const { return m_lineCount; }
+    quint64 fileSize() const { return m_fileSize; } // indexed bytes
+    qsizetype trigramCount() const { return qsizetype(m_keys.size()); }
+
+    /// Byte offset of the first line of @p block: where a line walk that
+    /// skips to it starts, at line block * blockLines().
+    quint64 blockOffset(qint64 block) const { return m_blockOffsets[size_t(block)]; }
+
+    /**
+     * Per block: whether it may contain @p literal (raw bytes, either
+     * case). Empty when the index cannot tell - a literal under three bytes
+     * - and every block must be searched.
+     */
+    std::vector<bool> candidates(QByteArrayView literal) const;
+
+    /// Lines the index speaks for in the file now @p fileSize bytes long:
+    /// all it indexed, less an unterminated last line once the file grew.
+    qint64 coveredLines(quint64 fileSize) const;
+
+    /// Heap bytes of the posting lists and tables.
+    size_t memoryUsage() const;
+
+    /**
+     * The index stored in @p cache for @p source, or null: none stored, or
+     * the file no longer starts with the bytes it indexed. A grown file
+     * keeps its index (see coveredLines()).
+     */
+    static std::shared_ptr<const TrigramIndex> lookup(const LineIndexCache& cache,
+                                                      const FileSource& source);
+
+    /// Write this index of @p source to @p cache (LineIndexCache::store()
+    /// rules: minFileSize(), atomic replace, then evict). False on failure.
+    bool store(const LineIndexCache& cache, const FileSource& source) const;
+
+private:
+    friend struct TrigramIndexBuilder;
+
+    qint64 m_blockLines = kDefaultBlockLines;
+    qint64 m_lineCount = 0;
+    quint64 m_fileSize = 0;
+    bool m_lastLineTerminated = true;
+    std::vector<quint64> m_blockOffsets;
+    std::vector<quint32> m_keys;     // ascending trigrams
+    std::vector<quint64> m_starts;   // m_keys.size() + 1 offsets into m_postings
+    QByteArray m_postings;           // varint block deltas, per key
+};
+
+struct TrigramIndexResult {
+    std::shared_ptr<const TrigramIndex> index;
+    qint64 elapsedMs = 0;
+    bool fromCache = false; // looked up, not built
+    ScanStats stats;
+};
+
+/**
+ * Build the trigram index of @p source's lines on worker threads, one
+ * block per chunk. Same QPromise contract as buildLineIndex: cancellable
+ * between blocks, permille progress, deliver with a QFutureWatcher and
+ * check isCanceled() before result().
+ *
+ * Memory: memoryUsage() of the result, typically a few percent of the
+ * file (bytes/line = memoryUsage() / lineCount()); while building, one
+ * 2 MiB bitmap per worker plus the growing posting lists.
+ *
+ * With @p cache, a stored index for the file - or for a prefix of it, when
+ * it grew - is returned instead (fromCache), and a built one is stored off
+ * the critical path, as buildLineIndex() does.
+ */
+QFuture<TrigramIndexResult> buildTrigramIndex(std::shared_ptr<FileSource> source,
+                                              std::shared_ptr<const LineIndex> index,
+                                              std::shared_ptr<const LineIndexCache> cache = nullptr,
+                                              qint64 blockLines = TrigramIndex::kDefaultBlockLines);
+
+} // namespace logdor
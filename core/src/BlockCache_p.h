@@ -0,0 +1,59 @@
+#pragma once
+
+// Internal sharded LRU of byte blocks for FileSource's non-contiguous
+// modes. Not installed; include from core/src only.
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+
+#include <memory>
+
+namespace logdor::detail {
+
+/**
+ * LRU of byte blocks keyed by block (or span) number, split into
+ * independently locked shards so concurrent readers rarely meet: key k
+ * lives in shard k % shards, an LRU of maxCost / shards. Lookups hand out
+ * implicitly shared copies, so callers copy bytes after the shard lock is
+ * gone. Every insert's cost must fit one shard's share.
+ */
+class BlockCache {
+public:
+    BlockCache(int maxCost, int shards)
+        : m_shards(std::make_unique<Shard[]>(size_t(shards)))
+        , m_count(quint64(shards))
+    {
+        for (int i = 0; i < shards; ++i)
+            m_shards[size_t(i)].blocks.setMaxCost(maxCost / shards);
+    }
+
+    /// The block under @p key; null on a miss.
+    QByteArray find(quint64 key) const
+    {
+        Shard& shard = shardOf(key);
+        QMutexLocker lock(&shard.mutex);
+        const QByteArray* block = shard.blocks.object(key);
+        return block ? *block : QByteArray();
+    }
+
+    void insert(quint64 key, const QByteArray& block, int cost) const
+    {
+        Shard& shard = shardOf(key);
+        QMutexLocker lock(&shard.mutex);
+        shard.blocks.insert(key, new QByteArray(block), cost); // takes ownership
+    }
+
+private:
+    struct Shard {
+        QMutex mutex;
+        QCache<quint64, QByteArray> blocks;
+    };
+
+    Shard& shardOf(quint64 key) const { return m_shards[size_t(key % m_count)]; }
+
+    std::unique_ptr<Shard[]> m_shards;
+    quint64 m_count;
+};
+
+} // namespace logdor::detail
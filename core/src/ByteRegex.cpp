@@ -0,0 +1,298 @@
+#include "ByteRegex_p.h"
+
+#include <cstring>
+
+#ifdef LOGDOR_HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+namespace logdor::detail {
+
+namespace {
+
+#ifdef LOGDOR_HAVE_PCRE2
+
+// Room for the whole-match pair only: enough for a yes/no answer with any
+// number of groups (pcre2_match then returns 0, "ovector too small").
+pcre2_match_data* threadMatchData()
+{
+    thread_local const std::unique_ptr<pcre2_match_data, void (*)(pcre2_match_data*)>
+        data(pcre2_match_data_create(1, nullptr), &pcre2_match_data_free);
+    return data.get();
+}
+
+// QRegularExpression's JIT stack, per thread: 32 KiB growing to 512 KiB.
+// PCRE2's default is a fixed 32 KiB on the machine stack, which long lines
+// overflow where Qt would still have matched.
+pcre2_match_context* threadMatchContext()
+{
+    struct Context {
+        pcre2_jit_stack* stack = pcre2_jit_stack_create(32 * 1024, 512 * 1024, nullptr);
+        pcre2_match_context* context = pcre2_match_context_create(nullptr);
+
+        Context()
+        {
+            if (stack && context)
+                pcre2_jit_stack_assign(context, nullptr, stack);
+        }
+        ~Context()
+        {
+            pcre2_match_context_free(context);
+            pcre2_jit_stack_free(stack);
+        }
+    };
+    thread_local const Context context;
+    return context.context;
+}
+
+#endif
+
+bool isAsciiDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool isAsciiAlnum(char c)
+{
+    return isAsciiDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Index after the quantifier starting at @p i ('*', '+', '?' or a counted
+// "{n}", "{n,}", "{n,m}" - "{,m}" and inner spaces in newer PCRE2 - plus a
+// lazy/possessive suffix), or @p i when none starts there. A '{' of any
+// other shape is a literal.
+qsizetype quantifierEnd(const QByteArray& p, qsizetype i)
+{
+    const qsizetype n = p.size();
+    if (i >= n)
+        return i;
+    qsizetype end = i;
+    if (p[i] == '*' || p[i] == '+' || p[i] == '?') {
+        end = i + 1;
+    } else if (p[i] == '{') {
+        qsizetype j = i + 1;
+        bool digits = false;
+        while (j < n && (isAsciiDigit(p[j]) || p[j] == ',' || p[j] == ' ')) {
+            digits = digits || isAsciiDigit(p[j]);
+            ++j;
+        }
+        if (!digits || j >= n || p[j] != '}')
+            return i;
+        end = j + 1;
+    } else {
+        return i;
+    }
+    if (end < n && (p[end] == '?' || p[end] == '+'))
+        ++end;
+    return end;
+}
+
+// True when the quantifier at @p i (quantifierEnd(p, i) > i) allows zero
+// repetitions.
+bool quantifierAllowsZero(const QByteArray& p, qsizetype i)
+{
+    if (p[i] == '*' || p[i] == '?')
+        return true;
+    if (p[i] != '{')
+        return false; // '+'
+    for (qsizetype j = i + 1; p[j] != ',' && p[j] != '}'; ++j) {
+        if (isAsciiDigit(p[j]) && p[j] != '0')
+            return false;
+    }
+    return true;
+}
+
+// Index after the escape starting at @p i (p[i] == '\\'): the escaped
+// character plus whatever operand it takes (\x41, \x{..}, \p{..}, \cX,
+// \k<name>, octal and backreference digits).
+qsizetype escapeEnd(const QByteArray& p, qsizetype i)
+{
+    const qsizetype n = p.size();
+    qsizetype j = i + 2;
+    if (i + 1 >= n)
+        return n;
+    const char e = p[i + 1];
+    const auto skipTo = [&](char close) {
+        const qsizetype at = p.indexOf(close, j);
+        return at < 0 ? j : at + 1;
+    };
+    if (j < n && p[j] == '{' && e != '\0' && std::strchr("xopPNgk", e))
+        return skipTo('}');
+    if ((e == 'k' || e == 'g') && j < n && (p[j] == '<' || p[j] == '\''))
+        return skipTo(p[j] == '<' ? '>' : '\'');
+    if (e == 'c' || e == 'p' || e == 'P')
+        return qMin(n, j + 1); // \cX, \pL
+    if (e == 'g' && j < n && (p[j] == '-' || p[j] == '+'))
+        ++j;
+    if (e == 'x') {
+        for (int k = 0; k < 2 && j < n && isAsciiAlnum(p[j]); ++k)
+            ++j;
+        return j;
+    }
+    if (isAsciiDigit(e) || e == 'g') {
+        while (j < n && isAsciiDigit(p[j]))
+            ++j;
+        return j;
+    }
+    return j;
+}
+
+// Index after the character class starting at @p i (p[i] == '[').
+qsizetype classEnd(const QByteArray& p, qsizetype i)
+{
+    const qsizetype n = p.size();
+    qsizetype j = i + 1;
+    if (j < n && p[j] == '^')
+        ++j;
+    if (j < n && p[j] == ']')
+        ++j; // a leading ']' is a member
+    while (j < n && p[j] != ']') {
+        if (p[j] == '\\') {
+            j += 2;
+        } else if (p[j] == '[' && j + 1 < n && p[j + 1] == ':') {
+            const qsizetype close = p.indexOf(":]", j + 2);
+            j = close < 0 ? j + 1 : close + 2;
+        } else {
+            ++j;
+        }
+    }
+    return qMin(n, j + 1);
+}
+
+} // namespace
+
+#ifdef LOGDOR_HAVE_PCRE2
+
+ByteRegex::ByteRegex(const QString& pattern, bool caseSensitive)
+{
+    const QByteArray utf8 = pattern.toUtf8();
+    int error = 0;
+    PCRE2_SIZE errorOffset = 0;
+    pcre2_code* code = pcre2_compile(
+        reinterpret_cast<PCRE2_SPTR>(utf8.constData()), PCRE2_SIZE(utf8.size()),
+        PCRE2_UTF | PCRE2_MATCH_INVALID_UTF | (caseSensitive ? 0 : PCRE2_CASELESS),
+        &error, &errorOffset, nullptr);
+    if (!code)
+        return;
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE); // best effort: else interpreted
+    m_code.reset(code, [](const pcre2_code* c) {
+        pcre2_code_free(const_cast<pcre2_code*>(c));
+    });
+}
+
+bool ByteRegex::isValid() const
+{
+    return m_code != nullptr;
+}
+
+bool ByteRegex::matches(QByteArrayView subject) const
+{
+    if (!m_code)
+        return false;
+    // An empty view may carry a null pointer; PCRE2 wants a real one.
+    static constexpr char kEmpty[] = "";
+    const auto* data = reinterpret_cast<PCRE2_SPTR>(subject.isEmpty() ? kEmpty
+                                                                      : subject.data());
+    const int rc = pcre2_match(m_code.get(), data, PCRE2_SIZE(subject.size()), 0, 0,
+                               threadMatchData(), threadMatchContext());
+    if (rc >= 0 || rc == PCRE2_ERROR_NOMATCH)
+        return rc >= 0;
+    // The JIT gave up (its stack, a limit): let the interpreter decide
+    // rather than drop the line. Its own failures are no match, as in
+    // QRegularExpression.
+    return pcre2_match(m_code.get(), data, PCRE2_SIZE(subject.size()), 0, PCRE2_NO_JIT,
+                       threadMatchData(), threadMatchContext())
+        >= 0;
+}
+
+#else
+
+ByteRegex::ByteRegex(const QString& pattern, bool caseSensitive)
+    : m_regex(pattern, caseSensitive ? QRegularExpression::NoPatternOption
+                                     : QRegularExpression::CaseInsensitiveOption)
+{
+}
+
+bool ByteRegex::isValid() const
+{
+    return m_regex.isValid();
+}
+
+bool ByteRegex::matches(QByteArrayView subject) const
+{
+    return m_regex.isValid() && m_regex.match(QString::fromUtf8(subject)).hasMatch();
+}
+
+#endif
+
+QByteArray requiredLiteral(const QString& pattern, bool caseSensitive)
+{
+    const QByteArray p = pattern.toUtf8();
+    if (p.contains("(?") || p.contains("\\Q") || p.contains("\\E"))
+        return {};
+
+    QByteArray best;
+    QByteArray run;
+    const auto endRun = [&] {
+        if (run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+    int depth = 0;
+    const qsizetype n = p.size();
+    for (qsizetype i = 0; i < n;) {
+        const char c = p[i];
+        if (c == '(' || c == ')') {
+            // Group contents are not collected: they may be optional or
+            // alternatives. A quantifier on the group applies to it alone.
+            depth += c == '(' ? 1 : -1;
+            endRun();
+            i = c == ')' ? quantifierEnd(p, i + 1) : i + 1;
+            continue;
+        }
+        if (c == '|') {
+            if (depth == 0)
+                return {}; // top-level alternation: nothing is required
+            ++i;
+            continue;
+        }
+
+        // One atom: its literal character, or -1 when it is none.
+        int literal = -1;
+        qsizetype next = i + 1;
+        if (c == '\\') {
+            next = escapeEnd(p, i);
+            const char e = i + 1 < n ? p[i + 1] : '\0';
+            if (next == i + 2 && !isAsciiAlnum(e) && uchar(e) < 0x80 && e != '\0')
+                literal = uchar(e);
+        } else if (c == '[') {
+            next = classEnd(p, i);
+        } else if (c != '.' && c != '^' && c != '$' && c != '{' && uchar(c) < 0x80
+                   && quantifierEnd(p, i) == i) {
+            literal = uchar(c);
+        }
+        if (literal == '\n' || literal == '\r')
+            literal = -1;
+        if (literal >= 0 && !caseSensitive) {
+            if (literal >= 'A' && literal <= 'Z')
+                literal += 32;
+            if (literal == 'k' || literal == 's')
+                literal = -1; // folds to non-ASCII too
+        }
+
+        const qsizetype after = quantifierEnd(p, next);
+        if (depth > 0 || literal < 0 || (after > next && quantifierAllowsZero(p, next))) {
+            endRun();
+        } else {
+            run += char(literal);
+            if (after > next)
+                endRun(); // repeated: what follows is not adjacent
+        }
+        i = after;
+    }
+    endRun();
+    return best;
+}
+
+} // namespace logdor::detail
@@ -0,0 +1,71 @@
+#pragma once
+
+// Internal regular expressions over UTF-8 bytes for Matcher (see
+// TextMatch_p.h). Not installed; include from core/src only.
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+#ifndef LOGDOR_HAVE_PCRE2
+#include <QRegularExpression>
+#endif
+
+#include <memory>
+
+#ifdef LOGDOR_HAVE_PCRE2
+struct pcre2_real_code_8; // pcre2_code in 8-bit mode
+#endif
+
+namespace logdor::detail {
+
+/**
+ * A regular expression matched against a line's UTF-8 bytes in place.
+ *
+ * With PCRE2 (LOGDOR_WITH_PCRE2) the pattern is compiled by the 8-bit
+ * library in UTF mode, JIT-compiled where supported: no UTF-16 copy of
+ * each line. Syntax and options are those of QRegularExpression, which is
+ * PCRE2 16-bit underneath - no UCP (\w, \d are ASCII), Unicode case
+ * folding when caseless, and the same per-thread JIT stack (32 KiB growing
+ * to 512 KiB) with the interpreter as fallback past it, so a pattern that
+ * matched a long line through Qt still does. One difference remains:
+ * bytes that are not valid
+ * UTF-8 match no character (PCRE2_MATCH_INVALID_UTF) where QString would
+ * have turned them into U+FFFD. Without PCRE2 this wraps
+ * QRegularExpression and converts each subject, as before.
+ *
+ * Immutable after construction; matches() is safe from any thread (each
+ * thread keeps its own match data and JIT stack). Copies share the compiled pattern.
+ */
+class ByteRegex {
+public:
+    ByteRegex() = default;
+    ByteRegex(const QString& pattern, bool caseSensitive);
+
+    /// False for a pattern that failed to compile; it then matches nothing.
+    bool isValid() const;
+
+    bool matches(QByteArrayView subject) const;
+
+private:
+#ifdef LOGDOR_HAVE_PCRE2
+    std::shared_ptr<const pcre2_real_code_8> m_code;
+#else
+    QRegularExpression m_regex;
+#endif
+};
+
+/**
+ * An ASCII string every match of @p pattern contains - the longest run of
+ * literal characters outside groups, lowercased when !@p caseSensitive - or
+ * empty when there is none, the pattern has top-level alternation, or it
+ * uses constructs the scan does not model (inline options, \Q..\E). Never
+ * holds '\n' or '\r'. Caseless runs also stop at 'k' and 's', whose
+ * Unicode case folds (KELVIN SIGN, LONG S) are not ASCII.
+ *
+ * A line without it cannot match, so it serves as a substring prefilter
+ * ahead of the regex: "transa[ck]tion \w+" gives "transa".
+ */
+QByteArray requiredLiteral(const QString& pattern, bool caseSensitive);
+
+} // namespace logdor::detail
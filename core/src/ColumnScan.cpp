@@ -1,8 +1,9 @@
 #include "logdor/ColumnScan.h"
 
+#include "ScanDriver_p.h"
+
 #include <QElapsedTimer>
 #include <QThread>
-#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
 #include <algorithm>
@@ -48,7 +49,7 @@ ChunkShard scanChunk(const FileSource& source, const LineIndex& index,
     ParsedRow row;
     for (qint64 line = first; line < end; ++line) {
         // Parsing is much slower than filtering; honor cancel mid-chunk so
-        // latency stays bounded by ~4k parses, not a whole super-chunk.
+        // latency stays bounded by ~4k parses, not a whole chunk.
         // A truncated shard is fine - a cancelled scan discards everything.
         if ((line & 4095) == 0 && promise.isCanceled())
             return shard;
@@ -200,36 +201,33 @@ QFuture<ColumnScanResult> extractColumns(
         const QList<TimestampCodec> columnCodecs = resolveCodecs(
             *source, *index, *parser, schema, columns, timeContext);
 
+        const auto pass = source->sequentialScan();
         const qint64 total = index->lineCount();
         const qint64 first = std::min(firstLine, total);
-        const int threads = qMax(1, QThread::idealThreadCount());
-        const qint64 superChunk = linesPerChunk * threads;
         QList<ChunkShard> shards;
-
-        struct Range { qint64 first, end; };
-        for (qint64 base = first; base < total; base += superChunk) {
-            if (promise.isCanceled())
-                return;
-            const qint64 superEnd = std::min(total, base + superChunk);
-            QList<Range> ranges;
-            for (qint64 s = base; s < superEnd; s += linesPerChunk)
-                ranges.append({ s, std::min(superEnd, s + linesPerChunk) });
-
-            auto chunkShards = QtConcurrent::blockingMapped(ranges,
-                std::function<ChunkShard(const Range&)>([&](const Range& r) {
-                    return scanChunk(*source, *index, *parser, columns,
-                                     columnTypes, columnCodecs, wantSeverity,
-                                     r.first, r.end, promise);
-                }));
-            for (auto& shard : chunkShards)
+        ScanStats stats;
+        const auto chunks = detail::byteBalancedChunks(*index, first, total,
+                                                       linesPerChunk);
+        const bool finished = detail::driveChunks<ChunkShard>(
+            *source, *index, chunks, QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                return scanChunk(*source, *index, *parser, columns, columnTypes,
+                                 columnCodecs, wantSeverity, c.first, c.end,
+                                 promise);
+            },
+            [&](ChunkShard&& shard, const detail::LineChunk& c) {
                 shards.append(std::move(shard));
-            promise.setProgressValue(int((superEnd - first) * 1000
-                                         / std::max<qint64>(total - first, 1)));
-        }
+                promise.setProgressValue(int((c.end - first) * 1000
+                                             / std::max<qint64>(total - first, 1)));
+            },
+            [&] { return promise.isCanceled(); }, &stats);
+        if (!finished)
+            return;
 
         ColumnScanResult result = mergeShards(std::move(shards), columns,
                                               columnTypes, columnCodecs,
                                               wantSeverity, total - first);
+        result.stats = std::move(stats);
         result.elapsedMs = timer.elapsed();
         promise.setProgressValue(1000);
         promise.addResult(std::move(result));
@@ -1,140 +1,81 @@
 #include "logdor/FileSource.h"
 
+#include "logdor/LineIndexCache.h"
+
+#include "BlockCache_p.h"
+#include "PlatformIo_p.h"
+#include "SeekIndex_p.h"
+
+#include <QDir>
 #include <QPromise>
 #include <QtConcurrentRun>
 #include <QtEnvironmentVariables>
 
-#ifdef LOGDOR_HAVE_ZLIB
-#include <zlib.h>
-#endif
-
 #include <cstring>
 
 namespace logdor {
 
 namespace {
 
-constexpr char kGzipMagic[2] = { '\x1f', '\x8b' };
-
-qint64 maxDecompressedBytes()
+quint64 megabytesFromEnv(const char* name, quint64 fallback)
 {
-    // Gzip-bomb cap: 4 GiB unless overridden.
     bool ok = false;
-    const qint64 mb = qEnvironmentVariableIntValue("LOGDOR_MAX_DECOMPRESSED_MB",
-                                                   &ok);
-    return (ok && mb > 0 ? mb : qint64(4096)) * 1024 * 1024;
+    const qint64 mb = qEnvironmentVariableIntValue(name, &ok);
+    return ok && mb >= 0 ? quint64(mb) * 1024 * 1024 : fallback;
 }
 
-#ifdef LOGDOR_HAVE_ZLIB
-// Inflate the whole (possibly multi-member, per rotated-log convention)
-// gzip stream. Returns false with @p error set on corrupt/truncated input,
-// the bomb cap, or cancellation (empty error).
-bool inflateAll(QFile& file, QByteArray& out, QString* error,
-                QPromise<FileSource::AsyncOpenResult>* promise)
+quint64 maxInflatedBytes()
 {
-    constexpr qsizetype kStep = 4 * 1024 * 1024;
-    const qint64 compressedSize = qMax<qint64>(file.size(), 1);
-    const qint64 cap = maxDecompressedBytes();
+    // Larger seekable content opens Seekable instead of living on the heap.
+    return megabytesFromEnv("LOGDOR_MAX_DECOMPRESSED_MB", FileSource::kMaxInflatedBytes);
+}
 
-    z_stream stream = {};
-    if (inflateInit2(&stream, 15 + 32) != Z_OK) { // gzip or zlib wrapper
-        if (error)
-            *error = QStringLiteral("zlib initialization failed");
-        return false;
-    }
+quint64 maxWholeBytes()
+{
+    // Content without seek points must fit the heap: the bomb cap.
+    return megabytesFromEnv("LOGDOR_MAX_WHOLE_MB", FileSource::kMaxWholeBytes);
+}
 
-    QByteArray inBuffer(kStep, Qt::Uninitialized);
-    QByteArray outBuffer(kStep, Qt::Uninitialized);
-    bool sawEnd = false;
-    for (;;) {
-        if (promise && promise->isCanceled()) {
-            inflateEnd(&stream);
-            if (error)
-                error->clear();
-            return false;
-        }
-        if (stream.avail_in == 0) {
-            const qint64 got = file.read(inBuffer.data(), inBuffer.size());
-            if (got < 0) {
-                inflateEnd(&stream);
-                if (error)
-                    *error = QStringLiteral("read failed: %1")
-                                 .arg(file.errorString());
-                return false;
-            }
-            if (got == 0)
-                break; // input exhausted
-            stream.next_in = reinterpret_cast<Bytef*>(inBuffer.data());
-            stream.avail_in = uInt(got);
-            if (promise)
-                promise->setProgressValue(
-                    int(file.pos() * 1000 / compressedSize));
-        }
+// Shards of the block and scan caches; a Seekable span's cost (at most 4)
+// must fit one shard.
+constexpr int kBlockCacheShards = 8;
+constexpr int kScanCacheShards = 2;
 
-        stream.next_out = reinterpret_cast<Bytef*>(outBuffer.data());
-        stream.avail_out = uInt(outBuffer.size());
-        const int rc = inflate(&stream, Z_NO_FLUSH);
-        if (rc != Z_OK && rc != Z_STREAM_END) {
-            inflateEnd(&stream);
-            if (error)
-                *error = QStringLiteral("corrupt gzip stream");
-            return false;
-        }
-        out.append(outBuffer.constData(),
-                   outBuffer.size() - qsizetype(stream.avail_out));
-        if (out.size() > cap) {
-            inflateEnd(&stream);
-            if (error)
-                *error = QStringLiteral(
-                    "decompressed size exceeds the %1 MiB cap "
-                    "(LOGDOR_MAX_DECOMPRESSED_MB overrides)")
-                             .arg(maxDecompressedBytes() / (1024 * 1024));
-            return false;
-        }
-        if (rc == Z_STREAM_END) {
-            sawEnd = true;
-            if (stream.avail_in == 0 && file.atEnd())
-                break;
-            // Rotated logs are commonly concatenated members.
-            if (inflateReset2(&stream, 15 + 32) != Z_OK)
-                break;
-            sawEnd = false;
-        }
-    }
-    inflateEnd(&stream);
-    if (!sawEnd) {
-        if (error)
-            *error = QStringLiteral("truncated gzip stream");
-        return false;
-    }
-    return true;
-}
-#endif // LOGDOR_HAVE_ZLIB
+// readInto() calls at least this long are scan chunks: hint the OS to
+// fetch the range after them, which the next chunk reads.
+constexpr qsizetype kReadAheadMin = 256 * 1024;
 
-bool startsWithGzipMagic(QFile& file)
+// QCache cost of a decompressed span: one per started block, so frame
+// spans of up to 16 MiB keep the caches within their byte budget.
+int spanCost(const QByteArray& span)
 {
-    char magic[2] = {};
-    const bool match = file.read(magic, 2) == 2
-        && magic[0] == kGzipMagic[0] && magic[1] == kGzipMagic[1];
-    file.seek(0);
-    return match;
+    return int(qMax<qsizetype>(1, (span.size() + FileSource::kBlockSize - 1)
+                                      / FileSource::kBlockSize));
 }
 
 } // namespace
 
+FileSource::FileSource()
+    : m_blockCache(std::make_unique<detail::BlockCache>(kMaxCachedBlocks,
+                                                        kBlockCacheShards))
+    , m_scanCache(std::make_unique<detail::BlockCache>(kMaxScanSpans,
+                                                       kScanCacheShards))
+{
+}
+
+FileSource::~FileSource() = default;
+
 bool FileSource::isCompressedFile(const QString& path)
 {
-#ifdef LOGDOR_HAVE_ZLIB
     QFile file(path);
-    return file.open(QIODevice::ReadOnly) && startsWithGzipMagic(file);
-#else
-    Q_UNUSED(path)
-    return false;
-#endif
+    return file.open(QIODevice::ReadOnly)
+        && detail::sniffCodec(file) != detail::Codec::None;
 }
 
 std::shared_ptr<FileSource> FileSource::openImpl(
-    const QString& path, QString* error, QPromise<AsyncOpenResult>* promise)
+    const QString& path, QString* error,
+    const std::shared_ptr<const LineIndexCache>& cache,
+    QPromise<AsyncOpenResult>* promise, bool* fromCache)
 {
     // std::make_shared can't reach the private constructor.
     std::shared_ptr<FileSource> src(new FileSource);
@@ -145,31 +86,63 @@ std::shared_ptr<FileSource> FileSource::openImpl(
                          .arg(path, src->m_file.errorString());
         return nullptr;
     }
+    src->m_fd = src->m_file.handle();
+    src->m_fileSize = quint64(src->m_file.size());
 
-#ifdef LOGDOR_HAVE_ZLIB
     // Magic bytes win over suffix: a .gz named plainly still inflates, a
-    // plain file named .gz opens as-is.
-    if (startsWithGzipMagic(src->m_file)) {
-        QString inflateError;
-        if (!inflateAll(src->m_file, src->m_decompressed, &inflateError,
-                        promise)) {
-            if (error)
-                *error = inflateError.isEmpty()
-                    ? QString() // cancelled
-                    : QStringLiteral("Cannot decompress %1: %2")
-                          .arg(path, inflateError);
-            return nullptr;
+    // plain file named .zst opens as-is.
+    if (const detail::Codec codec = detail::sniffCodec(src->m_file);
+        codec != detail::Codec::None) {
+        const QString checkpointPath
+            = cache ? cache->checkpointFilePath(path) : QString();
+        auto seek = std::make_shared<detail::SeekIndex>();
+        const bool cached = cache
+            && detail::loadSeekIndex(checkpointPath, src->m_file, seek.get());
+        if (!cached) {
+            const qint64 compressedSize = qMax<qint64>(src->m_file.size(), 1);
+            detail::PassCallbacks callbacks;
+            callbacks.cancelled = [promise] {
+                return promise && promise->isCanceled();
+            };
+            callbacks.progress = [promise, compressedSize](qint64 consumed) {
+                if (promise)
+                    promise->setProgressValue(int(consumed * 1000 / compressedSize));
+            };
+            QString decodeError;
+            if (!detail::buildSeekIndex(codec, src->m_file, kCheckpointSpacing,
+                                        maxInflatedBytes(), maxWholeBytes(),
+                                        &src->m_decompressed, seek.get(),
+                                        &decodeError, callbacks)) {
+                if (error)
+                    *error = decodeError.isEmpty()
+                        ? QString() // cancelled
+                        : QStringLiteral("Cannot decompress %1: %2")
+                              .arg(path, decodeError);
+                return nullptr;
+            }
+        }
+        src->m_size = seek->size;
+        if (quint64(src->m_decompressed.size()) == src->m_size) {
+            src->m_decompressed.squeeze();
+            src->m_mode = Mode::Decompressed;
+            return src;
         }
-        src->m_decompressed.squeeze();
-        src->m_size = quint64(src->m_decompressed.size());
-        src->m_mode = Mode::Decompressed;
+        // Too large to hold - or reopened from cached checkpoints, which
+        // only Seekable files store. The cache is best-effort, as for
+        // line indexes.
+        src->m_decompressed = QByteArray();
+        src->m_mode = Mode::Seekable;
+        if (fromCache)
+            *fromCache = cached;
+        if (cache && !cached && src->m_size >= cache->minFileSize()
+            && QDir().mkpath(cache->directory())
+            && detail::saveSeekIndex(checkpointPath, *seek, src->m_file))
+            cache->evict();
+        src->m_seek = std::move(seek);
         return src;
     }
-#else
-    Q_UNUSED(promise)
-#endif
 
-    src->m_size = quint64(src->m_file.size());
+    src->m_size = src->m_fileSize;
 
     // QFile::map(0, 0) fails by contract; an empty file is trivially
     // "mapped" - data() hands out a valid empty range.
@@ -182,20 +155,26 @@ std::shared_ptr<FileSource> FileSource::openImpl(
         src->m_map = src->m_file.map(0, qint64(src->m_size));
 
     src->m_mode = src->m_map ? Mode::Mapped : Mode::Buffered;
+    // Idle until a pass starts: the view's faults are scattered.
+    detail::adviseMapping(src->m_map, 0, src->m_size, detail::MapAdvice::Random);
     return src;
 }
 
-std::shared_ptr<FileSource> FileSource::open(const QString& path, QString* error)
+std::shared_ptr<FileSource> FileSource::open(
+    const QString& path, QString* error,
+    std::shared_ptr<const LineIndexCache> cache)
 {
-    return openImpl(path, error, nullptr);
+    return openImpl(path, error, cache, nullptr, nullptr);
 }
 
-QFuture<FileSource::AsyncOpenResult> FileSource::openAsync(const QString& path)
+QFuture<FileSource::AsyncOpenResult> FileSource::openAsync(
+    const QString& path, std::shared_ptr<const LineIndexCache> cache)
 {
-    return QtConcurrent::run([path](QPromise<AsyncOpenResult>& promise) {
+    return QtConcurrent::run([path, cache](QPromise<AsyncOpenResult>& promise) {
         promise.setProgressRange(0, 1000);
         AsyncOpenResult result;
-        result.source = openImpl(path, &result.error, &promise);
+        result.source = openImpl(path, &result.error, cache, &promise,
+                                 &result.fromCache);
         if (promise.isCanceled())
             return;
         promise.setProgressValue(1000);
@@ -231,27 +210,30 @@ QByteArray FileSource::read(quint64 offset, qsizetype length) const
     if (const char* base = data())
         return QByteArray(base + offset, length);
 
-    // Buffered: assemble from cached 4 MiB blocks.
+    if (m_mode == Mode::Seekable) {
+        QByteArray out(length, Qt::Uninitialized);
+        out.truncate(readSpans(offset, out.data(), length, *m_blockCache));
+        return out;
+    }
+
+    // Buffered: assemble from cached 4 MiB blocks. A miss reads outside
+    // any lock; two readers missing the same block both read it.
     QByteArray out;
     out.reserve(length);
-    QMutexLocker lock(&m_ioMutex);
     while (length > 0) {
         const quint64 blockNo = offset / kBlockSize;
-        QByteArray* block = m_blockCache.object(blockNo);
-        if (!block) {
-            auto loaded = std::make_unique<QByteArray>(
-                readUncached(blockNo * kBlockSize, kBlockSize));
-            block = loaded.get();
-            // insert() takes ownership; cost 1 per block, capacity 32.
-            if (!m_blockCache.insert(blockNo, loaded.get()))
-                break; // insertion failure only if cost > maxCost; cannot happen
-            loaded.release();
+        QByteArray block = m_blockCache->find(blockNo);
+        if (block.isNull()) {
+            block = readUncached(blockNo * kBlockSize, kBlockSize);
+            if (block.isEmpty())
+                break; // read error, or the file shrank
+            m_blockCache->insert(blockNo, block, 1);
         }
         const qsizetype within = qsizetype(offset - blockNo * kBlockSize);
-        const qsizetype take = qMin(length, block->size() - within);
+        const qsizetype take = qMin(length, block.size() - within);
         if (take <= 0)
             break;
-        out.append(block->constData() + within, take);
+        out.append(block.constData() + within, take);
         offset += quint64(take);
         length -= take;
     }
@@ -269,6 +251,74 @@ qsizetype FileSource::readInto(quint64 offset, char* dst, qsizetype length) cons
         return length;
     }
 
+    if (m_mode == Mode::Seekable)
+        return readSpans(offset, dst, length, *m_scanCache);
+
+    const qsizetype done = readAt(offset, dst, length);
+    // Chunk scans read ranges in file order across threads: start the
+    // next one's I/O now, so a slow filesystem overlaps it with this
+    // chunk's compute.
+    if (m_fd >= 0 && done >= kReadAheadMin) {
+        const quint64 next = offset + quint64(done);
+        detail::adviseWillNeed(m_fd, next, qMin(quint64(done), m_size - next));
+    }
+    return done;
+}
+
+FileSource::SequentialScan::~SequentialScan()
+{
+    if (!m_source)
+        return;
+    QMutexLocker lock(&m_source->m_adviceMutex);
+    if (--m_source->m_sequentialScans == 0)
+        detail::adviseMapping(m_source->m_map, 0, m_source->m_size,
+                              detail::MapAdvice::Random);
+}
+
+FileSource::SequentialScan FileSource::sequentialScan() const
+{
+    QMutexLocker lock(&m_adviceMutex);
+    if (m_sequentialScans++ == 0)
+        detail::adviseMapping(m_map, 0, m_size, detail::MapAdvice::Sequential);
+    return SequentialScan(this);
+}
+
+void FileSource::prefetch(quint64 offset, quint64 length) const
+{
+    if (offset >= m_size)
+        return;
+    length = qMin(length, m_size - offset);
+    if (m_map)
+        detail::adviseMapping(m_map, offset, length, detail::MapAdvice::WillNeed);
+    else if (m_mode == Mode::Buffered && m_fd >= 0)
+        detail::adviseWillNeed(m_fd, offset, length);
+}
+
+void FileSource::dropPages(quint64 offset, quint64 length) const
+{
+    if (offset >= m_size || (m_mode != Mode::Mapped && m_mode != Mode::Buffered))
+        return;
+    length = qMin(length, m_size - offset);
+    // Unmap first: the page cache keeps pages any mapping still holds.
+    detail::adviseMapping(m_map, offset, length, detail::MapAdvice::DontNeed);
+    if (m_fd >= 0)
+        detail::adviseDontNeed(m_fd, offset, length);
+}
+
+quint64 FileSource::residentBytes(quint64 offset, quint64 length) const
+{
+    if (offset >= m_size)
+        return 0;
+    length = qMin(length, m_size - offset);
+    return m_map ? detail::residentBytes(m_map, offset, length) : length;
+}
+
+qsizetype FileSource::readAt(quint64 offset, char* dst, qsizetype length) const
+{
+    // Positional reads on the descriptor need no lock; only a QFile
+    // without one falls back to seek + read under m_ioMutex.
+    if (m_fd >= 0)
+        return qsizetype(qMax<qint64>(detail::readAt(m_fd, offset, dst, length), 0));
     QMutexLocker lock(&m_ioMutex);
     if (!m_file.seek(qint64(offset)))
         return 0;
@@ -284,10 +334,38 @@ qsizetype FileSource::readInto(quint64 offset, char* dst, qsizetype length) cons
 
 QByteArray FileSource::readUncached(quint64 offset, qsizetype length) const
 {
-    // Caller holds m_ioMutex.
-    if (!m_file.seek(qint64(offset)))
-        return {};
-    return m_file.read(length);
+    QByteArray bytes(length, Qt::Uninitialized);
+    bytes.truncate(readAt(offset, bytes.data(), length));
+    return bytes;
+}
+
+qsizetype FileSource::readSpans(quint64 offset, char* dst, qsizetype length,
+                                const detail::BlockCache& cache) const
+{
+    // Seekable: copy from cached spans; a miss reads the span's compressed
+    // bytes and decodes them, both outside any lock. Two readers missing
+    // the same span both decode it - wasted work, same bytes.
+    qsizetype done = 0;
+    while (done < length) {
+        const size_t spanNo = m_seek->spanOf(offset);
+        const quint64 spanStart = m_seek->points[spanNo].out;
+        QByteArray span = cache.find(spanNo);
+        if (span.isNull()) {
+            const auto [first, last] = m_seek->spanInput(spanNo, m_fileSize);
+            const QByteArray input = readUncached(first, qsizetype(last - first));
+            span = QByteArray(qsizetype(m_seek->spanEnd(spanNo) - spanStart),
+                              Qt::Uninitialized);
+            if (!detail::decodeSpan(*m_seek, spanNo, input, span.data()))
+                break; // the file changed under us
+            cache.insert(spanNo, span, spanCost(span));
+        }
+        const qsizetype within = qsizetype(offset - spanStart);
+        const qsizetype take = qMin(length - done, span.size() - within);
+        std::memcpy(dst + done, span.constData() + within, size_t(take));
+        done += take;
+        offset += quint64(take);
+    }
+    return done;
 }
 
 } // namespace logdor
@@ -1,13 +1,18 @@
 #include "logdor/FilterScan.h"
 
+#include "ScanDriver_p.h"
 #include "TextMatch_p.h"
 
 #include <QElapsedTimer>
+#include <QRandomGenerator>
 #include <QThread>
-#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <optional>
 
 namespace logdor {
 
@@ -15,13 +20,29 @@ using detail::Matcher;
 
 namespace {
 
-std::vector<qint32> scanRange(const FileSource& source, const LineIndex& index,
-                              const Matcher& matcher, const LineFilter& filter,
-                              qint64 first, qint64 end)
+// The per-line decision, for lines the chunk search does not cover.
+bool lineMatches(const Matcher& matcher, const LineFilter& filter, qint64 line,
+                 QByteArrayView raw)
 {
-    std::vector<qint32> matches;
-    const bool queryEmpty = matcher.mode == Matcher::Mode::Empty;
+    bool match;
+    if (filter.fieldQuery) {
+        // Query mode: the compiled query replaces the plain text match.
+        match = filter.fieldQuery->evaluate(line, raw, filter.columns) != filter.invert;
+    } else {
+        // Empty query ignores invert (legacy); with a query, XOR applies.
+        match = matcher.mode == Matcher::Mode::Empty
+            || (matcher.textMatches(raw) != filter.invert);
+    }
+    return match && (!filter.extraPredicate || filter.extraPredicate(line, raw));
+}
 
+// Hand each match in lines [first, end) to @p emit, ascending: scanRange()
+// collects them, countRange() only counts.
+template <typename Emit>
+void visitRange(const FileSource& source, const LineIndex& index,
+                const Matcher& matcher, const LineFilter& filter, qint64 first,
+                qint64 end, Emit emit)
+{
     // Buffered sources: one bulk read per chunk instead of a lock per line.
     QByteArray scratch;
     const char* base = nullptr;
@@ -37,26 +58,131 @@ std::vector<qint32> scanRange(const FileSource& source, const LineIndex& index,
         base = scratch.constData();
     }
 
+    const auto contentOf = [&](qint64 line) {
+        return QByteArrayView(base + (index.offsetOf(line) - baseOffset),
+                              index.lengthOf(line));
+    };
+
+    if (!filter.fieldQuery && matcher.searchesChunks()) {
+        // Search the chunk's bytes as one run and map each hit to its line,
+        // instead of a setup per line: the "grep for a request ID" case
+        // touches the index only at hits. The needle holds no terminator,
+        // so a hit lies inside one line's content; a regex then decides
+        // that line, and the search resumes at the next one. Lines between
+        // hits are non-matches, which only invert has to emit.
+        const auto decide = [&](qint64 line, bool textMatch) {
+            if (textMatch != filter.invert
+                && (!filter.extraPredicate || filter.extraPredicate(line, contentOf(line))))
+                emit(line);
+        };
+        const quint64 stop = index.endOffsetOf(end - 1);
+        quint64 at = index.offsetOf(first);
+        qint64 next = first; // first undecided line
+        while (at < stop) {
+            const qsizetype found = matcher.find(
+                QByteArrayView(base + (at - baseOffset), qsizetype(stop - at)));
+            if (found < 0)
+                break;
+            const quint64 hit = at + quint64(found);
+            // Frequent hits land a few lines on: probe those before the
+            // binary search.
+            qint64 line = next;
+            for (int probe = 0; probe < 8 && index.endOffsetOf(line) <= hit; ++probe)
+                ++line;
+            if (index.endOffsetOf(line) <= hit)
+                line = index.lineAt(hit);
+            if (filter.invert) {
+                for (; next < line; ++next)
+                    decide(next, false);
+            }
+            decide(line, matcher.confirmHit(contentOf(line)));
+            next = line + 1;
+            at = index.endOffsetOf(line);
+        }
+        if (filter.invert) {
+            for (; next < end; ++next)
+                decide(next, false);
+        }
+        return;
+    }
+
     for (qint64 line = first; line < end; ++line) {
-        const QByteArrayView raw(base + (index.offsetOf(line) - baseOffset),
-                                 index.lengthOf(line));
-        bool match;
-        if (filter.fieldQuery) {
-            // Query mode: the compiled query replaces the plain text match.
-            match = filter.fieldQuery->evaluate(line, raw, filter.columns)
-                != filter.invert;
+        if (lineMatches(matcher, filter, line, contentOf(line)))
+            emit(line);
+    }
+}
+
+std::vector<qint32> scanRange(const FileSource& source, const LineIndex& index,
+                              const Matcher& matcher, const LineFilter& filter,
+                              qint64 first, qint64 end)
+{
+    std::vector<qint32> matches;
+    visitRange(source, index, matcher, filter, first, end,
+               [&](qint64 line) { matches.push_back(qint32(line)); });
+    return matches;
+}
+
+qint64 countRange(const FileSource& source, const LineIndex& index,
+                  const Matcher& matcher, const LineFilter& filter, qint64 first,
+                  qint64 end)
+{
+    qint64 count = 0;
+    visitRange(source, index, matcher, filter, first, end, [&](qint64) { ++count; });
+    return count;
+}
+
+// Rows [firstRow, endRow) of @p candidates only: a refinement visits the
+// previous result's lines and nothing between them.
+std::vector<qint32> scanCandidates(const FileSource& source, const LineIndex& index,
+                                   const Matcher& matcher, const LineFilter& filter,
+                                   const RowSet& candidates, qint64 firstRow,
+                                   qint64 endRow)
+{
+    std::vector<qint32> matches;
+    QByteArray scratch;
+    for (qint64 row = firstRow; row < endRow; ++row) {
+        const qint64 line = candidates.sourceLine(row);
+        const quint64 offset = index.offsetOf(line);
+        const qsizetype length = index.lengthOf(line);
+        QByteArrayView raw;
+        if (source.isContiguous()) {
+            raw = QByteArrayView(source.data() + offset, length);
         } else {
-            // Empty query ignores invert (legacy); with a query, XOR applies.
-            match = queryEmpty || (matcher.textMatches(raw) != filter.invert);
+            scratch.resize(length);
+            source.readInto(offset, scratch.data(), length);
+            raw = scratch;
         }
-        if (match && filter.extraPredicate)
-            match = filter.extraPredicate(line, raw);
-        if (match)
+        if (lineMatches(matcher, filter, line, raw))
             matches.push_back(qint32(line));
     }
     return matches;
 }
 
+// Cut @p candidates into chunks of at most @p maxLines rows and
+// kScanChunkBytes bytes of their own lines (the gaps between them are not
+// read). Each chunk spans its first to its last candidate line, so it is
+// marked as not reading that span: the driver must not warm the gaps.
+std::vector<detail::LineChunk> candidateChunks(const LineIndex& index,
+                                               const RowSet& candidates,
+                                               qint64 maxLines)
+{
+    std::vector<detail::LineChunk> chunks;
+    const qint64 rows = candidates.size();
+    qint64 row = 0;
+    while (row < rows) {
+        const qint64 first = candidates.sourceLine(row);
+        quint64 bytes = 0;
+        qint64 taken = 0;
+        do {
+            bytes += index.lengthOf(candidates.sourceLine(row + taken));
+            ++taken;
+        } while (row + taken < rows && taken < maxLines && bytes < detail::kScanChunkBytes);
+        chunks.push_back({ first, candidates.sourceLine(row + taken - 1) + 1, false });
+        row += taken;
+    }
+    return chunks;
+}
+
 // Union of [m - before, m + after] over sorted matches, clamped to
 // [0, total). Linear interval merge; no per-line hashing.
 std::vector<qint32> expandContext(const std::vector<qint32>& matches,
@@ -78,12 +204,401 @@ std::vector<qint32> expandContext(const std::vector<qint32>& matches,
     return visible;
 }
 
+// Keep the first (or last) limit.count of the ascending @p matches.
+void applyLimit(std::vector<qint32>& matches, const MatchLimit& limit)
+{
+    if (limit.count <= 0 || qint64(matches.size()) <= limit.count)
+        return;
+    if (limit.fromEnd)
+        matches.erase(matches.begin(), matches.end() - limit.count);
+    else
+        matches.resize(size_t(limit.count));
+}
+
+// Lines [first, total) in byteBalancedChunks() pieces, less the blocks
+// @p trigrams rules out: those missing the text needle, or any required
+// literal of a field query. Lines the index does not cover are kept, and
+// so is everything under invert or without a literal of three bytes.
+std::vector<detail::LineChunk> prunedChunks(const LineIndex& index,
+                                            const TrigramIndex* trigrams,
+                                            const Matcher& matcher,
+                                            const LineFilter& filter, qint64 first,
+                                            qint64 total, qint64 maxLines)
+{
+    std::vector<bool> mask;
+    if (trigrams && !filter.invert) {
+        QList<QByteArray> literals;
+        if (filter.fieldQuery)
+            literals = filter.fieldQuery->requiredLiterals();
+        else if (matcher.searchesChunks())
+            literals.append(matcher.asciiNeedle);
+        for (const QByteArray& literal : literals) {
+            std::vector<bool> blocks = trigrams->candidates(literal);
+            if (blocks.empty())
+                continue;
+            if (mask.empty()) {
+                mask = std::move(blocks);
+                continue;
+            }
+            for (size_t b = 0; b < mask.size(); ++b)
+                mask[b] = mask[b] && blocks[b];
+        }
+    }
+    if (mask.empty())
+        return detail::byteBalancedChunks(index, first, total, maxLines);
+
+    const qint64 covered = std::min(trigrams->coveredLines(index.fileSize()), total);
+    const qint64 blockLines = trigrams->blockLines();
+    std::vector<detail::LineChunk> chunks;
+    const auto keep = [&](qint64 from, qint64 to) {
+        from = std::max(from, first);
+        if (from >= to)
+            return;
+        const auto pieces = detail::byteBalancedChunks(index, from, to, maxLines);
+        chunks.insert(chunks.end(), pieces.begin(), pieces.end());
+    };
+    qint64 run = -1; // first line of the run of candidate blocks
+    for (size_t b = 0; b < mask.size() && qint64(b) * blockLines < covered; ++b) {
+        if (mask[b] && run < 0) {
+            run = qint64(b) * blockLines;
+        } else if (!mask[b] && run >= 0) {
+            keep(run, qint64(b) * blockLines);
+            run = -1;
+        }
+    }
+    keep(run >= 0 ? run : covered, total);
+    return chunks;
+}
+
+// Viewport-first claim order for scanFilter(): chunk indices outward from
+// the one holding @p focusLine - it, the next, the previous, and so on - so
+// the chunks merged at any time form one contiguous run of lines.
+std::vector<size_t> outwardOrder(const std::vector<detail::LineChunk>& chunks,
+                                 qint64 focusLine)
+{
+    if (chunks.empty())
+        return {};
+    // A focus in a gap between chunks (pruned blocks) goes with the chunk
+    // before it, or the first.
+    const auto holder = std::upper_bound(
+        chunks.begin(), chunks.end(), focusLine,
+        [](qint64 line, const detail::LineChunk& c) { return line < c.first; });
+    const size_t focus = holder == chunks.begin() ? 0 : size_t(holder - chunks.begin()) - 1;
+    std::vector<size_t> order;
+    order.reserve(chunks.size());
+    order.push_back(focus);
+    for (size_t step = 1; order.size() < chunks.size(); ++step) {
+        if (focus + step < chunks.size())
+            order.push_back(focus + step);
+        if (step <= focus)
+            order.push_back(focus - step);
+    }
+    return order;
+}
+
+// Streaming publication for scanFilter()/refineFilter(): after a merge, the
+// rows of the matches so far go out as a partial result once @p intervalMs
+// have passed since the previous one. Negative publishes nothing. Called
+// under the driver's merge lock, which the interval keeps cheap.
+class Publisher {
+public:
+    Publisher(qint64 intervalMs, const LineFilter& filter, qint64 total,
+              const QElapsedTimer& timer)
+        : m_intervalMs(intervalMs)
+        , m_next(intervalMs)
+        , m_filter(filter)
+        , m_total(total)
+        , m_timer(timer)
+    {
+    }
+
+    // Whether to publish now that @p found matches are decided. Nothing new
+    // to show waits for the next merge, or the end; the first publication
+    // goes out even when empty, so the previous filter's rows don't linger
+    // on a scan that finds nothing.
+    bool due(qint64 found) const
+    {
+        return m_intervalMs >= 0 && m_timer.elapsed() >= m_next && found != m_published;
+    }
+
+    // @p matches: every match decided so far, ascending.
+    void publish(const std::vector<qint32>& matches,
+                 QPromise<FilterScanResult>& promise)
+    {
+        m_published = qint64(matches.size());
+        m_next = m_timer.elapsed() + m_intervalMs;
+
+        FilterScanResult result;
+        result.rows = RowSet::fromLines(
+            expandContext(matches, m_filter.contextBefore, m_filter.contextAfter,
+                          m_total),
+            m_total);
+        result.matchCount = m_published;
+        result.elapsedMs = m_timer.elapsed();
+        result.partial = true;
+        promise.addResult(std::move(result));
+    }
+
+private:
+    qint64 m_intervalMs;
+    qint64 m_next;
+    qint64 m_published = -1;
+    const LineFilter& m_filter;
+    qint64 m_total;
+    const QElapsedTimer& m_timer;
+};
+
+// Rows of @p rows whose line is below @p line: where a search from that
+// line starts.
+qint64 rowsBefore(const RowSet& rows, qint64 line)
+{
+    if (rows.isAll())
+        return std::clamp<qint64>(line, 0, rows.size());
+    qint64 lo = 0;
+    qint64 hi = rows.size();
+    while (lo < hi) {
+        const qint64 mid = lo + (hi - lo) / 2;
+        if (rows.sourceLine(mid) < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Rows [firstRow, endRow) of @p within in findMatch()'s search order - up
+// from firstRow, or down from endRow - as chunks that start at
+// kFindFirstChunkLines rows and double up to @p maxLines, so a near hit
+// costs one small read. Every line of an all() set is searched, in
+// byte-balanced pieces; otherwise a chunk spans its first to last row and
+// reads only those rows, so the driver does not warm it.
+std::vector<detail::LineChunk> findChunks(const LineIndex& index, const RowSet& within,
+                                          qint64 firstRow, qint64 endRow,
+                                          bool backward, qint64 maxLines)
+{
+    std::vector<detail::LineChunk> chunks;
+    qint64 span = std::min(kFindFirstChunkLines, maxLines);
+    for (qint64 done = 0; done < endRow - firstRow;) {
+        const qint64 take = std::min(span, endRow - firstRow - done);
+        const qint64 from = backward ? endRow - done - take : firstRow + done;
+        if (within.isAll()) {
+            auto pieces = detail::byteBalancedChunks(index, from, from + take, take);
+            if (backward)
+                std::reverse(pieces.begin(), pieces.end());
+            chunks.insert(chunks.end(), pieces.begin(), pieces.end());
+        } else {
+            chunks.push_back({ within.sourceLine(from),
+                               within.sourceLine(from + take - 1) + 1, false });
+        }
+        done += take;
+        span = std::min(span * 2, maxLines);
+    }
+    return chunks;
+}
+
+// One window of at most @p windowLines lines (and kScanChunkBytes) at a
+// random start within each of @p strata equal runs of lines. Seeded from the
+// line count, so repeated estimates over a file agree.
+std::vector<detail::LineChunk> sampleWindows(const LineIndex& index, int strata,
+                                             qint64 windowLines)
+{
+    const qint64 total = index.lineCount();
+    QRandomGenerator random{ quint32(total) };
+    std::vector<detail::LineChunk> windows;
+    windows.reserve(size_t(strata));
+    for (int h = 0; h < strata; ++h) {
+        const qint64 lo = total * h / strata;
+        const qint64 hi = total * (h + 1) / strata;
+        const quint64 starts = quint64(std::max<qint64>(hi - lo - windowLines, 0)) + 1;
+        const qint64 start = lo + qint64(random.generate64() % starts);
+        const qint64 end = std::min(hi, start + windowLines);
+        windows.push_back(detail::byteBalancedChunks(index, start, end, windowLines).front());
+    }
+    return windows;
+}
+
+// Match rate of the sample windows (a ratio estimate: matches over lines)
+// and its standard error. The variance is the simple-random-sample one,
+// which stratifying only tightens, so the interval errs wide.
+class SampleEstimate {
+public:
+    SampleEstimate(const std::vector<detail::LineChunk>& windows,
+                   const std::vector<qint64>& hits, qint64 total)
+    {
+        const size_t k = windows.size();
+        for (size_t i = 0; i < k; ++i) {
+            m_lines += windows[i].end - windows[i].first;
+            m_hits += hits[i];
+        }
+        m_rate = double(m_hits) / double(m_lines);
+        if (k > 1) {
+            double squares = 0;
+            for (size_t i = 0; i < k; ++i) {
+                const double residual = double(hits[i])
+                    - m_rate * double(windows[i].end - windows[i].first);
+                squares += residual * residual;
+            }
+            const double meanLines = double(m_lines) / double(k);
+            const double fraction = double(m_lines) / double(total);
+            m_rateError = std::sqrt((1.0 - fraction) * squares / double(k - 1)
+                                    / double(k)) / meanLines;
+        }
+    }
+
+    // @p found exact matches over the first @p decided lines, the rest
+    // estimated, with a 95% interval.
+    FilterCountResult estimate(qint64 found, qint64 decided, qint64 total) const
+    {
+        double low = m_rate - 1.96 * m_rateError;
+        double high = m_rate + 1.96 * m_rateError;
+        // A sample of no matches (or nothing but) shows no spread; the rule
+        // of three bounds the rate it could have missed.
+        if (m_hits == 0)
+            high = 3.0 / double(m_lines);
+        if (m_hits == m_lines)
+            low = 1.0 - 3.0 / double(m_lines);
+        const double rest = double(total - decided);
+        FilterCountResult result;
+        result.matchCount = found + std::llround(rest * m_rate);
+        result.low = found + std::llround(rest * std::clamp(low, 0.0, 1.0));
+        result.high = found + std::llround(rest * std::clamp(high, 0.0, 1.0));
+        result.partial = true;
+        return result;
+    }
+
+private:
+    qint64 m_lines = 0;
+    qint64 m_hits = 0;
+    double m_rate = 0;
+    double m_rateError = 0;
+};
+
 } // namespace
 
+MatchLimit takeMatchLimit(QString* text)
+{
+    // Parsed right to left: "| head 500" <- digits, keyword, pipe.
+    qsizetype end = text->size();
+    const auto skipSpaces = [&] {
+        while (end > 0 && text->at(end - 1).isSpace())
+            --end;
+    };
+    skipSpaces();
+    const qsizetype digitsEnd = end;
+    while (end > 0 && text->at(end - 1).isDigit())
+        --end;
+    bool ok = false;
+    const qint64 count = QStringView(*text).mid(end, digitsEnd - end).toLongLong(&ok);
+    if (!ok || count <= 0 || end == 0 || !text->at(end - 1).isSpace())
+        return {};
+    skipSpaces();
+    if (end < 4)
+        return {};
+    const QStringView keyword = QStringView(*text).mid(end - 4, 4);
+    const bool head = keyword.compare(u"head", Qt::CaseInsensitive) == 0;
+    if (!head && keyword.compare(u"tail", Qt::CaseInsensitive) != 0)
+        return {};
+    end -= 4;
+    skipSpaces();
+    if (end == 0 || text->at(end - 1) != u'|')
+        return {};
+    --end;
+    skipSpaces();
+    text->truncate(end);
+    return { count, !head };
+}
+
+bool LineFilter::narrows(const LineFilter& previous) const
+{
+    if (previous.limit.count > 0)
+        return false;
+    // An empty previous query matched every line its predicate accepted.
+    if (!previous.fieldQuery && previous.query.isEmpty())
+        return true;
+    if (fieldQuery || previous.fieldQuery) {
+        // NOT (a AND b) widens NOT a: only uninverted queries narrow.
+        return fieldQuery && previous.fieldQuery && !invert && !previous.invert
+            && fieldQuery->narrows(*previous.fieldQuery);
+    }
+    if (query.isEmpty() || regexMode != previous.regexMode
+        || caseSensitive != previous.caseSensitive || invert != previous.invert)
+        return false;
+    if (query == previous.query)
+        return true;
+    if (regexMode)
+        return false; // no containment order between patterns
+    // A line holding a needle holds every part of it: extending the needle
+    // narrows, and under invert shortening it does.
+    const QString& longer = invert ? previous.query : query;
+    const QString& shorter = invert ? query : previous.query;
+    // Folded ASCII needles fold only ASCII letters, others fold through
+    // QString (where U+212A KELVIN SIGN is a 'k'), so both must agree.
+    if (!caseSensitive && detail::isAsciiOnly(longer) != detail::isAsciiOnly(shorter))
+        return false;
+    return longer.contains(shorter, caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
+FilterResultCache::FilterResultCache(qsizetype maxBytes)
+    : m_entries(maxBytes)
+{
+}
+
+QString FilterResultCache::keyOf(const LineFilter& filter,
+                                 const TimeParseContext& timeContext)
+{
+    if (filter.isPassthrough()
+        || (filter.extraPredicate && filter.extraPredicateKey.isEmpty()))
+        return {};
+
+    // Length-prefixed fields: no query text can forge a separator.
+    QString key;
+    const auto field = [&key](QChar tag, const QString& value) {
+        key += tag;
+        key += QString::number(value.size());
+        key += u':';
+        key += value;
+    };
+    if (filter.fieldQuery) {
+        field(u'f', filter.fieldQuery->text().trimmed());
+        field(u'z', QString::fromLatin1(timeContext.assumedZone.id()));
+        field(u'y', QStringLiteral("%1/%2").arg(timeContext.referenceYear)
+                        .arg(timeContext.referenceMonth));
+    } else if (!filter.query.isEmpty()) {
+        field(filter.regexMode ? u'r' : u't', filter.query);
+    }
+    if (filter.fieldQuery || !filter.query.isEmpty()) {
+        key += filter.caseSensitive ? u'C' : u'c';
+        key += filter.invert ? u'I' : u'i';
+    }
+    field(u'b', QString::number(filter.contextBefore));
+    field(u'a', QString::number(filter.contextAfter));
+    if (filter.limit.count > 0)
+        field(filter.limit.fromEnd ? u'l' : u'h', QString::number(filter.limit.count));
+    if (filter.extraPredicate)
+        field(u'p', filter.extraPredicateKey);
+    return key;
+}
+
+const FilterScanResult* FilterResultCache::find(const QString& key)
+{
+    return key.isEmpty() ? nullptr : m_entries.object(key);
+}
+
+void FilterResultCache::insert(const QString& key, FilterScanResult result)
+{
+    if (key.isEmpty())
+        return;
+    const qsizetype cost = qsizetype(result.rows.memoryUsage())
+        + qsizetype(sizeof(FilterScanResult)) + key.size() * qsizetype(sizeof(QChar));
+    m_entries.insert(key, new FilterScanResult(std::move(result)), cost);
+}
+
 QFuture<FilterScanResult> scanFilter(std::shared_ptr<FileSource> source,
                                      std::shared_ptr<const LineIndex> index,
                                      LineFilter filter, qint64 linesPerChunk,
-                                     qint64 firstLine)
+                                     qint64 firstLine, qint64 publishIntervalMs,
+                                     qint64 focusLine,
+                                     std::shared_ptr<const TrigramIndex> trigrams)
 {
     Q_ASSERT(source && index);
     Q_ASSERT(linesPerChunk > 0);
@@ -93,8 +608,8 @@ QFuture<FilterScanResult> scanFilter(std::shared_ptr<FileSource> source,
                                       filter.fieldQuery->needsSeverity()));
 
     return QtConcurrent::run([source, index, filter = std::move(filter),
-                              linesPerChunk,
-                              firstLine](QPromise<FilterScanResult>& promise) {
+                              linesPerChunk, firstLine, publishIntervalMs, focusLine,
+                              trigrams](QPromise<FilterScanResult>& promise) {
         QElapsedTimer timer;
         timer.start();
         promise.setProgressRange(0, 1000);
@@ -114,45 +629,336 @@ QFuture<FilterScanResult> scanFilter(std::shared_ptr<FileSource> source,
                 result.rows = RowSet::fromLines(std::move(tail), total);
             }
             result.matchCount = total - first;
+            result.fileSize = index->fileSize();
             result.elapsedMs = timer.elapsed();
             promise.setProgressValue(1000);
             promise.addResult(std::move(result));
             return;
         }
 
+        const auto pass = source->sequentialScan();
         const Matcher matcher(filter.query, filter.caseSensitive,
                               filter.regexMode);
-        const int threads = qMax(1, QThread::idealThreadCount());
-        const qint64 superChunk = linesPerChunk * threads;
         std::vector<qint32> matches;
+        Publisher publisher(publishIntervalMs, filter, total, timer);
+        const auto lineChunks = prunedChunks(*index, trigrams.get(), matcher, filter,
+                                             first, total, linesPerChunk);
+        qint64 toDecide = 0;
+        for (const detail::LineChunk& c : lineChunks)
+            toDecide += c.end - c.first;
 
-        struct Range { qint64 first, end; };
-        for (qint64 base = first; base < total; base += superChunk) {
-            if (promise.isCanceled())
-                return;
-            const qint64 superEnd = std::min(total, base + superChunk);
-            QList<Range> ranges;
-            for (qint64 s = base; s < superEnd; s += linesPerChunk)
-                ranges.append({ s, std::min(superEnd, s + linesPerChunk) });
-
-            // blockingMapped also executes on this (calling) thread, so
-            // running it from inside a pool thread cannot deadlock the pool.
-            const auto chunkMatches = QtConcurrent::blockingMapped(ranges,
-                std::function<std::vector<qint32>(const Range&)>(
-                    [&](const Range& r) {
-                        return scanRange(*source, *index, matcher, filter,
-                                         r.first, r.end);
-                    }));
-            for (const auto& v : chunkMatches)
-                matches.insert(matches.end(), v.begin(), v.end());
-            promise.setProgressValue(
-                int((superEnd - first) * 1000 / (total - first)));
+        // Viewport-first (outward from the focus) and last-N (from the end)
+        // scans claim and merge chunks out of line order, keeping matches per
+        // chunk; the merged ones are always the contiguous run [lo, hi) of
+        // lineChunks.
+        const MatchLimit limit = filter.limit;
+        std::vector<size_t> order;
+        if (limit.count > 0 && limit.fromEnd) {
+            order.resize(lineChunks.size());
+            std::iota(order.rbegin(), order.rend(), size_t(0));
+        } else if (limit.count == 0 && focusLine >= first && focusLine < total) {
+            order = outwardOrder(lineChunks, focusLine);
         }
+        const bool focused = !order.empty();
+        std::vector<detail::LineChunk> chunks;
+        if (focused) {
+            chunks.reserve(order.size());
+            for (size_t i : order)
+                chunks.push_back(lineChunks[i]);
+        }
+        std::vector<std::vector<qint32>> byChunk(focused ? lineChunks.size() : 0);
+        size_t mergedCount = 0;
+        size_t lo = 0;
+        size_t hi = 0;
+        qint64 found = 0;
+        qint64 decided = 0;
+        // Set under the merge lock once the limit is met; workers stop
+        // claiming as they do on cancellation.
+        std::atomic<bool> enough = false;
+        const auto window = [&] {
+            std::vector<qint32> run;
+            run.reserve(size_t(found));
+            for (size_t i = lo; i < hi; ++i)
+                run.insert(run.end(), byChunk[i].begin(), byChunk[i].end());
+            return run;
+        };
+
+        const bool finished = detail::driveChunks<std::vector<qint32>>(
+            *source, *index, focused ? chunks : lineChunks,
+            QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                return scanRange(*source, *index, matcher, filter, c.first, c.end);
+            },
+            [&](std::vector<qint32>&& chunkMatches, const detail::LineChunk& c) {
+                if (enough.load(std::memory_order_relaxed))
+                    return; // chunks claimed before the limit was met
+                found += qint64(chunkMatches.size());
+                decided += c.end - c.first;
+                if (focused) {
+                    const size_t at = order[mergedCount++];
+                    byChunk[at] = std::move(chunkMatches);
+                    lo = mergedCount == 1 ? at : std::min(lo, at);
+                    hi = std::max(hi, at + 1);
+                } else {
+                    matches.insert(matches.end(), chunkMatches.begin(),
+                                   chunkMatches.end());
+                }
+                promise.setProgressValue(int(decided * 1000 / toDecide));
+                if (limit.count > 0 && found >= limit.count)
+                    enough.store(true, std::memory_order_relaxed);
+                // The last merge is the final result.
+                else if (decided < toDecide && publisher.due(found))
+                    publisher.publish(focused ? window() : matches, promise);
+            },
+            [&] {
+                return promise.isCanceled() || enough.load(std::memory_order_relaxed);
+            },
+            &result.stats);
+        if (!finished && !enough)
+            return;
+        if (focused)
+            matches = window();
+        applyLimit(matches, limit);
+
+        result.matchCount = qint64(matches.size());
+        result.rows = RowSet::fromLines(
+            expandContext(matches, filter.contextBefore, filter.contextAfter, total),
+            total);
+        result.fileSize = index->fileSize();
+        result.elapsedMs = timer.elapsed();
+        promise.setProgressValue(1000);
+        promise.addResult(std::move(result));
+    });
+}
+
+QFuture<FilterScanResult> refineFilter(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndex> index,
+                                       LineFilter filter, RowSet candidates,
+                                       qint64 linesPerChunk, qint64 publishIntervalMs)
+{
+    Q_ASSERT(source && index);
+    Q_ASSERT(linesPerChunk > 0);
+    Q_ASSERT(candidates.lineCount() == index->lineCount());
+    if (candidates.isAll() || filter.isPassthrough())
+        return scanFilter(std::move(source), std::move(index), std::move(filter),
+                          linesPerChunk, 0, publishIntervalMs);
+
+    return QtConcurrent::run([source, index, filter = std::move(filter),
+                              candidates = std::move(candidates), linesPerChunk,
+                              publishIntervalMs](QPromise<FilterScanResult>& promise) {
+        QElapsedTimer timer;
+        timer.start();
+        promise.setProgressRange(0, 1000);
+
+        const qint64 total = index->lineCount();
+        const qint64 rows = candidates.size();
+        FilterScanResult result;
+        const Matcher matcher(filter.query, filter.caseSensitive,
+                              filter.regexMode);
+        std::vector<qint32> matches;
+        Publisher publisher(publishIntervalMs, filter, total, timer);
+        const auto chunks = candidateChunks(*index, candidates, linesPerChunk);
+        const bool finished = detail::driveChunks<std::vector<qint32>>(
+            *source, *index, chunks, QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                return scanCandidates(*source, *index, matcher, filter, candidates,
+                                      candidates.rowForSourceLine(c.first),
+                                      candidates.rowForSourceLine(c.end - 1) + 1);
+            },
+            [&](std::vector<qint32>&& chunkMatches, const detail::LineChunk& c) {
+                matches.insert(matches.end(), chunkMatches.begin(),
+                               chunkMatches.end());
+                const qint64 rowsDone = candidates.rowForSourceLine(c.end - 1) + 1;
+                promise.setProgressValue(int(rowsDone * 1000 / rows));
+                if (rowsDone < rows && publisher.due(qint64(matches.size())))
+                    publisher.publish(matches, promise);
+            },
+            [&] { return promise.isCanceled(); }, &result.stats);
+        if (!finished)
+            return;
 
+        // Context is expanded afresh around the surviving matches; the
+        // previous result's context rows are only candidates.
+        applyLimit(matches, filter.limit);
         result.matchCount = qint64(matches.size());
         result.rows = RowSet::fromLines(
             expandContext(matches, filter.contextBefore, filter.contextAfter, total),
             total);
+        result.fileSize = index->fileSize();
+        result.elapsedMs = timer.elapsed();
+        promise.setProgressValue(1000);
+        promise.addResult(std::move(result));
+    });
+}
+
+QFuture<FilterCountResult> countFilter(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndex> index,
+                                       LineFilter filter, qint64 linesPerChunk,
+                                       int sampleChunks, qint64 publishIntervalMs)
+{
+    Q_ASSERT(source && index);
+    Q_ASSERT(linesPerChunk > 0);
+    Q_ASSERT(!filter.fieldQuery
+             || filter.columns.covers(filter.fieldQuery->referencedColumns(),
+                                      filter.fieldQuery->needsSeverity()));
+
+    return QtConcurrent::run([source, index, filter = std::move(filter), linesPerChunk,
+                              sampleChunks,
+                              publishIntervalMs](QPromise<FilterCountResult>& promise) {
+        QElapsedTimer timer;
+        timer.start();
+        promise.setProgressRange(0, 1000);
+
+        const qint64 total = index->lineCount();
+        FilterCountResult result;
+        if (filter.query.isEmpty() && !filter.fieldQuery && !filter.extraPredicate) {
+            result.matchCount = result.low = result.high = total;
+            result.elapsedMs = timer.elapsed();
+            promise.setProgressValue(1000);
+            promise.addResult(std::move(result));
+            return;
+        }
+
+        const Matcher matcher(filter.query, filter.caseSensitive,
+                              filter.regexMode);
+        const auto count = [&](const detail::LineChunk& c) {
+            return countRange(*source, *index, matcher, filter, c.first, c.end);
+        };
+        const auto cancelled = [&] { return promise.isCanceled(); };
+
+        // The sample first, while it is a small share of the file: an
+        // estimate a few hundred kilobytes of reads can give.
+        std::optional<SampleEstimate> sample;
+        const qint64 windowLines = std::min(linesPerChunk, kCountSampleLines);
+        if (sampleChunks > 0 && total > 4 * sampleChunks * windowLines) {
+            const auto windows = sampleWindows(*index, sampleChunks, windowLines);
+            std::vector<qint64> hits;
+            hits.reserve(windows.size());
+            if (!detail::driveChunks<qint64>(
+                    *source, *index, windows, QThread::idealThreadCount(), count,
+                    [&](qint64 n, const detail::LineChunk&) { hits.push_back(n); },
+                    cancelled))
+                return;
+            sample.emplace(windows, hits, total);
+            FilterCountResult estimate = sample->estimate(0, 0, total);
+            estimate.elapsedMs = timer.elapsed();
+            promise.addResult(std::move(estimate));
+        }
+
+        const auto pass = source->sequentialScan();
+        const auto chunks = detail::byteBalancedChunks(*index, 0, total, linesPerChunk);
+        qint64 found = 0;
+        qint64 decided = 0;
+        qint64 nextPublish = timer.elapsed() + publishIntervalMs;
+        const bool finished = detail::driveChunks<qint64>(
+            *source, *index, chunks, QThread::idealThreadCount(), count,
+            [&](qint64 n, const detail::LineChunk& c) {
+                found += n;
+                decided += c.end - c.first;
+                promise.setProgressValue(int(decided * 1000 / total));
+                if (sample && publishIntervalMs >= 0 && decided < total
+                    && timer.elapsed() >= nextPublish) {
+                    FilterCountResult estimate = sample->estimate(found, decided, total);
+                    estimate.elapsedMs = timer.elapsed();
+                    promise.addResult(std::move(estimate));
+                    nextPublish = timer.elapsed() + publishIntervalMs;
+                }
+            },
+            cancelled, &result.stats);
+        if (!finished)
+            return;
+
+        result.matchCount = result.low = result.high = found;
+        result.elapsedMs = timer.elapsed();
+        promise.setProgressValue(1000);
+        promise.addResult(std::move(result));
+    });
+}
+
+QFuture<FindResult> findMatch(std::shared_ptr<FileSource> source,
+                              std::shared_ptr<const LineIndex> index, LineFilter filter,
+                              RowSet within, qint64 fromLine, bool backward,
+                              qint64 linesPerChunk)
+{
+    Q_ASSERT(source && index);
+    Q_ASSERT(linesPerChunk > 0);
+    Q_ASSERT(within.lineCount() == index->lineCount());
+    Q_ASSERT(!filter.fieldQuery
+             || filter.columns.covers(filter.fieldQuery->referencedColumns(),
+                                      filter.fieldQuery->needsSeverity()));
+
+    return QtConcurrent::run([source, index, filter = std::move(filter),
+                              within = std::move(within), fromLine, backward,
+                              linesPerChunk](QPromise<FindResult>& promise) {
+        QElapsedTimer timer;
+        timer.start();
+        promise.setProgressRange(0, 1000);
+
+        const qint64 firstRow = backward ? 0 : rowsBefore(within, fromLine + 1);
+        const qint64 endRow = backward ? rowsBefore(within, fromLine) : within.size();
+        const Matcher matcher(filter.query, filter.caseSensitive,
+                              filter.regexMode);
+        const auto chunks = findChunks(*index, within, firstRow, endRow, backward,
+                                       linesPerChunk);
+        // Rows of a chunk: its lines when every line is searched.
+        const auto rowRange = [&](const detail::LineChunk& c) {
+            return within.isAll()
+                ? std::pair(c.first, c.end)
+                : std::pair(within.rowForSourceLine(c.first),
+                            within.rowForSourceLine(c.end - 1) + 1);
+        };
+
+        FindResult result;
+        // Set under the merge lock at the first chunk with a hit, the
+        // nearest one: chunks merge in search order. Workers stop claiming.
+        std::atomic<bool> found = false;
+        const bool finished = detail::driveChunks<qint64>(
+            *source, *index, chunks, QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                // The chunk's nearest match, -1 when none.
+                qint64 hit = -1;
+                if (within.isAll()) {
+                    visitRange(*source, *index, matcher, filter, c.first, c.end,
+                               [&](qint64 line) {
+                                   if (backward || hit < 0)
+                                       hit = line;
+                               });
+                    return hit;
+                }
+                QByteArray scratch;
+                const auto [first, end] = rowRange(c);
+                for (qint64 i = 0; i < end - first && hit < 0; ++i) {
+                    const qint64 line = within.sourceLine(backward ? end - 1 - i : first + i);
+                    const quint64 offset = index->offsetOf(line);
+                    const qsizetype length = index->lengthOf(line);
+                    QByteArrayView raw;
+                    if (source->isContiguous()) {
+                        raw = QByteArrayView(source->data() + offset, length);
+                    } else {
+                        scratch.resize(length);
+                        source->readInto(offset, scratch.data(), length);
+                        raw = scratch;
+                    }
+                    if (lineMatches(matcher, filter, line, raw))
+                        hit = line;
+                }
+                return hit;
+            },
+            [&](qint64 hit, const detail::LineChunk& c) {
+                if (found.load(std::memory_order_relaxed))
+                    return; // claimed before the hit was merged
+                const auto [first, end] = rowRange(c);
+                result.rowsSearched += end - first;
+                promise.setProgressValue(int(result.rowsSearched * 1000 / (endRow - firstRow)));
+                if (hit >= 0) {
+                    result.line = hit;
+                    found.store(true, std::memory_order_relaxed);
+                }
+            },
+            [&] { return promise.isCanceled() || found.load(std::memory_order_relaxed); });
+        if (!finished && !found)
+            return;
+
         result.elapsedMs = timer.elapsed();
         promise.setProgressValue(1000);
         promise.addResult(std::move(result));
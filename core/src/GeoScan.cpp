@@ -1,9 +1,10 @@
 #include "logdor/GeoScan.h"
 
+#include "ScanDriver_p.h"
+
 #include <QElapsedTimer>
 #include <QRegularExpression>
 #include <QThread>
-#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
 #include <algorithm>
@@ -177,31 +178,24 @@ QFuture<GeoScanResult> scanCoordinates(std::shared_ptr<FileSource> source,
         timer.start();
         promise.setProgressRange(0, 1000);
 
+        const auto pass = source->sequentialScan();
         const qint64 total = index->lineCount();
-        const int threads = qMax(1, QThread::idealThreadCount());
-        const qint64 superChunk = linesPerChunk * threads;
-
         GeoScanResult result;
-        struct Range { qint64 first, end; };
-        for (qint64 base = 0; base < total; base += superChunk) {
-            if (promise.isCanceled())
-                return;
-            const qint64 superEnd = std::min(total, base + superChunk);
-            QList<Range> ranges;
-            for (qint64 s = base; s < superEnd; s += linesPerChunk)
-                ranges.append({ s, std::min(superEnd, s + linesPerChunk) });
-
-            const auto chunkPoints = QtConcurrent::blockingMapped(ranges,
-                std::function<std::vector<GeoPoint>(const Range&)>(
-                    [&](const Range& r) {
-                        return scanRange(*source, *index, r.first, r.end,
-                                         promise);
-                    }));
-            for (const auto& v : chunkPoints)
-                result.points.insert(result.points.end(), v.begin(), v.end());
-            promise.setProgressValue(
-                int(superEnd * 1000 / std::max<qint64>(total, 1)));
-        }
+        const auto chunks = detail::byteBalancedChunks(*index, 0, total,
+                                                       linesPerChunk);
+        const bool finished = detail::driveChunks<std::vector<GeoPoint>>(
+            *source, *index, chunks, QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                return scanRange(*source, *index, c.first, c.end, promise);
+            },
+            [&](std::vector<GeoPoint>&& points, const detail::LineChunk& c) {
+                result.points.insert(result.points.end(), points.begin(),
+                                     points.end());
+                promise.setProgressValue(int(c.end * 1000 / std::max<qint64>(total, 1)));
+            },
+            [&] { return promise.isCanceled(); }, &result.stats);
+        if (!finished)
+            return;
 
         result.elapsedMs = timer.elapsed();
         promise.setProgressValue(1000);
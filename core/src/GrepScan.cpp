@@ -1,11 +1,14 @@
 #include "logdor/GrepScan.h"
 
 #include "logdor/FileSource.h"
+#include "logdor/LineIndexCache.h"
+#include "logdor/TrigramIndex.h"
 #include "TextMatch_p.h"
 
 #include <QtConcurrentRun>
 
 #include <cstring>
+#include <vector>
 
 namespace logdor {
 
@@ -14,11 +17,60 @@ using detail::Matcher;
 namespace {
 
 constexpr qsizetype kChunkBytes = 16 * 1024 * 1024;
+// Files at least this large are evicted from the page cache once grepped:
+// a folder sweep reads each byte once and should not displace the cache.
+// Pages the viewer still maps stay.
+constexpr quint64 kDropBehindBytes = 64 * 1024 * 1024;
+
+// Bytes [begin, end) of a file, starting at a line start, whose first
+// line is number firstLine.
+struct Span {
+    quint64 begin = 0;
+    quint64 end = 0;
+    qint32 firstLine = 0;
+};
+
+// The spans of @p source that may hold a match: the blocks @p trigrams
+// keeps for the needle, plus any growth past what it indexed. Adjacent
+// blocks merge into one span. Null index: the whole file.
+std::vector<Span> searchSpans(const FileSource& source, const TrigramIndex* trigrams,
+                              const Matcher& matcher)
+{
+    const quint64 size = source.size();
+    std::vector<bool> mask;
+    if (trigrams && matcher.searchesChunks() && trigrams->fileSize() <= size)
+        mask = trigrams->candidates(matcher.asciiNeedle);
+    if (mask.empty())
+        return { { 0, size, 0 } };
+
+    const qint64 blocks = trigrams->blockCount();
+    // An unterminated last line that grew is searched with its growth.
+    if (blocks > 0 && trigrams->coveredLines(size) < trigrams->lineCount())
+        mask[size_t(blocks - 1)] = true;
+    std::vector<Span> spans;
+    const auto add = [&spans](quint64 begin, quint64 end, qint64 firstLine) {
+        if (begin >= end)
+            return;
+        if (!spans.empty() && spans.back().end == begin)
+            spans.back().end = end;
+        else
+            spans.push_back({ begin, end, qint32(firstLine) });
+    };
+    for (qint64 b = 0; b < blocks; ++b) {
+        if (mask[size_t(b)]) {
+            add(trigrams->blockOffset(b),
+                b + 1 < blocks ? trigrams->blockOffset(b + 1) : trigrams->fileSize(),
+                b * trigrams->blockLines());
+        }
+    }
+    add(trigrams->fileSize(), size, trigrams->lineCount());
+    return spans;
+}
 
 // Walk one file's lines, appending matches. Returns false on cancel.
 bool grepFile(const FileSource& source, const Matcher& matcher,
-              const GrepQuery& query, GrepFileResult& result,
-              const QPromise<GrepFileResult>& promise)
+              const GrepQuery& query, const TrigramIndex* trigrams,
+              GrepFileResult& result, const QPromise<GrepFileResult>& promise)
 {
     QByteArray buffer;   // scratch for non-contiguous sources
     QByteArray carry;    // unterminated line spanning chunks
@@ -45,54 +97,75 @@ bool grepFile(const FileSource& source, const Matcher& matcher,
         ++lineNo;
         return true;
     };
+    const auto read = [&](quint64 pos, qsizetype len) -> QByteArrayView {
+        if (source.isContiguous())
+            return QByteArrayView(source.data() + pos, len);
+        buffer.resize(len);
+        len = source.readInto(pos, buffer.data(), len);
+        return QByteArrayView(buffer.constData(), qMax<qsizetype>(len, 0));
+    };
 
-    for (quint64 pos = 0; pos < size;) {
-        if (promise.isCanceled())
-            return false;
-        qsizetype len = qsizetype(qMin(quint64(kChunkBytes), size - pos));
-        const char* chunk = nullptr;
-        if (source.isContiguous()) {
-            chunk = source.data() + pos;
-        } else {
-            buffer.resize(len);
-            len = source.readInto(pos, buffer.data(), len);
-            if (len <= 0)
-                break;
-            chunk = buffer.constData();
-        }
-
-        if (pos == 0 && std::memchr(chunk, '\0', size_t(len))) {
+    const std::vector<Span> spans = searchSpans(source, trigrams, matcher);
+    const bool whole = spans.size() == 1 && spans.front().begin == 0
+        && spans.front().end == size;
+    if (size > 0 && !whole) {
+        // The binary check reads the first chunk even where no span does.
+        const QByteArrayView head = read(0, qsizetype(qMin(quint64(kChunkBytes), size)));
+        if (std::memchr(head.data(), '\0', size_t(head.size()))) {
             result.skippedBinary = true;
             return true;
         }
+    }
 
-        const char* p = chunk;
-        const char* const end = chunk + len;
-        while (p < end) {
-            const char* nl = static_cast<const char*>(
-                std::memchr(p, '\n', size_t(end - p)));
-            if (!nl) {
-                carry.append(p, end - p);
-                if (carry.size() == qsizetype(end - p))
-                    carryStart = pos + quint64(p - chunk);
+    for (const Span& span : spans) {
+        lineNo = span.firstLine;
+        for (quint64 pos = span.begin; pos < span.end;) {
+            if (promise.isCanceled())
+                return false;
+            const QByteArrayView bytes
+                = read(pos, qsizetype(qMin(quint64(kChunkBytes), span.end - pos)));
+            const qsizetype len = bytes.size();
+            if (len <= 0)
                 break;
+            const char* chunk = bytes.data();
+
+            if (pos == 0 && whole && std::memchr(chunk, '\0', size_t(len))) {
+                result.skippedBinary = true;
+                return true;
             }
-            if (!carry.isEmpty()) {
-                carry.append(p, nl - p);
-                if (!consider(QByteArrayView(carry), carryStart))
+
+            const char* p = chunk;
+            const char* const end = chunk + len;
+            while (p < end) {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(p, '\n', size_t(end - p)));
+                if (!nl) {
+                    carry.append(p, end - p);
+                    if (carry.size() == qsizetype(end - p))
+                        carryStart = pos + quint64(p - chunk);
+                    break;
+                }
+                if (!carry.isEmpty()) {
+                    carry.append(p, nl - p);
+                    if (!consider(QByteArrayView(carry), carryStart))
+                        return true;
+                    carry.clear();
+                } else if (!consider(
+                               QByteArrayView(p, qsizetype(nl - p)),
+                               pos + quint64(p - chunk))) {
                     return true;
-                carry.clear();
-            } else if (!consider(
-                           QByteArrayView(p, qsizetype(nl - p)),
-                           pos + quint64(p - chunk))) {
-                return true;
+                }
+                p = nl + 1;
             }
-            p = nl + 1;
+            pos += quint64(len);
+        }
+        // Spans end at a line start or the end of the file.
+        if (!carry.isEmpty()) {
+            if (!consider(QByteArrayView(carry), carryStart))
+                return true;
+            carry.clear();
         }
-        pos += quint64(len);
     }
-    if (!carry.isEmpty())
-        consider(QByteArrayView(carry), carryStart);
     return true;
 }
 
@@ -122,7 +195,14 @@ QFuture<GrepFileResult> grepFolder(QStringList files, GrepQuery query)
                 promise.addResult(std::move(result));
                 continue;
             }
-            if (!grepFile(*source, matcher, query, result, promise))
+            const auto pass = source->sequentialScan();
+            const auto trigrams = query.indexCache && matcher.searchesChunks()
+                ? TrigramIndex::lookup(*query.indexCache, *source) : nullptr;
+            const bool finished = grepFile(*source, matcher, query, trigrams.get(),
+                                           result, promise);
+            if (source->size() >= kDropBehindBytes)
+                source->dropPages(0, source->size());
+            if (!finished)
                 return; // cancelled mid-file
             if (!result.matches.isEmpty() || result.skippedBinary
                 || !result.error.isEmpty())
@@ -0,0 +1,390 @@
+#include "SeekIndex_p.h"
+
+#ifdef LOGDOR_HAVE_ZLIB
+
+#include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace logdor::detail {
+
+namespace {
+
+constexpr qsizetype kWindowSize = 32 * 1024; // deflate's maximum distance
+constexpr qsizetype kInputStep = 4 * 1024 * 1024;
+
+// Hands out the next piece of compressed input; empty at the end or after
+// a read error (reported through the source's own error string).
+using InputFn = std::function<QByteArrayView()>;
+
+struct PassOptions {
+    quint64 spacing = 0;
+    // Decompressed bytes still allowed on the heap across all passes of one
+    // build; a pass that cannot reserve its output stops keeping it and
+    // drives the budget negative so every other pass stops too.
+    std::atomic<qint64>* keepBudget = nullptr;
+    const std::function<bool()>* cancelled = nullptr;
+    const std::function<void(qint64)>* progress = nullptr; // serial only
+};
+
+// One checkpointing pass over the gzip data starting at compressed offset
+// @p start. Inflates to the end of the input, or with @p oneMember only the
+// member at @p start (@p memberEnd receives the offset past its trailer).
+// Checkpoint outs count from the pass's first output byte; an empty window
+// marks the start of a member. Returns false with @p error set, or empty
+// on cancellation.
+bool inflatePass(const InputFn& nextInput, quint64 start, bool oneMember,
+                 const PassOptions& options, QByteArray* head, bool* kept,
+                 SeekIndex* index, quint64* memberEnd, QString* error)
+{
+    index->size = 0;
+    index->points.assign(1, Checkpoint {});
+    index->points.front().in = start;
+    head->clear();
+    *kept = true;
+
+    z_stream stream = {};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) { // gzip or zlib wrapper
+        *error = QStringLiteral("zlib initialization failed");
+        return false;
+    }
+    const auto fail = [&stream, error](const QString& message) {
+        inflateEnd(&stream);
+        *error = message;
+        return false;
+    };
+    quint64 fed = start; // compressed offset just past the current input
+    const auto refill = [&] {
+        const QByteArrayView piece = nextInput();
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece.data()));
+        stream.avail_in = uInt(piece.size());
+        fed += quint64(piece.size());
+        if (options.progress && *options.progress)
+            (*options.progress)(qint64(fed));
+        return !piece.isEmpty();
+    };
+    const auto position = [&] { return fed - stream.avail_in; };
+
+    // Output goes round a 32 KiB ring, so the window a checkpoint needs is
+    // always at hand. Z_BLOCK stops inflate at every block boundary.
+    QByteArray ring(kWindowSize, Qt::Uninitialized);
+    qsizetype at = 0;
+    bool wrapped = false;
+    quint64 out = 0;
+    bool sawEnd = false;
+    for (;;) {
+        if (stream.avail_in == 0) {
+            if (*options.cancelled && (*options.cancelled)())
+                return fail(QString());
+            if (!refill())
+                break; // input exhausted
+        }
+        if (at == kWindowSize) {
+            at = 0;
+            wrapped = true;
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(ring.data() + at);
+        stream.avail_out = uInt(kWindowSize - at);
+        const int rc = inflate(&stream, Z_BLOCK);
+        if (rc != Z_OK && rc != Z_STREAM_END)
+            return fail(QStringLiteral("corrupt gzip stream"));
+        const qsizetype produced = kWindowSize - at - qsizetype(stream.avail_out);
+        if (*kept && options.keepBudget->fetch_sub(produced) >= produced) {
+            head->append(ring.constData() + at, produced);
+        } else if (*kept) {
+            *kept = false;
+            *head = QByteArray(); // too long to hold: frees the buffer
+            options.keepBudget->store(std::numeric_limits<qint64>::min() / 2);
+        }
+        at += produced;
+        out += quint64(produced);
+
+        if (rc == Z_STREAM_END) {
+            if (oneMember) {
+                sawEnd = true;
+                *memberEnd = position();
+                break;
+            }
+            if (stream.avail_in == 0 && !refill()) {
+                sawEnd = true;
+                break;
+            }
+            // Rotated logs are commonly concatenated members.
+            if (inflateReset2(&stream, 15 + 32) != Z_OK)
+                return fail(QStringLiteral("corrupt gzip stream"));
+            if (out - index->points.back().out >= options.spacing) {
+                Checkpoint point;
+                point.out = out;
+                point.in = position();
+                index->points.push_back(std::move(point));
+            }
+            continue;
+        }
+
+        // At the end of a block that is not the stream's last one (or just
+        // past a member header), inflation can resume from raw deflate given
+        // the pending bits and the preceding 32 KiB.
+        if ((stream.data_type & 128) && !(stream.data_type & 64)
+            && out - index->points.back().out >= options.spacing) {
+            Checkpoint point;
+            point.out = out;
+            point.in = position();
+            point.bits = stream.data_type & 7;
+            const QByteArray window = wrapped
+                ? ring.mid(at) + ring.left(at)
+                : QByteArray::fromRawData(ring.constData(), at);
+            point.window = qCompress(window, 1);
+            index->points.push_back(std::move(point));
+        }
+    }
+    inflateEnd(&stream);
+    if (!error->isEmpty())
+        return false; // the input reported a read failure
+    if (!sawEnd) {
+        *error = QStringLiteral("truncated gzip stream");
+        return false;
+    }
+    index->size = out;
+    return true;
+}
+
+// Offsets in @p data that open a plausible gzip member: magic, deflate,
+// no reserved flag bits, a known XFL. Compressed bytes forge this rarely,
+// and a forgery never joins the verified chain of member ends.
+std::vector<quint64> memberCandidates(QByteArrayView data)
+{
+    std::vector<quint64> starts;
+    const char* const begin = data.data();
+    const char* const end = begin + data.size();
+    for (const char* p = begin; end - p >= 10;) {
+        p = static_cast<const char*>(std::memchr(p, 0x1f, size_t(end - p - 9)));
+        if (!p)
+            break;
+        const auto byte = [p](int i) { return uchar(p[i]); };
+        if (byte(1) == 0x8b && byte(2) == 8 && (byte(3) & 0xe0) == 0
+            && (byte(8) == 0 || byte(8) == 2 || byte(8) == 4))
+            starts.push_back(quint64(p - begin));
+        ++p;
+    }
+    return starts;
+}
+
+// One member inflated by a parallel worker.
+struct MemberRun {
+    quint64 start = 0;
+    quint64 end = 0;
+    SeekIndex index;
+    QByteArray head;
+    bool kept = false;
+    bool ok = false;
+    QString error;
+};
+
+enum class ParallelOutcome { Done, Failed, Serial };
+
+// Parallel pass over a mapped gzip file: candidate members are inflated in
+// rounds on the pool, then chained in file order - each member must end
+// exactly where the next verified one starts. Anything the chain cannot
+// explain (a single member, trailing bytes, a zlib member) is left to the
+// serial pass.
+ParallelOutcome buildParallel(QByteArrayView data, const PassOptions& options,
+                              QByteArray* head, SeekIndex* index, QString* error)
+{
+    const std::vector<quint64> starts = memberCandidates(data);
+    const int threads = QThread::idealThreadCount();
+    if (starts.size() < 2 || starts.front() != 0 || threads < 2)
+        return ParallelOutcome::Serial;
+
+    index->size = 0;
+    index->points.clear();
+    std::vector<QByteArray> heads;
+    bool keptAll = true;
+    quint64 chain = 0; // compressed offset the next member must start at
+    size_t next = 0;   // first candidate not yet inflated
+    while (chain < quint64(data.size())) {
+        if (*options.cancelled && (*options.cancelled)()) {
+            error->clear();
+            return ParallelOutcome::Failed;
+        }
+        while (next < starts.size() && starts[next] < chain)
+            ++next; // inside a verified member: a forgery
+        if (next == starts.size() || starts[next] != chain)
+            return ParallelOutcome::Serial;
+        QList<MemberRun> round;
+        for (size_t i = next; i < starts.size() && round.size() < threads; ++i) {
+            MemberRun run;
+            run.start = starts[i];
+            round.append(std::move(run));
+        }
+        next += size_t(round.size());
+
+        // One member per worker; this open's own pool thread takes a
+        // member too (the driveChunks() caveat), so the round finishes
+        // even when every other pool thread is busy.
+        QtConcurrent::blockingMap(round, [&](MemberRun& run) {
+            quint64 fed = run.start;
+            const InputFn input = [&] {
+                const quint64 take = qMin<quint64>(kInputStep, quint64(data.size()) - fed);
+                const QByteArrayView piece = data.sliced(qsizetype(fed), qsizetype(take));
+                fed += take;
+                return piece;
+            };
+            PassOptions member = options;
+            member.progress = nullptr;
+            run.ok = inflatePass(input, run.start, true, member, &run.head, &run.kept,
+                                 &run.index, &run.end, &run.error);
+        });
+
+        for (MemberRun& run : round) {
+            if (run.start != chain)
+                continue; // a forgery, or beyond a member still to be verified
+            if (!run.ok) {
+                *error = run.error;
+                return ParallelOutcome::Failed;
+            }
+            // Member starts closer than the spacing to the last checkpoint
+            // add nothing but table entries (think bgzip's 64 KiB members).
+            for (Checkpoint& point : run.index.points) {
+                point.out += index->size;
+                if (!index->points.empty() && point.window.isEmpty()
+                    && point.out - index->points.back().out < options.spacing)
+                    continue;
+                index->points.push_back(std::move(point));
+            }
+            index->size += run.index.size;
+            keptAll = keptAll && run.kept;
+            if (keptAll)
+                heads.push_back(std::move(run.head));
+            chain = run.end;
+        }
+        if (*options.progress)
+            (*options.progress)(qint64(chain));
+    }
+
+    head->clear();
+    if (keptAll) {
+        head->reserve(qsizetype(index->size));
+        for (const QByteArray& part : heads)
+            head->append(part);
+    }
+    return ParallelOutcome::Done;
+}
+
+} // namespace
+
+bool buildGzipIndex(QFile& file, quint64 spacing, quint64 keepLimit,
+                    QByteArray* head, SeekIndex* index, QString* error,
+                    const PassCallbacks& callbacks)
+{
+    std::atomic<qint64> keepBudget { qint64(qMin<quint64>(keepLimit, quint64(
+        std::numeric_limits<qint64>::max()))) };
+    PassOptions options;
+    options.spacing = spacing;
+    options.keepBudget = &keepBudget;
+    options.cancelled = &callbacks.cancelled;
+    options.progress = &callbacks.progress;
+    error->clear();
+
+    // Multi-member files inflate member-parallel straight from a mapping.
+    if (uchar* map = file.size() > 0 ? file.map(0, file.size()) : nullptr) {
+        const ParallelOutcome outcome = buildParallel(
+            QByteArrayView(reinterpret_cast<const char*>(map), file.size()), options,
+            head, index, error);
+        file.unmap(map);
+        if (outcome != ParallelOutcome::Serial) {
+            index->points.shrink_to_fit();
+            return outcome == ParallelOutcome::Done;
+        }
+        keepBudget = qint64(qMin<quint64>(keepLimit, quint64(
+            std::numeric_limits<qint64>::max())));
+    }
+
+    if (!file.seek(0)) {
+        *error = QStringLiteral("seek failed: %1").arg(file.errorString());
+        return false;
+    }
+    QByteArray buffer(kInputStep, Qt::Uninitialized);
+    const InputFn input = [&]() -> QByteArrayView {
+        const qint64 got = file.read(buffer.data(), buffer.size());
+        if (got < 0) {
+            *error = QStringLiteral("read failed: %1").arg(file.errorString());
+            return {};
+        }
+        return QByteArrayView(buffer.constData(), got);
+    };
+    quint64 end = 0;
+    bool kept = false;
+    const bool ok = inflatePass(input, 0, false, options, head, &kept, index, &end,
+                                error);
+    index->points.shrink_to_fit();
+    return ok;
+}
+
+bool decodeGzipSpan(const SeekIndex& index, size_t span, QByteArrayView input,
+                    char* out)
+{
+    const Checkpoint& point = index.points[span];
+    // Member starts begin at a gzip header; every other span in raw
+    // deflate, which hands member trailers and headers back to us.
+    bool raw = !point.window.isEmpty();
+    z_stream stream = {};
+    if (inflateInit2(&stream, raw ? -15 : 15 + 32) != Z_OK)
+        return false;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = uInt(input.size());
+    if (raw) {
+        if (point.bits) {
+            if (stream.avail_in == 0) {
+                inflateEnd(&stream);
+                return false;
+            }
+            inflatePrime(&stream, point.bits, *stream.next_in >> (8 - point.bits));
+            ++stream.next_in;
+            --stream.avail_in;
+        }
+        const QByteArray window = qUncompress(point.window);
+        if (window.isEmpty()
+            || inflateSetDictionary(&stream,
+                                    reinterpret_cast<const Bytef*>(window.constData()),
+                                    uInt(window.size()))
+                != Z_OK) {
+            inflateEnd(&stream);
+            return false;
+        }
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(out);
+    stream.avail_out = uInt(index.spanEnd(span) - point.out);
+    while (stream.avail_out > 0) {
+        const int rc = inflate(&stream, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            if (raw) {
+                // Raw deflate leaves the member's CRC32 + ISIZE trailer.
+                if (stream.avail_in < 8)
+                    break;
+                stream.next_in += 8;
+                stream.avail_in -= 8;
+            }
+            if (stream.avail_in == 0 || inflateReset2(&stream, 15 + 32) != Z_OK)
+                break;
+            raw = false;
+            continue;
+        }
+        if (rc != Z_OK)
+            break;
+    }
+    const bool complete = stream.avail_out == 0;
+    inflateEnd(&stream);
+    return complete;
+}
+
+} // namespace logdor::detail
+
+#endif // LOGDOR_HAVE_ZLIB
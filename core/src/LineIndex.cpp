@@ -1,22 +1,145 @@
 #include "logdor/LineIndex.h"
 
+#include "logdor/FileSource.h"
+
+#include <cstring>
 #include <limits>
 
 namespace logdor {
 
+struct LineIndex::SparseState {
+    std::shared_ptr<const FileSource> source;
+};
+
+namespace {
+
+constexpr quint64 kSpanReadBytes = 64 * 1024; // non-contiguous sources
+
+// One thread's most recently decoded sparse span. It is keyed by the
+// SparseState's control block, which the weak_ptr keeps from being
+// recycled, so a destroyed index can never alias a live one.
+struct SpanCache {
+    std::weak_ptr<const void> owner;
+    qint64 span = -1;
+    std::vector<quint64> starts; // one per line of the span
+    std::vector<quint64> crlf;   // one bit per line of the span
+};
+
+thread_local SpanCache t_spanCache;
+
+template <typename Owner, typename Decode>
+const SpanCache& cachedSpan(const std::shared_ptr<Owner>& owner, qint64 span,
+                            int stride, Decode&& decode)
+{
+    SpanCache& cache = t_spanCache;
+    if (cache.span != span || cache.owner.owner_before(owner)
+        || owner.owner_before(cache.owner)) {
+        cache.starts.resize(size_t(stride));
+        cache.crlf.assign(size_t(stride + 63) / 64, 0);
+        decode(cache.starts.data(), cache.crlf.data());
+        cache.owner = owner;
+        cache.span = span;
+    }
+    return cache;
+}
+
+} // namespace
+
+struct LineIndex::Block {
+    quint32 delta[kBlockSize];
+    quint64 crlf[kBlockSize / 64];
+    std::unique_ptr<quint64[]> wide; // once an entry overflowed the delta
+};
+
+struct LineIndex::Page {
+    std::vector<BlockRef> refs;
+    std::vector<std::shared_ptr<Block>> blocks; // null for mapped blocks
+};
+
+// Copies share the block table; a builder's copy (snapshot()) clones the
+// tail it would otherwise keep writing underneath the copy.
+
+LineIndex::LineIndex(const LineIndex& other)
+    : m_pages(other.m_pages)
+    , m_image(other.m_image)
+    , m_sparse(other.m_sparse)
+    , m_count(other.m_count)
+    , m_entries(other.m_entries)
+    , m_lastStart(other.m_lastStart)
+    , m_fileSize(other.m_fileSize)
+    , m_stride(other.m_stride)
+    , m_wideMode(other.m_wideMode)
+    , m_lastLineTerminated(other.m_lastLineTerminated)
+    , m_finalized(other.m_finalized)
+{
+    if (!m_finalized)
+        cloneTail();
+    bindTail();
+}
+
+LineIndex::LineIndex(LineIndex&& other) noexcept
+    : m_pages(std::move(other.m_pages))
+    , m_image(std::move(other.m_image))
+    , m_sparse(std::move(other.m_sparse))
+    , m_count(other.m_count)
+    , m_entries(other.m_entries)
+    , m_lastStart(other.m_lastStart)
+    , m_fileSize(other.m_fileSize)
+    , m_stride(other.m_stride)
+    , m_wideMode(other.m_wideMode)
+    , m_lastLineTerminated(other.m_lastLineTerminated)
+    , m_finalized(other.m_finalized)
+{
+    bindTail();
+    other.bindTail();
+}
+
+LineIndex& LineIndex::operator=(const LineIndex& other)
+{
+    if (this != &other)
+        *this = LineIndex(other);
+    return *this;
+}
+
+LineIndex& LineIndex::operator=(LineIndex&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+    m_pages = std::move(other.m_pages);
+    m_image = std::move(other.m_image);
+    m_sparse = std::move(other.m_sparse);
+    m_count = other.m_count;
+    m_entries = other.m_entries;
+    m_lastStart = other.m_lastStart;
+    m_fileSize = other.m_fileSize;
+    m_stride = other.m_stride;
+    m_wideMode = other.m_wideMode;
+    m_lastLineTerminated = other.m_lastLineTerminated;
+    m_finalized = other.m_finalized;
+    bindTail();
+    other.bindTail();
+    return *this;
+}
+
+void LineIndex::setSparse(int stride, std::shared_ptr<const FileSource> source)
+{
+    Q_ASSERT(!m_finalized);
+    Q_ASSERT(stride <= kMaxSparseStride);
+    Q_ASSERT(m_count == 0 || stride == m_stride);
+    if (stride <= 1)
+        return;
+    Q_ASSERT(source);
+    m_stride = stride;
+    m_sparse = std::make_shared<const SparseState>(SparseState{ std::move(source) });
+}
+
 void LineIndex::reserveLines(qint64 approx)
 {
     if (approx <= 0)
         return;
-    // +1: addTerminator provisionally starts a next line that finalize()
-    // may pop again; without headroom that one push doubles the capacity.
-    if (m_wideMode) {
-        m_wide.reserve(size_t(approx) + 1);
-    } else {
-        m_delta.reserve(size_t(approx) + 1);
-        m_blockBase.reserve(size_t((approx >> kBlockShift) + 2));
-    }
-    m_crlf.reserve(size_t(approx) + 1);
+    // Blocks are fixed-size; only the page directory grows.
+    const qint64 entries = approx / m_stride + 1;
+    m_pages.reserve(size_t(entries >> kPageShift) + 1);
 }
 
 void LineIndex::addTerminator(quint64 newlinePos, bool precededByCr)
@@ -25,17 +148,39 @@ void LineIndex::addTerminator(quint64 newlinePos, bool precededByCr)
     if (m_count == 0)
         appendStart(0);
 
-    // The terminator belongs to the current last line.
-    const size_t terminated = size_t(m_count - 1);
-    if (m_crlf.size() <= terminated)
-        m_crlf.resize(terminated + 1, false);
-    m_crlf[terminated] = precededByCr;
+    // The terminator belongs to the current last line. Sparse indexes read
+    // CRLF back from the bytes instead.
+    if (m_stride == 1)
+        setCrlf(m_count - 1, precededByCr);
 
     // Provisionally start the next line; finalize() drops it if the file
     // ends exactly here (a trailing '\n' creates no empty final line).
     appendStart(newlinePos + 1);
 }
 
+void LineIndex::addTerminators(const quint64* terminators, qsizetype count)
+{
+    Q_ASSERT(!m_finalized);
+    if (count <= 0)
+        return;
+    if (m_count == 0)
+        appendStart(0);
+
+    if (m_stride > 1) {
+        for (qsizetype i = 0; i < count; ++i)
+            appendStart((terminators[i] & ~kPrecededByCr) + 1);
+        return;
+    }
+
+    // Each terminator ends the current last line, which sits in the tail
+    // block.
+    for (qsizetype i = 0; i < count; ++i) {
+        const quint64 t = terminators[i];
+        setCrlf(m_count - 1, (t & kPrecededByCr) != 0);
+        appendStart((t & ~kPrecededByCr) + 1);
+    }
+}
+
 void LineIndex::finalize(quint64 fileSizeBytes)
 {
     Q_ASSERT(!m_finalized);
@@ -46,7 +191,7 @@ void LineIndex::finalize(quint64 fileSizeBytes)
         if (fileSizeBytes > 0)
             appendStart(0);
         m_lastLineTerminated = false;
-    } else if (offsetOf(m_count - 1) == fileSizeBytes) {
+    } else if (m_lastStart == fileSizeBytes) {
         // Provisional line after the final '\n' is phantom; the real last
         // line was terminated.
         popLastStart();
@@ -55,19 +200,33 @@ void LineIndex::finalize(quint64 fileSizeBytes)
         m_lastLineTerminated = false;
     }
 
-    // Immutable from here on: drop growth slack (an unhinted build can carry
-    // up to 2x capacity from geometric growth).
-    m_crlf.resize(size_t(m_count), false);
-    m_crlf.shrink_to_fit();
-    m_blockBase.shrink_to_fit();
-    m_delta.shrink_to_fit();
-    m_wide.shrink_to_fit();
+    // Immutable from here on: the tail may now be shared by copies.
+    m_pages.shrink_to_fit();
+    m_tail = nullptr;
+    m_tailRef = nullptr;
+    if (m_sparse) // new content, new span-cache identity
+        m_sparse = std::make_shared<const SparseState>(*m_sparse);
     m_finalized = true;
 }
 
+LineIndex LineIndex::snapshot() const
+{
+    Q_ASSERT(!m_finalized);
+    LineIndex copy = *this;
+    // Ending the copy where the provisional line starts makes that line
+    // the phantom finalize() drops: the snapshot stops at its last '\n'
+    // (and is empty before the first one).
+    copy.finalize(m_lastStart);
+    return copy;
+}
+
 LineIndex LineIndex::resumedFrom(const LineIndex& index)
 {
     LineIndex resumed = index;
+    resumed.cloneTail();
+    resumed.bindTail();
+    if (resumed.m_sparse) // spans decoded from the copy must not alias
+        resumed.m_sparse = std::make_shared<const SparseState>(*resumed.m_sparse);
     resumed.m_finalized = false;
     if (resumed.m_lastLineTerminated) {
         // finalize() popped the provisional start after the final '\n';
@@ -80,60 +239,255 @@ LineIndex LineIndex::resumedFrom(const LineIndex& index)
 
 void LineIndex::appendStart(quint64 offset)
 {
-    if (m_wideMode) {
-        m_wide.push_back(offset);
-        ++m_count;
-        return;
-    }
-    if ((m_count & kBlockMask) == 0) {
-        m_blockBase.push_back(offset);
-        m_delta.push_back(0);
-        ++m_count;
-        return;
-    }
-    const quint64 delta = offset - m_blockBase.back();
-    if (delta > std::numeric_limits<quint32>::max()) {
-        migrateToWide();
-        m_wide.push_back(offset);
-        ++m_count;
-        return;
-    }
-    m_delta.push_back(quint32(delta));
+    m_lastStart = offset;
+    if (m_stride == 1 || m_count % m_stride == 0)
+        pushEntry(offset);
     ++m_count;
 }
 
+void LineIndex::pushEntry(quint64 offset)
+{
+    const size_t at = size_t(m_entries & kBlockMask);
+    if (at == 0)
+        startBlock(offset);
+    if (m_tailRef->delta) {
+        const quint64 delta = offset - m_tailRef->base;
+        if (delta <= std::numeric_limits<quint32>::max()) {
+            m_tail->delta[at] = quint32(delta);
+            ++m_entries;
+            return;
+        }
+        widenTail();
+    }
+    m_tail->wide[at] = offset;
+    ++m_entries;
+}
+
 void LineIndex::popLastStart()
 {
     Q_ASSERT(m_count > 0);
     --m_count;
-    if (m_wideMode) {
-        m_wide.pop_back();
+    if (m_stride > 1 && m_count % m_stride != 0)
+        return; // not a checkpoint
+    --m_entries;
+    if ((m_entries & kBlockMask) != 0)
         return;
-    }
-    m_delta.pop_back();
-    if ((m_count & kBlockMask) == 0)
-        m_blockBase.pop_back();
+    // The popped entry opened the tail block: drop the block (and its page
+    // when that empties too).
+    Page& page = *m_pages.back().page;
+    page.refs.pop_back();
+    page.blocks.pop_back();
+    if (page.refs.empty())
+        m_pages.pop_back();
+    bindTail();
+}
+
+void LineIndex::startBlock(quint64 base)
+{
+    if (m_pages.empty() || m_pages.back().page->refs.size() == kPageBlocks)
+        m_pages.push_back({ nullptr, std::make_shared<Page>() });
+    Page& page = *m_pages.back().page;
+    auto block = std::make_shared<Block>();
+    page.refs.push_back({ base, block->delta, nullptr, block->crlf });
+    page.blocks.push_back(std::move(block));
+    bindTail(); // refs may have reallocated
 }
 
-void LineIndex::migrateToWide()
+void LineIndex::widenTail()
 {
-    m_wide.reserve(size_t(m_count) + 1);
-    for (qint64 i = 0; i < m_count; ++i)
-        m_wide.push_back(m_blockBase[size_t(i >> kBlockShift)]
-                         + m_delta[size_t(i)]);
-    m_blockBase.clear();
-    m_blockBase.shrink_to_fit();
-    m_delta.clear();
-    m_delta.shrink_to_fit();
+    const size_t used = size_t(m_entries & kBlockMask);
+    m_tail->wide = std::make_unique<quint64[]>(size_t(kBlockSize));
+    for (size_t i = 0; i < used; ++i)
+        m_tail->wide[i] = m_tailRef->base + m_tail->delta[i];
+    m_tailRef->delta = nullptr;
+    m_tailRef->wide = m_tail->wide.get();
     m_wideMode = true;
 }
 
+void LineIndex::setCrlf(qint64 line, bool crlf)
+{
+    const qint64 at = line & kBlockMask;
+    quint64& word = m_tail->crlf[at >> 6];
+    const quint64 bit = quint64(1) << (at & 63);
+    word = crlf ? word | bit : word & ~bit;
+}
+
+// Give this index its own copy of the last page and last block - the only
+// parts a builder writes - leaving every other block shared. A mapped tail
+// block lands on the heap.
+void LineIndex::cloneTail()
+{
+    if (m_pages.empty())
+        return;
+    PageSlot& slot = m_pages.back();
+    slot.page = std::make_shared<Page>(*slot.page);
+    BlockRef& ref = slot.page->refs.back();
+    const size_t used = size_t((m_entries - 1) & kBlockMask) + 1;
+    auto block = std::make_shared<Block>();
+    if (ref.delta) {
+        std::memcpy(block->delta, ref.delta, used * sizeof(quint32));
+    } else {
+        block->wide = std::make_unique<quint64[]>(size_t(kBlockSize));
+        std::memcpy(block->wide.get(), ref.wide, used * sizeof(quint64));
+    }
+    std::memcpy(block->crlf, ref.crlf, (used + 63) / 64 * sizeof(quint64));
+    ref = { ref.base, ref.delta ? block->delta : nullptr, block->wide.get(),
+            block->crlf };
+    slot.page->blocks.back() = std::move(block);
+}
+
+void LineIndex::bindTail() noexcept
+{
+    m_tail = nullptr;
+    m_tailRef = nullptr;
+    if (m_pages.empty())
+        return;
+    PageSlot& slot = m_pages.back();
+    slot.refs = slot.page->refs.data();
+    m_tailRef = &slot.page->refs.back();
+    m_tail = slot.page->blocks.back().get();
+}
+
+// Point the block table at a mapped image's contiguous arrays (narrow:
+// @p base and @p delta; wide: @p wide). The caller keeps the image alive
+// through m_image.
+void LineIndex::mapArrays(const quint64* base, const quint32* delta,
+                          const quint64* wide, const quint64* crlf,
+                          qint64 entries)
+{
+    Q_ASSERT(m_pages.empty());
+    const size_t blocks = size_t((entries + kBlockMask) >> kBlockShift);
+    m_pages.reserve((blocks + kPageBlocks - 1) / kPageBlocks);
+    for (size_t b = 0; b < blocks; ++b) {
+        if (b % kPageBlocks == 0) {
+            auto page = std::make_shared<Page>();
+            const size_t n = qMin(kPageBlocks, blocks - b);
+            page->refs.reserve(n);
+            page->blocks.resize(n);
+            m_pages.push_back({ nullptr, std::move(page) });
+        }
+        const size_t first = b << kBlockShift;
+        const BlockRef ref = wide
+            ? BlockRef{ wide[first], nullptr, wide + first, crlf + first / 64 }
+            : BlockRef{ base[b], delta + first, nullptr, crlf + first / 64 };
+        m_pages.back().page->refs.push_back(ref);
+    }
+    for (PageSlot& slot : m_pages)
+        slot.refs = slot.page->refs.data();
+    m_entries = entries;
+    m_wideMode = wide != nullptr;
+}
+
+quint64 LineIndex::sparseOffsetOf(qint64 line) const noexcept
+{
+    const qint64 span = line / m_stride;
+    const qint64 at = line - span * m_stride;
+    if (at == 0)
+        return entryOffset(span); // checkpoints need no scan
+    const SpanCache& cache = cachedSpan(m_sparse, span, m_stride,
+        [&](quint64* starts, quint64* crlf) { decodeSpan(span, starts, crlf); });
+    return cache.starts[size_t(at)];
+}
+
+bool LineIndex::sparseEndsWithCrLf(qint64 line) const noexcept
+{
+    const qint64 span = line / m_stride;
+    const qint64 at = line - span * m_stride;
+    const SpanCache& cache = cachedSpan(m_sparse, span, m_stride,
+        [&](quint64* starts, quint64* crlf) { decodeSpan(span, starts, crlf); });
+    return (cache.crlf[size_t(at) >> 6] >> (at & 63)) & 1;
+}
+
+// Scan the bytes from checkpoint @p span to the next one (or EOF) for the
+// span's line starts and CRLF bits. @p crlfWords must arrive zeroed.
+void LineIndex::decodeSpan(qint64 span, quint64* starts, quint64* crlfWords) const
+{
+    const qint64 lines = qMin<qint64>(m_stride, m_count - span * m_stride);
+    const quint64 begin = entryOffset(span);
+    const quint64 end = span + 1 < m_entries ? entryOffset(span + 1) : m_fileSize;
+    starts[0] = begin;
+
+    qint64 found = 0; // terminators seen; line `found` is being scanned
+    char prev = '\0';
+    const auto scan = [&](const char* data, qsizetype len, quint64 base) {
+        const char* p = data;
+        const char* const stop = data + len;
+        while (found < lines
+               && (p = static_cast<const char*>(
+                       std::memchr(p, '\n', size_t(stop - p))))) {
+            const quint64 pos = base + quint64(p - data);
+            const char before = p > data ? p[-1] : prev;
+            if (pos > starts[found] && before == '\r')
+                crlfWords[found >> 6] |= quint64(1) << (found & 63);
+            if (++found < lines)
+                starts[found] = pos + 1;
+            ++p;
+        }
+        if (len > 0)
+            prev = data[len - 1];
+    };
+
+    const FileSource& source = *m_sparse->source;
+    if (source.isContiguous()) {
+        scan(source.data() + begin, qsizetype(end - begin), begin);
+    } else {
+        std::vector<char> buffer(size_t(qMin(end - begin, kSpanReadBytes)));
+        for (quint64 pos = begin; pos < end && found < lines;) {
+            const qsizetype got = source.readInto(
+                pos, buffer.data(), qsizetype(qMin(end - pos, quint64(buffer.size()))));
+            if (got <= 0)
+                break;
+            scan(buffer.data(), got, pos);
+            pos += quint64(got);
+        }
+    }
+    // The bytes changed underneath us: stay monotonic rather than garbage.
+    for (qint64 k = found + 1; k < lines; ++k)
+        starts[k] = end;
+}
+
+qint64 LineIndex::lineAt(quint64 offset) const noexcept
+{
+    if (m_count == 0)
+        return -1;
+    // Last stored start <= offset; entry 0 starts the file.
+    qint64 lo = 0;
+    qint64 hi = m_entries - 1;
+    while (lo < hi) {
+        const qint64 mid = lo + (hi - lo + 1) / 2;
+        if (entryOffset(mid) <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (m_stride == 1)
+        return lo;
+
+    // Sparse: the same search among the lines of checkpoint lo's span.
+    qint64 first = lo * m_stride;
+    qint64 last = qMin(first + m_stride, m_count) - 1;
+    while (first < last) {
+        const qint64 mid = first + (last - first + 1) / 2;
+        if (sparseOffsetOf(mid) <= offset)
+            first = mid;
+        else
+            last = mid - 1;
+    }
+    return first;
+}
+
 size_t LineIndex::memoryUsage() const noexcept
 {
-    return m_blockBase.capacity() * sizeof(quint64)
-        + m_delta.capacity() * sizeof(quint32)
-        + m_wide.capacity() * sizeof(quint64)
-        + m_crlf.capacity() / 8;
+    size_t total = m_pages.capacity() * sizeof(PageSlot);
+    for (const PageSlot& slot : m_pages) {
+        total += sizeof(Page) + slot.page->refs.capacity() * sizeof(BlockRef)
+            + slot.page->blocks.capacity() * sizeof(std::shared_ptr<Block>);
+        for (const auto& block : slot.page->blocks) {
+            if (block)
+                total += sizeof(Block) + (block->wide ? kBlockSize * sizeof(quint64) : 0);
+        }
+    }
+    return total;
 }
 
 } // namespace logdor
@@ -0,0 +1,332 @@
+#include "logdor/LineIndexCache.h"
+
+#include "logdor/FileSource.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <cstring>
+#include <vector>
+
+namespace logdor {
+
+namespace {
+
+constexpr char kMagic[8] = { 'L', 'O', 'G', 'D', 'O', 'R', 'I', 'X' };
+constexpr quint32 kVersion = 1;
+constexpr quint32 kByteOrderMark = 0x01020304; // rejects foreign-endian files
+constexpr quint32 kFlagWide = 1;
+constexpr quint32 kFlagLastLineTerminated = 2;
+constexpr quint64 kTailBytes = 4096;
+
+// Fixed-size file header; the arrays follow, each 8-byte aligned so the
+// mapping can be read in place.
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint64 lineCount;
+    quint64 fileSize;      // indexed bytes of the log
+    qint64 mtimeMs;        // log mtime when stored
+    quint32 flags;
+    quint32 prefixLength;  // FileIdentity
+    char prefixSha256[64]; // FileIdentity, hex
+    char tailSha256[32];   // raw SHA-256 of the last indexed <= 4 KiB
+};
+static_assert(sizeof(Header) == 144 && sizeof(Header) % 8 == 0);
+
+// Byte offsets of the arrays after the header.
+struct Layout {
+    quint64 blockBase = 0; // narrow mode
+    quint64 delta = 0;     // narrow mode
+    quint64 wide = 0;      // wide mode
+    quint64 crlf = 0;
+    quint64 crlfWords = 0;
+    quint64 total = 0;
+};
+
+Layout layoutFor(quint64 lines, bool wide)
+{
+    Layout layout;
+    quint64 at = sizeof(Header);
+    if (wide) {
+        layout.wide = at;
+        at += lines * sizeof(quint64);
+    } else {
+        const quint64 blocks
+            = (lines + quint64(LineIndex::kBlockMask)) >> LineIndex::kBlockShift;
+        layout.blockBase = at;
+        at += blocks * sizeof(quint64);
+        layout.delta = at;
+        at += (lines * sizeof(quint32) + 7) & ~quint64(7);
+    }
+    layout.crlf = at;
+    layout.crlfWords = (lines + 63) / 64;
+    layout.total = at + layout.crlfWords * sizeof(quint64);
+    return layout;
+}
+
+QByteArray tailHash(const FileSource& source, quint64 end)
+{
+    const quint64 length = qMin(end, kTailBytes);
+    return QCryptographicHash::hash(source.read(end - length, qsizetype(length)),
+                                    QCryptographicHash::Sha256);
+}
+
+qint64 mtimeMs(const FileSource& source)
+{
+    return QFileInfo(source.filePath()).lastModified().toMSecsSinceEpoch();
+}
+
+QString fileKey(const QString& logPath)
+{
+    const QByteArray key = QCryptographicHash::hash(
+        QFileInfo(logPath).absoluteFilePath().toUtf8(), QCryptographicHash::Sha256);
+    return QString::fromLatin1(key.toHex().left(32));
+}
+
+// Line indexes, FileSource's compressed-file checkpoints, trigram indexes.
+QStringList cacheFilePatterns()
+{
+    return { QStringLiteral("*.lidx"), QStringLiteral("*.ckpt"),
+             QStringLiteral("*.tgm") };
+}
+
+// Whether the mapped arrays of @p data describe lines of a
+// header.fileSize-byte file: starts from 0, each after the one before
+// (every line holds at least its terminator), the last inside the file,
+// and no "\r\n" flag on a line too short to hold the '\r'. The identity
+// checks vouch for the log, not for these bytes, and a bad offset would
+// send a reader past the log's mapping.
+bool arraysValid(const uchar* data, const Layout& layout, const Header& header, bool wide)
+{
+    const quint64 lines = header.lineCount;
+    const auto* base = reinterpret_cast<const quint64*>(data + layout.blockBase);
+    const auto* delta = reinterpret_cast<const quint32*>(data + layout.delta);
+    const auto* wideStarts = reinterpret_cast<const quint64*>(data + layout.wide);
+    const auto* crlf = reinterpret_cast<const quint64*>(data + layout.crlf);
+    const auto startOf = [&](quint64 line) {
+        return wide ? wideStarts[line] : base[line >> LineIndex::kBlockShift] + delta[line];
+    };
+    const auto crlfAt = [crlf](quint64 line) { return (crlf[line >> 6] >> (line & 63)) & 1; };
+
+    quint64 previous = 0;
+    for (quint64 line = 0; line < lines; ++line) {
+        const quint64 start = startOf(line);
+        if (line == 0 ? start != 0 : start <= previous || start >= header.fileSize)
+            return false;
+        if (line > 0 && crlfAt(line - 1) && start - previous < 2)
+            return false;
+        previous = start;
+    }
+    const quint64 terminator = header.flags & kFlagLastLineTerminated ? 1 : 0;
+    return lines == 0
+        || (!crlfAt(lines - 1) || header.fileSize - previous >= terminator + 1);
+}
+
+// Keeps a cache file mapped for as long as an index reads from it.
+struct MappedImage {
+    QFile file;
+    uchar* data = nullptr;
+
+    ~MappedImage()
+    {
+        if (data)
+            file.unmap(data);
+    }
+};
+
+} // namespace
+
+LineIndexCache::LineIndexCache(const QString& directory, quint64 maxBytes,
+                               quint64 minFileSize)
+    : m_directory(directory)
+    , m_maxBytes(maxBytes)
+    , m_minFileSize(minFileSize)
+{
+}
+
+QString LineIndexCache::cacheFilePath(const QString& logPath) const
+{
+    return m_directory + QLatin1Char('/') + fileKey(logPath) + QStringLiteral(".lidx");
+}
+
+QString LineIndexCache::checkpointFilePath(const QString& logPath) const
+{
+    return m_directory + QLatin1Char('/') + fileKey(logPath) + QStringLiteral(".ckpt");
+}
+
+QString LineIndexCache::trigramFilePath(const QString& logPath) const
+{
+    return m_directory + QLatin1Char('/') + fileKey(logPath) + QStringLiteral(".tgm");
+}
+
+LineIndexCache::Entry LineIndexCache::lookup(const FileSource& source) const
+{
+    Entry entry;
+    auto image = std::make_shared<MappedImage>();
+    image->file.setFileName(cacheFilePath(source.filePath()));
+    if (!image->file.open(QIODevice::ReadOnly))
+        return entry;
+
+    Header header;
+    if (image->file.read(reinterpret_cast<char*>(&header), sizeof header)
+            != qint64(sizeof header)
+        || std::memcmp(header.magic, kMagic, sizeof kMagic) != 0
+        || header.version != kVersion || header.byteOrder != kByteOrderMark
+        || header.lineCount > header.fileSize) // every line holds >= 1 byte
+        return entry;
+    const bool wide = header.flags & kFlagWide;
+    const Layout layout = layoutFor(header.lineCount, wide);
+    if (layout.total != quint64(image->file.size()))
+        return entry; // truncated or foreign
+
+    FileIdentity identity;
+    identity.size = header.fileSize;
+    identity.prefixLength = header.prefixLength;
+    identity.prefixSha256 = QByteArray(header.prefixSha256, sizeof header.prefixSha256);
+    const IdentityMatch match = matchIdentity(identity, source);
+    if (match == IdentityMatch::Mismatch
+        || (match == IdentityMatch::Identical && header.mtimeMs != mtimeMs(source))
+        || tailHash(source, header.fileSize)
+            != QByteArray::fromRawData(header.tailSha256, sizeof header.tailSha256))
+        return entry;
+
+    image->data = image->file.map(0, image->file.size());
+    if (!image->data || !arraysValid(image->data, layout, header, wide))
+        return entry;
+
+    auto index = std::make_shared<LineIndex>();
+    const uchar* data = image->data;
+    const auto* crlf = reinterpret_cast<const quint64*>(data + layout.crlf);
+    if (wide) {
+        index->mapArrays(nullptr, nullptr,
+                         reinterpret_cast<const quint64*>(data + layout.wide), crlf,
+                         qint64(header.lineCount));
+    } else {
+        index->mapArrays(reinterpret_cast<const quint64*>(data + layout.blockBase),
+                         reinterpret_cast<const quint32*>(data + layout.delta),
+                         nullptr, crlf, qint64(header.lineCount));
+    }
+    index->m_count = qint64(header.lineCount);
+    index->m_fileSize = header.fileSize;
+    index->m_lastLineTerminated = header.flags & kFlagLastLineTerminated;
+    index->m_finalized = true;
+    index->m_image = std::move(image);
+    if (header.lineCount > 0)
+        index->m_lastStart = index->offsetOf(index->m_count - 1);
+
+    // A hit is a use: refresh the mtime that evict() orders by.
+    QFile touch(cacheFilePath(source.filePath()));
+    if (touch.open(QIODevice::ReadWrite))
+        touch.setFileTime(QDateTime::currentDateTimeUtc(),
+                          QFileDevice::FileModificationTime);
+
+    entry.index = std::move(index);
+    entry.match = match;
+    return entry;
+}
+
+bool LineIndexCache::store(const FileSource& source, const LineIndex& index) const
+{
+    const quint64 size = index.fileSize();
+    if (size < m_minFileSize || size > source.size() || index.isSparse())
+        return false;
+    const FileIdentity identity = computeFileIdentity(source);
+    if (size < identity.prefixLength
+        || identity.prefixSha256.size() != qsizetype(sizeof Header::prefixSha256))
+        return false; // the identity prefix must lie inside the indexed range
+
+    Header header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.version = kVersion;
+    header.byteOrder = kByteOrderMark;
+    header.lineCount = quint64(index.lineCount());
+    header.fileSize = size;
+    header.mtimeMs = mtimeMs(source);
+    header.flags = (index.isWide() ? kFlagWide : 0)
+        | (index.lastLineTerminated() ? kFlagLastLineTerminated : 0);
+    header.prefixLength = identity.prefixLength;
+    std::memcpy(header.prefixSha256, identity.prefixSha256.constData(),
+                sizeof header.prefixSha256);
+    const QByteArray tail = tailHash(source, size);
+    std::memcpy(header.tailSha256, tail.constData(), sizeof header.tailSha256);
+
+    const Layout layout = layoutFor(header.lineCount, index.isWide());
+
+    if (!QDir().mkpath(m_directory))
+        return false;
+    QSaveFile out(cacheFilePath(source.filePath()));
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    const auto write = [&out](const void* bytes, quint64 length) {
+        return out.write(static_cast<const char*>(bytes), qint64(length))
+            == qint64(length);
+    };
+    // The arrays are written block by block from the index's block table:
+    // entries [first, first + used) of each block.
+    const qint64 lines = index.lineCount();
+    const auto used = [lines](qint64 first) {
+        return quint64(qMin(LineIndex::kBlockSize, lines - first));
+    };
+    bool ok = write(&header, sizeof header);
+    if (index.isWide()) {
+        // Wide if any block is: narrow blocks are widened on the way out.
+        std::vector<quint64> offsets(size_t(LineIndex::kBlockSize));
+        for (qint64 first = 0; ok && first < lines; first += LineIndex::kBlockSize) {
+            for (quint64 i = 0; i < used(first); ++i)
+                offsets[i] = index.entryOffset(first + qint64(i));
+            ok = write(offsets.data(), used(first) * sizeof(quint64));
+        }
+    } else {
+        std::vector<quint64> bases;
+        for (qint64 first = 0; first < lines; first += LineIndex::kBlockSize)
+            bases.push_back(index.blockOf(first).base);
+        ok = ok && write(bases.data(), bases.size() * sizeof(quint64));
+        for (qint64 first = 0; ok && first < lines; first += LineIndex::kBlockSize)
+            ok = write(index.blockOf(first).delta, used(first) * sizeof(quint32));
+        const quint64 deltaBytes = header.lineCount * sizeof(quint32);
+        const quint64 zeros = 0;
+        ok = ok && write(&zeros, layout.crlf - layout.delta - deltaBytes);
+    }
+    for (qint64 first = 0; ok && first < lines; first += LineIndex::kBlockSize)
+        ok = write(index.blockOf(first).crlf, (used(first) + 63) / 64 * sizeof(quint64));
+    if (!ok || !out.commit())
+        return false;
+
+    evict();
+    return true;
+}
+
+void LineIndexCache::evict() const
+{
+    // Oldest mtime first; lookup() hits refresh it, so this is LRU order.
+    const QFileInfoList files = QDir(m_directory).entryInfoList(
+        cacheFilePatterns(), QDir::Files, QDir::Time | QDir::Reversed);
+    quint64 total = 0;
+    for (const QFileInfo& file : files)
+        total += quint64(file.size());
+    for (const QFileInfo& file : files) {
+        if (total <= m_maxBytes)
+            break;
+        if (QFile::remove(file.filePath()))
+            total -= quint64(file.size());
+    }
+}
+
+quint64 LineIndexCache::diskUsage() const
+{
+    quint64 total = 0;
+    const QFileInfoList files = QDir(m_directory).entryInfoList(
+        cacheFilePatterns(), QDir::Files);
+    for (const QFileInfo& file : files)
+        total += quint64(file.size());
+    return total;
+}
+
+} // namespace logdor
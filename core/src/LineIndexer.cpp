@@ -1,73 +1,366 @@
 #include "logdor/LineIndexer.h"
 
+#include "logdor/LineIndexCache.h"
+
+#include "NewlineScan_p.h"
+
 #include <QElapsedTimer>
+#include <QThread>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
-#include <cstring>
+#include <functional>
+#include <vector>
 
 namespace logdor {
 
+namespace {
+
+using detail::NewlineKernel;
+
+// Terminator positions found by one parallel chunk worker, in file order,
+// in LineIndex::addTerminators() layout.
+struct ChunkTerminators {
+    std::vector<quint64> newlines;
+    qsizetype scanned = 0; // < the requested length only on a short read
+};
+
+int resolveThreads(int threads)
+{
+    return threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+}
+
+// Progressive publication for buildLineIndex(): a snapshot of the index
+// under construction goes out as a partial result every @p interval scanned
+// bytes (snapshots share all full blocks, so each costs O(1024)). A null
+// Publisher* publishes nothing.
+class Publisher {
+public:
+    Publisher(quint64 interval, quint64 start, const QElapsedTimer& timer)
+        : m_interval(interval)
+        , m_next(start + interval)
+        , m_start(start)
+        , m_timer(timer)
+    {
+    }
+
+    // The scan of @p building has reached @p pos.
+    void reached(const LineIndex& building, quint64 pos,
+                 QPromise<IndexingResult>& promise)
+    {
+        if (pos < m_next)
+            return;
+        m_next = pos + m_interval;
+        publish(std::make_shared<const LineIndex>(building.snapshot()), pos,
+                promise);
+    }
+
+    // Publish an already finalized @p index covering the first @p pos bytes.
+    void publish(std::shared_ptr<const LineIndex> index, quint64 pos,
+                 QPromise<IndexingResult>& promise)
+    {
+        if (index->lineCount() == 0)
+            return;
+        IndexingResult result;
+        result.lineCount = index->lineCount();
+        result.bytesScanned = pos - qMin(pos, m_start);
+        result.elapsedMs = m_timer.elapsed();
+        result.partial = true;
+        result.index = std::move(index);
+        promise.addResult(std::move(result));
+    }
+
+private:
+    quint64 m_interval;
+    quint64 m_next;
+    quint64 m_start;
+    const QElapsedTimer& m_timer;
+};
+
+// Sequential scan of [start, size) into @p index. Returns the end of the
+// scanned range, or -1 on cancel.
+qint64 indexSerial(const FileSource& source, LineIndex& index, quint64 start,
+                   quint64 size, qsizetype chunkSize, NewlineKernel kernel,
+                   Publisher* publisher, QPromise<IndexingResult>& promise)
+{
+    QByteArray buffer; // scratch for non-contiguous sources only
+    // Kernel output for one slice; sized for a '\n' in every byte.
+    std::vector<quint64> terminators(size_t(detail::kTerminatorSliceBytes));
+    // No seed needed: a build starts at 0, and an extend's resumeOffset()
+    // puts any '\r' that could precede a '\n' back inside the scanned range
+    // (see LineIndex::resumeOffset).
+    char lastByteOfPrevChunk = '\0';
+    quint64 pos = start;
+
+    while (pos < size) {
+        if (promise.isCanceled())
+            return -1;
+
+        qsizetype len = qsizetype(qMin(quint64(chunkSize), size - pos));
+        const char* chunk = nullptr;
+        if (source.isContiguous()) {
+            chunk = source.data() + pos;
+        } else {
+            if (buffer.size() < len)
+                buffer.resize(chunkSize);
+            const qsizetype got = source.readInto(pos, buffer.data(), len);
+            if (got <= 0)
+                break; // truncated underneath us; index what we have
+            len = got;
+            chunk = buffer.constData();
+        }
+
+        // Slices keep the kernel output cache-resident between the scan
+        // and the bulk append.
+        for (qsizetype at = 0; at < len; at += detail::kTerminatorSliceBytes) {
+            const qsizetype n = qMin(detail::kTerminatorSliceBytes, len - at);
+            const qsizetype found = detail::findTerminators(
+                kernel, chunk + at, n, pos + quint64(at),
+                at > 0 ? chunk[at - 1] : lastByteOfPrevChunk, terminators.data());
+            index.addTerminators(terminators.data(), found);
+        }
+
+        lastByteOfPrevChunk = chunk[len - 1];
+        pos += quint64(len);
+        promise.setProgressValue(int((pos - start) * 1000 / (size - start)));
+        if (publisher && pos < size) // the final result follows anyway
+            publisher->reached(index, pos, promise);
+    }
+    return qint64(pos);
+}
+
+// One worker's share of a parallel round. The byte before the chunk (when
+// inside the scanned range) is read along with it, so the CRLF check at the
+// chunk edge sees exactly what the sequential carry byte would.
+ChunkTerminators scanChunk(const FileSource& source, quint64 rangeStart,
+                           quint64 pos, qsizetype len, NewlineKernel kernel)
+{
+    ChunkTerminators out;
+    const qsizetype lead = pos > rangeStart ? 1 : 0;
+    QByteArray buffer; // scratch for non-contiguous sources only
+    const char* chunk = nullptr;
+    if (source.isContiguous()) {
+        chunk = source.data() + pos;
+    } else {
+        buffer.resize(len + lead);
+        const qsizetype got
+            = source.readInto(pos - quint64(lead), buffer.data(), len + lead);
+        if (got <= lead)
+            return out; // truncated underneath us
+        len = got - lead;
+        chunk = buffer.constData() + lead;
+    }
+    const char prevByte = lead ? chunk[-1] : '\0';
+
+    out.newlines.reserve(size_t(len / 64) + 1);
+    std::vector<quint64> terminators(
+        size_t(qMin(len, detail::kTerminatorSliceBytes)));
+    for (qsizetype at = 0; at < len; at += detail::kTerminatorSliceBytes) {
+        const qsizetype n = qMin(detail::kTerminatorSliceBytes, len - at);
+        const qsizetype found = detail::findTerminators(
+            kernel, chunk + at, n, pos + quint64(at),
+            at > 0 ? chunk[at - 1] : prevByte, terminators.data());
+        out.newlines.insert(out.newlines.end(), terminators.begin(),
+                            terminators.begin() + found);
+    }
+    out.scanned = len;
+    return out;
+}
+
+// Parallel scan of [start, size): rounds of @p threads chunks are scanned on
+// the pool, then stitched into @p index in file order on this thread.
+// Cancellation, progress and publication are per round. Returns the end of the scanned
+// range, or -1 on cancel.
+qint64 indexParallel(const FileSource& source, LineIndex& index, quint64 start,
+                     quint64 size, qsizetype chunkSize, int threads,
+                     NewlineKernel kernel, Publisher* publisher,
+                     QPromise<IndexingResult>& promise)
+{
+    struct Range { quint64 pos; qsizetype len; };
+    const quint64 round = quint64(chunkSize) * quint64(threads);
+    quint64 pos = start;
+
+    while (pos < size) {
+        if (promise.isCanceled())
+            return -1;
+        const quint64 roundEnd = qMin(size, pos + round);
+        QList<Range> ranges;
+        for (quint64 s = pos; s < roundEnd; s += quint64(chunkSize))
+            ranges.append({ s, qsizetype(qMin(quint64(chunkSize), roundEnd - s)) });
+
+        // blockingMapped also executes on this (calling) thread, so
+        // running it from inside a pool thread cannot deadlock the pool.
+        const auto chunks = QtConcurrent::blockingMapped(ranges,
+            std::function<ChunkTerminators(const Range&)>([&](const Range& r) {
+                return scanChunk(source, start, r.pos, r.len, kernel);
+            }));
+
+        for (qsizetype i = 0; i < chunks.size(); ++i) {
+            index.addTerminators(chunks[i].newlines.data(),
+                                 qsizetype(chunks[i].newlines.size()));
+            pos += quint64(chunks[i].scanned);
+            if (chunks[i].scanned < ranges[i].len)
+                return qint64(pos); // truncated underneath us; index what we have
+        }
+        promise.setProgressValue(int((pos - start) * 1000 / (size - start)));
+        if (publisher && pos < size) // the final result follows anyway
+            publisher->reached(index, pos, promise);
+    }
+    return qint64(pos);
+}
+
+// Index [start, size) of @p source into @p index with the requested
+// parallelism; a range that fits one chunk never pays for a round. The
+// newline kernel is resolved once per build.
+qint64 indexRange(const FileSource& source, LineIndex& index, quint64 start,
+                  quint64 size, qsizetype chunkSize, int threads,
+                  Publisher* publisher, QPromise<IndexingResult>& promise)
+{
+    const auto pass = source.sequentialScan();
+    const NewlineKernel kernel = detail::indexerNewlineKernel();
+    if (threads > 1 && size - start > quint64(chunkSize))
+        return indexParallel(source, index, start, size, chunkSize, threads,
+                             kernel, publisher, promise);
+    return indexSerial(source, index, start, size, chunkSize, kernel,
+                       publisher, promise);
+}
+
+// Full scan of @p source into result. False on cancel.
+bool scanAll(const std::shared_ptr<FileSource>& source, qsizetype chunkSize,
+             int threads, int sparseStride, Publisher* publisher,
+             QPromise<IndexingResult>& promise, IndexingResult& result)
+{
+    const quint64 size = source->size();
+    auto index = std::make_shared<LineIndex>();
+    index->setSparse(sparseStride, source);
+    // Rough reserve; logs average well above 64 B/line, so this
+    // over-reserves mildly and finalize() trims the slack.
+    index->reserveLines(qint64(size / 64) + 1);
+
+    const qint64 end = indexRange(*source, *index, 0, size, chunkSize,
+                                  resolveThreads(threads), publisher, promise);
+    if (end < 0)
+        return false;
+    index->finalize(quint64(end));
+
+    result.lineCount = index->lineCount();
+    result.bytesScanned = quint64(end);
+    result.index = std::move(index);
+    return true;
+}
+
+// Copy-on-extend of @p previous over the rest of @p source into result; a
+// sparse index keeps its stride and reads the reopened source from now on.
+// False on cancel.
+bool scanGrowth(const std::shared_ptr<FileSource>& source,
+                std::shared_ptr<const LineIndex> previous, qsizetype chunkSize,
+                int threads, Publisher* publisher,
+                QPromise<IndexingResult>& promise, IndexingResult& result)
+{
+    const quint64 size = source->size();
+    if (size < previous->fileSize()) {
+        // Shrunk underneath us: rotation raced the reopen. Hand back the
+        // previous index untouched; FileIdentity resolves what happened.
+        result.lineCount = previous->lineCount();
+        result.index = std::move(previous);
+        return true;
+    }
+
+    const quint64 start = previous->resumeOffset();
+    auto index = std::make_shared<LineIndex>(LineIndex::resumedFrom(*previous));
+    index->setSparse(previous->sparseStride(), source);
+    index->reserveLines(previous->lineCount() + qint64((size - start) / 64) + 1);
+
+    const qint64 end = indexRange(*source, *index, start, size, chunkSize,
+                                  resolveThreads(threads), publisher, promise);
+    if (end < 0)
+        return false;
+    index->finalize(quint64(end));
+
+    result.lineCount = index->lineCount();
+    result.bytesScanned = quint64(end) - start;
+    result.index = std::move(index);
+    return true;
+}
+
+} // namespace
+
 QFuture<IndexingResult> buildLineIndex(std::shared_ptr<FileSource> source,
-                                       qsizetype chunkSize)
+                                       qsizetype chunkSize, int threads,
+                                       int sparseStride, quint64 publishInterval)
 {
     Q_ASSERT(source);
     Q_ASSERT(chunkSize > 0);
+    Q_ASSERT(sparseStride <= LineIndex::kMaxSparseStride);
 
-    return QtConcurrent::run([source, chunkSize](QPromise<IndexingResult>& promise) {
+    return QtConcurrent::run([source, chunkSize, threads, sparseStride,
+                              publishInterval](QPromise<IndexingResult>& promise) {
         QElapsedTimer timer;
         timer.start();
         promise.setProgressRange(0, 1000);
 
-        const quint64 size = source->size();
-        auto index = std::make_shared<LineIndex>();
-        // Rough reserve; logs average well above 64 B/line, so this
-        // over-reserves mildly and finalize() trims the slack.
-        index->reserveLines(qint64(size / 64) + 1);
-
-        QByteArray buffer; // scratch for non-contiguous sources only
-        char lastByteOfPrevChunk = '\0';
-        quint64 pos = 0;
-
-        while (pos < size) {
-            if (promise.isCanceled())
-                return;
+        Publisher publisher(publishInterval, 0, timer);
+        IndexingResult result;
+        if (!scanAll(source, chunkSize, threads, sparseStride,
+                     publishInterval > 0 ? &publisher : nullptr, promise, result))
+            return;
+        result.elapsedMs = timer.elapsed();
+        promise.setProgressValue(1000);
+        promise.addResult(std::move(result));
+    });
+}
 
-            qsizetype len = qsizetype(qMin(quint64(chunkSize), size - pos));
-            const char* chunk = nullptr;
-            if (source->isContiguous()) {
-                chunk = source->data() + pos;
-            } else {
-                if (buffer.size() < len)
-                    buffer.resize(chunkSize);
-                const qsizetype got = source->readInto(pos, buffer.data(), len);
-                if (got <= 0)
-                    break; // truncated underneath us; index what we have
-                len = got;
-                chunk = buffer.constData();
-            }
-
-            const char* p = chunk;
-            const char* const end = chunk + len;
-            while ((p = static_cast<const char*>(
-                        std::memchr(p, '\n', size_t(end - p))))) {
-                const bool precededByCr =
-                    p > chunk ? p[-1] == '\r' : lastByteOfPrevChunk == '\r';
-                index->addTerminator(pos + quint64(p - chunk), precededByCr);
-                ++p;
-            }
-
-            lastByteOfPrevChunk = chunk[len - 1];
-            pos += quint64(len);
-            promise.setProgressValue(int(pos * 1000 / size));
-        }
+QFuture<IndexingResult> buildLineIndex(std::shared_ptr<FileSource> source,
+                                       std::shared_ptr<const LineIndexCache> cache,
+                                       qsizetype chunkSize, int threads,
+                                       int sparseStride, quint64 publishInterval)
+{
+    if (!cache || sparseStride > 1)
+        return buildLineIndex(std::move(source), chunkSize, threads, sparseStride,
+                              publishInterval);
+    Q_ASSERT(source);
+    Q_ASSERT(chunkSize > 0);
 
-        index->finalize(pos);
+    return QtConcurrent::run([source, cache, chunkSize, threads,
+                              publishInterval](QPromise<IndexingResult>& promise) {
+        QElapsedTimer timer;
+        timer.start();
+        promise.setProgressRange(0, 1000);
 
         IndexingResult result;
-        result.lineCount = index->lineCount();
-        result.bytesScanned = pos;
+        LineIndexCache::Entry cached = cache->lookup(*source);
+        if (cached.match == IdentityMatch::Identical) {
+            result.lineCount = cached.index->lineCount();
+            result.index = std::move(cached.index);
+            result.fromCache = true;
+        } else if (cached.match == IdentityMatch::Grown) {
+            // The cached prefix is already a finished index: show it while
+            // the growth is scanned.
+            const quint64 start = cached.index->resumeOffset();
+            Publisher publisher(publishInterval, start, timer);
+            if (publishInterval > 0)
+                publisher.publish(cached.index, start, promise);
+            if (!scanGrowth(source, std::move(cached.index), chunkSize, threads,
+                            publishInterval > 0 ? &publisher : nullptr, promise,
+                            result))
+                return;
+            result.fromCache = true;
+        } else {
+            Publisher publisher(publishInterval, 0, timer);
+            if (!scanAll(source, chunkSize, threads, 1,
+                         publishInterval > 0 ? &publisher : nullptr, promise,
+                         result))
+                return;
+        }
         result.elapsedMs = timer.elapsed();
-        result.index = std::move(index);
+
+        if (result.bytesScanned > 0) {
+            // Persist off the critical path: the caller gets its index now,
+            // the (possibly large) cache write runs on its own pool task.
+            (void)QtConcurrent::run([source, cache, index = result.index] {
+                cache->store(*source, *index);
+            });
+        }
         promise.setProgressValue(1000);
         promise.addResult(std::move(result));
     });
@@ -75,85 +368,31 @@ QFuture<IndexingResult> buildLineIndex(std::shared_ptr<FileSource> source,
 
 QFuture<IndexingResult> extendLineIndex(std::shared_ptr<FileSource> source,
                                         std::shared_ptr<const LineIndex> previous,
-                                        qsizetype chunkSize)
+                                        qsizetype chunkSize, int threads)
 {
     Q_ASSERT(source);
     Q_ASSERT(previous);
     Q_ASSERT(chunkSize > 0);
 
-    return QtConcurrent::run([source, previous,
-                              chunkSize](QPromise<IndexingResult>& promise) {
+    return QtConcurrent::run([source, previous, chunkSize,
+                              threads](QPromise<IndexingResult>& promise) {
         QElapsedTimer timer;
         timer.start();
         promise.setProgressRange(0, 1000);
 
-        const quint64 size = source->size();
         IndexingResult result;
-        if (size < previous->fileSize()) {
-            // Shrunk underneath us: rotation raced the reopen. Hand back the
-            // previous index untouched; FileIdentity resolves what happened.
-            result.index = previous;
-            result.lineCount = previous->lineCount();
-            result.elapsedMs = timer.elapsed();
-            promise.setProgressValue(1000);
-            promise.addResult(std::move(result));
+        if (!scanGrowth(source, previous, chunkSize, threads, nullptr, promise,
+                        result))
             return;
-        }
-
-        const quint64 start = previous->resumeOffset();
-        auto index = std::make_shared<LineIndex>(
-            LineIndex::resumedFrom(*previous));
-        index->reserveLines(previous->lineCount()
-                            + qint64((size - start) / 64) + 1);
-
-        QByteArray buffer; // scratch for non-contiguous sources only
-        // No seed needed: resumeOffset() puts any '\r' that could precede a
-        // '\n' back inside the scanned range (see LineIndex::resumeOffset).
-        char lastByteOfPrevChunk = '\0';
-        quint64 pos = start;
-
-        while (pos < size) {
-            if (promise.isCanceled())
-                return;
-
-            qsizetype len = qsizetype(qMin(quint64(chunkSize), size - pos));
-            const char* chunk = nullptr;
-            if (source->isContiguous()) {
-                chunk = source->data() + pos;
-            } else {
-                if (buffer.size() < len)
-                    buffer.resize(chunkSize);
-                const qsizetype got = source->readInto(pos, buffer.data(), len);
-                if (got <= 0)
-                    break; // truncated underneath us; index what we have
-                len = got;
-                chunk = buffer.constData();
-            }
-
-            const char* p = chunk;
-            const char* const end = chunk + len;
-            while ((p = static_cast<const char*>(
-                        std::memchr(p, '\n', size_t(end - p))))) {
-                const bool precededByCr =
-                    p > chunk ? p[-1] == '\r' : lastByteOfPrevChunk == '\r';
-                index->addTerminator(pos + quint64(p - chunk), precededByCr);
-                ++p;
-            }
-
-            lastByteOfPrevChunk = chunk[len - 1];
-            pos += quint64(len);
-            promise.setProgressValue(int((pos - start) * 1000 / (size - start)));
-        }
-
-        index->finalize(pos);
-
-        result.lineCount = index->lineCount();
-        result.bytesScanned = pos - start;
         result.elapsedMs = timer.elapsed();
-        result.index = std::move(index);
         promise.setProgressValue(1000);
         promise.addResult(std::move(result));
     });
 }
 
+const char* lineIndexKernelName()
+{
+    return detail::newlineKernelName(detail::indexerNewlineKernel());
+}
+
 } // namespace logdor
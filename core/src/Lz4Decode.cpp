@@ -0,0 +1,41 @@
+#include "SeekIndex_p.h"
+
+#ifdef LOGDOR_HAVE_LZ4
+
+#include <QFile>
+
+#include <lz4frame.h>
+
+namespace logdor::detail {
+
+bool decodeWholeLz4(QFile& file, quint64 cap, QByteArray* head, QString* error,
+                    const PassCallbacks& callbacks)
+{
+    LZ4F_dctx* context = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION))) {
+        *error = QStringLiteral("lz4 initialization failed");
+        return false;
+    }
+    const DecodeStep step = [context](QByteArrayView* input, bool, char** out,
+                                      qsizetype* room, bool* complete) {
+        size_t consumed = size_t(input->size());
+        size_t produced = size_t(*room);
+        const size_t rc = LZ4F_decompress(context, *out, &produced, input->data(),
+                                          &consumed, nullptr);
+        if (LZ4F_isError(rc))
+            return false;
+        *input = input->sliced(qsizetype(consumed));
+        *out += produced;
+        *room -= qsizetype(produced);
+        if (consumed > 0 || produced > 0)
+            *complete = rc == 0; // 0: a frame ended and is fully flushed
+        return true;
+    };
+    const bool ok = decodeWhole(file, "lz4", step, cap, head, error, callbacks);
+    LZ4F_freeDecompressionContext(context);
+    return ok;
+}
+
+} // namespace logdor::detail
+
+#endif // LOGDOR_HAVE_LZ4
@@ -0,0 +1,117 @@
+#include "MultiMatch_p.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace logdor::detail {
+
+MultiMatcher::MultiMatcher(const QList<QByteArray>& needles, bool folded)
+    : m_needleCount(needles.size())
+{
+    Q_ASSERT(!needles.isEmpty() && needles.size() <= kMaxNeedles);
+
+    // Byte classes: 0 for bytes no needle holds.
+    for (const QByteArray& needle : needles) {
+        for (char c : needle) {
+            if (m_class[uchar(c)] == 0)
+                m_class[uchar(c)] = quint8(m_classCount++);
+        }
+    }
+    if (folded) {
+        for (int c = 'A'; c <= 'Z'; ++c)
+            m_class[size_t(c)] = m_class[size_t(c + 32)];
+    }
+    const quint32 classes = m_classCount;
+
+    // The trie; kNone marks a missing edge until the DFA pass fills it.
+    constexpr quint32 kNone = ~quint32(0);
+    std::vector<quint32> edges(classes, kNone);
+    m_found.assign(1, 0);
+    for (qsizetype i = 0; i < needles.size(); ++i) {
+        Q_ASSERT(!needles[i].isEmpty());
+        quint32 state = 0;
+        for (char c : needles[i]) {
+            const size_t at = state * classes + m_class[uchar(c)];
+            if (edges[at] == kNone) {
+                edges[at] = quint32(m_found.size());
+                m_found.push_back(0);
+                edges.resize(edges.size() + classes, kNone);
+            }
+            state = edges[at];
+        }
+        m_found[state] |= quint64(1) << i;
+        m_all |= quint64(1) << i;
+    }
+
+    // Breadth-first: a state's failure state is complete before its
+    // children, so missing edges copy the failure state's (already
+    // resolved) edge and outputs inherit along failure links.
+    const size_t states = m_found.size();
+    std::vector<quint32> fail(states, 0);
+    std::deque<quint32> queue;
+    for (quint32 c = 0; c < classes; ++c) {
+        quint32& edge = edges[c];
+        if (edge == kNone) {
+            edge = 0;
+        } else {
+            queue.push_back(edge);
+        }
+    }
+    while (!queue.empty()) {
+        const quint32 state = queue.front();
+        queue.pop_front();
+        m_found[state] |= m_found[fail[state]];
+        for (quint32 c = 0; c < classes; ++c) {
+            quint32& edge = edges[state * classes + c];
+            const quint32 viaFail = edges[fail[state] * classes + c];
+            if (edge == kNone) {
+                edge = viaFail;
+            } else {
+                fail[edge] = viaFail;
+                queue.push_back(edge);
+            }
+        }
+    }
+
+    // Renumber so the states that end a needle come last: the scan then
+    // spots them by row alone, with nothing but the lookup on its chain.
+    std::vector<quint32> renumbered(states);
+    quint32 number = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t state = 0; state < states; ++state) {
+            if ((m_found[state] != 0) == (pass == 1))
+                renumbered[state] = number++;
+        }
+    }
+    std::vector<quint64> found(states);
+    m_next.resize(edges.size());
+    for (size_t state = 0; state < states; ++state) {
+        const size_t row = size_t(renumbered[state]) * classes;
+        found[renumbered[state]] = m_found[state];
+        for (quint32 c = 0; c < classes; ++c)
+            m_next[row + c] = renumbered[edges[state * classes + c]] * classes;
+    }
+    m_found = std::move(found);
+    m_firstOutputRow = quint32(std::count(m_found.begin(), m_found.end(), 0))
+        * classes;
+}
+
+quint64 MultiMatcher::scan(QByteArrayView hay) const
+{
+    const quint32* const next = m_next.data();
+    const quint64* const found = m_found.data();
+    const quint32 classes = m_classCount;
+    quint64 hits = 0;
+    quint32 row = 0;
+    for (char c : hay) {
+        row = next[row + m_class[uchar(c)]];
+        if (row >= m_firstOutputRow) {
+            hits |= found[row / classes];
+            if (hits == m_all)
+                break;
+        }
+    }
+    return hits;
+}
+
+} // namespace logdor::detail
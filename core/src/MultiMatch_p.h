@@ -0,0 +1,54 @@
+#pragma once
+
+// Internal multi-needle substring search for CompiledQuery's free-text
+// terms. Not installed; include from core/src only.
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+#include <array>
+#include <vector>
+
+namespace logdor::detail {
+
+/**
+ * Aho-Corasick automaton over up to kMaxNeedles ASCII needles: one pass
+ * over a line yields the set of needles it contains, as a bitmask (bit i =
+ * needle i), instead of one search per needle.
+ *
+ * Compiled to a full DFA over byte classes - one class per distinct needle
+ * byte (upper- and lowercase share one when folded), one for all other
+ * bytes - so the scan is a table lookup per byte with no failure-link
+ * walks, and the table stays small (states x classes). The scan stops
+ * early once every needle is found.
+ *
+ * Immutable after construction; scan() is safe from any thread.
+ */
+class MultiMatcher {
+public:
+    static constexpr int kMaxNeedles = 64;
+
+    /// @p needles: non-empty, at most kMaxNeedles, pre-lowercased when
+    /// @p folded (ASCII-only case folding, as in findAscii).
+    MultiMatcher(const QList<QByteArray>& needles, bool folded);
+
+    qsizetype needleCount() const { return m_needleCount; }
+
+    /// Bit i set when needle i occurs in @p hay.
+    quint64 scan(QByteArrayView hay) const;
+
+private:
+    std::array<quint8, 256> m_class {};
+    quint32 m_classCount = 1;
+    // Row per state, column per class: the next state's row offset
+    // (state * m_classCount), so the scan never multiplies.
+    std::vector<quint32> m_next;
+    std::vector<quint64> m_found; // per state: needles ending here
+    // States ending a needle are numbered last; their rows start here.
+    quint32 m_firstOutputRow = 0;
+    quint64 m_all = 0;
+    qsizetype m_needleCount = 0;
+};
+
+} // namespace logdor::detail
@@ -0,0 +1,262 @@
+#include "NewlineScan_p.h"
+
+#include "logdor/LineIndex.h"
+
+#include <QtAlgorithms>
+#include <QtEnvironmentVariables>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LOGDOR_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LOGDOR_TARGET(isa) // MSVC emits any intrinsic without opt-in
+#else
+#include <cpuid.h>
+#define LOGDOR_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace logdor::detail {
+
+namespace {
+
+constexpr quint64 kCr = LineIndex::kPrecededByCr;
+
+qsizetype findScalar(const char* data, qsizetype len, quint64 base,
+                     char prevByte, quint64* out)
+{
+    quint64* const first = out;
+    const char* p = data;
+    const char* const end = data + len;
+    while ((p = static_cast<const char*>(
+                std::memchr(p, '\n', size_t(end - p))))) {
+        const bool precededByCr = p > data ? p[-1] == '\r' : prevByte == '\r';
+        *out++ = (base + quint64(p - data)) | (precededByCr ? kCr : 0);
+        ++p;
+    }
+    return qsizetype(out - first);
+}
+
+#ifdef LOGDOR_X86_KERNELS
+
+// Emit one 64-byte block's newlines. @p carry is 1 when the byte before the
+// block is '\r'; it is updated for the next block.
+inline quint64* emitBlock(quint64 nl, quint64 cr, quint64 blockBase,
+                          quint64& carry, quint64* out)
+{
+    const quint64 crBeforeLf = ((cr << 1) | carry) & nl;
+    carry = cr >> 63;
+    while (nl) {
+        const int i = qCountTrailingZeroBits(nl);
+        *out++ = (blockBase + quint64(i)) | (((crBeforeLf >> i) & 1) << 63);
+        nl &= nl - 1;
+    }
+    return out;
+}
+
+// Per-ISA classification of 64 bytes into a newline mask and a CR mask.
+
+LOGDOR_TARGET("sse2")
+inline void classifySse2(const char* p, quint64& nl, quint64& cr)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i crv = _mm_set1_epi8('\r');
+    nl = cr = 0;
+    for (int k = 0; k < 4; ++k) {
+        const __m128i v
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+        nl |= quint64(quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf))))
+            << (16 * k);
+        cr |= quint64(quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(v, crv))))
+            << (16 * k);
+    }
+}
+
+LOGDOR_TARGET("avx2")
+inline void classifyAvx2(const char* p, quint64& nl, quint64& cr)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i crv = _mm256_set1_epi8('\r');
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i hi
+        = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    nl = quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, lf))))
+        | quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, lf)))) << 32;
+    cr = quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, crv))))
+        | quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, crv)))) << 32;
+}
+
+LOGDOR_TARGET("avx512f,avx512bw")
+inline void classifyAvx512(const char* p, quint64& nl, quint64& cr)
+{
+    const __m512i v = _mm512_loadu_si512(p);
+    nl = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'));
+    cr = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\r'));
+}
+
+// The drivers are spelled out per ISA (rather than templated over the
+// classifier) so each loop is compiled for its own target and the
+// classifier inlines into it. The final partial block is classified from a
+// zero-padded copy - zeros are neither '\n' nor '\r'.
+
+LOGDOR_TARGET("sse2")
+qsizetype findSse2(const char* data, qsizetype len, quint64 base, char prevByte,
+                   quint64* out)
+{
+    quint64* const first = out;
+    quint64 carry = prevByte == '\r' ? 1 : 0;
+    quint64 nl = 0, cr = 0;
+    qsizetype i = 0;
+    for (; i + 64 <= len; i += 64) {
+        classifySse2(data + i, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    if (i < len) {
+        alignas(64) char tail[64] = {};
+        std::memcpy(tail, data + i, size_t(len - i));
+        classifySse2(tail, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    return qsizetype(out - first);
+}
+
+LOGDOR_TARGET("avx2")
+qsizetype findAvx2(const char* data, qsizetype len, quint64 base, char prevByte,
+                   quint64* out)
+{
+    quint64* const first = out;
+    quint64 carry = prevByte == '\r' ? 1 : 0;
+    quint64 nl = 0, cr = 0;
+    qsizetype i = 0;
+    for (; i + 64 <= len; i += 64) {
+        classifyAvx2(data + i, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    if (i < len) {
+        alignas(64) char tail[64] = {};
+        std::memcpy(tail, data + i, size_t(len - i));
+        classifyAvx2(tail, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    return qsizetype(out - first);
+}
+
+LOGDOR_TARGET("avx512f,avx512bw")
+qsizetype findAvx512(const char* data, qsizetype len, quint64 base,
+                     char prevByte, quint64* out)
+{
+    quint64* const first = out;
+    quint64 carry = prevByte == '\r' ? 1 : 0;
+    quint64 nl = 0, cr = 0;
+    qsizetype i = 0;
+    for (; i + 64 <= len; i += 64) {
+        classifyAvx512(data + i, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    if (i < len) {
+        alignas(64) char tail[64] = {};
+        std::memcpy(tail, data + i, size_t(len - i));
+        classifyAvx512(tail, nl, cr);
+        out = emitBlock(nl, cr, base + quint64(i), carry, out);
+    }
+    return qsizetype(out - first);
+}
+
+void cpuid(int leaf, int subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int k = 0; k < 4; ++k)
+        regs[k] = unsigned(r[k]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0: which register states the OS saves on context switch.
+quint64 osEnabledXState()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    unsigned eax = 0, edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return quint64(eax) | (quint64(edx) << 32);
+#endif
+}
+
+NewlineKernel detectKernel()
+{
+    unsigned regs[4] = {};
+    cpuid(0, 0, regs);
+    const unsigned maxLeaf = regs[0];
+    cpuid(1, 0, regs);
+    const bool osxsave = regs[2] & (1u << 27);
+    if (maxLeaf < 7 || !osxsave)
+        return NewlineKernel::Sse2;
+    const quint64 xcr0 = osEnabledXState();
+    cpuid(7, 0, regs);
+    const bool ymm = (xcr0 & 0x6) == 0x6;       // SSE + AVX state
+    const bool zmm = (xcr0 & 0xE6) == 0xE6;     // + opmask, ZMM upper halves
+    const bool avx512 = (regs[1] & (1u << 16)) && (regs[1] & (1u << 30));
+    if (zmm && avx512)
+        return NewlineKernel::Avx512;
+    if (ymm && (regs[1] & (1u << 5)))
+        return NewlineKernel::Avx2;
+    return NewlineKernel::Sse2;
+}
+
+#endif // LOGDOR_X86_KERNELS
+
+} // namespace
+
+NewlineKernel bestNewlineKernel()
+{
+#ifdef LOGDOR_X86_KERNELS
+    static const NewlineKernel best = detectKernel();
+    return best;
+#else
+    return NewlineKernel::Scalar;
+#endif
+}
+
+NewlineKernel indexerNewlineKernel()
+{
+    return qEnvironmentVariableIsSet("LOGDOR_FORCE_SCALAR_INDEX")
+        ? NewlineKernel::Scalar
+        : bestNewlineKernel();
+}
+
+const char* newlineKernelName(NewlineKernel kernel)
+{
+    switch (kernel) {
+    case NewlineKernel::Scalar: return "scalar";
+    case NewlineKernel::Sse2: return "sse2";
+    case NewlineKernel::Avx2: return "avx2";
+    case NewlineKernel::Avx512: return "avx512";
+    }
+    return "?";
+}
+
+qsizetype findTerminators(NewlineKernel kernel, const char* data, qsizetype len,
+                          quint64 base, char prevByte, quint64* out)
+{
+    switch (kernel) {
+#ifdef LOGDOR_X86_KERNELS
+    case NewlineKernel::Sse2:
+        return findSse2(data, len, base, prevByte, out);
+    case NewlineKernel::Avx2:
+        return findAvx2(data, len, base, prevByte, out);
+    case NewlineKernel::Avx512:
+        return findAvx512(data, len, base, prevByte, out);
+#endif
+    default:
+        return findScalar(data, len, base, prevByte, out);
+    }
+}
+
+} // namespace logdor::detail
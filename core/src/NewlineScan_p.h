@@ -0,0 +1,40 @@
+#pragma once
+
+// Internal newline classification kernels for the line indexer.
+// Not installed; include from core/src only.
+
+#include <QtGlobal>
+
+namespace logdor::detail {
+
+/// Implementations of findTerminators, slowest first. Sse2 is the x86-64
+/// baseline; Avx2/Avx512 are picked at runtime when CPU and OS support them.
+enum class NewlineKernel : quint8 { Scalar, Sse2, Avx2, Avx512 };
+
+/// The fastest kernel this machine supports (detected once). Non-x86
+/// builds always get Scalar. LOGDOR_FORCE_SCALAR_INDEX=1 makes the indexer
+/// ignore this and use Scalar (bench comparisons, tests).
+NewlineKernel bestNewlineKernel();
+
+/// Kernel the indexer should use for a build starting now: Scalar when
+/// LOGDOR_FORCE_SCALAR_INDEX is set, else bestNewlineKernel().
+NewlineKernel indexerNewlineKernel();
+
+const char* newlineKernelName(NewlineKernel kernel);
+
+/// Bytes per findTerminators call the indexer feeds; its output scratch
+/// must hold one entry per byte.
+constexpr qsizetype kTerminatorSliceBytes = 64 * 1024;
+
+/**
+ * Write the file offset (@p base + i) of every '\n' in [data, data + len)
+ * to @p out, in order, OR-ed with LineIndex::kPrecededByCr when the byte
+ * before it is '\r'. @p prevByte is the byte before @p data ('\0' when
+ * none). @p out must have room for @p len entries. Returns the number
+ * written. Every kernel produces identical output; the SIMD ones classify
+ * 64 bytes per step into a newline mask and a CR-before-LF mask.
+ */
+qsizetype findTerminators(NewlineKernel kernel, const char* data, qsizetype len,
+                          quint64 base, char prevByte, quint64* out);
+
+} // namespace logdor::detail
@@ -0,0 +1,154 @@
+#include "PlatformIo_p.h"
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <qt_windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
+#include <vector>
+
+namespace logdor::detail {
+
+qint64 readAt(int fd, quint64 offset, char* dst, qsizetype length)
+{
+    qint64 done = 0;
+#ifdef Q_OS_WIN
+    const HANDLE handle = HANDLE(_get_osfhandle(fd));
+    if (handle == INVALID_HANDLE_VALUE)
+        return -1;
+    while (done < length) {
+        // An explicit offset makes ReadFile positional even on a
+        // synchronous handle.
+        OVERLAPPED at = {};
+        const quint64 position = offset + quint64(done);
+        at.Offset = DWORD(position);
+        at.OffsetHigh = DWORD(position >> 32);
+        DWORD got = 0;
+        const DWORD want = DWORD(qMin<qint64>(length - done, 1 << 30));
+        if (!ReadFile(handle, dst + done, want, &got, &at))
+            return GetLastError() == ERROR_HANDLE_EOF ? done : -1;
+        if (got == 0)
+            break;
+        done += got;
+    }
+#else
+    while (done < length) {
+        const size_t want = size_t(qMin<qint64>(length - done, SSIZE_MAX));
+        const ssize_t got = ::pread(fd, dst + done, want, off_t(offset + quint64(done)));
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (got == 0)
+            break;
+        done += got;
+    }
+#endif
+    return done;
+}
+
+void adviseWillNeed(int fd, quint64 offset, quint64 length)
+{
+#if defined(Q_OS_DARWIN)
+    radvisory advice;
+    advice.ra_offset = off_t(offset);
+    advice.ra_count = int(qMin<quint64>(length, INT_MAX));
+    ::fcntl(fd, F_RDADVISE, &advice);
+#elif defined(Q_OS_UNIX)
+    ::posix_fadvise(fd, off_t(offset), off_t(length), POSIX_FADV_WILLNEED);
+#else
+    Q_UNUSED(fd)
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
+
+void adviseDontNeed(int fd, quint64 offset, quint64 length)
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_DARWIN)
+    ::posix_fadvise(fd, off_t(offset), off_t(length), POSIX_FADV_DONTNEED);
+#else
+    // Darwin and Windows have no per-file page-cache eviction.
+    Q_UNUSED(fd)
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
+
+quint64 pageSize()
+{
+#ifdef Q_OS_WIN
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return quint64(info.dwPageSize);
+#else
+    return quint64(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+quint64 residentBytes(const uchar* base, quint64 offset, quint64 length)
+{
+#ifdef Q_OS_WIN
+    // The working-set queries say nothing about the file cache.
+    Q_UNUSED(base)
+    Q_UNUSED(offset)
+    return length;
+#else
+    if (!base || length == 0)
+        return 0;
+    const quint64 page = pageSize();
+    const quint64 first = offset & ~(page - 1);
+    const quint64 end = offset + length;
+#ifdef Q_OS_DARWIN
+    std::vector<char> vec(size_t((end - first + page - 1) / page));
+#else
+    std::vector<unsigned char> vec(size_t((end - first + page - 1) / page));
+#endif
+    if (::mincore(const_cast<uchar*>(base) + first, size_t(end - first), vec.data()) != 0)
+        return length;
+    quint64 resident = 0;
+    for (size_t i = 0; i < vec.size(); ++i) {
+        if (!(vec[i] & 1))
+            continue;
+        const quint64 from = qMax(offset, first + i * page);
+        resident += qMin(end, first + (i + 1) * page) - from;
+    }
+    return resident;
+#endif
+}
+
+void adviseMapping(const uchar* base, quint64 offset, quint64 length,
+                   MapAdvice advice)
+{
+    if (!base || length == 0)
+        return;
+#ifdef Q_OS_WIN
+    // Only prefetching has a Windows counterpart.
+    if (advice == MapAdvice::WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<uchar*>(base) + offset;
+        range.NumberOfBytes = SIZE_T(length);
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    const quint64 page = pageSize();
+    const quint64 first = offset & ~(page - 1); // madvise wants page alignment
+    int flag = MADV_NORMAL;
+    switch (advice) {
+    case MapAdvice::Sequential: flag = MADV_SEQUENTIAL; break;
+    case MapAdvice::Random: flag = MADV_RANDOM; break;
+    case MapAdvice::WillNeed: flag = MADV_WILLNEED; break;
+    case MapAdvice::DontNeed: flag = MADV_DONTNEED; break;
+    }
+    ::madvise(const_cast<uchar*>(base) + first, size_t(offset + length - first), flag);
+#endif
+}
+
+} // namespace logdor::detail
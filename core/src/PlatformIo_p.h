@@ -0,0 +1,48 @@
+#pragma once
+
+// Internal OS file primitives FileSource reads through. Not installed;
+// include from core/src only. QFile has no positional read, so these go to
+// the descriptor QFile::handle() exposes.
+
+#include <QtGlobal>
+
+namespace logdor::detail {
+
+/**
+ * Read up to @p length bytes at @p offset of descriptor @p fd into @p dst
+ * without moving any file position - safe from many threads at once on one
+ * descriptor. Retries short reads; returns the bytes read (short only at
+ * end of file) or -1 on an error.
+ */
+qint64 readAt(int fd, quint64 offset, char* dst, qsizetype length);
+
+/// Ask the OS to start reading [offset, offset + length) of @p fd into its
+/// page cache in the background. A hint: never blocks, never fails.
+void adviseWillNeed(int fd, quint64 offset, quint64 length);
+
+/// Ask the OS to drop [offset, offset + length) of @p fd from its page
+/// cache; pages still mapped somewhere stay.
+void adviseDontNeed(int fd, quint64 offset, quint64 length);
+
+/// Paging advice for a read-only file mapping.
+enum class MapAdvice : quint8 {
+    Sequential, // read ahead aggressively, reclaim behind
+    Random,     // no speculative read-ahead on faults
+    WillNeed,   // page the range in now, in the background
+    DontNeed,   // unmap the range's pages from this process
+};
+
+/// The VM page size - the granule of the advice and residency calls.
+quint64 pageSize();
+
+/// Bytes of [offset, offset + length) of the mapping at @p base that are in
+/// memory (mincore - for a file mapping, the page cache). Whole pages are
+/// counted, clamped to the range. Where the OS cannot tell, all of them.
+quint64 residentBytes(const uchar* base, quint64 offset, quint64 length);
+
+/// Apply @p advice to [offset, offset + length) of the mapping at @p base
+/// (page-aligned, as QFile::map returns). Hints: no-ops where unsupported.
+void adviseMapping(const uchar* base, quint64 offset, quint64 length,
+                   MapAdvice advice);
+
+} // namespace logdor::detail
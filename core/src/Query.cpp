@@ -1,5 +1,6 @@
 #include "logdor/Query.h"
 
+#include "MultiMatch_p.h"
 #include "TextMatch_p.h"
 
 #include <QDateTime>
@@ -146,6 +147,35 @@ bool bytesEqualFolded(QByteArrayView a, QByteArrayView b, bool folded)
     return true;
 }
 
+// Below this many plain free-text terms, one vectorized search per term
+// beats a byte-at-a-time automaton pass (break-even measured at 7-8 terms
+// on 100-byte lines).
+constexpr qsizetype kMinAutomatonTerms = 8;
+
+} // namespace
+
+// The plain (ASCII, non-regex) free-text terms, found in one pass per line.
+struct CompiledQuery::Terms {
+    detail::MultiMatcher automaton;
+};
+
+namespace {
+
+// Per-evaluate() bitmask of the terms a line contains; the automaton runs
+// the first time a FreeText leaf asks, so short-circuited lines skip it.
+struct TermHits {
+    const detail::MultiMatcher* automaton = nullptr;
+    QByteArrayView raw;
+    std::optional<quint64> mask;
+
+    bool has(int bit)
+    {
+        if (!mask)
+            mask = automaton->scan(raw);
+        return (*mask >> bit) & 1;
+    }
+};
+
 } // namespace
 
 struct CompiledQuery::Node {
@@ -165,6 +195,7 @@ struct CompiledQuery::Node {
 
     // FreeText
     std::optional<detail::Matcher> matcher;
+    int termBit = -1; // bit in the Terms automaton's mask, or -1 if not in it
 
     // StringCmp / IntCmp / SeverityCmp / DateTimeCmp / TimeOfDayCmp
     int column = -1;
@@ -172,37 +203,43 @@ struct CompiledQuery::Node {
     QByteArray needleUtf8;       // pre-lowercased when folded
     bool folded = false;
     bool needleAscii = true;
+    detail::SearchKernel kernel = detail::SearchKernel::Scalar;
     QString needleUtf16;         // non-ASCII path
-    std::optional<QRegularExpression> wildcard; // anchored, for '*'/'?'
+    std::optional<detail::ByteRegex> wildcard; // anchored, for '*'/'?'
     qint64 intLiteral = 0;
     quint8 severityLiteral = 0;
     qint64 lowerMs = 0, upperMs = 0; // DateTimeCmp epoch / TimeOfDayCmp tod
     std::shared_ptr<const std::vector<std::pair<qint64, qint32>>>
         todOffsets; // TimeOfDayCmp: zone steps for epoch -> local time of day
 
-    bool eval(qint64 line, QByteArrayView raw, const ColumnSnapshot& cols) const
+    bool eval(qint64 line, QByteArrayView raw, const ColumnSnapshot& cols,
+              TermHits& hits) const
     {
         switch (kind) {
         case Kind::And:
-            return std::all_of(children.begin(), children.end(),
-                               [&](const auto& c) { return c->eval(line, raw, cols); });
+            return std::all_of(children.begin(), children.end(), [&](const auto& c) {
+                return c->eval(line, raw, cols, hits);
+            });
         case Kind::Or:
-            return std::any_of(children.begin(), children.end(),
-                               [&](const auto& c) { return c->eval(line, raw, cols); });
+            return std::any_of(children.begin(), children.end(), [&](const auto& c) {
+                return c->eval(line, raw, cols, hits);
+            });
         case Kind::Not:
-            return !children.front()->eval(line, raw, cols);
+            return !children.front()->eval(line, raw, cols, hits);
         case Kind::AlwaysTrue:
             return true;
         case Kind::FreeText:
+            if (termBit >= 0)
+                return hits.has(termBit);
             return matcher->textMatches(raw);
         case Kind::StringCmp: {
             const QByteArrayView value = cols.columns[column]->stringAt(line);
             if (wildcard)
-                return wildcard->match(QString::fromUtf8(value)).hasMatch();
+                return wildcard->matches(value);
             switch (op) {
             case CmpOp::Contains:
                 if (needleAscii)
-                    return detail::containsAscii(value, needleUtf8, folded);
+                    return detail::containsAscii(kernel, value, needleUtf8, folded);
                 return QString::fromUtf8(value).contains(
                     needleUtf16, folded ? Qt::CaseInsensitive : Qt::CaseSensitive);
             case CmpOp::Equals:
@@ -444,6 +481,10 @@ struct QueryParser {
     QueryError error;
     QList<int> referencedColumns;
     bool needsSeverity = false;
+    // Text end of each top-level AND operand, in order (see narrows()).
+    QList<qsizetype> conjunctEnds;
+    qsizetype consumedEnd = 0; // text end of the last token advanced past
+    int depth = 0;             // open parentheses
     std::shared_ptr<const std::vector<std::pair<qint64, qint32>>> m_todOffsets;
 
     QueryParser(const QString& text, const QList<FieldSchema>& schema,
@@ -476,7 +517,11 @@ struct QueryParser {
         return m_todOffsets;
     }
 
-    void advance() { current = tokenizer.next(); }
+    void advance()
+    {
+        consumedEnd = current.position + current.length;
+        current = tokenizer.next();
+    }
 
     void fail(const Token& at, const QString& message)
     {
@@ -530,6 +575,8 @@ struct QueryParser {
         auto left = parseUnary();
         if (!left)
             return nullptr;
+        if (depth == 0)
+            conjunctEnds.append(consumedEnd);
         while (true) {
             if (current.kind == Token::Kind::KwAnd) {
                 advance();
@@ -543,6 +590,8 @@ struct QueryParser {
             auto right = parseUnary();
             if (!right)
                 return nullptr;
+            if (depth == 0)
+                conjunctEnds.append(consumedEnd);
             auto node = makeNode(Kind::And);
             node->children.push_back(std::move(left));
             node->children.push_back(std::move(right));
@@ -570,7 +619,9 @@ struct QueryParser {
         if (current.kind == Token::Kind::LParen) {
             const Token open = current;
             advance();
+            ++depth;
             auto inner = parseOr();
+            --depth;
             if (!inner)
                 return nullptr;
             if (current.kind != Token::Kind::RParen) {
@@ -740,15 +791,14 @@ struct QueryParser {
             && (value.contains(u'*') || value.contains(u'?'))) {
             node->wildcard.emplace(QRegularExpression::wildcardToRegularExpression(
                                        value, QRegularExpression::DefaultWildcardConversion),
-                                   cs == Qt::CaseSensitive
-                                       ? QRegularExpression::NoPatternOption
-                                       : QRegularExpression::CaseInsensitiveOption);
+                                   cs == Qt::CaseSensitive);
         } else {
             node->needleAscii = detail::isAsciiOnly(value);
             node->needleUtf8 = value.toUtf8();
             if (node->folded && node->needleAscii)
                 node->needleUtf8 = node->needleUtf8.toLower();
             node->needleUtf16 = value;
+            node->kernel = detail::searchKernel();
         }
         if (!referencedColumns.contains(column))
             referencedColumns.append(column);
@@ -879,13 +929,85 @@ std::shared_ptr<const CompiledQuery> CompiledQuery::compile(
     query->m_text = text;
     query->m_referencedColumns = std::move(parser.referencedColumns);
     query->m_needsSeverity = parser.needsSeverity;
+    query->m_cs = cs;
+    query->m_options = options;
+    // Under a top-level OR the operands are not conjuncts of the whole.
+    if (query->m_root->kind != Node::Kind::Or)
+        query->m_conjunctEnds = std::move(parser.conjunctEnds);
+    query->gatherTerms();
     return query;
 }
 
+void CompiledQuery::gatherTerms()
+{
+    // Plain free-text leaves, in query order; repeated needles share a bit.
+    std::vector<Node*> leaves;
+    const auto collect = [&](const auto& self, Node* node) -> void {
+        if (node->kind == Node::Kind::FreeText
+            && (node->matcher->mode == detail::Matcher::Mode::AsciiExact
+                || node->matcher->mode == detail::Matcher::Mode::AsciiFolded))
+            leaves.push_back(node);
+        for (const auto& child : node->children)
+            self(self, child.get());
+    };
+    collect(collect, m_root.get());
+    if (qsizetype(leaves.size()) < kMinAutomatonTerms)
+        return;
+
+    // Past kMaxNeedles distinct needles the rest stay per-term matchers.
+    QList<QByteArray> needles;
+    for (Node* leaf : leaves) {
+        const QByteArray& needle = leaf->matcher->asciiNeedle;
+        qsizetype bit = needles.indexOf(needle);
+        if (bit < 0 && needles.size() < detail::MultiMatcher::kMaxNeedles) {
+            bit = needles.size();
+            needles.append(needle);
+        }
+        leaf->termBit = int(bit);
+    }
+    m_terms.reset(new Terms { detail::MultiMatcher(
+        needles, leaves.front()->matcher->mode == detail::Matcher::Mode::AsciiFolded) });
+}
+
+bool CompiledQuery::narrows(const CompiledQuery& previous) const
+{
+    if (m_cs != previous.m_cs || m_options != previous.m_options)
+        return false;
+    // Each prefix of the top-level conjuncts parses on its own to the same
+    // terms, so matching this query implies matching that prefix.
+    const QString before = previous.m_text.trimmed();
+    if (m_text.trimmed() == before)
+        return true;
+    return std::any_of(m_conjunctEnds.begin(), m_conjunctEnds.end(),
+                       [&](qsizetype end) { return m_text.left(end).trimmed() == before; });
+}
+
+QList<QByteArray> CompiledQuery::requiredLiterals() const
+{
+    // Under OR or NOT a term is not required; below AND it is.
+    QList<QByteArray> literals;
+    const auto collect = [&](const auto& self, const Node* node) -> void {
+        if (node->kind == Node::Kind::And) {
+            for (const auto& child : node->children)
+                self(self, child.get());
+        } else if (node->kind == Node::Kind::FreeText && node->matcher->searchesChunks()
+                   && !literals.contains(node->matcher->asciiNeedle)) {
+            literals.append(node->matcher->asciiNeedle);
+        }
+    };
+    collect(collect, m_root.get());
+    return literals;
+}
+
 bool CompiledQuery::evaluate(qint64 line, QByteArrayView raw,
                              const ColumnSnapshot& columns) const
 {
-    return m_root->eval(line, raw, columns);
+    TermHits hits;
+    if (m_terms) {
+        hits.automaton = &m_terms->automaton;
+        hits.raw = raw;
+    }
+    return m_root->eval(line, raw, columns, hits);
 }
 
 //=== Term building ===========================================================
@@ -0,0 +1,33 @@
+#include "ScanDriver_p.h"
+
+namespace logdor::detail {
+
+std::vector<LineChunk> byteBalancedChunks(const LineIndex& index, qint64 first,
+                                          qint64 end, qint64 maxLines)
+{
+    const auto bytes = [&index](qint64 from, qint64 to) {
+        return lineBytes(index, from, to).length;
+    };
+    std::vector<LineChunk> chunks;
+    for (qint64 at = first; at < end;) {
+        qint64 stop = qMin(end, at + maxLines);
+        if (bytes(at, stop) > kScanChunkBytes) {
+            // The longest prefix within the budget, but at least one line.
+            qint64 lo = at + 1;
+            qint64 hi = stop - 1;
+            while (lo < hi) {
+                const qint64 mid = lo + (hi - lo + 1) / 2;
+                if (bytes(at, mid) <= kScanChunkBytes)
+                    lo = mid;
+                else
+                    hi = mid - 1;
+            }
+            stop = lo;
+        }
+        chunks.push_back({ at, stop });
+        at = stop;
+    }
+    return chunks;
+}
+
+} // namespace logdor::detail
@@ -0,0 +1,170 @@
+#pragma once
+
+// Internal driver of the chunk-parallel line scans (FilterScan, ColumnScan,
+// GeoScan). Not installed; include from core/src only.
+
+#include "logdor/LineIndex.h"
+#include "logdor/ScanStats.h"
+
+#include "ScanSchedule_p.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+namespace logdor::detail {
+
+/// Chunks are cut at this many bytes unless a single line is longer.
+constexpr quint64 kScanChunkBytes = 4 * 1024 * 1024;
+
+struct LineChunk {
+    qint64 first = 0;
+    qint64 end = 0;
+    /// False when the scan reads only some lines of [first, end) - a
+    /// refinement's candidates - so the span may be mostly bytes it skips.
+    /// driveChunks() then neither probes nor warms it.
+    bool readsSpan = true;
+};
+
+/**
+ * Cut lines [first, end) of @p index into chunks of at most @p maxLines
+ * lines and kScanChunkBytes bytes (a longer line is a chunk of its own),
+ * so a run of megabyte lines costs its worker no more than an ordinary
+ * chunk.
+ */
+std::vector<LineChunk> byteBalancedChunks(const LineIndex& index, qint64 first,
+                                          qint64 end, qint64 maxLines);
+
+/**
+ * Run @p scan over @p chunks on @p threads workers and hand each result to
+ * @p merge in chunk order - the order of @p chunks, which need not be line
+ * order.
+ *
+ * No per-round barrier: a worker claims the next pending chunk as soon as
+ * it is free, so one slow chunk holds up only its own worker. Whoever
+ * finishes the chunk at the merge cursor merges every ready chunk after
+ * it, under the driver's lock. Claims run at most a window of chunks ahead
+ * of that cursor, which bounds the results held unmerged. Within each
+ * block of @p threads chunks the claim order comes from ScanScheduler:
+ * resident chunks first, cold ones warmed ahead. Chunks that do not read
+ * their whole span (LineChunk::readsSpan) go first and are never warmed.
+ *
+ * Like blockingMapped the calling thread works too, so this is safe from
+ * inside a pool task. Workers check @p cancelled before each claim; the
+ * result is false once it reported true. @p stats, when given, receives
+ * each worker's busy share of the wall time.
+ */
+template <typename Result, typename Scan, typename Merge, typename Cancelled>
+bool driveChunks(const FileSource& source, const LineIndex& index,
+                 const std::vector<LineChunk>& chunks, int threads, Scan scan,
+                 Merge merge, Cancelled cancelled, ScanStats* stats = nullptr)
+{
+    const size_t count = chunks.size();
+    const size_t block = size_t(qMax(1, threads));
+    const size_t window = 4 * block;
+
+    QElapsedTimer wall;
+    wall.start();
+    ScanScheduler scheduler(source);
+    QMutex mutex; // guards everything below
+    QWaitCondition merged;
+    std::vector<std::optional<Result>> ready(count);
+    std::vector<size_t> claimOrder;
+    claimOrder.reserve(count);
+    size_t nextClaim = 0;
+    size_t mergeCursor = 0;
+    bool stop = false;
+    std::vector<qint64> busyNs(block, 0);
+
+    const auto bytesOf = [&](size_t i) {
+        return lineBytes(index, chunks[i].first, chunks[i].end);
+    };
+    // Under the lock: extend claimOrder by the next block in the order the
+    // scheduler picks, and warm the block after it - chunk by chunk, never
+    // their union: pruned or viewport-first chunks need not be adjacent,
+    // and the bytes between them are not read.
+    const auto planBlock = [&] {
+        const size_t from = claimOrder.size();
+        const size_t to = qMin(count, from + block);
+        QList<ByteRange> ranges;
+        std::vector<size_t> planned;
+        for (size_t i = from; i < to; ++i) {
+            if (!chunks[i].readsSpan) {
+                claimOrder.push_back(i);
+                continue;
+            }
+            ranges.append(bytesOf(i));
+            planned.push_back(i);
+        }
+        for (qsizetype i : scheduler.plan(ranges))
+            claimOrder.push_back(planned[size_t(i)]);
+        for (size_t i = to; i < qMin(count, to + block); ++i) {
+            if (chunks[i].readsSpan)
+                scheduler.warmAhead(bytesOf(i));
+        }
+    };
+
+    QList<int> workers(static_cast<qsizetype>(block));
+    std::iota(workers.begin(), workers.end(), 0);
+    QtConcurrent::blockingMap(workers, [&](int worker) {
+        QElapsedTimer busy;
+        for (;;) {
+            size_t chunkNo = 0;
+            {
+                QMutexLocker lock(&mutex);
+                for (;;) {
+                    if (stop)
+                        return;
+                    if (nextClaim == claimOrder.size() && claimOrder.size() < count)
+                        planBlock();
+                    if (nextClaim == claimOrder.size())
+                        return; // all claimed
+                    chunkNo = claimOrder[nextClaim];
+                    if (chunkNo < mergeCursor + window)
+                        break;
+                    merged.wait(&mutex);
+                }
+                ++nextClaim;
+            }
+            if (cancelled()) {
+                QMutexLocker lock(&mutex);
+                stop = true;
+                merged.wakeAll();
+                return;
+            }
+
+            busy.start();
+            Result result = scan(chunks[chunkNo]);
+            busyNs[size_t(worker)] += busy.nsecsElapsed();
+
+            QMutexLocker lock(&mutex);
+            ready[chunkNo].emplace(std::move(result));
+            if (chunkNo != mergeCursor)
+                continue;
+            while (mergeCursor < count && ready[mergeCursor]) {
+                merge(std::move(*ready[mergeCursor]), chunks[mergeCursor]);
+                ready[mergeCursor].reset();
+                ++mergeCursor;
+            }
+            merged.wakeAll();
+        }
+    });
+
+    if (stats) {
+        const double wallNs = double(qMax<qint64>(wall.nsecsElapsed(), 1));
+        stats->chunks = count;
+        stats->threadUtilization.clear();
+        for (qint64 ns : busyNs)
+            stats->threadUtilization.push_back(double(ns) / wallNs);
+    }
+    return !stop && mergeCursor == count;
+}
+
+} // namespace logdor::detail
@@ -0,0 +1,105 @@
+#include "ScanSchedule_p.h"
+
+#include "PlatformIo_p.h"
+
+namespace logdor::detail {
+
+namespace {
+
+// A chunk with more than 1/8 of its bytes out of memory is cold: it would
+// stall a worker long enough to be worth running last.
+constexpr quint64 kColdShare = 8;
+
+} // namespace
+
+ScanScheduler::ScanScheduler(const FileSource& source)
+    : m_source(source)
+{
+}
+
+ScanScheduler::~ScanScheduler()
+{
+    if (!m_thread)
+        return;
+    {
+        QMutexLocker lock(&m_mutex); // no wakeup lost before the wait
+        m_stop.store(true);
+    }
+    m_wake.wakeAll();
+    m_thread->wait();
+}
+
+bool ScanScheduler::isCold(ByteRange range) const
+{
+    if (m_source.mode() != FileSource::Mode::Mapped || range.length == 0)
+        return false;
+    const quint64 resident = m_source.residentBytes(range.offset, range.length);
+    return (range.length - resident) * kColdShare > range.length;
+}
+
+std::vector<qsizetype> ScanScheduler::plan(const QList<ByteRange>& chunks)
+{
+    std::vector<qsizetype> order;
+    std::vector<qsizetype> cold;
+    order.reserve(size_t(chunks.size()));
+    for (qsizetype i = 0; i < chunks.size(); ++i) {
+        if (isCold(chunks[i]))
+            cold.push_back(i);
+        else
+            order.push_back(i);
+    }
+    for (qsizetype i : cold) {
+        enqueue(chunks[i]);
+        order.push_back(i);
+    }
+    return order;
+}
+
+void ScanScheduler::warmAhead(ByteRange range)
+{
+    if (isCold(range))
+        enqueue(range);
+}
+
+void ScanScheduler::enqueue(ByteRange range)
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_queue.push_back(range);
+    }
+    if (!m_thread) {
+        m_thread.reset(QThread::create([this] { warmLoop(); }));
+        m_thread->setObjectName(QStringLiteral("logdor-warm"));
+        m_thread->start();
+    }
+    m_wake.wakeOne();
+}
+
+void ScanScheduler::warmLoop()
+{
+    const auto* base = reinterpret_cast<const volatile uchar*>(m_source.data());
+    const quint64 page = pageSize();
+    for (;;) {
+        ByteRange range;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.empty() && !m_stop.load())
+                m_wake.wait(&m_mutex);
+            if (m_stop.load())
+                return;
+            range = m_queue.front();
+            m_queue.pop_front();
+        }
+        // Readahead for the whole range first, then fault it in page by
+        // page: this thread takes the disk stalls the workers would.
+        m_source.prefetch(range.offset, range.length);
+        const quint64 end = range.offset + range.length;
+        for (quint64 at = range.offset; at < end; at += page) {
+            if (m_stop.load(std::memory_order_relaxed))
+                return;
+            (void)base[at];
+        }
+    }
+}
+
+} // namespace logdor::detail
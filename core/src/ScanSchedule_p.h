@@ -0,0 +1,74 @@
+#pragma once
+
+// Internal page-cache-aware ordering for the chunked scans (see
+// ScanDriver_p.h). Not installed; include from core/src only.
+
+#include "logdor/FileSource.h"
+#include "logdor/LineIndex.h"
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace logdor::detail {
+
+struct ByteRange {
+    quint64 offset = 0;
+    quint64 length = 0;
+};
+
+/// The bytes of lines [first, end) of @p index, terminators included.
+inline ByteRange lineBytes(const LineIndex& index, qint64 first, qint64 end)
+{
+    const quint64 from = index.offsetOf(first);
+    const quint64 to = end < index.lineCount() ? index.offsetOf(end) : index.fileSize();
+    return { from, to - from };
+}
+
+/**
+ * Execution order for rounds of chunk scans over one source that is only
+ * partly in the page cache. plan() puts a round's resident chunks first,
+ * so the workers compute on cached bytes instead of stalling on disk, and
+ * queues the cold ones on a warm thread that faults them in - in the order
+ * the workers will reach them. warmAhead() queues the next round's bytes
+ * behind those. Callers still merge results in chunk order; only the
+ * execution order changes.
+ *
+ * Inert (file order, no thread) unless the source is Mapped and something
+ * is cold; the thread starts on the first cold range and is joined - after
+ * at most one page of I/O - by the destructor.
+ */
+class ScanScheduler {
+public:
+    explicit ScanScheduler(const FileSource& source);
+    ~ScanScheduler();
+
+    ScanScheduler(const ScanScheduler&) = delete;
+    ScanScheduler& operator=(const ScanScheduler&) = delete;
+
+    /// Positions into @p chunks in the order to run them.
+    std::vector<qsizetype> plan(const QList<ByteRange>& chunks);
+
+    /// Start warming @p range if it is cold; returns at once.
+    void warmAhead(ByteRange range);
+
+private:
+    bool isCold(ByteRange range) const;
+    void enqueue(ByteRange range);
+    void warmLoop();
+
+    const FileSource& m_source;
+    QMutex m_mutex; // guards m_queue
+    QWaitCondition m_wake;
+    std::deque<ByteRange> m_queue;
+    std::atomic<bool> m_stop { false }; // polled per page while warming
+    std::unique_ptr<QThread> m_thread;
+};
+
+} // namespace logdor::detail
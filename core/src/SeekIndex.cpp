@@ -0,0 +1,371 @@
+#include "SeekIndex_p.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+
+namespace logdor::detail {
+
+namespace {
+
+constexpr qsizetype kInputStep = 4 * 1024 * 1024;
+constexpr qsizetype kMaxStoredWindow = 2 * 32 * 1024; // qCompress worst case
+constexpr quint64 kTailBytes = 4096;
+
+constexpr char kMagic[8] = { 'L', 'O', 'G', 'D', 'O', 'R', 'S', 'X' };
+constexpr quint32 kVersion = 1;
+constexpr quint32 kByteOrderMark = 0x01020304; // rejects foreign-endian files
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint64 compressedSize;
+    qint64 mtimeMs;        // compressed file mtime when stored
+    quint64 size;          // decompressed bytes
+    quint64 pointCount;
+    quint32 codec;
+    quint32 reserved;
+    char tailSha256[32];   // raw SHA-256 of the last <= 4 KiB compressed
+};
+static_assert(sizeof(Header) == 88);
+
+// Followed by windowBytes of qCompress()ed window.
+struct PointRecord {
+    quint64 out;
+    quint64 in;
+    quint32 bits;
+    quint32 windowBytes;
+};
+static_assert(sizeof(PointRecord) == 24);
+
+QByteArray tailHash(QFile& file)
+{
+    const quint64 size = quint64(file.size());
+    const quint64 length = qMin(size, kTailBytes);
+    if (!file.seek(qint64(size - length)))
+        return {};
+    return QCryptographicHash::hash(file.read(qint64(length)),
+                                    QCryptographicHash::Sha256);
+}
+
+qint64 mtimeMs(const QFile& file)
+{
+    return QFileInfo(file.fileName()).lastModified().toMSecsSinceEpoch();
+}
+
+struct Magic {
+    Codec codec;
+    const char* bytes;
+    qsizetype length;
+};
+
+// Compiled-in codecs only; the empty sentinel matches anything else.
+constexpr Magic kMagics[] = {
+#ifdef LOGDOR_HAVE_ZLIB
+    { Codec::Gzip, "\x1f\x8b", 2 },
+#endif
+#ifdef LOGDOR_HAVE_ZSTD
+    { Codec::Zstd, "\x28\xb5\x2f\xfd", 4 },
+#endif
+#ifdef LOGDOR_HAVE_XZ
+    { Codec::Xz, "\xfd\x37\x7a\x58\x5a\x00", 6 },
+#endif
+#ifdef LOGDOR_HAVE_LZ4
+    { Codec::Lz4, "\x04\x22\x4d\x18", 4 },
+#endif
+    { Codec::None, "", 0 },
+};
+
+} // namespace
+
+Codec sniffCodec(QFile& file)
+{
+    char bytes[6] = {};
+    const qint64 got = file.read(bytes, sizeof bytes);
+    file.seek(0);
+    for (const Magic& magic : kMagics) {
+        if (got >= magic.length
+            && std::memcmp(bytes, magic.bytes, size_t(magic.length)) == 0)
+            return magic.codec;
+    }
+    return Codec::None;
+}
+
+size_t SeekIndex::spanOf(quint64 offset) const
+{
+    const auto after = std::upper_bound(
+        points.begin(), points.end(), offset,
+        [](quint64 value, const Checkpoint& point) { return value < point.out; });
+    return size_t(after - points.begin()) - 1;
+}
+
+quint64 SeekIndex::spanEnd(size_t span) const
+{
+    return span + 1 < points.size() ? points[span + 1].out : size;
+}
+
+std::pair<quint64, quint64> SeekIndex::spanInput(size_t span, quint64 fileSize) const
+{
+    const Checkpoint& point = points[span];
+    const quint64 first = point.in - (point.bits ? 1 : 0);
+    // A gzip span's last symbols end inside byte points[span + 1].in - 1; a
+    // few bytes of slack keep inflate off its input-starved path.
+    const quint64 last = span + 1 < points.size() ? points[span + 1].in + 8 : fileSize;
+    return { first, qMin(last, fileSize) };
+}
+
+quint64 SeekIndex::memoryUsage() const
+{
+    quint64 total = points.capacity() * sizeof(Checkpoint);
+    for (const Checkpoint& point : points)
+        total += quint64(point.window.capacity());
+    return total;
+}
+
+bool decodeWhole(QFile& file, const char* name, const DecodeStep& step,
+                 quint64 cap, QByteArray* head, QString* error,
+                 const PassCallbacks& callbacks)
+{
+    head->clear();
+    error->clear();
+    if (!file.seek(0)) {
+        *error = QStringLiteral("seek failed: %1").arg(file.errorString());
+        return false;
+    }
+    QByteArray buffer(kInputStep, Qt::Uninitialized);
+    QByteArray content;
+    qsizetype used = 0;
+    quint64 fed = 0;
+    bool complete = false;
+    for (bool finish = false; !finish;) {
+        if (callbacks.cancelled && callbacks.cancelled())
+            return false;
+        const qint64 got = file.read(buffer.data(), buffer.size());
+        if (got < 0) {
+            *error = QStringLiteral("read failed: %1").arg(file.errorString());
+            return false;
+        }
+        fed += quint64(got);
+        finish = got == 0;
+        QByteArrayView input(buffer.constData(), got);
+        qsizetype room = 0;
+        do {
+            if (used == content.size()) {
+                // Grow geometrically, one byte past the cap to notice it.
+                const quint64 grown = qMin(qMax<quint64>(quint64(used) * 2, kInputStep),
+                                           cap + 1);
+                if (quint64(used) >= grown) {
+                    *error = QStringLiteral(
+                                 "decompressed size exceeds the %1 MiB cap "
+                                 "(LOGDOR_MAX_WHOLE_MB overrides)")
+                                 .arg(cap / (1024 * 1024));
+                    return false;
+                }
+                content.resize(qsizetype(grown));
+            }
+            char* out = content.data() + used;
+            room = content.size() - used;
+            const qsizetype before = input.size();
+            if (!step(&input, finish, &out, &room, &complete)) {
+                *error = QStringLiteral("corrupt %1 stream").arg(QLatin1String(name));
+                return false;
+            }
+            const qsizetype produced = content.size() - used - room;
+            used += produced;
+            if (!finish && produced == 0 && input.size() == before && room > 0) {
+                *error = QStringLiteral("corrupt %1 stream").arg(QLatin1String(name));
+                return false; // stalled with input left
+            }
+        } while (!input.isEmpty() || room == 0);
+        if (callbacks.progress)
+            callbacks.progress(qint64(fed));
+    }
+    if (!complete) {
+        *error = QStringLiteral("truncated %1 stream").arg(QLatin1String(name));
+        return false;
+    }
+    content.truncate(used);
+    content.squeeze();
+    *head = std::move(content);
+    return true;
+}
+
+bool buildSeekIndex(Codec codec, QFile& file, quint64 spacing, quint64 keepLimit,
+                    quint64 wholeCap, QByteArray* head, SeekIndex* index,
+                    QString* error, const PassCallbacks& callbacks)
+{
+    *index = SeekIndex();
+    error->clear();
+    bool ok = false;
+    switch (codec) {
+#ifdef LOGDOR_HAVE_ZLIB
+    case Codec::Gzip:
+        ok = buildGzipIndex(file, spacing, keepLimit, head, index, error, callbacks);
+        break;
+#endif
+#ifdef LOGDOR_HAVE_ZSTD
+    case Codec::Zstd:
+        ok = buildZstdIndex(file, spacing, keepLimit, wholeCap, head, index, error,
+                            callbacks);
+        break;
+#endif
+#ifdef LOGDOR_HAVE_XZ
+    case Codec::Xz:
+        ok = decodeWholeXz(file, wholeCap, head, error, callbacks);
+        break;
+#endif
+#ifdef LOGDOR_HAVE_LZ4
+    case Codec::Lz4:
+        ok = decodeWholeLz4(file, wholeCap, head, error, callbacks);
+        break;
+#endif
+    default:
+        *error = QStringLiteral("unsupported compression");
+        break;
+    }
+    Q_UNUSED(file)
+    Q_UNUSED(spacing)
+    Q_UNUSED(keepLimit)
+    Q_UNUSED(wholeCap)
+    Q_UNUSED(callbacks)
+    if (!ok)
+        return false;
+    index->codec = codec;
+    if (index->points.empty()) {
+        // Decoded whole: a single span, never read through the index.
+        index->size = quint64(head->size());
+        index->points.assign(1, Checkpoint {});
+    }
+    index->points.shrink_to_fit();
+    return true;
+}
+
+bool decodeSpan(const SeekIndex& index, size_t span, QByteArrayView input, char* out)
+{
+    Q_UNUSED(span)
+    Q_UNUSED(input)
+    Q_UNUSED(out)
+    switch (index.codec) {
+#ifdef LOGDOR_HAVE_ZLIB
+    case Codec::Gzip:
+        return decodeGzipSpan(index, span, input, out);
+#endif
+#ifdef LOGDOR_HAVE_ZSTD
+    case Codec::Zstd:
+        return decodeZstdSpan(index, span, input, out);
+#endif
+    default:
+        return false; // whole-decoded codecs have no spans
+    }
+}
+
+bool saveSeekIndex(const QString& path, const SeekIndex& index, QFile& compressed)
+{
+    Header header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.version = kVersion;
+    header.byteOrder = kByteOrderMark;
+    header.compressedSize = quint64(compressed.size());
+    header.mtimeMs = mtimeMs(compressed);
+    header.size = index.size;
+    header.pointCount = index.points.size();
+    header.codec = quint32(index.codec);
+    const QByteArray tail = tailHash(compressed);
+    if (tail.size() != qsizetype(sizeof header.tailSha256))
+        return false;
+    std::memcpy(header.tailSha256, tail.constData(), sizeof header.tailSha256);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    const auto write = [&file](const void* bytes, qint64 length) {
+        return file.write(static_cast<const char*>(bytes), length) == length;
+    };
+    bool ok = write(&header, sizeof header);
+    for (const Checkpoint& point : index.points) {
+        if (!ok)
+            break;
+        const PointRecord record { point.out, point.in, quint32(point.bits),
+                                   quint32(point.window.size()) };
+        ok = write(&record, sizeof record)
+            && write(point.window.constData(), point.window.size());
+    }
+    return ok && file.commit();
+}
+
+bool loadSeekIndex(const QString& path, QFile& compressed, SeekIndex* index)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    Header header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof header)
+            != qint64(sizeof header)
+        || std::memcmp(header.magic, kMagic, sizeof kMagic) != 0
+        || header.version != kVersion || header.byteOrder != kByteOrderMark
+        || header.codec != quint32(sniffCodec(compressed))
+        || header.codec == quint32(Codec::None)
+        || header.compressedSize != quint64(compressed.size())
+        || header.mtimeMs != mtimeMs(compressed)
+        || header.pointCount == 0
+        || header.pointCount > quint64(file.size()) / sizeof(PointRecord)
+        || tailHash(compressed)
+            != QByteArray::fromRawData(header.tailSha256, sizeof header.tailSha256))
+        return false;
+
+    SeekIndex loaded;
+    loaded.codec = Codec(header.codec);
+    loaded.size = header.size;
+    loaded.points.resize(size_t(header.pointCount));
+    for (size_t i = 0; i < loaded.points.size(); ++i) {
+        PointRecord record;
+        if (file.read(reinterpret_cast<char*>(&record), sizeof record)
+                != qint64(sizeof record)
+            || record.bits > 7 || record.windowBytes > kMaxStoredWindow)
+            return false;
+        Checkpoint& point = loaded.points[i];
+        point.out = record.out;
+        point.in = record.in;
+        point.bits = int(record.bits);
+        point.window = file.read(record.windowBytes);
+        if (point.window.size() != qsizetype(record.windowBytes))
+            return false;
+        // Spans must be ordered, non-empty and inside both files; member
+        // and frame starts (the first point among them) go without a window.
+        const bool first = i == 0;
+        if (first ? (point.out != 0 || point.in != 0 || !point.window.isEmpty())
+                  : (point.out <= loaded.points[i - 1].out
+                     || point.in <= loaded.points[i - 1].in))
+            return false;
+        if (point.window.isEmpty() && point.bits != 0)
+            return false;
+        if (loaded.codec != Codec::Gzip && !point.window.isEmpty())
+            return false;
+        if (point.out > loaded.size || point.in > header.compressedSize)
+            return false;
+    }
+    if (!file.atEnd())
+        return false;
+    // Frame spans are allocated whole on a read.
+    for (size_t i = 0; loaded.codec != Codec::Gzip && i < loaded.points.size(); ++i) {
+        if (loaded.spanEnd(i) - loaded.points[i].out > kMaxSpanBytes)
+            return false;
+    }
+    *index = std::move(loaded);
+
+    // A hit is a use: refresh the mtime LineIndexCache::evict() orders by.
+    file.close();
+    if (file.open(QIODevice::ReadWrite))
+        file.setFileTime(QDateTime::currentDateTimeUtc(),
+                         QFileDevice::FileModificationTime);
+    return true;
+}
+
+} // namespace logdor::detail
@@ -0,0 +1,141 @@
+#pragma once
+
+// Internal random access into compressed files for FileSource's
+// Decompressed and Seekable modes. Not installed; include from core/src
+// only. Each codec backend compiles only with its library
+// (LOGDOR_HAVE_ZLIB / _ZSTD / _XZ / _LZ4); sniffCodec() never reports one
+// that is missing.
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+class QFile;
+QT_END_NAMESPACE
+
+namespace logdor::detail {
+
+/// Compressed formats FileSource opens, told apart by magic bytes.
+enum class Codec : quint8 { None, Gzip, Zstd, Xz, Lz4 };
+
+/// The (compiled-in) codec whose magic starts @p file, else None. Leaves
+/// the file position at 0.
+Codec sniffCodec(QFile& file);
+
+/// Spans larger than this are not worth serving piecewise: a stream whose
+/// seek points lie further apart (a single zstd frame, say) inflates whole.
+constexpr quint64 kMaxSpanBytes = 16 * 1024 * 1024;
+
+/// Where decoding can resume: after a deflate block boundary (gzip), or at
+/// the start of a gzip member or zstd frame.
+struct Checkpoint {
+    quint64 out = 0;   // decompressed offset
+    quint64 in = 0;    // compressed offset of the next whole byte
+    int bits = 0;      // 0..7 bits of byte (in - 1) not yet consumed
+    QByteArray window; // gzip: qCompress()ed last <= 32 KiB of output; empty
+                       // at the start of a member or frame (no history)
+};
+
+/**
+ * Checkpoint table of one compressed file. points[0] is the stream start;
+ * span k is the decompressed range [points[k].out, spanEnd(k)), decoded
+ * from points[k] alone.
+ */
+struct SeekIndex {
+    Codec codec = Codec::None;
+    quint64 size = 0; // decompressed bytes
+    std::vector<Checkpoint> points;
+
+    /// The span holding decompressed @p offset (< size).
+    size_t spanOf(quint64 offset) const;
+    quint64 spanEnd(size_t span) const;
+
+    /// Compressed range [first, last) that decodeSpan() reads for @p span.
+    std::pair<quint64, quint64> spanInput(size_t span, quint64 fileSize) const;
+
+    /// Heap footprint of the table and its windows.
+    quint64 memoryUsage() const;
+};
+
+/// Open-time pass callbacks: @p cancelled is polled (from any thread)
+/// between 4 MiB input steps; @p progress receives compressed offsets on
+/// the calling thread.
+struct PassCallbacks {
+    std::function<bool()> cancelled;
+    std::function<void(qint64)> progress;
+};
+
+/**
+ * Decode @p file, a @p codec stream, once. On success either @p head holds
+ * the whole content - it fits @p keepLimit, or the stream has no usable
+ * seek points, and then at most @p wholeCap bytes - or @p head is empty and
+ * @p index serves the content span by span, with checkpoints at least
+ * @p spacing decompressed bytes apart. Returns false with @p error set on
+ * corrupt, truncated or oversized input, or with @p error empty on
+ * cancellation.
+ */
+bool buildSeekIndex(Codec codec, QFile& file, quint64 spacing, quint64 keepLimit,
+                    quint64 wholeCap, QByteArray* head, SeekIndex* index,
+                    QString* error, const PassCallbacks& callbacks);
+
+/// Decode @p span of @p index into @p out (spanEnd - out bytes) from
+/// @p input, the file bytes of spanInput(). False on corrupt input.
+bool decodeSpan(const SeekIndex& index, size_t span, QByteArrayView input,
+                char* out);
+
+/// Persist @p index for the compressed file @p compressed (keyed by its
+/// size, mtime and last 4 KiB) to @p path, atomically.
+bool saveSeekIndex(const QString& path, const SeekIndex& index,
+                   QFile& compressed);
+
+/// Load the index saveSeekIndex() wrote for @p compressed; false when the
+/// file is missing, foreign, damaged or describes other content.
+bool loadSeekIndex(const QString& path, QFile& compressed, SeekIndex* index);
+
+// ---- Backends --------------------------------------------------------------
+
+/**
+ * One streaming decoder step for decodeWhole(): consume from @p input and
+ * write to @p out (both advanced), with @p finish once the input is
+ * exhausted. Sets @p complete when everything consumed so far forms whole
+ * streams. False on corrupt input.
+ */
+using DecodeStep = std::function<bool(QByteArrayView* input, bool finish,
+                                      char** out, qsizetype* room,
+                                      bool* complete)>;
+
+/// Drive @p step over all of @p file into @p head, failing beyond @p cap
+/// bytes. @p name labels errors ("corrupt zstd stream").
+bool decodeWhole(QFile& file, const char* name, const DecodeStep& step,
+                 quint64 cap, QByteArray* head, QString* error,
+                 const PassCallbacks& callbacks);
+
+/// Gzip: zran-style checkpoints, member-parallel for concatenated archives
+/// (GzipIndex.cpp). Always seekable, so there is no whole cap.
+bool buildGzipIndex(QFile& file, quint64 spacing, quint64 keepLimit,
+                    QByteArray* head, SeekIndex* index, QString* error,
+                    const PassCallbacks& callbacks);
+bool decodeGzipSpan(const SeekIndex& index, size_t span, QByteArrayView input,
+                    char* out);
+
+/// Zstd: frame starts from the seekable-format seek table or a frame walk;
+/// single-frame files decode whole (ZstdIndex.cpp).
+bool buildZstdIndex(QFile& file, quint64 spacing, quint64 keepLimit,
+                    quint64 wholeCap, QByteArray* head, SeekIndex* index,
+                    QString* error, const PassCallbacks& callbacks);
+bool decodeZstdSpan(const SeekIndex& index, size_t span, QByteArrayView input,
+                    char* out);
+
+/// Xz and lz4 frames carry no usable seek points: whole decodes
+/// (XzDecode.cpp, Lz4Decode.cpp).
+bool decodeWholeXz(QFile& file, quint64 cap, QByteArray* head, QString* error,
+                   const PassCallbacks& callbacks);
+bool decodeWholeLz4(QFile& file, quint64 cap, QByteArray* head, QString* error,
+                    const PassCallbacks& callbacks);
+
+} // namespace logdor::detail
@@ -0,0 +1,185 @@
+#include "TextMatch_p.h"
+
+#include "NewlineScan_p.h"
+
+#include <QtAlgorithms>
+#include <QtEnvironmentVariables>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LOGDOR_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define LOGDOR_TARGET(isa) // MSVC emits any intrinsic without opt-in
+#else
+#define LOGDOR_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace logdor::detail {
+
+namespace {
+
+inline bool isLowerAscii(char c)
+{
+    return c >= 'a' && c <= 'z';
+}
+
+// Needle bytes [1, n - 1) at @p at; the kernels have checked both ends.
+inline bool middleMatches(const char* at, const char* needle, qsizetype n,
+                          bool folded)
+{
+    if (!folded)
+        return n <= 2 || std::memcmp(at + 1, needle + 1, size_t(n - 2)) == 0;
+    for (qsizetype i = 1; i + 1 < n; ++i) {
+        char h = at[i];
+        if (h >= 'A' && h <= 'Z')
+            h = char(h + 32);
+        if (h != needle[i])
+            return false;
+    }
+    return true;
+}
+
+qsizetype findScalar(const char* hay, qsizetype size, const char* needle,
+                     qsizetype n, bool folded)
+{
+    if (size < n)
+        return -1;
+    const char first = needle[0];
+    const char firstUp = folded && isLowerAscii(first) ? char(first - 32) : first;
+    const char last = needle[n - 1];
+    const char lastUp = folded && isLowerAscii(last) ? char(last - 32) : last;
+    const char* p = hay;
+    const char* const end = hay + size - n + 1;
+
+    while (p < end) {
+        const char* c = static_cast<const char*>(std::memchr(p, first, size_t(end - p)));
+        if (firstUp != first) {
+            const char* c2 = static_cast<const char*>(
+                std::memchr(p, firstUp, size_t(end - p)));
+            if (!c || (c2 && c2 < c))
+                c = c2;
+        }
+        if (!c)
+            return -1;
+        if ((c[n - 1] == last || c[n - 1] == lastUp)
+            && middleMatches(c, needle, n, folded))
+            return qsizetype(c - hay);
+        p = c + 1;
+    }
+    return -1;
+}
+
+#ifdef LOGDOR_X86_KERNELS
+
+// First-and-last-byte filter: a candidate position needs the needle's
+// first byte there and its last byte n - 1 further on. Folded letters are
+// compared with bit 0x20 forced on both sides (the needle is lowercase), so
+// 'A' and 'a' both pass and nothing else does; other bytes compare exactly.
+// The positions whose last byte would pass the end go to findScalar.
+
+LOGDOR_TARGET("sse2")
+qsizetype findSse2(const char* hay, qsizetype size, const char* needle,
+                   qsizetype n, bool folded)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    const __m128i firstFold
+        = _mm_set1_epi8(folded && isLowerAscii(needle[0]) ? 0x20 : 0);
+    const __m128i lastFold
+        = _mm_set1_epi8(folded && isLowerAscii(needle[n - 1]) ? 0x20 : 0);
+    qsizetype i = 0;
+    for (; i + n - 1 + 16 <= size; i += 16) {
+        const __m128i a = _mm_or_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i)), firstFold);
+        const __m128i b = _mm_or_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + n - 1)),
+            lastFold);
+        quint32 mask = quint32(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        while (mask) {
+            const qsizetype at = i + qCountTrailingZeroBits(mask);
+            if (middleMatches(hay + at, needle, n, folded))
+                return at;
+            mask &= mask - 1;
+        }
+    }
+    const qsizetype rest = findScalar(hay + i, size - i, needle, n, folded);
+    return rest < 0 ? -1 : i + rest;
+}
+
+LOGDOR_TARGET("avx2")
+qsizetype findAvx2(const char* hay, qsizetype size, const char* needle,
+                   qsizetype n, bool folded)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    const __m256i firstFold
+        = _mm256_set1_epi8(folded && isLowerAscii(needle[0]) ? 0x20 : 0);
+    const __m256i lastFold
+        = _mm256_set1_epi8(folded && isLowerAscii(needle[n - 1]) ? 0x20 : 0);
+    qsizetype i = 0;
+    for (; i + n - 1 + 32 <= size; i += 32) {
+        const __m256i a = _mm256_or_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i)), firstFold);
+        const __m256i b = _mm256_or_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + n - 1)),
+            lastFold);
+        quint32 mask = quint32(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        while (mask) {
+            const qsizetype at = i + qCountTrailingZeroBits(mask);
+            if (middleMatches(hay + at, needle, n, folded))
+                return at;
+            mask &= mask - 1;
+        }
+    }
+    const qsizetype rest = findScalar(hay + i, size - i, needle, n, folded);
+    return rest < 0 ? -1 : i + rest;
+}
+
+#endif // LOGDOR_X86_KERNELS
+
+SearchKernel bestSearchKernel()
+{
+    switch (bestNewlineKernel()) {
+    case NewlineKernel::Scalar: return SearchKernel::Scalar;
+    case NewlineKernel::Sse2: return SearchKernel::Sse2;
+    case NewlineKernel::Avx2:
+    case NewlineKernel::Avx512: return SearchKernel::Avx2;
+    }
+    return SearchKernel::Scalar;
+}
+
+} // namespace
+
+SearchKernel searchKernel()
+{
+    return qEnvironmentVariableIsSet("LOGDOR_FORCE_SCALAR_SEARCH")
+        ? SearchKernel::Scalar
+        : bestSearchKernel();
+}
+
+qsizetype findAscii(SearchKernel kernel, QByteArrayView hay, QByteArrayView needle,
+                    bool folded)
+{
+    const qsizetype n = needle.size();
+    if (n == 0)
+        return 0;
+    if (hay.size() < n)
+        return -1;
+    switch (kernel) {
+#ifdef LOGDOR_X86_KERNELS
+    case SearchKernel::Sse2:
+        return findSse2(hay.data(), hay.size(), needle.data(), n, folded);
+    case SearchKernel::Avx2:
+        return findAvx2(hay.data(), hay.size(), needle.data(), n, folded);
+#endif
+    default:
+        return findScalar(hay.data(), hay.size(), needle.data(), n, folded);
+    }
+}
+
+} // namespace logdor::detail
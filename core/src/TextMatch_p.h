@@ -3,12 +3,12 @@
 // Internal shared text-matching primitives for FilterScan and Query.
 // Not installed; include from core/src only.
 
+#include "ByteRegex_p.h"
+
 #include <QByteArrayView>
-#include <QRegularExpression>
 #include <QString>
 
 #include <algorithm>
-#include <cstring>
 
 namespace logdor::detail {
 
@@ -18,81 +18,98 @@ inline bool isAsciiOnly(const QString& s)
                        [](QChar c) { return c.unicode() < 0x80; });
 }
 
-// Substring search with a memchr first-byte skip. @p needle must be
-// pre-lowercased when @p folded; ASCII-only case folding (matches
-// QString::contains for ASCII needles under Qt's simple folding).
-inline bool containsAscii(QByteArrayView hay, QByteArrayView needle, bool folded)
-{
-    const qsizetype n = needle.size();
-    if (n == 0)
-        return true;
-    if (hay.size() < n)
-        return false;
+/// Implementations of findAscii, slowest first. Sse2 is the x86-64
+/// baseline; Avx2 is picked at runtime when CPU and OS support it.
+enum class SearchKernel : quint8 { Scalar, Sse2, Avx2 };
 
-    const char first = needle[0];
-    const char firstUp = folded && first >= 'a' && first <= 'z'
-        ? char(first - 32) : first;
-    const char* p = hay.data();
-    const char* const end = hay.data() + hay.size() - n + 1;
-
-    while (p < end) {
-        const char* c1 = static_cast<const char*>(std::memchr(p, first, size_t(end - p)));
-        const char* c = c1;
-        if (firstUp != first) {
-            const char* c2 = static_cast<const char*>(
-                std::memchr(p, firstUp, size_t(end - p)));
-            if (!c || (c2 && c2 < c))
-                c = c2;
-        }
-        if (!c)
-            return false;
-        bool ok = true;
-        for (qsizetype i = 1; i < n; ++i) {
-            char h = c[i];
-            if (folded && h >= 'A' && h <= 'Z')
-                h = char(h + 32);
-            if (h != needle[i]) {
-                ok = false;
-                break;
-            }
-        }
-        if (ok)
-            return true;
-        p = c + 1;
-    }
-    return false;
+/// Kernel for a matcher compiled now: the fastest this machine supports
+/// (the newline kernel's detection), or Scalar when
+/// LOGDOR_FORCE_SCALAR_SEARCH is set (bench comparisons, tests). Reads the
+/// environment: hold the result, don't call per line.
+SearchKernel searchKernel();
+
+/**
+ * Position of the first occurrence of @p needle in @p hay, or -1. @p needle
+ * must be pre-lowercased when @p folded; ASCII-only case folding (matches
+ * QString::contains for ASCII needles under Qt's simple folding).
+ *
+ * Scalar skips to the needle's first byte with memchr (twice when folded:
+ * lower and upper case). The SIMD kernels compare the first and the last
+ * needle byte at 16/32 positions per step and verify only where both
+ * agree, which stays fast on text full of the needle's first letter. All
+ * kernels return the same position.
+ */
+qsizetype findAscii(SearchKernel kernel, QByteArrayView hay, QByteArrayView needle,
+                    bool folded);
+
+inline bool containsAscii(SearchKernel kernel, QByteArrayView hay,
+                          QByteArrayView needle, bool folded)
+{
+    return findAscii(kernel, hay, needle, folded) >= 0;
 }
 
-// Compiled once; match paths are thread-safe (QRegularExpression::match is
-// documented thread-safe on a shared const instance).
+// Compiled once; match paths are thread-safe (ByteRegex::matches is, on a
+// shared const instance).
 struct Matcher {
     enum class Mode { Empty, AsciiExact, AsciiFolded, Utf16, Regex };
     Mode mode = Mode::Empty;
-    QByteArray asciiNeedle; // pre-lowercased in AsciiFolded mode
+    // The ASCII needle, or in Regex mode the pattern's required literal
+    // (empty when it has none); pre-lowercased when folded.
+    QByteArray asciiNeedle;
+    bool folded = false;
     QString utf16Needle;
     Qt::CaseSensitivity cs = Qt::CaseInsensitive;
-    QRegularExpression regex;
+    ByteRegex regex;
+    SearchKernel kernel = SearchKernel::Scalar;
+    // ASCII needle that cannot span a terminator: see searchesChunks().
+    bool chunkSearch = false;
 
     Matcher(const QString& query, bool caseSensitive, bool regexMode)
     {
         cs = caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
         if (query.isEmpty())
             return;
+        kernel = searchKernel();
         if (regexMode) {
             mode = Mode::Regex;
-            regex = QRegularExpression(query,
-                caseSensitive ? QRegularExpression::NoPatternOption
-                              : QRegularExpression::CaseInsensitiveOption);
+            regex = ByteRegex(query, caseSensitive);
             // Invalid pattern: never matches (legacy behavior).
+            if (regex.isValid())
+                asciiNeedle = requiredLiteral(query, caseSensitive);
+            folded = !caseSensitive;
         } else if (isAsciiOnly(query)) {
             mode = caseSensitive ? Mode::AsciiExact : Mode::AsciiFolded;
             asciiNeedle = query.toUtf8();
-            if (mode == Mode::AsciiFolded)
+            folded = mode == Mode::AsciiFolded;
+            if (folded)
                 asciiNeedle = asciiNeedle.toLower();
         } else {
             mode = Mode::Utf16;
             utf16Needle = query;
         }
+        chunkSearch = !asciiNeedle.isEmpty() && !asciiNeedle.contains('\n')
+            && !asciiNeedle.contains('\r');
+    }
+
+    /**
+     * True when every line textMatches() accepts holds a find() hit, and a
+     * find() over a run of whole lines cannot hit across a line end: an
+     * ASCII needle (or a regex's required literal) without '\n' or '\r'.
+     * A hit's line is then a match once confirmHit() agrees.
+     */
+    bool searchesChunks() const { return chunkSearch; }
+
+    /// First hit in @p hay, or -1. Only when searchesChunks().
+    qsizetype find(QByteArrayView hay) const
+    {
+        return findAscii(kernel, hay, asciiNeedle, folded);
+    }
+
+    /// Whether the line @p raw holding a find() hit matches: always for a
+    /// plain needle, the regex's verdict in Regex mode.
+    bool confirmHit(QByteArrayView raw) const
+    {
+        return mode != Mode::Regex || regex.matches(raw);
     }
 
     bool textMatches(QByteArrayView raw) const
@@ -101,14 +118,17 @@ struct Matcher {
         case Mode::Empty:
             return true;
         case Mode::AsciiExact:
-            return containsAscii(raw, asciiNeedle, false);
+            return containsAscii(kernel, raw, asciiNeedle, false);
         case Mode::AsciiFolded:
-            return containsAscii(raw, asciiNeedle, true);
+            return containsAscii(kernel, raw, asciiNeedle, true);
         case Mode::Utf16:
             return QString::fromUtf8(raw).contains(utf16Needle, cs);
         case Mode::Regex:
-            return regex.isValid()
-                && regex.match(QString::fromUtf8(raw)).hasMatch();
+            // Lines without the required literal cannot match: skip the
+            // regex for them.
+            if (!asciiNeedle.isEmpty() && !containsAscii(kernel, raw, asciiNeedle, folded))
+                return false;
+            return regex.matches(raw);
         }
         return false;
     }
@@ -0,0 +1,459 @@
+#include "logdor/TrigramIndex.h"
+
+#include "logdor/FileIdentity.h"
+#include "logdor/LineIndexCache.h"
+
+#include "ScanDriver_p.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace logdor {
+
+namespace {
+
+constexpr char kMagic[8] = { 'L', 'O', 'G', 'D', 'O', 'R', 'T', 'G' };
+constexpr quint32 kVersion = 1;
+constexpr quint32 kByteOrderMark = 0x01020304; // rejects foreign-endian files
+constexpr quint32 kFlagLastLineTerminated = 1;
+constexpr quint64 kTailBytes = 4096;
+constexpr quint32 kKeySpace = quint32(1) << 24;
+
+// Fixed-size file header; block offsets, keys, posting starts and the
+// postings follow, each 8-byte aligned.
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint64 blockLines;
+    quint64 lineCount;
+    quint64 fileSize;      // indexed bytes of the log
+    qint64 mtimeMs;        // log mtime when stored
+    quint64 blockCount;
+    quint64 keyCount;
+    quint64 postingBytes;
+    quint32 flags;
+    quint32 prefixLength;  // FileIdentity
+    char prefixSha256[64]; // FileIdentity, hex
+    char tailSha256[32];   // raw SHA-256 of the last indexed <= 4 KiB
+};
+static_assert(sizeof(Header) == 176 && sizeof(Header) % 8 == 0);
+
+quint64 padded(quint64 bytes)
+{
+    return (bytes + 7) & ~quint64(7);
+}
+
+quint64 fileBytesFor(const Header& header)
+{
+    return sizeof(Header) + header.blockCount * sizeof(quint64)
+        + padded(header.keyCount * sizeof(quint32))
+        + (header.keyCount + 1) * sizeof(quint64) + padded(header.postingBytes);
+}
+
+QByteArray tailHash(const FileSource& source, quint64 end)
+{
+    const quint64 length = qMin(end, kTailBytes);
+    return QCryptographicHash::hash(source.read(end - length, qsizetype(length)),
+                                    QCryptographicHash::Sha256);
+}
+
+qint64 mtimeMs(const FileSource& source)
+{
+    return QFileInfo(source.filePath()).lastModified().toMSecsSinceEpoch();
+}
+
+inline quint8 fold(quint8 c)
+{
+    return c >= 'A' && c <= 'Z' ? quint8(c | 0x20) : c;
+}
+
+void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(quint8(value) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Calls @p visit with each block of the posting list in @p postings
+// [from, to). False - having stopped there - on a truncated or overlong
+// varint, or a block of @p blocks or more.
+template <typename Visit>
+bool decodePostings(const QByteArray& postings, quint64 from, quint64 to,
+                    quint64 blocks, Visit visit)
+{
+    quint64 next = 0;
+    quint64 value = 0;
+    int shift = 0;
+    for (quint64 at = from; at < to; ++at) {
+        if (shift > 63)
+            return false;
+        const quint8 byte = quint8(postings[qsizetype(at)]);
+        value |= quint64(byte & 0x7f) << shift;
+        shift += 7;
+        if (byte & 0x80)
+            continue;
+        if (value >= blocks - next)
+            return false;
+        visit(next + value);
+        next += value + 1;
+        value = 0;
+        shift = 0;
+    }
+    return shift == 0;
+}
+
+// The distinct folded trigrams of lines @p bytes, ascending. One 2 MiB
+// bitmap per thread dedupes them; only the bits set are cleared after.
+std::vector<quint32> blockTrigrams(QByteArrayView bytes)
+{
+    thread_local std::vector<quint64> seen(kKeySpace / 64);
+    std::vector<quint32> keys;
+    quint32 key = 0;
+    int run = 0; // bytes since the last line end, up to 3
+    for (const char ch : bytes) {
+        const quint8 c = quint8(ch);
+        if (c == '\n') {
+            run = 0;
+            continue;
+        }
+        key = ((key << 8) | fold(c)) & (kKeySpace - 1);
+        if (run < 3 && ++run < 3)
+            continue;
+        quint64& word = seen[key >> 6];
+        const quint64 bit = quint64(1) << (key & 63);
+        if (!(word & bit)) {
+            word |= bit;
+            keys.push_back(key);
+        }
+    }
+    for (quint32 k : keys)
+        seen[k >> 6] = 0;
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+} // namespace
+
+// Posting lists grow per block in block order: each one remembers the
+// block after its last, which the next delta counts from.
+struct TrigramIndexBuilder {
+    struct Posting {
+        QByteArray deltas;
+        quint64 next = 0;
+    };
+
+    TrigramIndex index;
+    QHash<quint32, Posting> postings;
+
+    void add(qint64 block, const std::vector<quint32>& keys)
+    {
+        for (quint32 key : keys) {
+            Posting& posting = postings[key];
+            appendVarint(posting.deltas, quint64(block) - posting.next);
+            posting.next = quint64(block) + 1;
+        }
+    }
+
+    std::shared_ptr<const TrigramIndex> finish()
+    {
+        index.m_keys.reserve(size_t(postings.size()));
+        qsizetype bytes = 0;
+        for (auto it = postings.cbegin(); it != postings.cend(); ++it) {
+            index.m_keys.push_back(it.key());
+            bytes += it->deltas.size();
+        }
+        std::sort(index.m_keys.begin(), index.m_keys.end());
+        index.m_starts.reserve(index.m_keys.size() + 1);
+        index.m_postings.reserve(bytes);
+        for (quint32 key : index.m_keys) {
+            index.m_starts.push_back(quint64(index.m_postings.size()));
+            index.m_postings.append(postings.value(key).deltas);
+        }
+        index.m_starts.push_back(quint64(index.m_postings.size()));
+        postings.clear();
+        return std::make_shared<const TrigramIndex>(std::move(index));
+    }
+};
+
+std::vector<bool> TrigramIndex::candidates(QByteArrayView literal) const
+{
+    if (literal.size() < 3)
+        return {};
+    std::vector<quint32> keys;
+    for (qsizetype i = 2; i < literal.size(); ++i) {
+        keys.push_back(quint32(fold(quint8(literal[i - 2]))) << 16
+                       | quint32(fold(quint8(literal[i - 1]))) << 8
+                       | fold(quint8(literal[i])));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // Posting ranges, shortest first: the intersection narrows fastest.
+    std::vector<std::pair<quint64, quint64>> lists;
+    for (quint32 key : keys) {
+        const auto at = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+        if (at == m_keys.end() || *at != key)
+            return std::vector<bool>(m_blockOffsets.size(), false);
+        const size_t i = size_t(at - m_keys.begin());
+        lists.emplace_back(m_starts[i], m_starts[i + 1]);
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+        return a.second - a.first < b.second - b.first;
+    });
+
+    std::vector<bool> result(m_blockOffsets.size(), false);
+    std::vector<bool> listed;
+    for (size_t n = 0; n < lists.size(); ++n) {
+        std::vector<bool>& into = n == 0 ? result : listed;
+        if (n > 0)
+            into.assign(m_blockOffsets.size(), false);
+        // Bounds-checked even though lookup() vetted every list.
+        decodePostings(m_postings, lists[n].first, lists[n].second, into.size(),
+                       [&into](quint64 block) { into[size_t(block)] = true; });
+        if (n > 0) {
+            for (size_t b = 0; b < result.size(); ++b)
+                result[b] = result[b] && listed[b];
+        }
+    }
+    return result;
+}
+
+qint64 TrigramIndex::coveredLines(quint64 fileSize) const
+{
+    if (fileSize < m_fileSize)
+        return 0; // not this file
+    if (fileSize == m_fileSize || m_lastLineTerminated)
+        return m_lineCount;
+    return std::max<qint64>(m_lineCount - 1, 0);
+}
+
+size_t TrigramIndex::memoryUsage() const
+{
+    return m_blockOffsets.capacity() * sizeof(quint64)
+        + m_keys.capacity() * sizeof(quint32) + m_starts.capacity() * sizeof(quint64)
+        + size_t(m_postings.capacity());
+}
+
+std::shared_ptr<const TrigramIndex> TrigramIndex::lookup(const LineIndexCache& cache,
+                                                         const FileSource& source)
+{
+    const QString path = cache.trigramFilePath(source.filePath());
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    Header header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof header) != qint64(sizeof header)
+        || std::memcmp(header.magic, kMagic, sizeof kMagic) != 0
+        || header.version != kVersion || header.byteOrder != kByteOrderMark
+        || header.blockLines == 0 || header.lineCount > header.fileSize
+        || header.blockCount
+            != (header.lineCount + header.blockLines - 1) / header.blockLines
+        || header.keyCount > kKeySpace || header.postingBytes > header.fileSize * 8
+        || fileBytesFor(header) != quint64(file.size()))
+        return nullptr; // truncated or foreign
+
+    FileIdentity identity;
+    identity.size = header.fileSize;
+    identity.prefixLength = header.prefixLength;
+    identity.prefixSha256 = QByteArray(header.prefixSha256, sizeof header.prefixSha256);
+    const IdentityMatch match = matchIdentity(identity, source);
+    if (match == IdentityMatch::Mismatch
+        || (match == IdentityMatch::Identical && header.mtimeMs != mtimeMs(source))
+        || tailHash(source, header.fileSize)
+            != QByteArray::fromRawData(header.tailSha256, sizeof header.tailSha256))
+        return nullptr;
+
+    TrigramIndexBuilder builder;
+    TrigramIndex& index = builder.index;
+    index.m_blockLines = qint64(header.blockLines);
+    index.m_lineCount = qint64(header.lineCount);
+    index.m_fileSize = header.fileSize;
+    index.m_lastLineTerminated = header.flags & kFlagLastLineTerminated;
+    index.m_blockOffsets.resize(size_t(header.blockCount));
+    index.m_keys.resize(size_t(header.keyCount));
+    index.m_starts.resize(size_t(header.keyCount + 1));
+    index.m_postings.resize(qsizetype(header.postingBytes));
+    const auto read = [&file](void* into, quint64 length, quint64 skip = 0) {
+        return file.read(static_cast<char*>(into), qint64(length)) == qint64(length)
+            && (skip == 0 || file.skip(qint64(skip)) == qint64(skip));
+    };
+    const quint64 keyBytes = header.keyCount * sizeof(quint32);
+    if (!read(index.m_blockOffsets.data(), header.blockCount * sizeof(quint64))
+        || !read(index.m_keys.data(), keyBytes, padded(keyBytes) - keyBytes)
+        || !read(index.m_starts.data(), (header.keyCount + 1) * sizeof(quint64))
+        || !read(index.m_postings.data(), header.postingBytes)
+        || index.m_starts.front() != 0 || index.m_starts.back() != header.postingBytes
+        || !std::is_sorted(index.m_starts.begin(), index.m_starts.end()))
+        return nullptr;
+    file.close();
+
+    // The identity checks vouch for the log, not for these bytes: a
+    // damaged file must not reach candidates() or a grep span. Keys
+    // strictly ascending, block offsets ascending within the indexed
+    // bytes, every posting a block that exists - one pass over the lists.
+    const auto& offsets = index.m_blockOffsets;
+    const auto& keys = index.m_keys;
+    if ((!offsets.empty() && (offsets.front() != 0 || offsets.back() > header.fileSize))
+        || !std::is_sorted(offsets.begin(), offsets.end())
+        || (!keys.empty() && keys.back() >= kKeySpace)
+        || std::adjacent_find(keys.begin(), keys.end(), std::greater_equal<>())
+            != keys.end())
+        return nullptr;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!decodePostings(index.m_postings, index.m_starts[i], index.m_starts[i + 1],
+                            header.blockCount, [](quint64) {}))
+            return nullptr;
+    }
+
+    // A hit is a use: refresh the mtime LineIndexCache::evict() orders by.
+    QFile touch(path);
+    if (touch.open(QIODevice::ReadWrite))
+        touch.setFileTime(QDateTime::currentDateTimeUtc(),
+                          QFileDevice::FileModificationTime);
+    return std::make_shared<const TrigramIndex>(std::move(index));
+}
+
+bool TrigramIndex::store(const LineIndexCache& cache, const FileSource& source) const
+{
+    if (m_fileSize < cache.minFileSize() || m_fileSize > source.size())
+        return false;
+    const FileIdentity identity = computeFileIdentity(source);
+    if (m_fileSize < identity.prefixLength
+        || identity.prefixSha256.size() != qsizetype(sizeof Header::prefixSha256))
+        return false; // the identity prefix must lie inside the indexed range
+
+    Header header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.version = kVersion;
+    header.byteOrder = kByteOrderMark;
+    header.blockLines = quint64(m_blockLines);
+    header.lineCount = quint64(m_lineCount);
+    header.fileSize = m_fileSize;
+    header.mtimeMs = mtimeMs(source);
+    header.blockCount = quint64(m_blockOffsets.size());
+    header.keyCount = quint64(m_keys.size());
+    header.postingBytes = quint64(m_postings.size());
+    header.flags = m_lastLineTerminated ? kFlagLastLineTerminated : 0;
+    header.prefixLength = identity.prefixLength;
+    std::memcpy(header.prefixSha256, identity.prefixSha256.constData(),
+                sizeof header.prefixSha256);
+    const QByteArray tail = tailHash(source, m_fileSize);
+    std::memcpy(header.tailSha256, tail.constData(), sizeof header.tailSha256);
+
+    if (!QDir().mkpath(cache.directory()))
+        return false;
+    QSaveFile out(cache.trigramFilePath(source.filePath()));
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    const quint64 zeros = 0;
+    const auto write = [&out, &zeros](const void* bytes, quint64 length) {
+        const quint64 pad = padded(length) - length;
+        return out.write(static_cast<const char*>(bytes), qint64(length)) == qint64(length)
+            && out.write(reinterpret_cast<const char*>(&zeros), qint64(pad)) == qint64(pad);
+    };
+    if (!write(&header, sizeof header)
+        || !write(m_blockOffsets.data(), m_blockOffsets.size() * sizeof(quint64))
+        || !write(m_keys.data(), m_keys.size() * sizeof(quint32))
+        || !write(m_starts.data(), m_starts.size() * sizeof(quint64))
+        || !write(m_postings.constData(), quint64(m_postings.size()))
+        || !out.commit())
+        return false;
+
+    cache.evict();
+    return true;
+}
+
+QFuture<TrigramIndexResult> buildTrigramIndex(std::shared_ptr<FileSource> source,
+                                              std::shared_ptr<const LineIndex> index,
+                                              std::shared_ptr<const LineIndexCache> cache,
+                                              qint64 blockLines)
+{
+    Q_ASSERT(source && index);
+    Q_ASSERT(blockLines > 0);
+
+    return QtConcurrent::run([source, index, cache,
+                              blockLines](QPromise<TrigramIndexResult>& promise) {
+        QElapsedTimer timer;
+        timer.start();
+        promise.setProgressRange(0, 1000);
+
+        TrigramIndexResult result;
+        if (cache) {
+            auto cached = TrigramIndex::lookup(*cache, *source);
+            // A stored index of the same lines (or of a prefix: the file grew
+            // since) serves as is.
+            if (cached && cached->blockLines() == blockLines
+                && cached->lineCount() <= index->lineCount()) {
+                result.index = std::move(cached);
+                result.fromCache = true;
+                result.elapsedMs = timer.elapsed();
+                promise.setProgressValue(1000);
+                promise.addResult(std::move(result));
+                return;
+            }
+        }
+
+        const qint64 total = index->lineCount();
+        const auto pass = source->sequentialScan();
+        TrigramIndexBuilder builder;
+        builder.index.m_blockLines = blockLines;
+        builder.index.m_lineCount = total;
+        builder.index.m_fileSize = index->fileSize();
+        builder.index.m_lastLineTerminated = index->lastLineTerminated();
+        std::vector<detail::LineChunk> blocks;
+        for (qint64 first = 0; first < total; first += blockLines) {
+            blocks.push_back({ first, std::min(first + blockLines, total) });
+            builder.index.m_blockOffsets.push_back(index->offsetOf(first));
+        }
+
+        const bool finished = detail::driveChunks<std::vector<quint32>>(
+            *source, *index, blocks, QThread::idealThreadCount(),
+            [&](const detail::LineChunk& c) {
+                const detail::ByteRange range = detail::lineBytes(*index, c.first, c.end);
+                if (source->isContiguous()) {
+                    return blockTrigrams(QByteArrayView(source->data() + range.offset,
+                                                        qsizetype(range.length)));
+                }
+                QByteArray bytes(qsizetype(range.length), Qt::Uninitialized);
+                source->readInto(range.offset, bytes.data(), bytes.size());
+                return blockTrigrams(bytes);
+            },
+            [&](std::vector<quint32>&& keys, const detail::LineChunk& c) {
+                builder.add(c.first / blockLines, keys);
+                promise.setProgressValue(int(c.end * 1000 / total));
+            },
+            [&] { return promise.isCanceled(); }, &result.stats);
+        if (!finished)
+            return;
+
+        result.index = builder.finish();
+        result.elapsedMs = timer.elapsed();
+        if (cache) {
+            // Persist off the critical path, as buildLineIndex() does.
+            (void)QtConcurrent::run([source, cache, built = result.index] {
+                built->store(*cache, *source);
+            });
+        }
+        promise.setProgressValue(1000);
+        promise.addResult(std::move(result));
+    });
+}
+
+} // namespace logdor
@@ -0,0 +1,44 @@
+#include "SeekIndex_p.h"
+
+#ifdef LOGDOR_HAVE_XZ
+
+#include <QFile>
+
+#include <lzma.h>
+
+#include <cstdint>
+
+namespace logdor::detail {
+
+bool decodeWholeXz(QFile& file, quint64 cap, QByteArray* head, QString* error,
+                   const PassCallbacks& callbacks)
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+    // Concatenated streams, as xz itself reads them (rotated logs).
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        *error = QStringLiteral("xz initialization failed");
+        return false;
+    }
+    const DecodeStep step = [&stream](QByteArrayView* input, bool finish, char** out,
+                                      qsizetype* room, bool* complete) {
+        stream.next_in = reinterpret_cast<const uint8_t*>(input->data());
+        stream.avail_in = size_t(input->size());
+        stream.next_out = reinterpret_cast<uint8_t*>(*out);
+        stream.avail_out = size_t(*room);
+        const lzma_ret rc = lzma_code(&stream, finish ? LZMA_FINISH : LZMA_RUN);
+        *input = input->sliced(input->size() - qsizetype(stream.avail_in));
+        *out += *room - qsizetype(stream.avail_out);
+        *room = qsizetype(stream.avail_out);
+        if (rc == LZMA_STREAM_END)
+            *complete = true;
+        // LZMA_BUF_ERROR: no progress possible - a truncated file at FINISH.
+        return rc == LZMA_OK || rc == LZMA_STREAM_END || rc == LZMA_BUF_ERROR;
+    };
+    const bool ok = decodeWhole(file, "xz", step, cap, head, error, callbacks);
+    lzma_end(&stream);
+    return ok;
+}
+
+} // namespace logdor::detail
+
+#endif // LOGDOR_HAVE_XZ
@@ -0,0 +1,201 @@
+#include "SeekIndex_p.h"
+
+#ifdef LOGDOR_HAVE_ZSTD
+
+#include <QFile>
+
+#include <zstd.h>
+
+#include <memory>
+
+namespace logdor::detail {
+
+namespace {
+
+constexpr quint64 kProgressStep = 4 * 1024 * 1024;
+
+// Seekable format (zstd contrib/seekable_format): the seek table is a
+// skippable frame at the end of the file, closed by a 9-byte footer.
+constexpr quint32 kSeekTableMagic = 0x184D2A5E;
+constexpr quint32 kSeekableMagic = 0x8F92EAB1;
+constexpr quint64 kFooterBytes = 9;
+constexpr quint32 kSkippableMask = 0xFFFFFFF0;
+constexpr quint32 kSkippableMagic = 0x184D2A50;
+
+struct Frame {
+    quint64 in = 0;
+    quint64 compressed = 0;
+    quint64 decompressed = 0;
+};
+
+quint32 readLe32(const char* p)
+{
+    const auto* u = reinterpret_cast<const uchar*>(p);
+    return quint32(u[0]) | quint32(u[1]) << 8 | quint32(u[2]) << 16
+        | quint32(u[3]) << 24;
+}
+
+struct DStreamDeleter {
+    void operator()(ZSTD_DStream* stream) const { ZSTD_freeDStream(stream); }
+};
+using DStreamPtr = std::unique_ptr<ZSTD_DStream, DStreamDeleter>;
+
+// The frames a seek table lists, or nothing when @p data carries none (or
+// one that disagrees with the file).
+std::vector<Frame> seekTableFrames(QByteArrayView data)
+{
+    const quint64 size = quint64(data.size());
+    if (size < kFooterBytes + 8)
+        return {};
+    const char* footer = data.data() + size - kFooterBytes;
+    const quint32 frameCount = readLe32(footer);
+    const uchar descriptor = uchar(footer[4]);
+    if (readLe32(footer + 5) != kSeekableMagic || (descriptor & 0x7c) != 0)
+        return {};
+    const quint64 entryBytes = descriptor & 0x80 ? 12 : 8;
+    const quint64 tableBytes = 8 + frameCount * entryBytes + kFooterBytes;
+    if (tableBytes > size)
+        return {};
+    const char* table = data.data() + size - tableBytes;
+    if (readLe32(table) != kSeekTableMagic
+        || readLe32(table + 4) != tableBytes - 8)
+        return {};
+
+    std::vector<Frame> frames(frameCount);
+    quint64 in = 0;
+    for (quint32 i = 0; i < frameCount; ++i) {
+        const char* entry = table + 8 + i * entryBytes;
+        frames[i] = { in, readLe32(entry), readLe32(entry + 4) };
+        in += frames[i].compressed;
+    }
+    if (in != size - tableBytes)
+        return {};
+    return frames;
+}
+
+// Walk the frame headers. Empty as soon as a frame does not record its
+// content size (streamed output) or does not parse - the whole-stream
+// decode then decides.
+std::vector<Frame> walkFrames(QByteArrayView data, const PassCallbacks& callbacks,
+                              bool* cancelled)
+{
+    std::vector<Frame> frames;
+    quint64 in = 0;
+    quint64 reported = 0;
+    while (in < quint64(data.size())) {
+        const char* at = data.data() + in;
+        const size_t left = size_t(quint64(data.size()) - in);
+        const size_t compressed = ZSTD_findFrameCompressedSize(at, left);
+        if (ZSTD_isError(compressed))
+            return {};
+        if ((readLe32(at) & kSkippableMask) != kSkippableMagic) {
+            const unsigned long long content = ZSTD_getFrameContentSize(at, left);
+            if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR)
+                return {};
+            frames.push_back({ in, compressed, content });
+        }
+        in += compressed;
+        if (in - reported >= kProgressStep) {
+            reported = in;
+            if (callbacks.cancelled && callbacks.cancelled()) {
+                *cancelled = true;
+                return {};
+            }
+            if (callbacks.progress)
+                callbacks.progress(qint64(in));
+        }
+    }
+    return frames;
+}
+
+} // namespace
+
+bool buildZstdIndex(QFile& file, quint64 spacing, quint64 keepLimit,
+                    quint64 wholeCap, QByteArray* head, SeekIndex* index,
+                    QString* error, const PassCallbacks& callbacks)
+{
+    // Frame sizes come from the seek table, else from the frame headers;
+    // either way nothing is decompressed to index a multi-frame file.
+    std::vector<Frame> frames;
+    bool cancelled = false;
+    if (uchar* map = file.size() > 0 ? file.map(0, file.size()) : nullptr) {
+        const QByteArrayView data(reinterpret_cast<const char*>(map), file.size());
+        frames = seekTableFrames(data);
+        if (frames.empty())
+            frames = walkFrames(data, callbacks, &cancelled);
+        file.unmap(map);
+    }
+    if (cancelled)
+        return false;
+
+    quint64 total = 0;
+    bool seekable = frames.size() > 1;
+    for (const Frame& frame : frames) {
+        total += frame.decompressed;
+        seekable = seekable && frame.decompressed <= kMaxSpanBytes;
+    }
+    if (!seekable || total <= keepLimit) {
+        DStreamPtr stream(ZSTD_createDStream());
+        if (!stream) {
+            *error = QStringLiteral("zstd initialization failed");
+            return false;
+        }
+        const DecodeStep step = [&stream](QByteArrayView* input, bool, char** out,
+                                          qsizetype* room, bool* complete) {
+            ZSTD_inBuffer in { input->data(), size_t(input->size()), 0 };
+            ZSTD_outBuffer to { *out, size_t(*room), 0 };
+            const size_t rc = ZSTD_decompressStream(stream.get(), &to, &in);
+            if (ZSTD_isError(rc))
+                return false;
+            *input = input->sliced(qsizetype(in.pos));
+            *out += to.pos;
+            *room -= qsizetype(to.pos);
+            if (in.pos > 0 || to.pos > 0)
+                *complete = rc == 0; // 0: a frame ended and is fully flushed
+            return true;
+        };
+        return decodeWhole(file, "zstd", step, wholeCap, head, error, callbacks);
+    }
+
+    // Spans start at frame boundaries: at least spacing apart, at most
+    // kMaxSpanBytes long. Empty frames never start one.
+    index->size = total;
+    index->points.assign(1, Checkpoint {});
+    quint64 out = 0;
+    for (const Frame& frame : frames) {
+        const quint64 span = out - index->points.back().out;
+        if (frame.decompressed > 0 && out > 0
+            && (span >= spacing || span + frame.decompressed > kMaxSpanBytes)) {
+            Checkpoint point;
+            point.out = out;
+            point.in = frame.in;
+            index->points.push_back(std::move(point));
+        }
+        out += frame.decompressed;
+    }
+    head->clear();
+    if (callbacks.progress)
+        callbacks.progress(file.size());
+    return true;
+}
+
+bool decodeZstdSpan(const SeekIndex& index, size_t span, QByteArrayView input,
+                    char* out)
+{
+    DStreamPtr stream(ZSTD_createDStream());
+    if (!stream)
+        return false;
+    ZSTD_inBuffer in { input.data(), size_t(input.size()), 0 };
+    ZSTD_outBuffer to { out, size_t(index.spanEnd(span) - index.points[span].out), 0 };
+    while (to.pos < to.size) {
+        const size_t before = in.pos + to.pos;
+        const size_t rc = ZSTD_decompressStream(stream.get(), &to, &in);
+        if (ZSTD_isError(rc) || in.pos + to.pos == before)
+            break; // corrupt, or out of input: the file changed under us
+    }
+    return to.pos == to.size;
+}
+
+} // namespace logdor::detail
+
+#endif // LOGDOR_HAVE_ZSTD
@@ -1,11 +1,25 @@
 #include <logdor/FileSource.h>
+#include <logdor/LineIndexCache.h>
 
+#include <QDateTime>
 #include <QTemporaryDir>
 #include <QTest>
 
+#include <thread>
+#include <vector>
+
 #ifdef LOGDOR_HAVE_ZLIB
 #include <zlib.h>
 #endif
+#ifdef LOGDOR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef LOGDOR_HAVE_XZ
+#include <lzma.h>
+#endif
+#ifdef LOGDOR_HAVE_LZ4
+#include <lz4frame.h>
+#endif
 
 using logdor::FileSource;
 
@@ -52,6 +66,74 @@ QByteArray gzipped(const QByteArray& payload)
 }
 #endif
 
+#ifdef LOGDOR_HAVE_ZSTD
+void appendLe32(QByteArray* out, quint32 value)
+{
+    for (int i = 0; i < 4; ++i)
+        out->append(char(value >> (8 * i)));
+}
+
+// Zstd frames of @p frameSize payload bytes each, optionally closed by a
+// seekable-format seek table (with checksums, as zstd's tool writes it).
+QByteArray zstdFrames(const QByteArray& payload, qsizetype frameSize,
+                      bool seekTable = false)
+{
+    QByteArray out;
+    QByteArray table;
+    quint32 frames = 0;
+    for (qsizetype at = 0; at < payload.size(); at += frameSize, ++frames) {
+        const QByteArray part = payload.mid(at, frameSize);
+        QByteArray frame(qsizetype(ZSTD_compressBound(size_t(part.size()))),
+                         Qt::Uninitialized);
+        const size_t n = ZSTD_compress(frame.data(), size_t(frame.size()),
+                                       part.constData(), size_t(part.size()), 3);
+        if (ZSTD_isError(n))
+            return {};
+        out += frame.left(qsizetype(n));
+        appendLe32(&table, quint32(n));
+        appendLe32(&table, quint32(part.size()));
+        appendLe32(&table, 0); // checksum: not verified by readers
+    }
+    if (seekTable) {
+        appendLe32(&out, 0x184D2A5E);
+        appendLe32(&out, quint32(table.size() + 9));
+        out += table;
+        appendLe32(&out, frames);
+        out += char(0x80);
+        appendLe32(&out, 0x8F92EAB1);
+    }
+    return out;
+}
+#endif
+
+#ifdef LOGDOR_HAVE_XZ
+QByteArray xzCompressed(const QByteArray& payload)
+{
+    QByteArray out(payload.size() + payload.size() / 2 + 4096, Qt::Uninitialized);
+    size_t used = 0;
+    if (lzma_easy_buffer_encode(1, LZMA_CHECK_CRC64, nullptr,
+                                reinterpret_cast<const uint8_t*>(payload.constData()),
+                                size_t(payload.size()),
+                                reinterpret_cast<uint8_t*>(out.data()), &used,
+                                size_t(out.size()))
+        != LZMA_OK)
+        return {};
+    return out.left(qsizetype(used));
+}
+#endif
+
+#ifdef LOGDOR_HAVE_LZ4
+QByteArray lz4Compressed(const QByteArray& payload)
+{
+    QByteArray out(qsizetype(LZ4F_compressFrameBound(size_t(payload.size()), nullptr)),
+                   Qt::Uninitialized);
+    const size_t n = LZ4F_compressFrame(out.data(), size_t(out.size()),
+                                        payload.constData(), size_t(payload.size()),
+                                        nullptr);
+    return LZ4F_isError(n) ? QByteArray() : out.left(qsizetype(n));
+}
+#endif
+
 } // namespace
 
 class tst_FileSource : public QObject {
@@ -62,6 +144,7 @@ private slots:
     {
         qunsetenv("LOGDOR_FORCE_BUFFERED");
         qunsetenv("LOGDOR_MAX_DECOMPRESSED_MB");
+        qunsetenv("LOGDOR_MAX_WHOLE_MB");
     }
 
 #ifdef LOGDOR_HAVE_ZLIB
@@ -98,6 +181,38 @@ private slots:
         QCOMPARE(src->read(0, 64), QByteArray("first half\nsecond half\n"));
     }
 
+    void gzipManyMembersInflateInOrder()
+    {
+        // bgzip-style archive: many small members, inflated member-parallel
+        // and stitched back in file order, whole or Seekable.
+        QTemporaryDir dir;
+        const QByteArray payload = patternedContent(6 * 1024 * 1024 + 999);
+        QByteArray archive;
+        for (qsizetype at = 0; at < payload.size(); at += 65280)
+            archive += gzipped(payload.mid(at, 65280));
+        const QString path = writeFile(dir, "bgzf.gz", archive);
+
+        auto whole = FileSource::open(path);
+        QVERIFY(whole);
+        QCOMPARE(whole->mode(), FileSource::Mode::Decompressed);
+        QVERIFY(whole->read(0, payload.size()) == payload);
+
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        auto seekable = FileSource::open(path);
+        QVERIFY(seekable);
+        QCOMPARE(seekable->mode(), FileSource::Mode::Seekable);
+        QCOMPARE(seekable->size(), quint64(payload.size()));
+        QVERIFY(seekable->read(0, payload.size()) == payload);
+
+        // A damaged member in the middle fails the whole open.
+        QByteArray corrupt = archive;
+        for (qsizetype i = archive.size() / 2; i < archive.size() / 2 + 64; ++i)
+            corrupt[i] = char(~corrupt[i]);
+        QString error;
+        QVERIFY(!FileSource::open(writeFile(dir, "bad.gz", corrupt), &error));
+        QVERIFY(!error.isEmpty());
+    }
+
     void gzipTruncatedAndCorruptFail()
     {
         QTemporaryDir dir;
@@ -130,15 +245,113 @@ private slots:
         QCOMPARE(src->read(0, content.size()), content);
     }
 
-    void gzipBombCapFails()
+    void gzipLargeStreamIsSeekable()
     {
         QTemporaryDir dir;
         qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "1");
+        // 10.5 MiB over two members: spans cross the member boundary.
+        const QByteArray payload = patternedContent(qsizetype(10.5 * 1024 * 1024));
+        const qsizetype split = 5 * 1024 * 1024 + 77;
         const QString path = writeFile(
-            dir, "bomb.gz", gzipped(QByteArray(3 * 1024 * 1024, 'x')));
-        QString error;
-        QVERIFY(!FileSource::open(path, &error));
-        QVERIFY(error.contains(QStringLiteral("cap")));
+            dir, "big.gz", gzipped(payload.left(split)) + gzipped(payload.mid(split)));
+
+        auto src = FileSource::open(path);
+        QVERIFY(src);
+        QCOMPARE(src->mode(), FileSource::Mode::Seekable);
+        QVERIFY(!src->isContiguous());
+        QCOMPARE(src->data(), nullptr);
+        QCOMPARE(src->size(), quint64(payload.size()));
+
+        // Inside a span, across checkpoints and the member end, clamped.
+        const qsizetype spacing = qsizetype(FileSource::kCheckpointSpacing);
+        QCOMPARE(src->read(100, 300), payload.mid(100, 300));
+        QCOMPARE(src->read(quint64(split - 1000), 5000), payload.mid(split - 1000, 5000));
+        QCOMPARE(src->read(quint64(spacing - 10), spacing + 20),
+                 payload.mid(spacing - 10, spacing + 20));
+        QCOMPARE(src->read(quint64(payload.size() - 64), 1024),
+                 payload.mid(payload.size() - 64));
+        QCOMPARE(src->read(quint64(payload.size()) + 5, 10), QByteArray());
+
+        QByteArray all(payload.size(), Qt::Uninitialized);
+        QCOMPARE(src->readInto(0, all.data(), all.size()), all.size());
+        QVERIFY(all == payload);
+    }
+
+    void gzipSeekableConcurrentReads()
+    {
+        QTemporaryDir dir;
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        const QByteArray payload = patternedContent(qsizetype(9.5 * 1024 * 1024));
+        auto src = FileSource::open(writeFile(dir, "par.gz", gzipped(payload)));
+        QVERIFY(src);
+        QCOMPARE(src->mode(), FileSource::Mode::Seekable);
+
+        // Readers inflate concurrently, each through both span caches.
+        std::vector<std::thread> readers;
+        std::vector<int> mismatches(4, 0);
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&, t] {
+                QByteArray into(300'000, Qt::Uninitialized);
+                for (int i = 0; i < 40; ++i) {
+                    const qsizetype at = qsizetype((i * 7919 + t * 104729) * 61)
+                        % (payload.size() - into.size());
+                    if (src->read(quint64(at), 4096) != payload.mid(at, 4096))
+                        ++mismatches[t];
+                    src->readInto(quint64(at), into.data(), into.size());
+                    if (into != payload.mid(at, into.size()))
+                        ++mismatches[t];
+                }
+            });
+        }
+        for (std::thread& reader : readers)
+            reader.join();
+        QCOMPARE(mismatches, std::vector<int>(4, 0));
+    }
+
+    void gzipCheckpointsPersistInCache()
+    {
+        QTemporaryDir dir;
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        const QByteArray payload = patternedContent(6 * 1024 * 1024);
+        const QString path = writeFile(dir, "cached.gz", gzipped(payload));
+        auto cache = std::make_shared<const LineIndexCache>(
+            dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        const auto openCached = [&] {
+            auto future = FileSource::openAsync(path, cache);
+            future.waitForFinished();
+            return future.result();
+        };
+
+        const FileSource::AsyncOpenResult first = openCached();
+        QVERIFY(first.source);
+        QVERIFY(!first.fromCache);
+        QVERIFY(QFile::exists(cache->checkpointFilePath(path)));
+        QVERIFY(cache->diskUsage() > 0);
+
+        // Reopen skips the inflate pass and reads the same bytes.
+        const FileSource::AsyncOpenResult second = openCached();
+        QVERIFY(second.source);
+        QVERIFY(second.fromCache);
+        QCOMPARE(second.source->mode(), FileSource::Mode::Seekable);
+        QCOMPARE(second.source->size(), quint64(payload.size()));
+        QCOMPARE(second.source->read(5 * 1024 * 1024, 4096),
+                 payload.mid(5 * 1024 * 1024, 4096));
+
+        // A touched .gz no longer matches; a damaged entry is ignored.
+        QFile gz(path);
+        QVERIFY(gz.open(QIODevice::ReadWrite));
+        QVERIFY(gz.setFileTime(QDateTime::currentDateTimeUtc().addSecs(-3600),
+                               QFileDevice::FileModificationTime));
+        gz.close();
+        QVERIFY(!openCached().fromCache);
+        QFile entry(cache->checkpointFilePath(path));
+        QVERIFY(entry.open(QIODevice::ReadWrite));
+        QVERIFY(entry.resize(entry.size() - 3));
+        entry.close();
+        const FileSource::AsyncOpenResult rebuilt = openCached();
+        QVERIFY(rebuilt.source);
+        QVERIFY(!rebuilt.fromCache);
+        QCOMPARE(rebuilt.source->read(0, payload.size()), payload);
     }
 
     void gzipOpenAsyncDeliversAndCancels()
@@ -170,6 +383,105 @@ private slots:
     }
 #endif // LOGDOR_HAVE_ZLIB
 
+#ifdef LOGDOR_HAVE_ZSTD
+    void zstdFramesAreSeekable()
+    {
+        QTemporaryDir dir;
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        // 1 MiB frames (zstd -B1M style), the last one short.
+        const QByteArray payload = patternedContent(qsizetype(10.3 * 1024 * 1024));
+        const QString path
+            = writeFile(dir, "framed.zst", zstdFrames(payload, 1024 * 1024));
+        QVERIFY(FileSource::isCompressedFile(path));
+
+        auto src = FileSource::open(path);
+        QVERIFY(src);
+        QCOMPARE(src->mode(), FileSource::Mode::Seekable);
+        QCOMPARE(src->size(), quint64(payload.size()));
+        const qsizetype spacing = qsizetype(FileSource::kCheckpointSpacing);
+        QCOMPARE(src->read(100, 300), payload.mid(100, 300));
+        QCOMPARE(src->read(quint64(spacing - 10), spacing + 20),
+                 payload.mid(spacing - 10, spacing + 20));
+        QCOMPARE(src->read(quint64(payload.size() - 64), 1024),
+                 payload.mid(payload.size() - 64));
+        QByteArray all(payload.size(), Qt::Uninitialized);
+        QCOMPARE(src->readInto(0, all.data(), all.size()), all.size());
+        QVERIFY(all == payload);
+    }
+
+    void zstdSeekTableOpensSeekableAndCaches()
+    {
+        QTemporaryDir dir;
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        const QByteArray payload = patternedContent(6 * 1024 * 1024 + 999);
+        const QString path = writeFile(
+            dir, "seekable.zst", zstdFrames(payload, 256 * 1024, true));
+        auto cache = std::make_shared<const LineIndexCache>(
+            dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+
+        QString error;
+        auto first = FileSource::open(path, &error, cache);
+        QVERIFY2(first, qPrintable(error));
+        QCOMPARE(first->mode(), FileSource::Mode::Seekable);
+        QCOMPARE(first->read(0, payload.size()), payload);
+        QVERIFY(QFile::exists(cache->checkpointFilePath(path)));
+
+        auto future = FileSource::openAsync(path, cache);
+        future.waitForFinished();
+        const FileSource::AsyncOpenResult second = future.result();
+        QVERIFY(second.source);
+        QVERIFY(second.fromCache);
+        QCOMPARE(second.source->read(5 * 1024 * 1024, 4096),
+                 payload.mid(5 * 1024 * 1024, 4096));
+    }
+
+    void zstdSingleFrameDecodesWhole()
+    {
+        QTemporaryDir dir;
+        qputenv("LOGDOR_MAX_DECOMPRESSED_MB", "0");
+        const QByteArray payload = patternedContent(3 * 1024 * 1024);
+        const QByteArray frame = zstdFrames(payload, payload.size());
+        auto src = FileSource::open(writeFile(dir, "one.zst", frame));
+        QVERIFY(src);
+        QCOMPARE(src->mode(), FileSource::Mode::Decompressed);
+        QCOMPARE(src->read(0, payload.size()), payload);
+
+        QString error;
+        QVERIFY(!FileSource::open(writeFile(dir, "trunc.zst", frame.left(frame.size() / 2)),
+                                  &error));
+        QVERIFY(error.contains(QStringLiteral("truncated zstd")));
+
+        // Without seek points the bomb cap still applies.
+        qputenv("LOGDOR_MAX_WHOLE_MB", "1");
+        QVERIFY(!FileSource::open(writeFile(dir, "bomb.zst", frame), &error));
+        QVERIFY(error.contains(QStringLiteral("cap")));
+    }
+#endif // LOGDOR_HAVE_ZSTD
+
+#if defined(LOGDOR_HAVE_XZ) && defined(LOGDOR_HAVE_LZ4)
+    void xzAndLz4DecodeWhole()
+    {
+        QTemporaryDir dir;
+        const QByteArray payload = patternedContent(2 * 1024 * 1024 + 17);
+        const QString xz = writeFile(
+            dir, "log.xz", xzCompressed(payload.left(1000)) + xzCompressed(payload.mid(1000)));
+        const QString lz4 = writeFile(dir, "log.lz4", lz4Compressed(payload));
+        for (const QString& path : { xz, lz4 }) {
+            QVERIFY(FileSource::isCompressedFile(path));
+            auto src = FileSource::open(path);
+            QVERIFY(src);
+            QCOMPARE(src->mode(), FileSource::Mode::Decompressed);
+            QCOMPARE(src->read(0, payload.size()), payload);
+        }
+
+        QString error;
+        const QByteArray whole = lz4Compressed(payload);
+        QVERIFY(!FileSource::open(writeFile(dir, "trunc.lz4", whole.left(whole.size() / 2)),
+                                  &error));
+        QVERIFY(error.contains(QStringLiteral("truncated lz4")));
+    }
+#endif
+
     void nonexistentFileFails()
     {
         QString error;
@@ -244,6 +556,80 @@ private slots:
         QCOMPARE(buf, content.mid(1234567, buf.size()));
     }
 
+    void bufferedConcurrentReads()
+    {
+        QTemporaryDir dir;
+        const QByteArray content = patternedContent(qsizetype(13.5 * 1024 * 1024));
+        qputenv("LOGDOR_FORCE_BUFFERED", "1");
+        auto src = FileSource::open(writeFile(dir, "shared.log", content));
+        QVERIFY(src);
+        QCOMPARE(src->mode(), FileSource::Mode::Buffered);
+
+        // Positional reads from many threads, through every cache shard.
+        std::vector<std::thread> readers;
+        std::vector<int> mismatches(6, 0);
+        for (int t = 0; t < 6; ++t) {
+            readers.emplace_back([&, t] {
+                QByteArray into(600'000, Qt::Uninitialized);
+                for (int i = 0; i < 60; ++i) {
+                    const qsizetype at = qsizetype((i * 7919 + t * 104729) * 67)
+                        % (content.size() - into.size());
+                    if (src->read(quint64(at), 9000) != content.mid(at, 9000))
+                        ++mismatches[t];
+                    src->readInto(quint64(at), into.data(), into.size());
+                    if (into != content.mid(at, into.size()))
+                        ++mismatches[t];
+                }
+            });
+        }
+        for (std::thread& reader : readers)
+            reader.join();
+        QCOMPARE(mismatches, std::vector<int>(6, 0));
+    }
+
+    void accessHintsKeepContent_data()
+    {
+        QTest::addColumn<bool>("buffered");
+        QTest::newRow("mapped") << false;
+        QTest::newRow("buffered") << true;
+    }
+
+    void accessHintsKeepContent()
+    {
+        QFETCH(bool, buffered);
+        QTemporaryDir dir;
+        const QByteArray content = patternedContent(qsizetype(5.5 * 1024 * 1024));
+        if (buffered)
+            qputenv("LOGDOR_FORCE_BUFFERED", "1");
+        auto src = FileSource::open(writeFile(dir, "hinted.log", content));
+        QVERIFY(src);
+        QCOMPARE(src->mode(), buffered ? FileSource::Mode::Buffered
+                                       : FileSource::Mode::Mapped);
+
+        {
+            // Nested and moved scopes; the last one out restores random.
+            auto outer = src->sequentialScan();
+            auto inner = src->sequentialScan();
+            FileSource::SequentialScan moved = std::move(inner);
+            QCOMPARE(src->read(4097, 5000), content.mid(4097, 5000));
+        }
+
+        // Unaligned, past-the-end and empty ranges are all fine.
+        src->prefetch(12345, 3 * 1024 * 1024);
+        src->prefetch(quint64(content.size()) - 10, 1024 * 1024);
+        src->prefetch(quint64(content.size()) + 10, 100);
+        src->prefetch(0, 0);
+        QCOMPARE(src->read(12345, 70000), content.mid(12345, 70000));
+
+        // Dropped pages fault back in with the same bytes.
+        src->dropPages(777, 2 * 1024 * 1024);
+        src->dropPages(0, quint64(content.size()) * 2);
+        QByteArray buf(qsizetype(1024 * 1024), '\0');
+        QCOMPARE(src->readInto(1000, buf.data(), buf.size()), buf.size());
+        QCOMPARE(buf, content.mid(1000, buf.size()));
+        if (!buffered)
+            QCOMPARE(QByteArray(src->data(), qsizetype(src->size())), content);
+    }
 };
 
 QTEST_APPLESS_MAIN(tst_FileSource)
@@ -8,6 +8,8 @@
 #include <QRegularExpression>
 #include <QTemporaryDir>
 #include <QTest>
+#include <QTimeZone>
+#include <QThread>
 
 using namespace logdor;
 
@@ -20,7 +22,7 @@ struct Opened {
 };
 
 Opened openContent(const QTemporaryDir& dir, const QString& name,
-                   const QByteArray& content)
+                   const QByteArray& content, int sparseStride = 1)
 {
     const QString path = dir.filePath(name);
     QFile f(path);
@@ -28,7 +30,8 @@ Opened openContent(const QTemporaryDir& dir, const QString& name,
         return {};
     f.close();
     auto source = FileSource::open(path);
-    auto future = buildLineIndex(source);
+    auto future = buildLineIndex(source, kDefaultIndexChunkSize,
+                                 kDefaultIndexThreads, sparseStride);
     future.waitForFinished();
     Opened o { source, future.result().index, {} };
     for (qint64 i = 0; i < o.index->lineCount(); ++i)
@@ -118,7 +121,11 @@ class tst_FilterScan : public QObject {
     Q_OBJECT
 
 private slots:
-    void cleanup() { qunsetenv("LOGDOR_FORCE_BUFFERED"); }
+    void cleanup()
+    {
+        qunsetenv("LOGDOR_FORCE_BUFFERED");
+        qunsetenv("LOGDOR_FORCE_SCALAR_SEARCH");
+    }
 
     void passthroughIsAllWithoutFileAccess()
     {
@@ -220,6 +227,231 @@ private slots:
         compareToReference(mapped, f, 3);
     }
 
+    void sparseIndexMatchesReference()
+    {
+        // The scan only sees offsetOf/lengthOf; a sparse index resolving
+        // them from the bytes must give the dense results, chunk edges and
+        // context windows included.
+        QTemporaryDir dir;
+        const QByteArray corpus = mixedCorpus(2000);
+        auto sparse = openContent(dir, "s.log", corpus, 64);
+        QVERIFY(sparse.index->isSparse());
+        sparse.lines = openContent(dir, "d.log", corpus).lines; // dense reference
+        LineFilter f;
+        f.query = "ERROR";
+        f.contextBefore = 2;
+        f.contextAfter = 1;
+        compareToReference(sparse, f, 3);
+        compareToReference(sparse, f, 1000);
+        f.invert = true;
+        compareToReference(sparse, f, 97);
+    }
+
+    void chunkSearchMatchesPerLine_data()
+    {
+        QTest::addColumn<QString>("query");
+        QTest::addColumn<bool>("caseSensitive");
+        QTest::addColumn<bool>("invert");
+        QTest::addColumn<int>("before");
+        QTest::addColumn<int>("after");
+        QTest::addColumn<bool>("buffered");
+
+        QTest::newRow("exact") << "ID-4242" << true << false << 0 << 0 << false;
+        QTest::newRow("folded") << "id-4242" << false << false << 0 << 0 << false;
+        QTest::newRow("exact-miss") << "id-4242" << true << false << 0 << 0 << false;
+        QTest::newRow("absent") << "ID-9999" << false << false << 0 << 0 << false;
+        QTest::newRow("invert-context") << "ID-4242" << false << true << 2 << 1 << false;
+        QTest::newRow("context") << "id-4242" << false << false << 3 << 3 << false;
+        QTest::newRow("buffered") << "ID-4242" << false << true << 1 << 0 << true;
+        // A '\r' in the needle could span a "\r\n": per-line path.
+        QTest::newRow("cr-needle") << "x\r" << true << false << 0 << 0 << false;
+    }
+
+    void chunkSearchMatchesPerLine()
+    {
+        // Rare hits at line starts and ends, on adjacent lines, twice on
+        // one line, on CRLF lines and on the unterminated last line: the
+        // whole-chunk search must decide every line as the per-line
+        // reference does.
+        QFETCH(QString, query);
+        QFETCH(bool, caseSensitive);
+        QFETCH(bool, invert);
+        QFETCH(int, before);
+        QFETCH(int, after);
+        QFETCH(bool, buffered);
+
+        QByteArray corpus;
+        for (int i = 0; i < 5000; ++i) {
+            if (i % 997 == 0)
+                corpus += "ID-4242 at start " + QByteArray::number(i);
+            else if (i % 997 == 1)
+                corpus += "ends with id-4242";
+            else if (i % 613 == 0)
+                corpus += "twice ID-4242 and Id-4242 " + QByteArray::number(i);
+            else if (i % 101 == 0)
+                corpus += "lone\rx\r inside " + QByteArray::number(i);
+            else
+                corpus += "plain line " + QByteArray::number(i) + " x";
+            corpus += i % 3 == 0 ? "\r\n" : "\n";
+        }
+        corpus += "last unterminated ID-4242";
+
+        if (buffered)
+            qputenv("LOGDOR_FORCE_BUFFERED", "1");
+        QTemporaryDir dir;
+        auto o = openContent(dir, "rare.log", corpus);
+        LineFilter f;
+        f.query = query;
+        f.caseSensitive = caseSensitive;
+        f.invert = invert;
+        f.contextBefore = before;
+        f.contextAfter = after;
+        compareToReference(o, f, 7);
+        compareToReference(o, f, kDefaultFilterChunkLines);
+
+        f.extraPredicate = [](qint64 line, QByteArrayView raw) {
+            return line % 2 == 0 || raw.size() > 20;
+        };
+        compareToReference(o, f, 97);
+    }
+
+    void searchKernelsMatchReference_data()
+    {
+        QTest::addColumn<bool>("scalar");
+        QTest::newRow("vector") << false;
+        QTest::newRow("scalar") << true;
+    }
+
+    void searchKernelsMatchReference()
+    {
+        // Lines of every length around the 16/32-byte vector steps, full of
+        // the needles' first and last letters in both cases, and of bytes
+        // one case bit away from them ('@' / '`', '[' / '{'): the vector
+        // kernels and the scalar one must accept exactly the reference's
+        // lines.
+        QFETCH(bool, scalar);
+        if (scalar)
+            qputenv("LOGDOR_FORCE_SCALAR_SEARCH", "1");
+
+        const QByteArray alphabet = "eEtTxX@`[{ -";
+        QByteArray corpus;
+        quint32 state = 7;
+        for (int i = 0; i < 3000; ++i) {
+            for (int k = 0; k < i % 80; ++k) {
+                state = state * 1103515245u + 12345u;
+                corpus += alphabet[int((state >> 16) % quint32(alphabet.size()))];
+            }
+            if (i % 37 == 0)
+                corpus.insert(corpus.size() - i % 80 / 2, "EvEnT@x");
+            corpus += '\n';
+        }
+        QTemporaryDir dir;
+        auto o = openContent(dir, "k.log", corpus);
+        for (const char* query : { "e", "eT", "ext", "event@x", "@`", "[t", "te{" }) {
+            for (bool caseSensitive : { false, true }) {
+                LineFilter f;
+                f.query = QString::fromLatin1(query);
+                f.caseSensitive = caseSensitive;
+                compareToReference(o, f, 53);
+                f.invert = true;
+                compareToReference(o, f, 53);
+            }
+        }
+    }
+
+    void regexPrefilterKeepsEveryMatch()
+    {
+        // Regexes run on the bytes behind a required-literal prefilter
+        // (and the chunk search when there is one); every pattern shape
+        // must still give the reference's lines. The KELVIN SIGN line
+        // matches "key" only under Unicode case folding.
+        QByteArray corpus = mixedCorpus(400);
+        corpus += "transaction commit\ntransaktion Rollback\n"
+                  "the \xE2\x84\xAA" "ey is here\nfile.log\nfilexlog\n"
+                  "abbbc\nac\nbazbar\nfoobaz\n";
+        QTemporaryDir dir;
+        auto o = openContent(dir, "re.log", corpus);
+        for (const char* pattern :
+             { "transa[ck]tion \\w+", "key", "\\.log$", "ab+c", "x{0,2}baz",
+               "(foo|bar)baz", "foo|bar", "ERROR.*step 1\\d", "\\x41?c", "caf\xC3\xA9 \\d+" }) {
+            for (bool caseSensitive : { false, true }) {
+                LineFilter f;
+                f.query = QString::fromUtf8(pattern);
+                f.regexMode = true;
+                f.caseSensitive = caseSensitive;
+                compareToReference(o, f, 31);
+                f.invert = true;
+                f.contextAfter = 1;
+                compareToReference(o, f, 31);
+            }
+        }
+    }
+
+    void deepRegexMatchesLongLines()
+    {
+        // A capturing group repeated once per byte of an 8 KB line: deeper
+        // than a fixed 32 KiB JIT stack goes, within QRegularExpression's
+        // 512 KiB. It must still match, not be dropped.
+        QTemporaryDir dir;
+        QByteArray corpus = "short ab line\n";
+        for (int i = 0; i < 4000; ++i)
+            corpus += "ab";
+        corpus += "c end\nanother line\n";
+        auto o = openContent(dir, "deep.log", corpus);
+        LineFilter f;
+        f.query = "^(a|b)*c end";
+        f.regexMode = true;
+        const auto result = runScan(o, f);
+        QCOMPARE(result.matchCount, qint64(1));
+        QCOMPARE(result.rows.sourceLine(0), qint64(1));
+    }
+
+    void longLinesSplitChunksByBytes()
+    {
+        // Three 3 MiB lines among short ones: one line-count chunk would
+        // cover everything, but chunks are cut at 4 MiB - a long line runs
+        // alone or with few neighbours - and the rows still merge in order.
+        QTemporaryDir dir;
+        QByteArray corpus;
+        for (int i = 0; i < 3; ++i) {
+            corpus += mixedCorpus(4000);
+            corpus += "ERROR long " + QByteArray(3 * 1024 * 1024, 'x') + '\n';
+        }
+        corpus += mixedCorpus(4000);
+        auto o = openContent(dir, "long.log", corpus);
+        LineFilter f;
+        f.query = "ERROR";
+        f.contextBefore = 1;
+        compareToReference(o, f, kDefaultFilterChunkLines);
+
+        const auto result = runScan(o, f, kDefaultFilterChunkLines);
+        QVERIFY(result.stats.chunks >= 3);
+        QCOMPARE(result.stats.threadUtilization.size(),
+                 size_t(qMax(1, QThread::idealThreadCount())));
+        for (double share : result.stats.threadUtilization)
+            QVERIFY(share >= 0.0 && share <= 1.0);
+    }
+
+    void partlyEvictedFileMergesInLineOrder()
+    {
+        // Evicted stripes make chunks cold: they run after the resident
+        // ones while the warm thread faults them in, yet the rows come out
+        // in line order. (Where nothing is evicted - tmpfs, macOS, pages
+        // not yet written back - this is the all-resident path.)
+        QTemporaryDir dir;
+        auto o = openContent(dir, "cold.log", mixedCorpus(300000));
+        QCOMPARE(o.source->mode(), FileSource::Mode::Mapped);
+        for (quint64 at = 0; at < o.source->size(); at += 2 * 1024 * 1024)
+            o.source->dropPages(at, 1024 * 1024);
+        LineFilter f;
+        f.query = "ERROR";
+        f.contextAfter = 1;
+        compareToReference(o, f, 1000);
+        f.query = "Warning";
+        f.contextAfter = 0;
+        compareToReference(o, f, 333);
+    }
+
     void crlfLinesMatchWithoutCr()
     {
         QTemporaryDir dir;
@@ -393,6 +625,508 @@ private slots:
         QCOMPARE(atEnd.result().matchCount, qint64(0));
     }
 
+    void streamingPublishesGrowingPartials()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "stream.log", mixedCorpus(400));
+        LineFilter f;
+        f.query = "ERROR";
+        f.contextBefore = 1;
+        f.contextAfter = 2;
+
+        // Interval 0: a partial after every merged chunk that found more.
+        auto future = scanFilter(o.source, o.index, f, 7, 0, /*publishIntervalMs=*/0);
+        future.waitForFinished();
+        const int count = future.resultCount();
+        QVERIFY(count > 2);
+        const FilterScanResult complete = future.resultAt(count - 1);
+        QVERIFY(!complete.partial);
+        const FilterScanResult plain = runScan(o, f);
+        QCOMPARE(complete.matchCount, plain.matchCount);
+        QCOMPARE(complete.rows.size(), plain.rows.size());
+
+        qint64 previousMatches = -1;
+        for (int i = 0; i < count - 1; ++i) {
+            const FilterScanResult partial = future.resultAt(i);
+            QVERIFY(partial.partial);
+            QVERIFY(partial.matchCount > previousMatches);
+            QVERIFY(partial.matchCount <= complete.matchCount);
+            previousMatches = partial.matchCount;
+            // Every partial row is a complete row; all lines counted.
+            QCOMPARE(partial.rows.lineCount(), complete.rows.lineCount());
+            for (qint64 row = 0; row < partial.rows.size(); ++row)
+                QVERIFY(complete.rows.rowForSourceLine(partial.rows.sourceLine(row)) >= 0);
+        }
+
+        // Nothing found: one empty partial clears the old rows, then the end.
+        f.query = "no such text";
+        auto empty = scanFilter(o.source, o.index, f, 7, 0, 0);
+        empty.waitForFinished();
+        QCOMPARE(empty.resultCount(), 2);
+        QVERIFY(empty.resultAt(0).partial);
+        QCOMPARE(empty.resultAt(0).rows.size(), qint64(0));
+        QVERIFY(!empty.resultAt(1).partial);
+
+        // Off by default, and refineFilter streams the same way.
+        f.query = "ERROR";
+        auto quiet = scanFilter(o.source, o.index, f, 7);
+        quiet.waitForFinished();
+        QCOMPARE(quiet.resultCount(), 1);
+        f.query = "ERROR something";
+        auto refined = refineFilter(o.source, o.index, f, plain.rows, 7, 0);
+        refined.waitForFinished();
+        QVERIFY(refined.resultCount() > 1);
+        QVERIFY(refined.resultAt(0).partial);
+        QCOMPARE(refined.resultAt(refined.resultCount() - 1).matchCount,
+                 plain.matchCount);
+    }
+
+    void focusedScanStartsAtFocusAndMatchesFullScan()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "focus.log", mixedCorpus(400));
+        LineFilter f;
+        f.query = "ERROR";
+        f.contextBefore = 1;
+        f.contextAfter = 2;
+        const FilterScanResult plain = runScan(o, f);
+
+        auto future = scanFilter(o.source, o.index, f, 7, 0, 0, /*focusLine=*/200);
+        future.waitForFinished();
+        const int count = future.resultCount();
+        QVERIFY(count > 2);
+        const FilterScanResult complete = future.resultAt(count - 1);
+        QVERIFY(!complete.partial);
+        QCOMPARE(complete.matchCount, plain.matchCount);
+        QCOMPARE(complete.rows.size(), plain.rows.size());
+        for (qint64 row = 0; row < plain.rows.size(); ++row)
+            QCOMPARE(complete.rows.sourceLine(row), plain.rows.sourceLine(row));
+
+        // The first partial is the focus chunk (lines 196-202).
+        const FilterScanResult first = future.resultAt(0);
+        QVERIFY(first.partial);
+        QCOMPARE(first.matchCount, qint64(2)); // 196, 200
+        QCOMPARE(first.rows.sourceLine(0), qint64(195));
+        QVERIFY(first.rows.rowForSourceLine(200) >= 0);
+
+        // Each partial is a contiguous run of the complete rows, growing at
+        // both ends.
+        qint64 previousFrom = -1;
+        qint64 previousTo = -1;
+        for (int i = 0; i < count - 1; ++i) {
+            const FilterScanResult partial = future.resultAt(i);
+            const qint64 from = complete.rows.rowForSourceLine(partial.rows.sourceLine(0));
+            QVERIFY(from >= 0);
+            for (qint64 row = 0; row < partial.rows.size(); ++row)
+                QCOMPARE(partial.rows.sourceLine(row), complete.rows.sourceLine(from + row));
+            const qint64 to = from + partial.rows.size();
+            if (previousFrom >= 0) {
+                QVERIFY(from <= previousFrom);
+                QVERIFY(to >= previousTo);
+            }
+            previousFrom = from;
+            previousTo = to;
+        }
+
+        // A limit sets its own order: the focus is ignored.
+        f.limit = { 3, false };
+        auto limited = scanFilter(o.source, o.index, f, 7, 0, -1, 200);
+        limited.waitForFinished();
+        QCOMPARE(limited.result().rows.sourceLine(0), qint64(0));
+
+        // A focus outside the scanned lines scans in line order.
+        f.limit = {};
+        auto outside = scanFilter(o.source, o.index, f, 7, 0, 0, 400);
+        outside.waitForFinished();
+        QCOMPARE(outside.resultAt(0).rows.sourceLine(0), qint64(0));
+    }
+
+    void takeMatchLimitSplitsSuffix_data()
+    {
+        QTest::addColumn<QString>("text");
+        QTest::addColumn<QString>("rest");
+        QTest::addColumn<qint64>("count");
+        QTest::addColumn<bool>("fromEnd");
+
+        QTest::newRow("head") << "error | head 500" << "error" << qint64(500) << false;
+        QTest::newRow("tail") << "level:error tag:wifi |tail 20  " << "level:error tag:wifi"
+                              << qint64(20) << true;
+        QTest::newRow("case") << "x | HEAD 3" << "x" << qint64(3) << false;
+        QTest::newRow("alone") << "| tail 7" << "" << qint64(7) << true;
+        QTest::newRow("zero") << "x | head 0" << "x | head 0" << qint64(0) << false;
+        QTest::newRow("no-count") << "x | head" << "x | head" << qint64(0) << false;
+        QTest::newRow("no-pipe") << "x head 5" << "x head 5" << qint64(0) << false;
+        QTest::newRow("glued") << "x | head5" << "x | head5" << qint64(0) << false;
+        QTest::newRow("word") << "x | ahead 5" << "x | ahead 5" << qint64(0) << false;
+    }
+
+    void takeMatchLimitSplitsSuffix()
+    {
+        QFETCH(QString, text);
+        QFETCH(QString, rest);
+        QFETCH(qint64, count);
+        QFETCH(bool, fromEnd);
+
+        const MatchLimit limit = takeMatchLimit(&text);
+        QCOMPARE(text, rest);
+        QCOMPARE(limit.count, count);
+        if (count > 0)
+            QCOMPARE(limit.fromEnd, fromEnd);
+    }
+
+    void limitKeepsFirstOrLastMatches()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "limit.log", mixedCorpus(4000));
+        LineFilter f;
+        f.query = "ERROR"; // every 4th line: 0, 4, ... 3996
+        f.contextAfter = 1;
+
+        f.limit = { 3, false };
+        const FilterScanResult head = runScan(o, f);
+        QCOMPARE(head.matchCount, qint64(3));
+        QCOMPARE(head.rows.size(), qint64(6));
+        QCOMPARE(head.rows.sourceLine(0), qint64(0));
+        QCOMPARE(head.rows.sourceLine(5), qint64(9));
+
+        f.limit = { 3, true };
+        const FilterScanResult tail = runScan(o, f);
+        QCOMPARE(tail.matchCount, qint64(3));
+        QCOMPARE(tail.rows.sourceLine(0), qint64(3988));
+        QCOMPARE(tail.rows.sourceLine(5), qint64(3997));
+
+        // Fewer matches than the limit: all of them, either way.
+        f.query = "step 12";
+        f.contextAfter = 0;
+        f.limit = { 1000, true };
+        const FilterScanResult few = runScan(o, f);
+        f.limit = {};
+        QCOMPARE(few.matchCount, runScan(o, f).matchCount);
+
+        // An empty query keeps the first or last lines.
+        f.query.clear();
+        f.limit = { 5, true };
+        QVERIFY(!f.isPassthrough());
+        const FilterScanResult lastLines = runScan(o, f);
+        QCOMPARE(lastLines.rows.size(), qint64(5));
+        QCOMPARE(lastLines.rows.sourceLine(0), qint64(3995));
+
+        // Limited rows bound no narrower filter, and key apart.
+        LineFilter narrower;
+        narrower.query = "ERROR something";
+        LineFilter limitedPrevious;
+        limitedPrevious.query = "ERROR";
+        limitedPrevious.limit = { 10, false };
+        QVERIFY(!narrower.narrows(limitedPrevious));
+        narrower.limit = { 10, false };
+        limitedPrevious.limit = {};
+        QVERIFY(narrower.narrows(limitedPrevious));
+        auto refined = refineFilter(o.source, o.index, narrower,
+                                    runScan(o, limitedPrevious).rows, 7);
+        refined.waitForFinished();
+        QCOMPARE(refined.result().matchCount, qint64(10));
+        LineFilter unlimited = narrower;
+        unlimited.limit = {};
+        QVERIFY(FilterResultCache::keyOf(narrower) != FilterResultCache::keyOf(unlimited));
+    }
+
+    void countMatchesScanAndEstimatesFirst()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "count.log", mixedCorpus(40000));
+        LineFilter f;
+        f.query = "ERROR"; // every 4th line
+        f.contextAfter = 3; // neither context nor a limit applies
+        f.limit = { 5, false };
+
+        auto exact = countFilter(o.source, o.index, f, 7);
+        exact.waitForFinished();
+        QCOMPARE(exact.resultCount(), 1);
+        QVERIFY(!exact.result().partial);
+        QCOMPARE(exact.result().matchCount, qint64(10000));
+        QCOMPARE(exact.result().low, qint64(10000));
+        QCOMPARE(exact.result().high, qint64(10000));
+
+        // Same count as the scan, whatever decides the lines.
+        f.contextAfter = 0;
+        f.limit = {};
+        LineFilter regex;
+        regex.query = "ERROR|debug";
+        regex.regexMode = true;
+        LineFilter inverted;
+        inverted.query = "step 1";
+        inverted.invert = true;
+        inverted.extraPredicate = [](qint64 line, QByteArrayView) { return line % 3 != 0; };
+        for (const LineFilter& g : { f, regex, inverted }) {
+            auto counted = countFilter(o.source, o.index, g, 7);
+            counted.waitForFinished();
+            QCOMPARE(counted.result().matchCount, runScan(o, g).matchCount);
+        }
+
+        // 16 windows of 64 lines, each holding exactly 16 ERROR lines: an
+        // estimate with no spread, then exact over more and more lines.
+        auto sampled = countFilter(o.source, o.index, f, 64, 16, 0);
+        sampled.waitForFinished();
+        QVERIFY(sampled.resultCount() > 2);
+        const FilterCountResult estimate = sampled.resultAt(0);
+        QVERIFY(estimate.partial);
+        QCOMPARE(estimate.matchCount, qint64(10000));
+        QCOMPARE(estimate.high - estimate.low, qint64(0));
+        const FilterCountResult counted = sampled.resultAt(sampled.resultCount() - 1);
+        QVERIFY(!counted.partial);
+        QCOMPARE(counted.matchCount, qint64(10000));
+
+        // A clustered needle: intervals hold their estimate and shrink as
+        // the exact share grows.
+        f.query = "step 1";
+        auto clustered = countFilter(o.source, o.index, f, 64, 16, 0);
+        clustered.waitForFinished();
+        qint64 width = o.index->lineCount();
+        for (int i = 0; i < clustered.resultCount() - 1; ++i) {
+            const FilterCountResult partial = clustered.resultAt(i);
+            QVERIFY(partial.partial);
+            QVERIFY(partial.low <= partial.matchCount);
+            QVERIFY(partial.matchCount <= partial.high);
+            QVERIFY(partial.high - partial.low <= width + 1);
+            width = partial.high - partial.low;
+        }
+        QCOMPARE(clustered.resultAt(clustered.resultCount() - 1).matchCount,
+                 runScan(o, f).matchCount);
+
+        // Nothing sampled is not nothing ruled out.
+        f.query = "no such text";
+        auto none = countFilter(o.source, o.index, f, 64, 16);
+        none.waitForFinished();
+        QCOMPARE(none.resultCount(), 2);
+        QCOMPARE(none.resultAt(0).matchCount, qint64(0));
+        QVERIFY(none.resultAt(0).high > 0);
+        QCOMPARE(none.resultAt(1).high, qint64(0));
+
+        // A sample this large against the file: straight to the exact count.
+        auto small = countFilter(o.source, o.index, f, 7, 2000);
+        small.waitForFinished();
+        QCOMPARE(small.resultCount(), 1);
+    }
+
+    void findMatchStopsAtNearestHit()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "find.log", mixedCorpus(4000));
+        const RowSet every = RowSet::all(4000);
+        LineFilter f;
+        f.query = "ERROR"; // lines 0, 4, 8, ...
+        const auto find = [&](const RowSet& within, qint64 from, bool backward,
+                              qint64 chunk = 64) {
+            auto future = findMatch(o.source, o.index, f, within, from, backward, chunk);
+            future.waitForFinished();
+            return future.result();
+        };
+
+        QCOMPARE(find(every, 5, false).line, qint64(8));
+        QCOMPARE(find(every, 8, false).line, qint64(12)); // strictly after
+        QCOMPARE(find(every, 8, true).line, qint64(4));
+        QCOMPARE(find(every, -1, false).line, qint64(0)); // wrapping around
+        QCOMPARE(find(every, 4000, true).line, qint64(3996));
+        QCOMPARE(find(every, 3996, false).line, qint64(-1));
+        QCOMPARE(find(every, 0, true).line, qint64(-1));
+        // A near hit reads only the first chunk.
+        QVERIFY(find(every, 5, false, kDefaultFilterChunkLines).rowsSearched
+                <= kFindFirstChunkLines);
+
+        // A lone distant match, over many growing chunks either way.
+        f.query = "step 3000";
+        QCOMPARE(find(every, 10, false).line, qint64(3000));
+        QCOMPARE(find(every, 3999, true).line, qint64(3000));
+        QCOMPARE(find(every, 3000, false).line, qint64(-1));
+        f.query = "step 3000$";
+        f.regexMode = true;
+        QCOMPARE(find(every, 3999, true, 7).line, qint64(3000));
+
+        // Only the given rows are searched.
+        f.query = "ERROR";
+        f.regexMode = false;
+        const RowSet some = RowSet::fromLines({ 2, 4, 9, 12, 20 }, 4000);
+        QCOMPARE(find(some, 5, false).line, qint64(12));
+        QCOMPARE(find(some, 12, true).line, qint64(4));
+        QCOMPARE(find(some, 20, false).line, qint64(-1));
+        QCOMPARE(find(some, -1, false, 1).line, qint64(4));
+    }
+
+    void narrowsOnlyWhenProvable_data()
+    {
+        QTest::addColumn<QString>("before");
+        QTest::addColumn<QString>("after");
+        QTest::addColumn<bool>("regexMode");
+        QTest::addColumn<bool>("invert");
+        QTest::addColumn<bool>("expected");
+
+        QTest::newRow("extended") << "connection ti" << "connection tim" << false << false << true;
+        QTest::newRow("prepended") << "step" << "failed at step" << false << false << true;
+        QTest::newRow("folded") << "error" << "ERROR something" << false << false << true;
+        QTest::newRow("replaced") << "connection ti" << "connection to" << false << false << false;
+        QTest::newRow("shortened") << "connection tim" << "connection ti" << false << false << false;
+        QTest::newRow("cleared") << "error" << "" << false << false << false;
+        QTest::newRow("from-empty") << "" << "error" << false << false << true;
+        QTest::newRow("invert-shortened") << "step 12" << "step 1" << false << true << true;
+        QTest::newRow("invert-extended") << "step 1" << "step 12" << false << true << false;
+        QTest::newRow("regex-same") << "step \\d" << "step \\d" << true << false << true;
+        QTest::newRow("regex-extended") << "step" << "step \\d" << true << false << false;
+        QTest::newRow("kelvin") << "k" << QString::fromUtf8("\xE2\x84\xAA" "1") << false << false << false;
+    }
+
+    void narrowsOnlyWhenProvable()
+    {
+        QFETCH(QString, before);
+        QFETCH(QString, after);
+        QFETCH(bool, regexMode);
+        QFETCH(bool, invert);
+        QFETCH(bool, expected);
+
+        LineFilter previous;
+        previous.query = before;
+        previous.regexMode = regexMode;
+        previous.invert = invert;
+        LineFilter next = previous;
+        next.query = after;
+        next.contextAfter = 2; // context never matters
+        QCOMPARE(next.narrows(previous), expected);
+
+        // Differing flags never narrow (an empty previous query has none).
+        if (!before.isEmpty()) {
+            next.caseSensitive = true;
+            QVERIFY(!next.narrows(previous));
+        }
+    }
+
+    void refineMatchesFullScan_data()
+    {
+        QTest::addColumn<bool>("buffered");
+        QTest::newRow("mapped") << false;
+        QTest::newRow("buffered") << true;
+    }
+
+    // As-you-type: each filter refines the rows of the one before it, with
+    // context changing along the way; every step must equal a full scan.
+    void refineMatchesFullScan()
+    {
+        QFETCH(bool, buffered);
+        if (buffered)
+            qputenv("LOGDOR_FORCE_BUFFERED", "1");
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "refine.log", mixedCorpus(600));
+
+        LineFilter filter;
+        filter.extraPredicate = [](qint64 line, QByteArrayView) { return line % 5 != 0; };
+        RowSet rows = runScan(o, filter).rows;
+        const QList<std::pair<QString, int>> steps = {
+            { "e", 2 }, { "er", 2 }, { "err", 0 }, { "error", 1 },
+            { "error something failed at step 1", 3 },
+        };
+        for (const auto& [query, context] : steps) {
+            LineFilter next = filter;
+            next.query = query;
+            next.contextBefore = context;
+            next.contextAfter = context;
+            QVERIFY(next.narrows(filter));
+            auto future = refineFilter(o.source, o.index, next, rows, 5);
+            future.waitForFinished();
+            const FilterScanResult refined = future.result();
+            const FilterScanResult full = runScan(o, next);
+            QCOMPARE(refined.matchCount, full.matchCount);
+            QCOMPARE(refined.rows.size(), full.rows.size());
+            for (qint64 row = 0; row < full.rows.size(); ++row)
+                QCOMPARE(refined.rows.sourceLine(row), full.rows.sourceLine(row));
+            filter = next;
+            rows = refined.rows;
+        }
+        QVERIFY(rows.size() > 0);
+    }
+
+    void resultCacheKeysNormalizedFilters()
+    {
+        LineFilter text;
+        text.query = "error";
+        const QString key = FilterResultCache::keyOf(text);
+        QVERIFY(!key.isEmpty());
+        QCOMPARE(FilterResultCache::keyOf(LineFilter {}), QString()); // passthrough
+
+        const auto differs = [&](auto change) {
+            LineFilter other = text;
+            change(other);
+            return FilterResultCache::keyOf(other) != key;
+        };
+        QVERIFY(differs([](LineFilter& f) { f.caseSensitive = true; }));
+        QVERIFY(differs([](LineFilter& f) { f.invert = true; }));
+        QVERIFY(differs([](LineFilter& f) { f.regexMode = true; }));
+        QVERIFY(differs([](LineFilter& f) { f.contextAfter = 1; }));
+        QVERIFY(differs([](LineFilter& f) { f.query = "errors"; }));
+        QVERIFY(!differs([](LineFilter& f) { f.columns = {}; }));
+
+        // A predicate needs a key; under an empty query the flags are moot.
+        LineFilter chrome;
+        chrome.extraPredicate = [](qint64, QByteArrayView) { return true; };
+        QCOMPARE(FilterResultCache::keyOf(chrome), QString());
+        chrome.extraPredicateKey = "levels:EF";
+        const QString chromeKey = FilterResultCache::keyOf(chrome);
+        QVERIFY(!chromeKey.isEmpty());
+        chrome.invert = true;
+        chrome.caseSensitive = true;
+        QCOMPARE(FilterResultCache::keyOf(chrome), chromeKey);
+        chrome.extraPredicateKey = "levels:F";
+        QVERIFY(FilterResultCache::keyOf(chrome) != chromeKey);
+
+        // Field queries key by trimmed text and time context.
+        auto parser = parserById(u"logcat");
+        LineFilter field;
+        field.fieldQuery = CompiledQuery::compile("level:error", parser->schema(),
+                                                  Qt::CaseInsensitive);
+        LineFilter padded = field;
+        padded.fieldQuery = CompiledQuery::compile(" level:error ", parser->schema(),
+                                                   Qt::CaseInsensitive);
+        QCOMPARE(FilterResultCache::keyOf(padded), FilterResultCache::keyOf(field));
+        TimeParseContext utc;
+        utc.assumedZone = QTimeZone::utc();
+        TimeParseContext tokyo;
+        tokyo.assumedZone = QTimeZone("Asia/Tokyo");
+        QVERIFY(FilterResultCache::keyOf(field, utc) != FilterResultCache::keyOf(field, tokyo));
+        QVERIFY(FilterResultCache::keyOf(field, utc) != key);
+    }
+
+    void resultCacheEvictsLeastRecentlyUsed()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "cache.log", mixedCorpus(4000));
+        const auto resultFor = [&](const QString& query) {
+            LineFilter f;
+            f.query = query;
+            return runScan(o, f);
+        };
+        const FilterScanResult errors = resultFor("ERROR"); // 1000 rows
+        const qsizetype entry = qsizetype(errors.rows.memoryUsage());
+
+        // Room for two entries of this size, not three.
+        FilterResultCache cache(entry * 2 + entry / 2);
+        cache.insert("a", errors);
+        cache.insert("b", resultFor("info"));
+        QVERIFY(cache.find("a")); // now most recently used
+        cache.insert("c", resultFor("Warning"));
+        QVERIFY(cache.find("a"));
+        QVERIFY(!cache.find("b"));
+        QVERIFY(cache.find("c"));
+        QVERIFY(cache.memoryUsage() <= cache.maxBytes());
+
+        const FilterScanResult* hit = cache.find("a");
+        QCOMPARE(hit->matchCount, errors.matchCount);
+        QCOMPARE(hit->rows.size(), errors.rows.size());
+        QCOMPARE(hit->rows.sourceLine(5), errors.rows.sourceLine(5));
+        QVERIFY(!cache.find(QString())); // uncacheable filters never hit
+
+        // Too large for the whole budget: not kept at all.
+        FilterResultCache tiny(entry / 2);
+        tiny.insert("a", errors);
+        QVERIFY(!tiny.find("a"));
+    }
+
     void cancellationProducesNoResult()
     {
         QTemporaryDir dir;
@@ -156,6 +156,28 @@ private slots:
         }
     }
 
+    void lineAtMapsEveryByte()
+    {
+        // Empty lines, CRLF, a lone '\r' and an unterminated last line,
+        // repeated across block boundaries: every byte - terminators
+        // included - maps to the line whose [offsetOf, endOffsetOf) holds it.
+        QByteArray data;
+        for (int i = 0; i < 2500; ++i)
+            data += i % 5 == 0 ? QByteArray("\n") : i % 5 == 1 ? QByteArray("crlf\r\n")
+                : "line\r" + QByteArray::number(i) + '\n';
+        data += "tail";
+        const LineIndex idx = indexOf(data);
+        qint64 line = 0;
+        for (qsizetype at = 0; at < data.size(); ++at) {
+            if (quint64(at) == idx.endOffsetOf(line))
+                ++line;
+            QCOMPARE(idx.lineAt(quint64(at)), line);
+        }
+        QCOMPARE(line, idx.lineCount() - 1);
+        QCOMPARE(idx.lineAt(quint64(data.size()) + 10), idx.lineCount() - 1);
+        QCOMPARE(indexOf("").lineAt(0), qint64(-1));
+    }
+
     void wideModeMigrationPreservesOffsets()
     {
         // Synthetic terminators only - no real multi-GB file needed. A >4 GiB
@@ -261,6 +283,97 @@ private slots:
         compareIndexes(extendOf(head, tail), indexOf(head + tail));
     }
 
+    void bulkAppendMatchesSingle()
+    {
+        // Batches of various sizes, crossing block boundaries and resuming
+        // over an unterminated "\r" tail, must equal per-call appends.
+        QByteArray data;
+        for (int i = 0; i < 2500; ++i)
+            data += QByteArray(i % 5, 'x') + (i % 3 ? "\n" : "\r\n");
+        data += "tail\r";
+
+        std::vector<quint64> terminators;
+        for (qsizetype i = 0; i < data.size(); ++i) {
+            if (data[i] == '\n')
+                terminators.push_back(quint64(i)
+                    | (i > 0 && data[i - 1] == '\r' ? LineIndex::kPrecededByCr : 0));
+        }
+        LineIndex bulk;
+        size_t at = 0;
+        for (size_t batch : { 0, 1, 1023, 1, 700 }) {
+            bulk.addTerminators(terminators.data() + at, qsizetype(batch));
+            at += batch;
+        }
+        bulk.addTerminators(terminators.data() + at,
+                            qsizetype(terminators.size() - at));
+        bulk.finalize(quint64(data.size()));
+        compareIndexes(bulk, indexOf(data));
+
+        const QByteArray grown = data + "\nmore\r\n";
+        LineIndex resumed = LineIndex::resumedFrom(bulk);
+        const quint64 extra[] = { quint64(data.size()) | LineIndex::kPrecededByCr,
+                                  quint64(grown.size() - 1) | LineIndex::kPrecededByCr };
+        resumed.addTerminators(extra, 2);
+        resumed.finalize(quint64(grown.size()));
+        compareIndexes(resumed, indexOf(grown));
+    }
+
+    void divergentExtendsShareNothingMutable()
+    {
+        // Two extends of one base share its full blocks; neither may see
+        // the other's lines, and the base must stay as it was - including
+        // when the resume point sits in a partly filled block.
+        for (const int headLines : { 2048, 2500 }) {
+            QByteArray head;
+            for (int i = 0; i < headLines; ++i)
+                head += QByteArray(i % 9, 'h') + (i % 4 ? "\n" : "\r\n");
+            head += "open";
+            QByteArray left, right;
+            for (int i = 0; i < 1500; ++i) {
+                left += QByteArray(i % 5, 'l') + "\n";
+                right += QByteArray(i % 3, 'r') + "\r\n";
+            }
+            const LineIndex base = indexOf(head);
+            const LineIndex a = extendOf(head, left);
+            const LineIndex b = extendOf(head, right);
+            LineIndex chained = LineIndex::resumedFrom(a);
+            chained.addTerminator(quint64(head.size() + left.size()) + 2, true);
+            chained.finalize(quint64(head.size() + left.size()) + 3);
+
+            compareIndexes(base, indexOf(head));
+            compareIndexes(a, indexOf(head + left));
+            compareIndexes(b, indexOf(head + right));
+            compareIndexes(chained, indexOf(head + left + "x\r\n"));
+        }
+    }
+
+    void snapshotWhileBuildingIsStable()
+    {
+        QByteArray data;
+        for (int i = 0; i < 3000; ++i)
+            data += QByteArray(i % 11, 's') + (i % 2 ? "\r\n" : "\n");
+        LineIndex building;
+        QList<LineIndex> snapshots;
+        QList<qsizetype> ends;
+        for (qsizetype i = 0; i < data.size(); ++i) {
+            if (data[i] != '\n')
+                continue;
+            building.addTerminator(quint64(i), i > 0 && data[i - 1] == '\r');
+            // Around block boundaries and in the middle of blocks.
+            const qint64 lines = building.lineCount() - 1;
+            if (lines % 1024 == 0 || lines % 1024 == 1 || lines % 700 == 0) {
+                snapshots.append(building.snapshot());
+                ends.append(i + 1);
+            }
+        }
+        building.finalize(quint64(data.size()));
+        compareIndexes(building, indexOf(data));
+        for (qsizetype k = 0; k < snapshots.size(); ++k) {
+            QVERIFY(snapshots[k].lastLineTerminated());
+            compareIndexes(snapshots[k], indexOf(data.left(ends[k])));
+        }
+    }
+
     void memoryStaysCompact()
     {
         LineIndex idx;
@@ -0,0 +1,263 @@
+#include <logdor/FileSource.h>
+#include <logdor/LineIndex.h>
+#include <logdor/LineIndexCache.h>
+#include <logdor/LineIndexer.h>
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+
+using namespace logdor;
+
+namespace {
+
+QString writeFile(const QTemporaryDir& dir, const QString& name,
+                  const QByteArray& content)
+{
+    const QString path = dir.filePath(name);
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly) || f.write(content) != content.size())
+        return {};
+    return path;
+}
+
+bool appendToFile(const QString& path, const QByteArray& bytes)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    return f.write(bytes) == bytes.size();
+}
+
+// Mixed endings, a lone '\r' and an unterminated tail.
+QByteArray logContent(int lines, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+    QByteArray data;
+    for (int i = 0; i < lines; ++i) {
+        data += "line " + QByteArray::number(i) + ' '
+            + QByteArray(int(rng.bounded(80)), 'x');
+        data += rng.bounded(3) == 0 ? "\r\n" : "\n";
+        if (i % 97 == 0)
+            data += "lone\rcr\n";
+    }
+    return data + "partial";
+}
+
+IndexingResult buildSync(const QString& path,
+                         std::shared_ptr<const LineIndexCache> cache = nullptr)
+{
+    auto future = buildLineIndex(FileSource::open(path), std::move(cache));
+    future.waitForFinished();
+    // Let the background store finish before the test inspects the cache.
+    QThreadPool::globalInstance()->waitForDone();
+    return future.result();
+}
+
+void compareIndexes(const LineIndex& actual, const LineIndex& expected)
+{
+    QCOMPARE(actual.lineCount(), expected.lineCount());
+    QCOMPARE(actual.fileSize(), expected.fileSize());
+    QCOMPARE(actual.lastLineTerminated(), expected.lastLineTerminated());
+    QCOMPARE(actual.resumeOffset(), expected.resumeOffset());
+    for (qint64 line = 0; line < expected.lineCount(); ++line) {
+        QCOMPARE(actual.offsetOf(line), expected.offsetOf(line));
+        QCOMPARE(actual.rawLengthOf(line), expected.rawLengthOf(line));
+        QCOMPARE(actual.endsWithCrLf(line), expected.endsWithCrLf(line));
+    }
+}
+
+} // namespace
+
+class tst_LineIndexCache : public QObject {
+    Q_OBJECT
+
+private slots:
+    void identicalReopenIsMapped()
+    {
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(5000, 1));
+        LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+
+        const IndexingResult built = buildSync(path);
+        QVERIFY(cache.store(*FileSource::open(path), *built.index));
+
+        const LineIndexCache::Entry entry = cache.lookup(*FileSource::open(path));
+        QCOMPARE(entry.match, IdentityMatch::Identical);
+        QVERIFY(entry.index->isMapped());
+        // Only the block table is on the heap.
+        QVERIFY(entry.index->memoryUsage() * 20 < built.index->memoryUsage());
+        compareIndexes(*entry.index, *built.index);
+    }
+
+    void cachedBuildStoresThenHits()
+    {
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(3000, 2));
+        auto cache = std::make_shared<const LineIndexCache>(
+            dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+
+        const IndexingResult first = buildSync(path, cache);
+        QVERIFY(!first.fromCache);
+        QCOMPARE(first.bytesScanned, quint64(QFileInfo(path).size()));
+        QVERIFY(QFile::exists(cache->cacheFilePath(path)));
+
+        const IndexingResult second = buildSync(path, cache);
+        QVERIFY(second.fromCache);
+        QCOMPARE(second.bytesScanned, quint64(0));
+        QVERIFY(second.index->isMapped());
+        compareIndexes(*second.index, *first.index);
+    }
+
+    void grownReopenScansOnlyNewBytes()
+    {
+        QTemporaryDir dir;
+        const QByteArray head = logContent(4000, 3);
+        const QString path = writeFile(dir, "a.log", head);
+        auto cache = std::make_shared<const LineIndexCache>(
+            dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        buildSync(path, cache);
+
+        const QByteArray tail = " finished\r\nmore\nlast line";
+        QVERIFY(appendToFile(path, tail));
+        QCOMPARE(cache->lookup(*FileSource::open(path)).match, IdentityMatch::Grown);
+
+        const IndexingResult grown = buildSync(path, cache);
+        QVERIFY(grown.fromCache);
+        QVERIFY(grown.index->isMapped()); // the extend shares the mapped blocks
+        // Only the unterminated "partial" line plus the appended bytes.
+        QCOMPARE(grown.bytesScanned, quint64(sizeof("partial") - 1 + tail.size()));
+        compareIndexes(*grown.index, *buildSync(path).index);
+
+        // The extended index replaced the entry.
+        const LineIndexCache::Entry entry = cache->lookup(*FileSource::open(path));
+        QCOMPARE(entry.match, IdentityMatch::Identical);
+        compareIndexes(*entry.index, *grown.index);
+    }
+
+    void changedContentMisses()
+    {
+        QTemporaryDir dir;
+        QByteArray content = logContent(2000, 4);
+        const QString path = writeFile(dir, "a.log", content);
+        LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        QVERIFY(cache.store(*FileSource::open(path), *buildSync(path).index));
+
+        // Same size and prefix, rewritten tail.
+        content[content.size() - 3] = '\n';
+        QVERIFY(!writeFile(dir, "a.log", content).isEmpty());
+        QCOMPARE(cache.lookup(*FileSource::open(path)).match, IdentityMatch::Mismatch);
+    }
+
+    void touchedMtimeMisses()
+    {
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(2000, 5));
+        LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        QVERIFY(cache.store(*FileSource::open(path), *buildSync(path).index));
+
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::ReadWrite));
+        QVERIFY(f.setFileTime(QDateTime::currentDateTimeUtc().addSecs(-3600),
+                              QFileDevice::FileModificationTime));
+        f.close();
+        QCOMPARE(cache.lookup(*FileSource::open(path)).match, IdentityMatch::Mismatch);
+    }
+
+    void corruptCacheFileMisses()
+    {
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(2000, 6));
+        LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        QVERIFY(cache.store(*FileSource::open(path), *buildSync(path).index));
+
+        QFile file(cache.cacheFilePath(path));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.resize(file.size() - 8));
+        file.close();
+        QCOMPARE(cache.lookup(*FileSource::open(path)).match, IdentityMatch::Mismatch);
+
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        QVERIFY(file.write("not an index") > 0);
+        file.close();
+        QCOMPARE(cache.lookup(*FileSource::open(path)).match, IdentityMatch::Mismatch);
+    }
+
+    void damagedArraysMiss_data()
+    {
+        // Narrow layout of 1025..2048 lines: a 144-byte header, two block
+        // bases, then one 32-bit delta per line.
+        QTest::addColumn<qint64>("at");
+        QTest::addColumn<QByteArray>("bytes");
+        QTest::newRow("first-not-at-zero") << qint64(144) << QByteArray("\x01", 1);
+        QTest::newRow("backwards") << qint64(160 + 5 * 4) << QByteArray(4, '\0');
+        QTest::newRow("past-the-file") << qint64(152) << QByteArray(8, '\x7f');
+    }
+
+    void damagedArraysMiss()
+    {
+        QFETCH(qint64, at);
+        QFETCH(QByteArray, bytes);
+
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(1900, 6));
+        LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        const IndexingResult built = buildSync(path);
+        QVERIFY(built.index->lineCount() > LineIndex::kBlockSize);
+        QVERIFY(built.index->lineCount() <= 2 * LineIndex::kBlockSize);
+        QVERIFY(!built.index->isWide());
+        QVERIFY(cache.store(*FileSource::open(path), *built.index));
+        QVERIFY(cache.lookup(*FileSource::open(path)).index);
+
+        QFile file(cache.cacheFilePath(path));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(at));
+        QCOMPARE(file.write(bytes), bytes.size());
+        file.close();
+        QCOMPARE(cache.lookup(*FileSource::open(path)).match, IdentityMatch::Mismatch);
+    }
+
+    void smallFilesAreNotStored()
+    {
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "a.log", logContent(100, 7));
+        LineIndexCache cache(dir.filePath("cache")); // default 64 MiB floor
+        QVERIFY(!cache.store(*FileSource::open(path), *buildSync(path).index));
+        QCOMPARE(cache.diskUsage(), quint64(0));
+    }
+
+    void evictsLeastRecentlyUsed()
+    {
+        QTemporaryDir dir;
+        const QString a = writeFile(dir, "a.log", logContent(3000, 8));
+        const QString b = writeFile(dir, "b.log", logContent(3000, 9));
+        const QString c = writeFile(dir, "c.log", logContent(3000, 10));
+        LineIndexCache unbounded(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        QVERIFY(unbounded.store(*FileSource::open(a), *buildSync(a).index));
+        QVERIFY(unbounded.store(*FileSource::open(b), *buildSync(b).index));
+        const quint64 two = unbounded.diskUsage();
+
+        // Age both entries, then use a: b becomes least recently used.
+        for (const QString& log : { a, b }) {
+            QFile f(unbounded.cacheFilePath(log));
+            QVERIFY(f.open(QIODevice::ReadWrite));
+            QVERIFY(f.setFileTime(QDateTime::currentDateTimeUtc().addSecs(-600),
+                                  QFileDevice::FileModificationTime));
+        }
+        QCOMPARE(unbounded.lookup(*FileSource::open(a)).match, IdentityMatch::Identical);
+
+        // Room for about two entries: storing c must evict b only.
+        LineIndexCache bounded(dir.filePath("cache"), two + two / 4, 0);
+        QVERIFY(bounded.store(*FileSource::open(c), *buildSync(c).index));
+        QVERIFY(bounded.diskUsage() <= bounded.maxBytes());
+        QVERIFY(QFile::exists(bounded.cacheFilePath(a)));
+        QVERIFY(!QFile::exists(bounded.cacheFilePath(b)));
+        QVERIFY(QFile::exists(bounded.cacheFilePath(c)));
+    }
+};
+
+QTEST_APPLESS_MAIN(tst_LineIndexCache)
+#include "tst_lineindexcache.moc"
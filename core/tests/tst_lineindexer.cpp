@@ -6,6 +6,8 @@
 #include <QTemporaryDir>
 #include <QTest>
 
+#include <thread>
+
 using logdor::FileSource;
 using logdor::IndexingResult;
 using logdor::LineIndex;
@@ -130,7 +132,11 @@ class tst_LineIndexer : public QObject {
     Q_OBJECT
 
 private slots:
-    void cleanup() { qunsetenv("LOGDOR_FORCE_BUFFERED"); }
+    void cleanup()
+    {
+        qunsetenv("LOGDOR_FORCE_BUFFERED");
+        qunsetenv("LOGDOR_FORCE_SCALAR_INDEX");
+    }
 
     void legacyParity_data()
     {
@@ -208,6 +214,235 @@ private slots:
         comparePairwise(content, *result.index);
     }
 
+    void parallelMatchesSequential_data()
+    {
+        QTest::addColumn<int>("chunkSize");
+        QTest::addColumn<int>("threads");
+        QTest::addColumn<bool>("forceBuffered");
+        for (int chunk : { 1, 3, 7, 4096 }) {
+            for (int threads : { 2, 3, 8 }) {
+                QTest::addRow("chunk=%d/threads=%d/mapped", chunk, threads)
+                    << chunk << threads << false;
+            }
+        }
+        QTest::addRow("chunk=7/threads=4/buffered") << 7 << 4 << true;
+        QTest::addRow("chunk=4096/threads=4/buffered") << 4096 << 4 << true;
+    }
+
+    void parallelMatchesSequential()
+    {
+        QFETCH(int, chunkSize);
+        QFETCH(int, threads);
+        QFETCH(bool, forceBuffered);
+
+        // Every line-ending shape, so chunk edges land between '\r' and
+        // '\n', on empty lines, and inside lone-CR content.
+        QRandomGenerator rng{ 7 };
+        QByteArray content;
+        while (content.size() < 64 * 1024)
+            content += randomBurst(rng);
+
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "parallel.log", content);
+        QVERIFY(!path.isEmpty());
+        if (forceBuffered)
+            qputenv("LOGDOR_FORCE_BUFFERED", "1");
+
+        auto sequential = buildLineIndex(FileSource::open(path), chunkSize, 1);
+        auto parallel = buildLineIndex(FileSource::open(path), chunkSize, threads);
+        sequential.waitForFinished();
+        parallel.waitForFinished();
+        QCOMPARE(parallel.progressValue(), 1000);
+        QCOMPARE(parallel.result().bytesScanned, quint64(content.size()));
+        compareIndexes(*parallel.result().index, *sequential.result().index);
+        comparePairwise(content, *parallel.result().index);
+    }
+
+    void vectorKernelMatchesScalar_data()
+    {
+        QTest::addColumn<int>("chunkSize");
+        // Chunk sizes around the 64-byte kernel block and the 64 KiB slice.
+        for (int chunk : { 1, 63, 64, 65, 4096, 64 * 1024 + 1, 1 << 20 })
+            QTest::addRow("chunk=%d", chunk) << chunk;
+    }
+
+    void vectorKernelMatchesScalar()
+    {
+        QFETCH(int, chunkSize);
+
+        QRandomGenerator rng{ 11 };
+        QByteArray content;
+        while (content.size() < 200 * 1024)
+            content += randomBurst(rng);
+        content += "\r"; // a final '\r' with nothing after it
+
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "kernel.log", content);
+        QVERIFY(!path.isEmpty());
+
+        const IndexingResult vectorized = buildSync(path, chunkSize);
+        qputenv("LOGDOR_FORCE_SCALAR_INDEX", "1");
+        QCOMPARE(QByteArray(logdor::lineIndexKernelName()), QByteArray("scalar"));
+        const IndexingResult scalar = buildSync(path, chunkSize);
+        compareIndexes(*vectorized.index, *scalar.index);
+        comparePairwise(content, *vectorized.index);
+    }
+
+    void parallelExtendMatchesFullRebuild()
+    {
+        // An extend over a resumed, unterminated final line: the parallel
+        // path must treat resumeOffset() as a range start (no carry byte).
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "follow.log", "head\r\npartial\r");
+        auto base = buildSync(path, 4096).index;
+        QVERIFY(base);
+
+        QByteArray burst = "\n";
+        for (int i = 0; i < 200; ++i)
+            burst += "appended " + QByteArray::number(i) + (i % 2 ? "\r\n" : "\n");
+        QVERIFY(appendToFile(path, burst));
+
+        auto future = extendLineIndex(FileSource::open(path), base, 5, 4);
+        future.waitForFinished();
+        const IndexingResult fresh = buildSync(path, 4096);
+        compareIndexes(*future.result().index, *fresh.index);
+        QVERIFY(future.result().index->endsWithCrLf(1)); // "partial\r\n"
+    }
+
+    void sparseMatchesDense_data()
+    {
+        QTest::addColumn<int>("stride");
+        QTest::addColumn<bool>("forceBuffered");
+        for (int stride : { 2, 3, 64, 1000 })
+            QTest::addRow("stride=%d/mapped", stride) << stride << false;
+        QTest::addRow("stride=64/buffered") << 64 << true;
+    }
+
+    void sparseMatchesDense()
+    {
+        QFETCH(int, stride);
+        QFETCH(bool, forceBuffered);
+
+        QRandomGenerator rng{ 13 };
+        QByteArray content;
+        while (content.size() < 128 * 1024)
+            content += randomBurst(rng);
+
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "sparse.log", content);
+        QVERIFY(!path.isEmpty());
+        if (forceBuffered)
+            qputenv("LOGDOR_FORCE_BUFFERED", "1");
+
+        const IndexingResult dense = buildSync(path, 4096);
+        auto future = buildLineIndex(FileSource::open(path), 4096, 4, stride);
+        future.waitForFinished();
+        const auto sparse = future.result().index;
+        QVERIFY(sparse->isSparse());
+        QCOMPARE(sparse->sparseStride(), stride);
+        QVERIFY(sparse->memoryUsage() < dense.index->memoryUsage());
+        compareIndexes(*sparse, *dense.index);
+        comparePairwise(content, *sparse);
+
+        // Random access, and from another thread (each has its own span).
+        for (int i = 0; i < 500; ++i) {
+            const qint64 line = rng.bounded(int(dense.lineCount));
+            QCOMPARE(sparse->offsetOf(line), dense.index->offsetOf(line));
+            QCOMPARE(sparse->lengthOf(line), dense.index->lengthOf(line));
+            const quint64 at = quint64(rng.bounded(int(content.size())));
+            QCOMPARE(sparse->lineAt(at), dense.index->lineAt(at));
+        }
+        bool otherThreadAgrees = true;
+        std::thread other([&] {
+            for (qint64 line = dense.lineCount - 1; line >= 0; --line) {
+                if (sparse->offsetOf(line) != dense.index->offsetOf(line)
+                    || sparse->endsWithCrLf(line) != dense.index->endsWithCrLf(line))
+                    otherThreadAgrees = false;
+            }
+        });
+        other.join();
+        QVERIFY(otherThreadAgrees);
+    }
+
+    void sparseExtendMatchesFullRebuild()
+    {
+        QTemporaryDir dir;
+        QRandomGenerator rng{ 17 };
+        QByteArray content;
+        while (content.size() < 16 * 1024)
+            content += randomBurst(rng);
+        const QString path = writeFile(dir, "follow.log", content);
+        auto future = buildLineIndex(FileSource::open(path), 4096, 1, 16);
+        future.waitForFinished();
+        auto index = future.result().index;
+
+        for (int round = 0; round < 20; ++round) {
+            const QByteArray burst = randomBurst(rng);
+            content += burst;
+            QVERIFY(appendToFile(path, burst));
+            index = extendSync(path, index, 4096).index;
+            QVERIFY(index->isSparse());
+        }
+        compareIndexes(*index, *buildSync(path, 4096).index);
+        comparePairwise(content, *index);
+    }
+
+    void progressiveBuildPublishesPrefixes_data()
+    {
+        QTest::addColumn<int>("threads");
+        QTest::addColumn<int>("stride");
+        QTest::newRow("serial") << 1 << 1;
+        QTest::newRow("parallel") << 4 << 1;
+        QTest::newRow("sparse") << 4 << 16;
+    }
+
+    void progressiveBuildPublishesPrefixes()
+    {
+        QFETCH(int, threads);
+        QFETCH(int, stride);
+        QRandomGenerator rng{ 19 };
+        QByteArray content;
+        while (content.size() < 256 * 1024)
+            content += randomBurst(rng);
+        QTemporaryDir dir;
+        const QString path = writeFile(dir, "progressive.log", content);
+
+        auto future = buildLineIndex(FileSource::open(path), 4096, threads,
+                                     stride, 16 * 1024);
+        future.waitForFinished();
+        QVERIFY(future.resultCount() > 2);
+        const IndexingResult last = future.resultAt(future.resultCount() - 1);
+        QVERIFY(!last.partial);
+        compareIndexes(*last.index, *buildSync(path, 4096).index);
+
+        // Every snapshot is a growing prefix of whole lines of the final
+        // index, published immutable.
+        qint64 previousLines = 0;
+        for (int i = 0; i < future.resultCount() - 1; ++i) {
+            const IndexingResult partial = future.resultAt(i);
+            QVERIFY(partial.partial);
+            const LineIndex& index = *partial.index;
+            QCOMPARE(index.lineCount(), partial.lineCount);
+            QVERIFY(index.lineCount() > previousLines);
+            QVERIFY(index.lineCount() < last.lineCount);
+            QCOMPARE(index.sparseStride(), stride);
+            QVERIFY(index.lastLineTerminated());
+            QCOMPARE(index.fileSize(), last.index->offsetOf(index.lineCount()));
+            for (qint64 line = 0; line < index.lineCount(); ++line) {
+                QCOMPARE(index.offsetOf(line), last.index->offsetOf(line));
+                QCOMPARE(index.rawLengthOf(line), last.index->rawLengthOf(line));
+                QCOMPARE(index.endsWithCrLf(line), last.index->endsWithCrLf(line));
+            }
+            previousLines = index.lineCount();
+        }
+
+        // Off by default: the final index is the only result.
+        auto plain = buildLineIndex(FileSource::open(path), 4096, threads, stride);
+        plain.waitForFinished();
+        QCOMPARE(plain.resultCount(), 1);
+        QVERIFY(!plain.result().partial);
+    }
+
     void progressReachesFullScale()
     {
         QTemporaryDir dir;
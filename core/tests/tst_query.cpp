@@ -277,6 +277,130 @@ private slots:
         QCOMPARE(matchesOf("\"and more\""), QList<int>{ 3 });
     }
 
+    // Eight or more plain free-text terms share one automaton pass per line;
+    // the tree must still see each term's own verdict. Padding with terms
+    // no row holds pushes every query here past that threshold.
+    void manyFreeTextTerms()
+    {
+        const auto padded = [](const QString& query) {
+            return QStringLiteral("(%1) OR zzz1 OR zzz2 OR zzz3 OR zzz4 OR zzz5 "
+                                  "OR zzz6 OR zzz7 OR zzz8").arg(query);
+        };
+        QCOMPARE(matchesOf(padded("timeout OR refused OR reset OR signal OR started")),
+                 (QList<int>{ 1, 2 }));
+        QCOMPARE(matchesOf(padded("connection failed NOT weak NOT ok")), QList<int>{ 0 });
+        QCOMPARE(matchesOf(padded("NOT (timeout OR refused OR reset OR signal)")),
+                 (QList<int>{ 0, 1, 3 }));
+        // Overlapping needles, and one that is a suffix of another.
+        QCOMPARE(matchesOf(padded("fail failed \"ailed h\" \"d hard\"")),
+                 QList<int>{ 0 });
+        QCOMPARE(matchesOf(padded("ail OR ai OR rt OR tar")), (QList<int>{ 0, 1 }));
+        // A repeated term shares its bit.
+        QCOMPARE(matchesOf(padded("signal weak OR NOT signal")), (QList<int>{ 0, 1, 2, 3 }));
+        QCOMPARE(matchesOf(padded("signal NOT signal")), QList<int>{});
+        // Folding follows the query's case sensitivity.
+        QCOMPARE(matchesOf(padded("WEAK OR OK OR MORE")), (QList<int>{ 1, 2, 3 }));
+        QCOMPARE(matchesOf(padded("WEAK OR OK OR MORE"), Qt::CaseSensitive), QList<int>{});
+        QCOMPARE(matchesOf(padded("weak OR OK OR more"), Qt::CaseSensitive),
+                 (QList<int>{ 2, 3 }));
+        // Field and non-ASCII terms mix with the gathered ones.
+        QCOMPARE(matchesOf(padded(QStringLiteral("tag:wifi (failed OR signal OR "
+                                                 "\"\u00fcn\u00efcode\")"))),
+                 (QList<int>{ 0, 2 }));
+    }
+
+    void moreFreeTextTermsThanOnePass()
+    {
+        // Past 64 distinct needles the remaining terms match on their own.
+        QStringList terms;
+        for (int i = 0; i < 70; ++i)
+            terms.append(QStringLiteral("zzz%1").arg(i));
+        QCOMPARE(matchesOf((terms + QStringList { "weak" }).join(" OR ")),
+                 QList<int>{ 2 });
+        QCOMPARE(matchesOf((QStringList { "weak" } + terms + QStringList { "more" })
+                               .join(" OR ")),
+                 (QList<int>{ 2, 3 }));
+        QCOMPARE(matchesOf((QStringList { "NOT more" } + terms).join(" OR ")),
+                 (QList<int>{ 0, 1, 2 }));
+    }
+
+    void narrowsWhenTermsAreAndedOn_data()
+    {
+        QTest::addColumn<QString>("before");
+        QTest::addColumn<QString>("after");
+        QTest::addColumn<bool>("expected");
+
+        QTest::newRow("same") << "level:error" << " level:error " << true;
+        QTest::newRow("implicit-and") << "level:error" << "level:error tag:wifi" << true;
+        QTest::newRow("explicit-and") << "tag:wifi" << "tag:wifi AND NOT pid:200" << true;
+        QTest::newRow("two-of-three") << "tag:wifi pid>=100" << "tag:wifi pid>=100 weak" << true;
+        QTest::newRow("group") << "(level:error OR level:info)"
+                               << "(level:error OR level:info) tag:wifi" << true;
+        QTest::newRow("or-binds-looser") << "level:error OR level:info"
+                                         << "level:error OR level:info tag:wifi" << false;
+        QTest::newRow("or-added") << "level:error" << "level:error OR tag:wifi" << false;
+        QTest::newRow("inside-group") << "(tag:wifi" << "(tag:wifi pid:200)" << false;
+        QTest::newRow("value-extended") << "tag:wi" << "tag:wifi" << false;
+        QTest::newRow("later-conjunct") << "tag:wifi" << "level:error tag:wifi" << false;
+        QTest::newRow("dropped") << "level:error tag:wifi" << "level:error" << false;
+    }
+
+    void narrowsWhenTermsAreAndedOn()
+    {
+        QFETCH(QString, before);
+        QFETCH(QString, after);
+        QFETCH(bool, expected);
+
+        const auto compile = [](const QString& text, Qt::CaseSensitivity cs) {
+            return CompiledQuery::compile(text, testSchema(), cs, {}, nullptr, testCtx());
+        };
+        const auto next = compile(after, Qt::CaseInsensitive);
+        QVERIFY(next);
+        const auto previous = compile(before, Qt::CaseInsensitive);
+        if (!previous) {
+            QVERIFY(!expected); // nothing to narrow
+            return;
+        }
+        QCOMPARE(next->narrows(*previous), expected);
+        // A case change is never a narrowing, whatever the text.
+        QVERIFY(!next->narrows(*compile(before, Qt::CaseSensitive)));
+
+        // Whenever it holds, the match sets must agree.
+        if (expected) {
+            const QList<int> narrowed = matchesOf(after);
+            const QList<int> wider = matchesOf(before);
+            for (int row : narrowed)
+                QVERIFY(wider.contains(row));
+        }
+    }
+
+    void requiredLiteralsAreTheAndedFreeText_data()
+    {
+        QTest::addColumn<QString>("text");
+        QTest::addColumn<QByteArrayList>("expected");
+
+        QTest::newRow("one") << "Timeout" << QByteArrayList { "timeout" };
+        QTest::newRow("among-fields") << "level:error timeout tag:wifi conn"
+                                      << QByteArrayList { "timeout", "conn" };
+        QTest::newRow("repeated") << "timeout timeout" << QByteArrayList { "timeout" };
+        QTest::newRow("or") << "timeout OR refused" << QByteArrayList {};
+        QTest::newRow("not") << "timeout AND NOT refused" << QByteArrayList { "timeout" };
+        QTest::newRow("group") << "(timeout OR refused) socket"
+                               << QByteArrayList { "socket" };
+        QTest::newRow("fields-only") << "level:error tag:wifi" << QByteArrayList {};
+    }
+
+    void requiredLiteralsAreTheAndedFreeText()
+    {
+        QFETCH(QString, text);
+        QFETCH(QByteArrayList, expected);
+
+        const auto query = CompiledQuery::compile(text, testSchema(), Qt::CaseInsensitive,
+                                                  {}, nullptr, testCtx());
+        QVERIFY(query);
+        QCOMPARE(query->requiredLiterals(), expected);
+    }
+
     void fieldNameNormalization()
     {
         const QList<FieldSchema> schema = {
@@ -0,0 +1,297 @@
+#include <logdor/FileSource.h>
+#include <logdor/FilterScan.h>
+#include <logdor/LineIndexCache.h>
+#include <logdor/LineIndexer.h>
+#include <logdor/TrigramIndex.h>
+
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThreadPool>
+
+#include <cstring>
+
+using namespace logdor;
+
+namespace {
+
+constexpr qint64 kBlockLines = 64;
+
+struct Opened {
+    std::shared_ptr<FileSource> source;
+    std::shared_ptr<const LineIndex> index;
+};
+
+Opened openPath(const QString& path)
+{
+    auto source = FileSource::open(path);
+    auto future = buildLineIndex(source);
+    future.waitForFinished();
+    return { source, future.result().index };
+}
+
+Opened openContent(const QTemporaryDir& dir, const QString& name,
+                   const QByteArray& content)
+{
+    const QString path = dir.filePath(name);
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly) || f.write(content) != content.size())
+        return {};
+    f.close();
+    return openPath(path);
+}
+
+TrigramIndexResult buildSync(const Opened& o,
+                             std::shared_ptr<const LineIndexCache> cache = nullptr)
+{
+    auto future = buildTrigramIndex(o.source, o.index, std::move(cache), kBlockLines);
+    future.waitForFinished();
+    // Let the background store finish before the test inspects the cache.
+    QThreadPool::globalInstance()->waitForDone();
+    return future.result();
+}
+
+// 20 blocks of filler; "Needle-XYZ" on one line of blocks 3 and 17, a
+// regex-friendly "code=4711" on block 9, CRLF endings on odd lines.
+QByteArray logContent(bool terminated = true)
+{
+    QByteArray data;
+    for (qint64 i = 0; i < 20 * kBlockLines; ++i) {
+        data += "line " + QByteArray::number(i) + " ordinary filler text";
+        if (i == 3 * kBlockLines + 5 || i == 17 * kBlockLines + 63)
+            data += " Needle-XYZ";
+        if (i == 9 * kBlockLines)
+            data += " code=4711";
+        data += i % 2 ? "\r\n" : "\n";
+    }
+    return terminated ? data : data + "unterminated tail";
+}
+
+FilterScanResult scanSync(const Opened& o, const LineFilter& filter,
+                          std::shared_ptr<const TrigramIndex> trigrams = nullptr)
+{
+    auto future = scanFilter(o.source, o.index, filter, kBlockLines / 4, 0, -1, -1,
+                             std::move(trigrams));
+    future.waitForFinished();
+    return future.resultAt(future.resultCount() - 1);
+}
+
+QList<qint64> blocksOf(const std::vector<bool>& mask)
+{
+    QList<qint64> blocks;
+    for (size_t b = 0; b < mask.size(); ++b) {
+        if (mask[b])
+            blocks << qint64(b);
+    }
+    return blocks;
+}
+
+} // namespace
+
+class tst_TrigramIndex : public QObject {
+    Q_OBJECT
+
+private slots:
+    void candidatesNarrowToBlocksHoldingTheLiteral()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "a.log", logContent());
+        const TrigramIndexResult built = buildSync(o);
+        QVERIFY(built.index && !built.fromCache);
+        const TrigramIndex& index = *built.index;
+        QCOMPARE(index.blockCount(), qint64(20));
+        QCOMPARE(index.lineCount(), o.index->lineCount());
+        QCOMPARE(index.blockOffset(3), o.index->offsetOf(3 * kBlockLines));
+        QVERIFY(index.memoryUsage() > 0);
+
+        QCOMPARE(blocksOf(index.candidates("needle-xyz")), (QList<qint64> { 3, 17 }));
+        // Folded: either case finds the same blocks.
+        QCOMPARE(blocksOf(index.candidates("NEEDLE-xyz")), (QList<qint64> { 3, 17 }));
+        QCOMPARE(blocksOf(index.candidates("4711")), QList<qint64> { 9 });
+        QCOMPARE(index.candidates("absent needle").size(), size_t(20));
+        QVERIFY(blocksOf(index.candidates("absent needle")).isEmpty());
+        // Too short to look up: every block must be searched.
+        QVERIFY(index.candidates("ne").empty());
+        // No trigram spans a line end.
+        QVERIFY(blocksOf(index.candidates("text\r\nline")).isEmpty());
+        QVERIFY(blocksOf(index.candidates("text line")).isEmpty());
+    }
+
+    void scanSkipsRuledOutBlocksWithTheSameResult_data()
+    {
+        QTest::addColumn<QString>("query");
+        QTest::addColumn<bool>("caseSensitive");
+        QTest::addColumn<bool>("regexMode");
+        QTest::addColumn<bool>("invert");
+        QTest::addColumn<bool>("pruned");
+
+        QTest::newRow("needle") << "needle-xyz" << false << false << false << true;
+        QTest::newRow("exact-case") << "Needle-XYZ" << true << false << false << true;
+        QTest::newRow("wrong-case") << "needle-xyz" << true << false << false << true;
+        QTest::newRow("absent") << "no such text" << false << false << false << true;
+        QTest::newRow("regex-literal") << "code=47\\d+" << false << true << false << true;
+        QTest::newRow("regex-no-literal") << "\\d{4}$" << false << true << false << false;
+        QTest::newRow("short") << "ne" << false << false << false << false;
+        QTest::newRow("invert") << "needle-xyz" << false << false << true << false;
+    }
+
+    void scanSkipsRuledOutBlocksWithTheSameResult()
+    {
+        QFETCH(QString, query);
+        QFETCH(bool, caseSensitive);
+        QFETCH(bool, regexMode);
+        QFETCH(bool, invert);
+        QFETCH(bool, pruned);
+
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "a.log", logContent(false));
+        const auto trigrams = buildSync(o).index;
+
+        LineFilter filter;
+        filter.query = query;
+        filter.caseSensitive = caseSensitive;
+        filter.regexMode = regexMode;
+        filter.invert = invert;
+        filter.contextBefore = 2;
+        filter.contextAfter = 1;
+        const FilterScanResult plain = scanSync(o, filter);
+        const FilterScanResult indexed = scanSync(o, filter, trigrams);
+        QCOMPARE(indexed.matchCount, plain.matchCount);
+        QCOMPARE(indexed.rows.size(), plain.rows.size());
+        for (qint64 row = 0; row < plain.rows.size(); ++row)
+            QCOMPARE(indexed.rows.sourceLine(row), plain.rows.sourceLine(row));
+        if (pruned)
+            QVERIFY(indexed.stats.chunks <= plain.stats.chunks / 5);
+        else
+            QCOMPARE(indexed.stats.chunks, plain.stats.chunks);
+    }
+
+    void grownFileKeepsItsIndexForThePrefix()
+    {
+        QTemporaryDir dir;
+        const QString path = dir.filePath("a.log");
+        const Opened before = openContent(dir, "a.log", logContent(false));
+        const auto trigrams = buildSync(before).index;
+
+        // The unterminated tail grows a match; so do new lines.
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Append));
+        f.write(" needle-xyz\nmore\nlast needle-xyz");
+        f.close();
+        const Opened after = openPath(path);
+        QCOMPARE(trigrams->coveredLines(after.index->fileSize()),
+                 before.index->lineCount() - 1);
+
+        LineFilter filter;
+        filter.query = QStringLiteral("needle-xyz");
+        const FilterScanResult plain = scanSync(after, filter);
+        const FilterScanResult indexed = scanSync(after, filter, trigrams);
+        QCOMPARE(plain.matchCount, qint64(4));
+        QCOMPARE(indexed.matchCount, plain.matchCount);
+        for (qint64 row = 0; row < plain.rows.size(); ++row)
+            QCOMPARE(indexed.rows.sourceLine(row), plain.rows.sourceLine(row));
+    }
+
+    void cachedBuildStoresThenHits()
+    {
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "a.log", logContent());
+        auto cache = std::make_shared<const LineIndexCache>(
+            dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+
+        const TrigramIndexResult first = buildSync(o, cache);
+        QVERIFY(!first.fromCache);
+        QVERIFY(QFile::exists(cache->trigramFilePath(o.source->filePath())));
+        QVERIFY(cache->diskUsage() > 0);
+
+        const TrigramIndexResult second = buildSync(o, cache);
+        QVERIFY(second.fromCache);
+        QCOMPARE(second.index->blockCount(), first.index->blockCount());
+        QCOMPARE(second.index->trigramCount(), first.index->trigramCount());
+        for (const char* literal : { "needle-xyz", "4711", "filler", "absent" })
+            QVERIFY(second.index->candidates(literal) == first.index->candidates(literal));
+    }
+
+    void changedFileIsNotLookedUp()
+    {
+        QTemporaryDir dir;
+        const QString path = dir.filePath("a.log");
+        const Opened o = openContent(dir, "a.log", logContent());
+        const LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        QVERIFY(buildSync(o).index->store(cache, *o.source));
+        QVERIFY(TrigramIndex::lookup(cache, *o.source));
+
+        // Same size, different bytes: no longer the indexed file.
+        QByteArray changed = logContent();
+        changed[changed.size() - 3] = 'Q';
+        const Opened rewritten = openContent(dir, "a.log", changed);
+        QVERIFY(!TrigramIndex::lookup(cache, *rewritten.source));
+
+        // Too small for the cache: not stored.
+        const LineIndexCache picky(dir.filePath("picky"), LineIndexCache::kDefaultMaxBytes,
+                                   quint64(changed.size()) + 1);
+        QVERIFY(!buildSync(rewritten).index->store(picky, *rewritten.source));
+        QVERIFY(!QFile::exists(picky.trigramFilePath(path)));
+    }
+
+    void damagedIndexIsNotLookedUp_data()
+    {
+        QTest::addColumn<QString>("damage");
+        QTest::newRow("unsorted-keys") << "keys";
+        QTest::newRow("posting-past-the-blocks") << "postings";
+        QTest::newRow("truncated-varint") << "varint";
+    }
+
+    void damagedIndexIsNotLookedUp()
+    {
+        QFETCH(QString, damage);
+
+        QTemporaryDir dir;
+        const Opened o = openContent(dir, "a.log", logContent());
+        const LineIndexCache cache(dir.filePath("cache"), LineIndexCache::kDefaultMaxBytes, 0);
+        const auto built = buildSync(o).index;
+        QVERIFY(built->store(cache, *o.source));
+        QVERIFY(built->trigramCount() > 1);
+        QVERIFY(TrigramIndex::lookup(cache, *o.source));
+
+        // Header layout: blockCount at 48, keyCount at 56, postingBytes at
+        // 64; 176 bytes, then block offsets, keys, starts and postings.
+        QFile file(cache.trigramFilePath(o.source->filePath()));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        const QByteArray bytes = file.readAll();
+        const auto field = [&bytes](qsizetype at) {
+            quint64 value;
+            std::memcpy(&value, bytes.constData() + at, sizeof value);
+            return qint64(value);
+        };
+        const qint64 keys = 176 + field(48) * 8;
+        const qint64 postings = keys + (field(56) * 4 + 7) / 8 * 8 + (field(56) + 1) * 8;
+        if (damage == "keys") {
+            file.seek(keys); // first key = the largest possible
+            file.write(QByteArray("\xff\xff\xff\x00", 4));
+        } else if (damage == "postings") {
+            file.seek(postings); // first posting: block 127 of 20
+            file.write(QByteArray(1, '\x7f'));
+        } else {
+            file.seek(postings + field(64) - 1); // last byte continues
+            file.write(QByteArray(1, '\x81'));
+        }
+        file.close();
+        QVERIFY(!TrigramIndex::lookup(cache, *o.source));
+    }
+
+    void cancelledBuildDeliversNothing()
+    {
+        QTemporaryDir dir;
+        QByteArray big;
+        while (big.size() < 8 * 1024 * 1024)
+            big += "some line of filler text for the index to chew on\n";
+        const Opened o = openContent(dir, "big.log", big);
+        auto future = buildTrigramIndex(o.source, o.index);
+        future.cancel();
+        future.waitForFinished();
+        QVERIFY(future.isCanceled());
+    }
+};
+
+QTEST_APPLESS_MAIN(tst_TrigramIndex)
+#include "tst_trigramindex.moc"
@@ -48,6 +48,11 @@ public:
         m_viewer->setHighlightRules(rules);
     }
 
+    void setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index) override
+    {
+        m_viewer->setTextIndex(std::move(index));
+    }
+
     // The regex pattern itself stays global (QSettings) - only table view
     // state is per-file.
     QJsonObject saveViewState() const override
@@ -278,6 +278,15 @@ void LogcatViewer::updatePredicate(bool refilter)
         return;
     }
 
+    // Same levels and tags, same lines: that is the result-cache identity.
+    QString cacheKey;
+    for (bool enabled : m_levelEnabled)
+        cacheKey += enabled ? u'1' : u'0';
+    QStringList tags(m_selectedTags.begin(), m_selectedTags.end());
+    tags.sort();
+    for (const QString& tag : std::as_const(tags))
+        cacheKey += QStringLiteral("|%1:%2").arg(tag.size()).arg(tag);
+
     // Captured by value; runs on scan worker threads (parser is stateless).
     m_viewer->setExtraPredicate(
         [levels = m_levelEnabled, tags = m_selectedTags, parser = m_parser](
@@ -289,7 +298,7 @@ void LogcatViewer::updatePredicate(bool refilter)
             return tags.isEmpty()
                 || tags.contains(row.fields[logdor::LogcatParser::Tag]);
         },
-        refilter);
+        refilter, cacheKey);
 }
 
 void LogcatViewer::setCoreSource(std::shared_ptr<logdor::FileSource> source,
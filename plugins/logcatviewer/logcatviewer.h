@@ -49,6 +49,11 @@ public:
         m_viewer->setHighlightRules(rules);
     }
 
+    void setTextIndex(std::shared_ptr<const logdor::TrigramIndex> index) override
+    {
+        m_viewer->setTextIndex(std::move(index));
+    }
+
     QJsonObject saveViewState() const override;
     void restoreViewState(const QJsonObject& state) override;
 
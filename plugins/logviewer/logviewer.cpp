@@ -88,7 +88,8 @@ void LogViewer::setActiveParser(
             [parser](qint64 line, QByteArrayView raw) {
                 return parser->isDataLine(line, raw);
             },
-            /*refilter=*/false);
+            /*refilter=*/false,
+            QStringLiteral("data-lines:%1").arg(parser->id()));
     } else {
         m_viewer->setExtraPredicate(nullptr, /*refilter=*/false);
     }
@@ -258,6 +258,7 @@ void MapViewer::setFilter(const FilterOptions& options)
 
     logdor::LineFilter filter;
     filter.query = options.query;
+    filter.limit = logdor::takeMatchLimit(&filter.query);
     filter.caseSensitive = options.caseSensitivity == Qt::CaseSensitive;
     filter.regexMode = options.inRegexMode;
     filter.invert = options.invertFilter;
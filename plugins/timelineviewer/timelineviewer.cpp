@@ -232,21 +232,25 @@ void TimelineViewer::applyFilterToFile(
     const qint32 fileId = file->fileId;
     const int generation = m_filterGeneration;
     const FilterOptions options = m_lastFilter;
+    // A "| head N" / "| tail N" suffix limits each file's matches.
+    QString text = options.query;
+    const MatchLimit limit = takeMatchLimit(&text);
 
-    if (options.query.trimmed().isEmpty()) {
+    if (text.trimmed().isEmpty() && limit.count == 0) {
         file->visibleRows = RowSet::all(file->index->lineCount());
         scheduleMerge();
         return;
     }
 
     LineFilter filter;
+    filter.limit = limit;
     filter.caseSensitive = options.caseSensitivity == Qt::CaseSensitive;
     filter.invert = options.invertFilter;
-    if (options.inQueryMode) {
+    if (options.inQueryMode && !text.trimmed().isEmpty()) {
         const auto context
             = TimeSettings::instance().contextForFile(file->path);
         auto query = CompiledQuery::compile(
-            options.query, file->parser->schema(), options.caseSensitivity,
+            text, file->parser->schema(), options.caseSensitivity,
             QueryOption::AllowUnknownFields, nullptr, context);
         if (!query)
             return; // invalid syntax: keep the current rows
@@ -270,8 +274,8 @@ void TimelineViewer::applyFilterToFile(
         filter.fieldQuery = query;
         filter.columns = file->columns.snapshot(query->referencedColumns(),
                                                 query->needsSeverity());
-    } else {
-        filter.query = options.query;
+    } else if (!options.inQueryMode) {
+        filter.query = text;
         filter.regexMode = options.inRegexMode;
     }
 